@@ -25,6 +25,27 @@ void* merge_dir_conf(apr_pool_t* pool, void* base, void* add) {
                                  ? child->trust_inbound_span
                                  : parent->trust_inbound_span;
 
+  conf->subrequest_aggregation = child->subrequest_aggregation
+                                      ? child->subrequest_aggregation
+                                      : parent->subrequest_aggregation;
+
+  conf->subrequest_span_threshold = child->subrequest_span_threshold
+                                        ? child->subrequest_span_threshold
+                                        : parent->subrequest_span_threshold;
+
+  conf->long_requests =
+      child->long_requests ? child->long_requests : parent->long_requests;
+
+  conf->server_timing =
+      child->server_timing ? child->server_timing : parent->server_timing;
+
+  conf->resource_accounting = child->resource_accounting
+                                  ? child->resource_accounting
+                                  : parent->resource_accounting;
+
+  conf->header_tags =
+      child->header_tags ? child->header_tags : parent->header_tags;
+
   conf->tags = child->tags;
   auto tmp = parent->tags;
   conf->tags.merge(tmp);
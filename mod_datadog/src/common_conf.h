@@ -2,11 +2,18 @@
 
 #include <datadog/tracer_config.h>
 
+#include <chrono>
 #include <optional>
 #include <string>
 #include <unordered_map>
 
 #include "apr_poll.h"
+#include "metrics/conf.h"
+#include "profiling/conf.h"
+#include "tracing/compression.h"
+#include "tracing/conf.h"
+#include "tracing/governor.h"
+#include "tracing/header_tags.h"
 
 #if defined(HTTPD_DD_RUM)
 #include "rum/config.h"
@@ -16,6 +23,38 @@ namespace datadog::conf {
 
 struct Module final {
   tracing::TracerConfig tracing;
+  metrics::conf::Module metrics;
+  tracing::conf::TailRetention tail_retention;
+  // Compute trace statistics in the module rather than in the Agent.
+  bool trace_stats = false;
+  // Traces kept per second by the whole server.
+  std::optional<double> trace_rate_limit;
+  // Tracing of the requests served from mod_cache.
+  std::optional<tracing::conf::CacheHits> cache_hits;
+  // Trace payloads waiting for the Agent. Main server only.
+  tracing::conf::TraceBuffer trace_buffer;
+  // Compression of the trace payloads sent over TCP. Main server only.
+  tracing::conf::TraceCompression trace_compression;
+  // File keeping the trace payloads the Agent could not take. Main server
+  // only.
+  std::optional<std::string> trace_spool_path;
+  std::size_t trace_spool_size = 64 * 1024 * 1024;
+  // File of the tracing settings changed while the server runs. Main server
+  // only.
+  std::optional<std::string> live_control_path;
+  // How request threads hand finished traces to the tracer. Main server
+  // only.
+  tracing::conf::SpanCollection span_collection =
+      tracing::conf::SpanCollection::direct;
+  // Spans of client connections and of their TLS handshake. Main server
+  // only.
+  bool connection_tracing = false;
+  // CPU profiler of the request threads. Main server only.
+  profiling::conf::Module profiling;
+  // Shedding of tracing work while the server is saturated.
+  tracing::conf::Governor governor;
+  // Interval between the checkpoint spans of long requests. Main server only.
+  std::chrono::seconds long_request_checkpoint_interval{30};
 };
 
 struct Directory final {
@@ -25,6 +64,21 @@ struct Directory final {
   std::optional<bool> tracing_enabled;
   std::optional<bool> trust_inbound_span;
   std::unordered_map<std::string, std::string> tags;
+  // Request and response headers reported as tags. Owned by the
+  // configuration pool.
+  const tracing::HeaderTags* header_tags = nullptr;
+  // Collapse subrequests into metrics of the parent span.
+  std::optional<bool> subrequest_aggregation;
+  // In aggregation mode, still report subrequests slower than this as spans.
+  std::optional<std::chrono::milliseconds> subrequest_span_threshold;
+  // Report the progress of the request before it is done: WebSocket tunnels,
+  // server-sent events, long polling.
+  std::optional<bool> long_requests;
+  // Send the timing and the trace context of the request in a
+  // `Server-Timing` response header.
+  std::optional<bool> server_timing;
+  // Report the CPU time, memory and traffic of each request.
+  std::optional<bool> resource_accounting;
 
   // RUM
 #if defined(HTTPD_DD_RUM)
@@ -0,0 +1,147 @@
+#include "aggregator.h"
+
+#include <cctype>
+#include <thread>
+
+namespace datadog::metrics {
+namespace {
+
+std::atomic<std::uint64_t> g_next_generation{1};
+
+thread_local std::uint64_t t_shard_generation = 0;
+thread_local void* t_shard = nullptr;
+
+// Segments with a digit made of hexadecimal digits and separators, like
+// numbers, hashes and UUIDs, or long enough to be tokens.
+bool is_identifier(std::string_view segment) {
+  bool digit = false;
+  bool hex = true;
+  for (const char ch : segment) {
+    const auto byte = static_cast<unsigned char>(ch);
+    if (std::isdigit(byte)) {
+      digit = true;
+    } else if (!std::isxdigit(byte) && ch != '-' && ch != '_') {
+      hex = false;
+    }
+  }
+  return digit && (hex || segment.size() >= 20);
+}
+
+}  // namespace
+
+std::string normalize_resource(std::string_view resource) {
+  // The path is the second word: "<method> <path> <protocol>".
+  const auto path_begin = resource.find(' ');
+  if (path_begin == resource.npos) return std::string(resource);
+  const auto path_end = resource.find(' ', path_begin + 1);
+
+  std::string normalized(resource.substr(0, path_begin + 1));
+  const std::string_view path =
+      resource.substr(path_begin + 1, path_end == resource.npos
+                                          ? resource.npos
+                                          : path_end - path_begin - 1);
+  std::size_t begin = 0;
+  while (begin <= path.size()) {
+    auto end = path.find('/', begin);
+    if (end == path.npos) end = path.size();
+    const auto segment = path.substr(begin, end - begin);
+    normalized += is_identifier(segment) ? "?" : segment;
+    if (end != path.size()) normalized += '/';
+    begin = end + 1;
+  }
+  if (path_end != resource.npos) normalized += resource.substr(path_end);
+  return normalized;
+}
+
+Aggregator::Aggregator() : generation_(g_next_generation.fetch_add(1)) {}
+
+void Aggregator::record(std::string_view service,
+                        std::string_view environment,
+                        std::string_view resource, int status,
+                        std::chrono::microseconds duration,
+                        std::uint64_t bytes_sent,
+                        const tracing::ResourceUsage* usage) {
+  Shard& shard = current_shard();
+
+  RequestKey key{std::string(service), std::string(environment),
+                 normalize_resource(resource), status / 100};
+  if (!admit(shard, key.resource)) key.resource = "other";
+
+  // Only the owning thread ever empties the slot, so the table is always
+  // there. Emptying it tells the flush thread to wait until we are done.
+  RequestTable* table = shard.table.exchange(nullptr, std::memory_order_acquire);
+
+  auto found = table->try_emplace(std::move(key)).first;
+
+  RequestStats& stats = found->second;
+  ++stats.hits;
+  if (status >= 500) ++stats.errors;
+  stats.bytes_sent += bytes_sent;
+  stats.latency_us.add(static_cast<double>(duration.count()));
+  if (usage != nullptr) {
+    ++stats.accounted;
+    stats.bytes_received += usage->bytes_read;
+    if (usage->cpu_time) {
+      stats.cpu_time_us.add(static_cast<double>(usage->cpu_time->count()));
+    }
+    if (usage->pool_bytes) {
+      stats.pool_bytes.add(static_cast<double>(*usage->pool_bytes));
+    }
+  }
+
+  shard.table.store(table, std::memory_order_release);
+}
+
+RequestTable Aggregator::collect() {
+  RequestTable merged;
+
+  std::lock_guard<std::mutex> lock(shards_mutex_);
+  for (auto& shard : shards_) {
+    auto* fresh_table = new RequestTable;
+    RequestTable* table = shard->table.load(std::memory_order_acquire);
+    while (table == nullptr || !shard->table.compare_exchange_weak(
+                                   table, fresh_table,
+                                   std::memory_order_acq_rel)) {
+      std::this_thread::yield();
+      table = shard->table.load(std::memory_order_acquire);
+    }
+
+    for (auto& [key, stats] : *table) {
+      merged[key].merge(stats);
+    }
+    delete table;
+  }
+
+  return merged;
+}
+
+bool Aggregator::admit(Shard& shard, const std::string& resource) {
+  if (shard.resources.count(resource) != 0) return true;
+  if (shard.all_resources) return false;
+
+  std::lock_guard<std::mutex> lock(resources_mutex_);
+  if (resources_.size() < max_resources) resources_.insert(resource);
+  if (resources_.size() < max_resources) {
+    shard.resources.insert(resource);
+    return true;
+  }
+
+  // No resource will be added anymore: the thread no longer needs the lock.
+  shard.resources = resources_;
+  shard.all_resources = true;
+  return shard.resources.count(resource) != 0;
+}
+
+Aggregator::Shard& Aggregator::current_shard() {
+  if (t_shard_generation == generation_) {
+    return *static_cast<Shard*>(t_shard);
+  }
+
+  std::lock_guard<std::mutex> lock(shards_mutex_);
+  shards_.emplace_back(std::make_unique<Shard>());
+  t_shard = shards_.back().get();
+  t_shard_generation = generation_;
+  return *shards_.back();
+}
+
+}  // namespace datadog::metrics
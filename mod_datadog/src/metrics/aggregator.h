@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "sketch.h"
+#include "tracing/resource_usage.h"
+
+namespace datadog::metrics {
+
+struct RequestKey final {
+  std::string service;
+  std::string environment;
+  std::string resource;
+  int status_class = 0;  ///< 1 for 1xx, 2 for 2xx, ..., 5 for 5xx
+
+  bool operator==(const RequestKey& other) const {
+    return status_class == other.status_class && service == other.service &&
+           environment == other.environment && resource == other.resource;
+  }
+};
+
+struct RequestKeyHash final {
+  std::size_t operator()(const RequestKey& key) const {
+    const std::hash<std::string_view> hasher;
+    return hasher(key.service) ^ (hasher(key.environment) << 1) ^
+           (hasher(key.resource) << 2) ^
+           static_cast<std::size_t>(key.status_class);
+  }
+};
+
+struct RequestStats final {
+  std::uint64_t hits = 0;
+  std::uint64_t errors = 0;
+  std::uint64_t bytes_sent = 0;
+  LatencySketch latency_us;
+  // Resources of the requests accounted for by `DatadogResourceAccounting`.
+  std::uint64_t accounted = 0;
+  std::uint64_t bytes_received = 0;
+  LatencySketch cpu_time_us;
+  LatencySketch pool_bytes;
+
+  void merge(const RequestStats& other) {
+    hits += other.hits;
+    errors += other.errors;
+    bytes_sent += other.bytes_sent;
+    latency_us.merge(other.latency_us);
+    accounted += other.accounted;
+    bytes_received += other.bytes_received;
+    cpu_time_us.merge(other.cpu_time_us);
+    pool_bytes.merge(other.pool_bytes);
+  }
+};
+
+using RequestTable =
+    std::unordered_map<RequestKey, RequestStats, RequestKeyHash>;
+
+// Replace the path segments of `resource` that look like identifiers, such
+// as numbers, hashes or UUIDs, by `?`: "GET /users/42 HTTP/1.1" becomes
+// "GET /users/? HTTP/1.1".
+std::string normalize_resource(std::string_view resource);
+
+// Aggregate RED (rate, errors, duration) metrics of every request served by
+// the process, independently of trace sampling.
+//
+// Each request thread records into its own shard, so recording never
+// contends with other request threads. The flush thread takes ownership of a
+// shard's table with a single compare-and-swap, leaving an empty one behind;
+// merging and serializing happen off the request path.
+//
+// Resources are normalized, and the process reports at most
+// `max_resources` distinct ones over its lifetime. Each thread remembers the
+// resources it has seen, so the lock guarding the set of the process is only
+// taken for new ones.
+class Aggregator final {
+ public:
+  // Number of distinct resources reported by the process.
+  // Requests with a resource beyond that limit are folded into `other`.
+  static constexpr std::size_t max_resources = 512;
+
+  Aggregator();
+
+  // @param resource  Resource name of the span of the request, normalized
+  //                  here
+  // @param usage     Resources used by the request, or `nullptr` if it was
+  //                  not accounted for
+  void record(std::string_view service, std::string_view environment,
+              std::string_view resource, int status,
+              std::chrono::microseconds duration, std::uint64_t bytes_sent,
+              const tracing::ResourceUsage* usage = nullptr);
+
+  // Return the statistics recorded since the previous call, merged across
+  // all threads.
+  RequestTable collect();
+
+ private:
+  struct Shard final {
+    std::atomic<RequestTable*> table{new RequestTable};
+    // Resources admitted, only used by the owning thread. Once the process
+    // has `max_resources`, a copy of all of them.
+    std::unordered_set<std::string> resources;
+    bool all_resources = false;
+    ~Shard() { delete table.load(); }
+  };
+
+  const std::uint64_t generation_;
+  std::mutex shards_mutex_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  std::mutex resources_mutex_;
+  std::unordered_set<std::string> resources_;
+
+  Shard& current_shard();
+
+  // Return whether `resource` is one of the `max_resources` reported.
+  bool admit(Shard& shard, const std::string& resource);
+};
+
+}  // namespace datadog::metrics
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include <string>
+
+namespace datadog::metrics::conf {
+
+struct Module final {
+  // DogStatsD URL. Request metrics are disabled when unset.
+  std::optional<std::string> url;
+  std::optional<std::chrono::seconds> flush_interval;
+};
+
+}  // namespace datadog::metrics::conf
@@ -0,0 +1,210 @@
+#include "dogstatsd.h"
+
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace datadog::metrics {
+namespace {
+
+constexpr std::string_view k_udp_scheme = "udp://";
+constexpr std::string_view k_unix_scheme = "unix://";
+
+// Largest UDP payload that fits an Ethernet frame without fragmentation.
+constexpr std::size_t k_udp_datagram_size = 1432;
+constexpr std::size_t k_unix_datagram_size = 8192;
+
+bool starts_with(std::string_view text, std::string_view prefix) {
+  return text.substr(0, prefix.size()) == prefix;
+}
+
+std::optional<Endpoint> parse_udp_endpoint(std::string_view authority) {
+  Endpoint endpoint;
+  endpoint.transport = Endpoint::Transport::UDP;
+
+  std::string_view port;
+  if (starts_with(authority, "[")) {
+    const auto closing_bracket = authority.find(']');
+    if (closing_bracket == std::string_view::npos) return std::nullopt;
+    endpoint.host = std::string(authority.substr(1, closing_bracket - 1));
+    auto rest = authority.substr(closing_bracket + 1);
+    if (!rest.empty()) {
+      if (rest.front() != ':') return std::nullopt;
+      port = rest.substr(1);
+    }
+  } else if (const auto colon = authority.rfind(':');
+             colon != std::string_view::npos) {
+    endpoint.host = std::string(authority.substr(0, colon));
+    port = authority.substr(colon + 1);
+  } else {
+    endpoint.host = std::string(authority);
+  }
+
+  if (endpoint.host.empty()) return std::nullopt;
+
+  if (!port.empty()) {
+    unsigned long number = 0;
+    for (char digit : port) {
+      if (digit < '0' || digit > '9') return std::nullopt;
+      number = number * 10 + static_cast<unsigned long>(digit - '0');
+      if (number > 65535) return std::nullopt;
+    }
+    endpoint.port = static_cast<std::uint16_t>(number);
+  }
+
+  return endpoint;
+}
+
+int open_udp_socket(const Endpoint& endpoint) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+
+  addrinfo* addresses = nullptr;
+  const std::string port = std::to_string(endpoint.port);
+  if (getaddrinfo(endpoint.host.c_str(), port.c_str(), &hints, &addresses) !=
+      0) {
+    errno = EHOSTUNREACH;
+    return -1;
+  }
+
+  int fd = -1;
+  for (addrinfo* address = addresses; address != nullptr;
+       address = address->ai_next) {
+    fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC,
+                address->ai_protocol);
+    if (fd == -1) continue;
+    if (connect(fd, address->ai_addr, address->ai_addrlen) == 0) break;
+    close(fd);
+    fd = -1;
+  }
+
+  freeaddrinfo(addresses);
+  return fd;
+}
+
+bool connect_unix_socket(int fd, const Endpoint& endpoint) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, endpoint.path.c_str(), endpoint.path.size());
+  return connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) ==
+         0;
+}
+
+int open_unix_socket(const Endpoint& endpoint) {
+  if (endpoint.path.size() >= sizeof(sockaddr_un::sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) return -1;
+
+  // The DogStatsD server may not be listening yet. The socket is kept
+  // unconnected in that case and reconnected on the next flush.
+  if (!connect_unix_socket(fd, endpoint) && errno != ENOENT &&
+      errno != ECONNREFUSED) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+}  // namespace
+
+std::optional<Endpoint> parse_endpoint(std::string_view url) {
+  if (starts_with(url, k_udp_scheme)) {
+    return parse_udp_endpoint(url.substr(k_udp_scheme.size()));
+  }
+
+  if (starts_with(url, k_unix_scheme)) {
+    Endpoint endpoint;
+    endpoint.transport = Endpoint::Transport::UNIX;
+    endpoint.path = std::string(url.substr(k_unix_scheme.size()));
+    if (endpoint.path.empty() || endpoint.path.front() != '/') {
+      return std::nullopt;
+    }
+    return endpoint;
+  }
+
+  return std::nullopt;
+}
+
+std::unique_ptr<DogStatsDClient> DogStatsDClient::open(
+    const Endpoint& endpoint) {
+  const bool is_udp = endpoint.transport == Endpoint::Transport::UDP;
+  const int fd = is_udp ? open_udp_socket(endpoint) : open_unix_socket(endpoint);
+  if (fd == -1) return nullptr;
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return std::make_unique<DogStatsDClient>(
+      endpoint, fd, is_udp ? k_udp_datagram_size : k_unix_datagram_size);
+}
+
+DogStatsDClient::DogStatsDClient(Endpoint endpoint, int socket,
+                                 std::size_t max_datagram_size)
+    : endpoint_(std::move(endpoint)),
+      socket_(socket),
+      max_datagram_size_(max_datagram_size) {
+  datagram_.reserve(max_datagram_size_);
+}
+
+DogStatsDClient::~DogStatsDClient() {
+  flush();
+  close(socket_);
+}
+
+void DogStatsDClient::count(std::string_view name, std::uint64_t value,
+                            std::string_view tags) {
+  append(fmt::format("{}:{}|c|#{}", name, value, tags));
+}
+
+void DogStatsDClient::gauge(std::string_view name, double value,
+                            std::string_view tags) {
+  append(fmt::format("{}:{}|g|#{}", name, value, tags));
+}
+
+void DogStatsDClient::distribution(std::string_view name, double value,
+                                   std::uint64_t weight,
+                                   std::string_view tags) {
+  if (weight == 0) return;
+  if (weight == 1) {
+    append(fmt::format("{}:{}|d|#{}", name, value, tags));
+  } else {
+    append(fmt::format("{}:{}|d|@{}|#{}", name, value,
+                       1.0 / static_cast<double>(weight), tags));
+  }
+}
+
+void DogStatsDClient::flush() {
+  if (datagram_.empty()) return;
+
+  // Errors are ignored on purpose: metrics are best effort.
+  if (send(socket_, datagram_.data(), datagram_.size(), MSG_NOSIGNAL) == -1 &&
+      endpoint_.transport == Endpoint::Transport::UNIX &&
+      (errno == ENOTCONN || errno == ECONNREFUSED || errno == ENOENT)) {
+    if (connect_unix_socket(socket_, endpoint_)) {
+      (void)send(socket_, datagram_.data(), datagram_.size(), MSG_NOSIGNAL);
+    }
+  }
+  datagram_.clear();
+}
+
+void DogStatsDClient::append(std::string_view line) {
+  if (!datagram_.empty() &&
+      datagram_.size() + 1 + line.size() > max_datagram_size_) {
+    flush();
+  }
+
+  if (!datagram_.empty()) datagram_ += '\n';
+  datagram_ += line;
+}
+
+}  // namespace datadog::metrics
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace datadog::metrics {
+
+struct Endpoint final {
+  enum class Transport { UDP, UNIX };
+
+  Transport transport = Transport::UDP;
+  std::string host;
+  std::uint16_t port = 8125;
+  std::string path;  ///< Unix domain socket path
+};
+
+// Parse a DogStatsD URL: `udp://<host>[:<port>]` or `unix://<path>`.
+std::optional<Endpoint> parse_endpoint(std::string_view url);
+
+// Fire-and-forget DogStatsD client.
+//
+// Metrics are batched into datagrams no larger than what the transport can
+// carry without fragmentation. Sends are non-blocking; a datagram that cannot
+// be sent right away is dropped rather than delaying the caller.
+class DogStatsDClient final {
+  Endpoint endpoint_;
+  int socket_ = -1;
+  std::size_t max_datagram_size_;
+  std::string datagram_;
+
+ public:
+  // Return a client connected to `endpoint`, or `nullptr` and set `errno`.
+  static std::unique_ptr<DogStatsDClient> open(const Endpoint& endpoint);
+
+  DogStatsDClient(Endpoint endpoint, int socket,
+                  std::size_t max_datagram_size);
+  ~DogStatsDClient();
+
+  DogStatsDClient(const DogStatsDClient&) = delete;
+  DogStatsDClient& operator=(const DogStatsDClient&) = delete;
+
+  void count(std::string_view name, std::uint64_t value,
+             std::string_view tags);
+  void gauge(std::string_view name, double value, std::string_view tags);
+  // Send `value` as a distribution, observed `weight` times: the DogStatsD
+  // server weighs it by the inverse of the sample rate.
+  void distribution(std::string_view name, double value, std::uint64_t weight,
+                    std::string_view tags);
+
+  // Send the pending datagram, if any.
+  void flush();
+
+ private:
+  void append(std::string_view line);
+};
+
+}  // namespace datadog::metrics
@@ -0,0 +1,101 @@
+#include "reporter.h"
+
+#include <apr_time.h>
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <string>
+
+#include "common_conf.h"
+#include "tracing/hooks.h"
+
+namespace datadog::metrics {
+namespace {
+
+// DogStatsD reserves `,`, `|` and `#` in tags.
+std::string sanitize_tag_value(std::string_view value) {
+  std::string sanitized(value);
+  std::replace_if(
+      sanitized.begin(), sanitized.end(),
+      [](char ch) { return ch == ',' || ch == '|' || ch == '#' || ch == '\n'; },
+      '_');
+  return sanitized;
+}
+
+std::string make_tags(const RequestKey& key) {
+  std::string tags = fmt::format("service:{},resource_name:{},status_class:{}xx",
+                                 sanitize_tag_value(key.service),
+                                 sanitize_tag_value(key.resource),
+                                 key.status_class);
+  if (!key.environment.empty()) {
+    tags += fmt::format(",env:{}", sanitize_tag_value(key.environment));
+  }
+  return tags;
+}
+
+// Send the values of `sketch`, multiplied by `scale`, as a distribution: one
+// value per bin, weighted by its count. Unlike quantiles computed by each
+// child, distributions are merged across children and hosts by Datadog.
+void send_distribution(DogStatsDClient& client, std::string_view name,
+                       const LatencySketch& sketch, double scale,
+                       std::string_view tags) {
+  sketch.visit([&](double value, std::uint64_t count) {
+    client.distribution(name, value * scale, count, tags);
+  });
+}
+
+}  // namespace
+
+Reporter::Reporter(std::unique_ptr<DogStatsDClient> client,
+                   tracing::EventScheduler& scheduler,
+                   std::chrono::seconds flush_interval)
+    : client_(std::move(client)) {
+  cancel_flush_ =
+      scheduler.schedule_recurring_event(flush_interval, [this] { flush(); });
+}
+
+Reporter::~Reporter() {
+  cancel_flush_();
+  flush();
+}
+
+void Reporter::on_log_transaction(request_rec* r,
+                                  const tracing::ResourceUsage* usage,
+                                  module* datadog_module) {
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(r->server->module_config, datadog_module));
+  if (module_conf == nullptr) return;
+
+  const auto& tracer_conf = module_conf->tracing;
+  const std::chrono::microseconds duration{apr_time_now() - r->request_time};
+  aggregator_.record(tracer_conf.service.value_or("httpd"),
+                     tracer_conf.environment.value_or(""),
+                     tracing::make_resource_name(r), r->status, duration,
+                     static_cast<std::uint64_t>(r->bytes_sent), usage);
+}
+
+void Reporter::flush() {
+  const RequestTable table = aggregator_.collect();
+
+  for (const auto& [key, stats] : table) {
+    const std::string tags = make_tags(key);
+
+    client_->count("httpd.request.hits", stats.hits, tags);
+    client_->count("httpd.request.errors", stats.errors, tags);
+    client_->count("httpd.request.bytes_sent", stats.bytes_sent, tags);
+    send_distribution(*client_, "httpd.request.duration", stats.latency_us,
+                      1e-6, tags);
+
+    if (stats.accounted == 0) continue;
+    client_->count("httpd.request.bytes_received", stats.bytes_received,
+                   tags);
+    send_distribution(*client_, "httpd.request.cpu_time", stats.cpu_time_us,
+                      1e-6, tags);
+    send_distribution(*client_, "httpd.request.pool_bytes", stats.pool_bytes,
+                      1.0, tags);
+  }
+
+  client_->flush();
+}
+
+}  // namespace datadog::metrics
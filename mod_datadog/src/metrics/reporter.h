@@ -0,0 +1,39 @@
+#pragma once
+
+#include <datadog/event_scheduler.h>
+#include <http_core.h>
+
+#include <chrono>
+#include <memory>
+
+#include "aggregator.h"
+#include "dogstatsd.h"
+
+namespace datadog::metrics {
+
+// Record the RED metrics of every request and periodically flush them to
+// DogStatsD.
+class Reporter final {
+  Aggregator aggregator_;
+  std::unique_ptr<DogStatsDClient> client_;
+  tracing::EventScheduler::Cancel cancel_flush_;
+
+ public:
+  Reporter(std::unique_ptr<DogStatsDClient> client,
+           tracing::EventScheduler& scheduler,
+           std::chrono::seconds flush_interval);
+  ~Reporter();
+
+  // Record a finished main request.
+  //
+  // @param r               Request
+  // @param usage           Resources used by `r`, or `nullptr` if it was not
+  //                        accounted for
+  // @param datadog_module  Datadog module
+  void on_log_transaction(request_rec* r, const tracing::ResourceUsage* usage,
+                          module* datadog_module);
+
+  void flush();
+};
+
+}  // namespace datadog::metrics
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace datadog::metrics {
+
+// Mergeable quantile sketch with bounded relative error, modeled after
+// DDSketch <https://arxiv.org/abs/1908.10693>.
+//
+// Positive values are mapped to logarithmically sized bins, so every quantile
+// estimate is within `relative_accuracy` of the exact value. Bins are stored
+// densely between the lowest and highest index seen. When the store exceeds
+// `max_bins`, the lowest bins are collapsed, which only degrades the accuracy
+// of the smallest values.
+class LatencySketch final {
+ public:
+  static constexpr double relative_accuracy = 0.01;
+  static constexpr std::size_t max_bins = 2048;
+
+  void add(double value) { add(value, 1); }
+
+  void add(double value, std::uint64_t weight) {
+    if (weight == 0) return;
+
+    count_ += weight;
+    sum_ += value * static_cast<double>(weight);
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+
+    if (value < min_indexable_value) {
+      zero_count_ += weight;
+    } else {
+      add_to_bin(index(value), weight);
+    }
+  }
+
+  void merge(const LatencySketch& other) {
+    if (other.count_ == 0) return;
+
+    count_ += other.count_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+    zero_count_ += other.zero_count_;
+
+    for (std::size_t i = 0; i < other.bins_.size(); ++i) {
+      add_to_bin(other.offset_ + static_cast<int>(i), other.bins_[i]);
+    }
+  }
+
+  // Return the estimated value at quantile `q` (in [0;1]), or 0 when empty.
+  double quantile(double q) const {
+    if (count_ == 0) return 0.0;
+    if (q <= 0.0) return min_;
+    if (q >= 1.0) return max_;
+
+    const double rank = q * static_cast<double>(count_ - 1);
+    double cumulated = static_cast<double>(zero_count_);
+    if (cumulated > rank) return std::max(min_, 0.0);
+
+    for (std::size_t i = 0; i < bins_.size(); ++i) {
+      cumulated += static_cast<double>(bins_[i]);
+      if (cumulated > rank) {
+        const double estimate = value(offset_ + static_cast<int>(i));
+        return std::clamp(estimate, min_, max_);
+      }
+    }
+
+    return max_;
+  }
+
+  void clear() { *this = LatencySketch{}; }
+
+  std::uint64_t count() const { return count_; }
+  double sum() const { return sum_; }
+  double min() const { return count_ == 0 ? 0.0 : min_; }
+  double max() const { return count_ == 0 ? 0.0 : max_; }
+  double average() const {
+    return count_ == 0 ? 0.0 : sum_ / static_cast<double>(count_);
+  }
+
+  // Invoke `visitor(value, count)` for every non-empty bin, with the value
+  // representing the bin, from the lowest to the highest. Values too small to
+  // be indexed are reported as 0.
+  template <typename Visitor>
+  void visit(Visitor&& visitor) const {
+    if (zero_count_ != 0) visitor(0.0, zero_count_);
+    for (std::size_t i = 0; i < bins_.size(); ++i) {
+      if (bins_[i] == 0) continue;
+      visitor(value(offset_ + static_cast<int>(i)), bins_[i]);
+    }
+  }
+
+  std::uint64_t zero_count() const { return zero_count_; }
+  int bin_offset() const { return offset_; }
+  const std::vector<std::uint64_t>& bins() const { return bins_; }
+
+  static double gamma() {
+    return (1.0 + relative_accuracy) / (1.0 - relative_accuracy);
+  }
+
+  // Index of the bin holding `value`. Bin `i` covers (gamma^(i-1), gamma^i].
+  static int index(double value) {
+    static const double log_gamma = std::log(gamma());
+    return static_cast<int>(std::ceil(std::log(value) / log_gamma));
+  }
+
+ private:
+  static constexpr double min_indexable_value = 1e-9;
+
+  std::vector<std::uint64_t> bins_;
+  int offset_ = 0;
+  std::uint64_t zero_count_ = 0;
+  std::uint64_t count_ = 0;
+  double sum_ = 0.0;
+  double min_ = std::numeric_limits<double>::max();
+  double max_ = std::numeric_limits<double>::lowest();
+
+  static double value(int bin_index) {
+    return 2.0 * std::pow(gamma(), bin_index) / (1.0 + gamma());
+  }
+
+  void add_to_bin(int bin_index, std::uint64_t weight) {
+    if (bins_.empty()) {
+      bins_.push_back(weight);
+      offset_ = bin_index;
+      return;
+    }
+
+    if (bin_index < offset_) {
+      const std::size_t missing = static_cast<std::size_t>(offset_ - bin_index);
+      if (bins_.size() + missing > max_bins) {
+        // Collapse into the lowest bin rather than growing downward.
+        bins_.front() += weight;
+        return;
+      }
+      bins_.insert(bins_.begin(), missing, 0);
+      offset_ = bin_index;
+    } else if (bin_index >= offset_ + static_cast<int>(bins_.size())) {
+      const std::size_t new_size =
+          static_cast<std::size_t>(bin_index - offset_) + 1;
+      if (new_size > max_bins) collapse_lowest(new_size - max_bins);
+      bins_.resize(static_cast<std::size_t>(bin_index - offset_) + 1, 0);
+    }
+
+    bins_[static_cast<std::size_t>(bin_index - offset_)] += weight;
+  }
+
+  void collapse_lowest(std::size_t bin_count) {
+    bin_count = std::min(bin_count, bins_.size() - 1);
+    std::uint64_t collapsed = 0;
+    for (std::size_t i = 0; i < bin_count; ++i) collapsed += bins_[i];
+
+    bins_.erase(bins_.begin(),
+                bins_.begin() + static_cast<std::ptrdiff_t>(bin_count));
+    bins_.front() += collapsed;
+    offset_ += static_cast<int>(bin_count);
+  }
+};
+
+}  // namespace datadog::metrics
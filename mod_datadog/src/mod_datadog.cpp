@@ -1,17 +1,26 @@
+#include <ap_mpm.h>
+#include <apr_optional_hooks.h>
 #include <apr_uri.h>
 #include <datadog/runtime_id.h>
 #include <datadog/tracer.h>
 #include <fmt/core.h>
+#include <http_connection.h>
 #include <http_core.h>
 #include <http_log.h>
 #include <http_protocol.h>
 #include <http_request.h>
+#include <mod_status.h>
 
 #include <atomic>
+#include <chrono>
 #include <memory>
 #include <string>
 
 #include "common_conf.h"
+#include "metrics/reporter.h"
+#include "profiling/profiler.h"
+#include "shared_memory.h"
+#include "status/scoreboard.h"
 #include "version.h"
 #if defined(HTTPD_DD_RUM)
 #include "rum/config.h"
@@ -21,27 +30,57 @@
 #endif
 #include <datadog/version.h>
 
+#include "tracing/compression.h"
 #include "tracing/conf.h"
+#include "tracing/connection.h"
+#include "tracing/governor_watcher.h"
+#include "tracing/header_tags.h"
 #include "tracing/hooks.h"
+#include "tracing/live_control_watcher.h"
+#include "tracing/long_requests.h"
+#include "tracing/registry.h"
+#include "tracing/request_traffic.h"
+#include "tracing/resource_usage.h"
+#include "tracing/server_timing.h"
+#include "tracing/stats_exporter.h"
 #include "utils.h"
 
 namespace dd = datadog::tracing;
 
 static std::atomic<bool> g_log_module_status = true;
 static std::unique_ptr<dd::RuntimeID> g_runtime_id = nullptr;
-static std::unique_ptr<dd::Tracer> g_tracer = nullptr;
+static std::unique_ptr<dd::TracerRegistry> g_tracer_registry = nullptr;
+static std::unique_ptr<datadog::metrics::Reporter> g_metrics_reporter = nullptr;
+static dd::stats::SharedTable* g_trace_stats = nullptr;
+static dd::SharedRateLimiter* g_rate_limiter = nullptr;
+static dd::Spool* g_spool = nullptr;
+static std::unique_ptr<dd::DeferredSpans> g_deferred_spans = nullptr;
+static dd::LiveControl* g_live_control = nullptr;
+static bool g_connection_tracing = false;
+static std::unique_ptr<dd::LiveControlWatcher> g_live_control_watcher =
+    nullptr;
+static dd::Governor* g_governor = nullptr;
+static std::unique_ptr<dd::GovernorWatcher> g_governor_watcher = nullptr;
+static std::unique_ptr<dd::stats::StatsExporter> g_trace_stats_exporter =
+    nullptr;
+static std::unique_ptr<datadog::profiling::Profiler> g_profiler = nullptr;
+static std::unique_ptr<dd::LongRequests> g_long_requests = nullptr;
+static datadog::status::Scoreboard* g_scoreboard = nullptr;
 
 APLOG_USE_MODULE(datadog);
 
 void* init_module_conf(apr_pool_t*, server_rec*);
+void* merge_module_conf(apr_pool_t*, void*, void*);
 apr_status_t destroy_module_conf(void*);
 
 // Hooks
 int on_post_config(apr_pool_t*, apr_pool_t*, apr_pool_t*, server_rec*);
 void on_child_init(apr_pool_t*, server_rec*);
 apr_status_t on_child_exit(void*);
+int on_pre_connection(conn_rec*, void*);
 int on_fixups(request_rec*);
 int on_log_transaction(request_rec*);
+int on_status(request_rec*, int);
 void register_hooks(apr_pool_t*);
 
 // Directives setter
@@ -52,8 +91,39 @@ const char* set_service_name(cmd_parms*, void*, const char*);
 const char* enable_tracing(cmd_parms*, void*, int);
 const char* add_or_overwrite_tag(cmd_parms*, void*, const char*, const char*);
 const char* enable_inbound_span(cmd_parms*, void*, int);
+const char* set_http_header_tags(cmd_parms*, void*, const char*);
+const char* enable_subrequest_aggregation(cmd_parms*, void*, int);
+const char* set_subrequest_span_threshold(cmd_parms*, void*, const char*);
+const char* enable_long_requests(cmd_parms*, void*, int);
+const char* enable_server_timing(cmd_parms*, void*, int);
+const char* enable_resource_accounting(cmd_parms*, void*, int);
+const char* set_long_request_checkpoint_interval(cmd_parms*, void*,
+                                                 const char*);
 const char* set_sampling_rate(cmd_parms*, void*, const char*);
 const char* set_propagation_style(cmd_parms*, void*, int, const char*[]);
+const char* set_metrics_url(cmd_parms*, void*, const char*);
+const char* set_metrics_flush_interval(cmd_parms*, void*, const char*);
+const char* enable_trace_stats(cmd_parms*, void*, int);
+const char* enable_connection_tracing(cmd_parms*, void*, int);
+const char* enable_tail_retention(cmd_parms*, void*, int);
+const char* set_trace_rate_limit(cmd_parms*, void*, const char*);
+const char* set_trace_buffer_size(cmd_parms*, void*, const char*);
+const char* set_trace_buffer_policy(cmd_parms*, void*, const char*);
+const char* set_trace_spool(cmd_parms*, void*, const char*, const char*);
+const char* set_trace_compression(cmd_parms*, void*, const char*,
+                                  const char*);
+const char* set_trace_compression_min_size(cmd_parms*, void*, const char*);
+const char* set_span_collection(cmd_parms*, void*, const char*);
+const char* set_cache_hit_sampling(cmd_parms*, void*, const char*);
+const char* set_live_control(cmd_parms*, void*, const char*);
+const char* set_profiler(cmd_parms*, void*, const char*, const char*);
+const char* enable_overhead_governor(cmd_parms*, void*, int);
+const char* set_overhead_governor_watermarks(cmd_parms*, void*, const char*,
+                                             const char*);
+const char* set_overhead_governor_sampling_rate(cmd_parms*, void*,
+                                                const char*);
+const char* set_tail_retention_latency(cmd_parms*, void*, const char*);
+const char* set_tail_retention_base_rate(cmd_parms*, void*, const char*);
 
 // clang-format off
 static const command_rec datadog_commands[] = {
@@ -64,11 +134,38 @@ static const command_rec datadog_commands[] = {
   AP_INIT_TAKE1("DatadogAgentUrl",             reinterpret_cast<cmd_func>(set_agent_url),           NULL, RSRC_CONF, "Set Datadog agent URL"),
   AP_INIT_TAKE1("DatadogSamplingRate",         reinterpret_cast<cmd_func>(set_sampling_rate),       NULL, RSRC_CONF, "Set Datadog sampling rate"),
   AP_INIT_TAKE_ARGV("DatadogPropagationStyle", reinterpret_cast<cmd_func>(set_propagation_style),   NULL, RSRC_CONF, "Set propagation style"),
+  AP_INIT_TAKE1("DatadogMetricsUrl",           reinterpret_cast<cmd_func>(set_metrics_url),         NULL, RSRC_CONF, "Set DogStatsD URL for request metrics"),
+  AP_INIT_TAKE1("DatadogMetricsFlushInterval", reinterpret_cast<cmd_func>(set_metrics_flush_interval), NULL, RSRC_CONF, "Set request metrics flush interval in seconds"),
+  AP_INIT_FLAG("DatadogTraceStats",            reinterpret_cast<cmd_func>(enable_trace_stats),      NULL, RSRC_CONF, "Compute trace statistics in the module"),
+  AP_INIT_FLAG("DatadogConnectionTracing",     reinterpret_cast<cmd_func>(enable_connection_tracing), NULL, RSRC_CONF, "Report client connections and their TLS handshake as spans"),
+  AP_INIT_TAKE1("DatadogTraceRateLimit",       reinterpret_cast<cmd_func>(set_trace_rate_limit),    NULL, RSRC_CONF, "Set the number of traces per second kept by the whole server"),
+  AP_INIT_TAKE1("DatadogTraceBufferSize",      reinterpret_cast<cmd_func>(set_trace_buffer_size),   NULL, RSRC_CONF, "Set the size in bytes of the trace payloads waiting for the Agent"),
+  AP_INIT_TAKE1("DatadogTraceBufferPolicy",    reinterpret_cast<cmd_func>(set_trace_buffer_policy), NULL, RSRC_CONF, "Drop the oldest or the new payload when the trace buffer is full"),
+  AP_INIT_TAKE12("DatadogTraceSpool",          reinterpret_cast<cmd_func>(set_trace_spool),         NULL, RSRC_CONF, "Keep the trace payloads the Agent could not take in a file"),
+  AP_INIT_TAKE12("DatadogTraceCompression",    reinterpret_cast<cmd_func>(set_trace_compression),   NULL, RSRC_CONF, "Compress the trace payloads sent to an Agent over TCP with Gzip or Zstd, at an optional level"),
+  AP_INIT_TAKE1("DatadogTraceCompressionMinSize", reinterpret_cast<cmd_func>(set_trace_compression_min_size), NULL, RSRC_CONF, "Set the size in bytes from which trace payloads are compressed"),
+  AP_INIT_TAKE1("DatadogSpanCollection",       reinterpret_cast<cmd_func>(set_span_collection),     NULL, RSRC_CONF, "Hand finished traces to the tracer directly or from per-thread queues"),
+  AP_INIT_TAKE1("DatadogLiveControl",          reinterpret_cast<cmd_func>(set_live_control),        NULL, RSRC_CONF, "Read tracing settings changed while the server runs from a file"),
+  AP_INIT_TAKE12("DatadogProfiler",            reinterpret_cast<cmd_func>(set_profiler),            NULL, RSRC_CONF, "Write CPU profiles of the request threads to a directory"),
+  AP_INIT_TAKE1("DatadogLongRequestCheckpointInterval", reinterpret_cast<cmd_func>(set_long_request_checkpoint_interval), NULL, RSRC_CONF, "Set the interval in seconds between the checkpoint spans of long requests"),
+  AP_INIT_FLAG("DatadogOverheadGovernor",      reinterpret_cast<cmd_func>(enable_overhead_governor), NULL, RSRC_CONF, "Shed tracing work while the server is saturated"),
+  AP_INIT_TAKE2("DatadogOverheadGovernorWatermarks", reinterpret_cast<cmd_func>(set_overhead_governor_watermarks), NULL, RSRC_CONF, "Set the percentages of busy workers from which tracing work is shed and under which it resumes"),
+  AP_INIT_TAKE1("DatadogOverheadGovernorSamplingRate", reinterpret_cast<cmd_func>(set_overhead_governor_sampling_rate), NULL, RSRC_CONF, "Set the ratio of traces kept while tracing work is shed"),
+  AP_INIT_TAKE1("DatadogCacheHitSampling",     reinterpret_cast<cmd_func>(set_cache_hit_sampling),  NULL, RSRC_CONF, "Keep this ratio of the traces of mod_cache hits, or Aggregate to only count them"),
+  AP_INIT_FLAG("DatadogTailRetention",         reinterpret_cast<cmd_func>(enable_tail_retention),   NULL, RSRC_CONF, "Decide to keep traces when requests are done"),
+  AP_INIT_TAKE1("DatadogTailRetentionLatency", reinterpret_cast<cmd_func>(set_tail_retention_latency), NULL, RSRC_CONF, "Keep traces of requests lasting at least this many milliseconds"),
+  AP_INIT_TAKE1("DatadogTailRetentionBaseRate", reinterpret_cast<cmd_func>(set_tail_retention_base_rate), NULL, RSRC_CONF, "Keep this ratio of the other traces"),
 
   // Server and Directive scope
   AP_INIT_FLAG("DatadogTracing",               reinterpret_cast<cmd_func>(enable_tracing),          NULL, RSRC_CONF | ACCESS_CONF, "Enable or disable Datadog tracing module"),
   AP_INIT_FLAG("DatadogTrustInboundSpan",      reinterpret_cast<cmd_func>(enable_inbound_span),     NULL, RSRC_CONF | ACCESS_CONF, "Trust inbound span headers"),
   AP_INIT_ITERATE2("DatadogAddTag",            reinterpret_cast<cmd_func>(add_or_overwrite_tag),    NULL, RSRC_CONF | ACCESS_CONF, "Append tags"),
+  AP_INIT_TAKE1("DatadogHttpHeaderTags",       reinterpret_cast<cmd_func>(set_http_header_tags),    NULL, RSRC_CONF | ACCESS_CONF, "Report request and response headers as tags"),
+  AP_INIT_FLAG("DatadogSubrequestAggregation", reinterpret_cast<cmd_func>(enable_subrequest_aggregation), NULL, RSRC_CONF | ACCESS_CONF, "Collapse subrequests into metrics of the parent span"),
+  AP_INIT_TAKE1("DatadogSubrequestSpanThreshold", reinterpret_cast<cmd_func>(set_subrequest_span_threshold), NULL, RSRC_CONF | ACCESS_CONF, "Keep spans of aggregated subrequests slower than this many milliseconds"),
+  AP_INIT_FLAG("DatadogServerTiming",          reinterpret_cast<cmd_func>(enable_server_timing),    NULL, RSRC_CONF | ACCESS_CONF, "Send the timing and trace context of requests in a Server-Timing header"),
+  AP_INIT_FLAG("DatadogLongRequests",          reinterpret_cast<cmd_func>(enable_long_requests),    NULL, RSRC_CONF | ACCESS_CONF, "Report the progress of long requests with checkpoint spans"),
+  AP_INIT_FLAG("DatadogResourceAccounting",    reinterpret_cast<cmd_func>(enable_resource_accounting), NULL, RSRC_CONF | ACCESS_CONF, "Report the CPU time, memory and traffic of each request"),
 
   RUM_MODULE_CMDS
 
@@ -82,11 +179,15 @@ module AP_MODULE_DECLARE_DATA datadog_module = {
     datadog::conf::merge_dir_conf, /* Merge handler for per-directory
                                       configurations */
     init_module_conf,              /* Per-server configuration handler */
-    NULL,             /* Merge handler for per-server configurations */
+    merge_module_conf, /* Merge handler for per-server configurations */
     datadog_commands, /* Any directives we may have for httpd */
     register_hooks    /* Our hook registering function */
 };
 
+static void insert_server_timing_filter(request_rec* r) {
+  dd::insert_server_timing_filter(r, &datadog_module);
+}
+
 #if defined(HTTPD_DD_RUM)
 static void insert_datadog_filters(request_rec* r) {
   ap_add_output_filter(rum_filter_name, NULL, r, r->connection);
@@ -97,9 +198,19 @@ void register_hooks(apr_pool_t*) {
   g_runtime_id = std::make_unique<dd::RuntimeID>(dd::RuntimeID::generate());
   ap_hook_post_config(on_post_config, NULL, NULL, APR_HOOK_MIDDLE);
   ap_hook_child_init(on_child_init, NULL, NULL, APR_HOOK_MIDDLE);
+  // After mod_ssl, which tells whether the connection uses TLS.
+  ap_hook_pre_connection(on_pre_connection, NULL, NULL, APR_HOOK_LAST);
+  dd::register_connection_hooks();
+  dd::register_request_traffic_filters();
   ap_hook_fixups(on_fixups, NULL, NULL, APR_HOOK_LAST);
+  ap_hook_insert_filter(insert_server_timing_filter, NULL, NULL,
+                        APR_HOOK_MIDDLE);
+  ap_hook_insert_error_filter(insert_server_timing_filter, NULL, NULL,
+                              APR_HOOK_MIDDLE);
+  dd::register_server_timing_filter();
   ap_hook_log_transaction(on_log_transaction, NULL, NULL,
                           APR_HOOK_REALLY_FIRST);
+  APR_OPTIONAL_HOOK(ap, status_hook, on_status, NULL, NULL, APR_HOOK_MIDDLE);
 
 #if defined(HTTPD_DD_RUM)
   ap_hook_insert_filter(insert_datadog_filters, NULL, NULL, APR_HOOK_MIDDLE);
@@ -108,7 +219,89 @@ void register_hooks(apr_pool_t*) {
 #endif
 }
 
-int on_post_config(apr_pool_t*, apr_pool_t*, apr_pool_t*, server_rec* s) {
+// Open the trace spool for the lifetime of the configuration pool `pconf`.
+// Return `nullptr` and log an error on failure.
+static dd::Spool* open_spool(apr_pool_t* pconf, server_rec* s,
+                             const char* path, std::size_t size) {
+  dd::Spool::Opened opened;
+  std::string error;
+  auto spool = dd::Spool::open(path, size, opened, error);
+  if (spool == nullptr) {
+    ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, "%s", error.c_str());
+    return nullptr;
+  }
+
+  if (opened == dd::Spool::Opened::RESET) {
+    ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s,
+                 "Trace spool file %s is invalid and has been reset", path);
+  } else if (const std::size_t pending = spool->pending_bytes()) {
+    ap_log_error(APLOG_MARK, APLOG_NOTICE, 0, s,
+                 "Trace spool file %s holds %zu bytes of traces to replay",
+                 path, pending);
+  }
+
+  dd::Spool* result = spool.release();
+  apr_pool_cleanup_register(
+      pconf, result,
+      [](void* data) -> apr_status_t {
+        delete static_cast<dd::Spool*>(data);
+        return APR_SUCCESS;
+      },
+      apr_pool_cleanup_null);
+  return result;
+}
+
+int on_post_config(apr_pool_t* pconf, apr_pool_t*, apr_pool_t*,
+                   server_rec* s) {
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(s->module_config, &datadog_module));
+
+  // Shared memory must be created before children are forked.
+  int max_children = 0;
+  if (ap_mpm_query(AP_MPMQ_HARD_LIMIT_DAEMONS, &max_children) != APR_SUCCESS) {
+    max_children = 0;
+  }
+  g_scoreboard = datadog::status::Scoreboard::create(
+      pconf, s, static_cast<std::size_t>(max_children));
+
+  g_trace_stats = nullptr;
+  if (module_conf != nullptr && module_conf->trace_stats) {
+    g_trace_stats =
+        datadog::common::make_shared_memory<dd::stats::SharedTable>(
+            pconf, s, "trace stats");
+  }
+
+  g_rate_limiter = nullptr;
+  if (module_conf != nullptr && module_conf->trace_rate_limit) {
+    g_rate_limiter = datadog::common::make_shared_memory<dd::SharedRateLimiter>(
+        pconf, s, "trace rate limiter");
+    if (g_rate_limiter != nullptr) {
+      g_rate_limiter->configure(*module_conf->trace_rate_limit);
+    }
+  }
+
+  g_spool = nullptr;
+  if (module_conf != nullptr && module_conf->trace_spool_path) {
+    g_spool = open_spool(pconf, s, module_conf->trace_spool_path->c_str(),
+                         module_conf->trace_spool_size);
+  }
+
+  g_connection_tracing =
+      module_conf != nullptr && module_conf->connection_tracing;
+
+  g_live_control = nullptr;
+  if (module_conf != nullptr && module_conf->live_control_path) {
+    g_live_control = datadog::common::make_shared_memory<dd::LiveControl>(
+        pconf, s, "live control");
+  }
+
+  g_governor = nullptr;
+  if (module_conf != nullptr && module_conf->governor.enabled) {
+    g_governor = datadog::common::make_shared_memory<dd::Governor>(
+        pconf, s, "overhead governor");
+    if (g_governor != nullptr) g_governor->configure(module_conf->governor);
+  }
+
   if (!g_log_module_status) {
     return OK;
   }
@@ -136,6 +329,21 @@ void* init_module_conf(apr_pool_t* pool, server_rec* s) {
   return opaque_ptr;
 }
 
+void* merge_module_conf(apr_pool_t* pool, void* base, void* add) {
+  const auto* parent = static_cast<datadog::conf::Module*>(base);
+  auto* module_conf =
+      new datadog::conf::Module(*static_cast<datadog::conf::Module*>(add));
+  auto* opaque_ptr = static_cast<void*>(module_conf);
+  apr_pool_cleanup_register(pool, opaque_ptr, destroy_module_conf,
+                            apr_pool_cleanup_null);
+
+  datadog::tracing::conf::merge(module_conf->tracing, parent->tracing);
+  datadog::tracing::conf::merge(module_conf->tail_retention,
+                                parent->tail_retention);
+  if (!module_conf->cache_hits) module_conf->cache_hits = parent->cache_hits;
+  return opaque_ptr;
+}
+
 apr_status_t destroy_module_conf(void* ptr) {
   delete static_cast<datadog::conf::Module*>(ptr);
   return 0;
@@ -252,6 +460,414 @@ const char* set_propagation_style(cmd_parms* cmd, void* /* cfg */, int argc,
   return NULL;
 }
 
+const char* set_metrics_url(cmd_parms* cmd, void* /* cfg */, const char* arg) {
+  if (!datadog::metrics::parse_endpoint(arg)) {
+    char* err_msg = new char[256];
+    fmt::format_to_n(err_msg, 256,
+                     "{}: failed to parse \"{}\" URL. Expected "
+                     "\"udp://<host>[:<port>]\" or \"unix://<path>\"",
+                     cmd->directive->directive, arg);
+    return err_msg;
+  }
+
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+
+  module_conf->metrics.url = arg;
+  return NULL;
+}
+
+const char* set_metrics_flush_interval(cmd_parms* cmd, void* /* cfg */,
+                                       const char* arg) {
+  char* end = NULL;
+  errno = 0;
+  long seconds = strtol(arg, &end, 10);
+  if (errno == ERANGE || *end != 0 || seconds <= 0) {
+    char* err_msg = new char[256];
+    fmt::format_to_n(err_msg, 256,
+                     "{}: \"{}\" is not a positive number of seconds",
+                     cmd->directive->directive, arg);
+    return err_msg;
+  }
+
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+
+  module_conf->metrics.flush_interval = std::chrono::seconds(seconds);
+  return NULL;
+}
+
+const char* enable_trace_stats(cmd_parms* cmd, void* /* cfg */, int value) {
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+
+  module_conf->trace_stats = value != 0;
+  return NULL;
+}
+
+const char* enable_connection_tracing(cmd_parms* cmd, void* /* cfg */,
+                                      int value) {
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+
+  module_conf->connection_tracing = value != 0;
+  return NULL;
+}
+
+const char* set_trace_rate_limit(cmd_parms* cmd, void* /* cfg */,
+                                 const char* arg) {
+  char* end = NULL;
+  errno = 0;
+  double limit = strtod(arg, &end);
+  if (errno == ERANGE || *end != 0 || limit < 0.0) {
+    char* err_msg = new char[256];
+    fmt::format_to_n(err_msg, 256,
+                     "{}: \"{}\" is not a positive number of traces per "
+                     "second",
+                     cmd->directive->directive, arg);
+    return err_msg;
+  }
+
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+
+  module_conf->trace_rate_limit = limit;
+  return NULL;
+}
+
+const char* set_trace_buffer_size(cmd_parms* cmd, void* /* cfg */,
+                                  const char* arg) {
+  char* end = NULL;
+  errno = 0;
+  long long bytes = strtoll(arg, &end, 10);
+  if (errno == ERANGE || *end != 0 || bytes < 0) {
+    char* err_msg = new char[256];
+    fmt::format_to_n(err_msg, 256,
+                     "{}: \"{}\" is not a positive number of bytes",
+                     cmd->directive->directive, arg);
+    return err_msg;
+  }
+
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+
+  module_conf->trace_buffer.max_bytes = static_cast<std::size_t>(bytes);
+  return NULL;
+}
+
+const char* set_trace_buffer_policy(cmd_parms* cmd, void* /* cfg */,
+                                    const char* arg) {
+  using Policy = datadog::tracing::conf::TraceBuffer::Policy;
+
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+
+  if (ap_cstr_casecmp(arg, "DropOldest") == 0) {
+    module_conf->trace_buffer.policy = Policy::drop_oldest;
+  } else if (ap_cstr_casecmp(arg, "DropNew") == 0) {
+    module_conf->trace_buffer.policy = Policy::drop_new;
+  } else {
+    char* err_msg = new char[256];
+    fmt::format_to_n(err_msg, 256,
+                     "{}: \"{}\" is not one of DropOldest or DropNew",
+                     cmd->directive->directive, arg);
+    return err_msg;
+  }
+
+  return NULL;
+}
+
+const char* set_trace_spool(cmd_parms* cmd, void* /* cfg */,
+                            const char* path, const char* size) {
+  // Records sizes are stored on 31 bits.
+  constexpr long long max_size = 1LL << 30;
+  constexpr long long min_size = 64 * 1024;
+
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+
+  if (size != NULL) {
+    char* end = NULL;
+    errno = 0;
+    long long bytes = strtoll(size, &end, 10);
+    if (errno == ERANGE || *end != 0 || bytes < min_size || bytes > max_size) {
+      char* err_msg = new char[256];
+      fmt::format_to_n(
+          err_msg, 256, "{}: \"{}\" is not a number of bytes between {} and {}",
+          cmd->directive->directive, size, min_size, max_size);
+      return err_msg;
+    }
+    module_conf->trace_spool_size = static_cast<std::size_t>(bytes);
+  }
+
+  module_conf->trace_spool_path = ap_server_root_relative(cmd->pool, path);
+  return NULL;
+}
+
+const char* set_trace_compression(cmd_parms* cmd, void* /* cfg */,
+                                  const char* codec_name, const char* level) {
+  using Codec = datadog::tracing::conf::TraceCompression::Codec;
+
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+  auto& compression = module_conf->trace_compression;
+
+  if (ap_cstr_casecmp(codec_name, "Off") == 0) {
+    compression.codec = Codec::none;
+  } else if (ap_cstr_casecmp(codec_name, "Gzip") == 0) {
+    compression.codec = Codec::gzip;
+  } else if (ap_cstr_casecmp(codec_name, "Zstd") == 0) {
+    compression.codec = Codec::zstd;
+  } else {
+    char* err_msg = new char[256];
+    fmt::format_to_n(err_msg, 256,
+                     "{}: \"{}\" is not one of Off, Gzip or Zstd",
+                     cmd->directive->directive, codec_name);
+    return err_msg;
+  }
+
+  if (!dd::is_supported(compression.codec)) {
+    char* err_msg = new char[256];
+    fmt::format_to_n(err_msg, 256,
+                     "{}: the module was built without support for \"{}\"",
+                     cmd->directive->directive, codec_name);
+    return err_msg;
+  }
+
+  compression.level.reset();
+  if (level != NULL) {
+    const auto [min_level, max_level] = dd::level_range(compression.codec);
+    char* end = NULL;
+    errno = 0;
+    long value = strtol(level, &end, 10);
+    if (errno == ERANGE || *end != 0 || value < min_level ||
+        value > max_level) {
+      char* err_msg = new char[256];
+      fmt::format_to_n(err_msg, 256,
+                       "{}: \"{}\" is not a level between {} and {}",
+                       cmd->directive->directive, level, min_level, max_level);
+      return err_msg;
+    }
+    compression.level = static_cast<int>(value);
+  }
+
+  return NULL;
+}
+
+const char* set_trace_compression_min_size(cmd_parms* cmd, void* /* cfg */,
+                                           const char* arg) {
+  char* end = NULL;
+  errno = 0;
+  long long bytes = strtoll(arg, &end, 10);
+  if (errno == ERANGE || *end != 0 || bytes < 0) {
+    char* err_msg = new char[256];
+    fmt::format_to_n(err_msg, 256,
+                     "{}: \"{}\" is not a positive number of bytes",
+                     cmd->directive->directive, arg);
+    return err_msg;
+  }
+
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+
+  module_conf->trace_compression.min_bytes = static_cast<std::size_t>(bytes);
+  return NULL;
+}
+
+const char* set_live_control(cmd_parms* cmd, void* /* cfg */,
+                             const char* arg) {
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+  module_conf->live_control_path = ap_server_root_relative(cmd->pool, arg);
+  return NULL;
+}
+
+const char* set_profiler(cmd_parms* cmd, void* /* cfg */,
+                         const char* directory, const char* frequency) {
+  constexpr long max_frequency = 1000;
+
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+
+  if (frequency != NULL) {
+    char* end = NULL;
+    errno = 0;
+    long hz = strtol(frequency, &end, 10);
+    if (errno == ERANGE || *end != 0 || hz < 1 || hz > max_frequency) {
+      char* err_msg = new char[256];
+      fmt::format_to_n(
+          err_msg, 256,
+          "{}: \"{}\" is not a number of samples per second between 1 and {}",
+          cmd->directive->directive, frequency, max_frequency);
+      return err_msg;
+    }
+    module_conf->profiling.frequency = static_cast<int>(hz);
+  }
+
+  module_conf->profiling.directory =
+      ap_server_root_relative(cmd->pool, directory);
+  return NULL;
+}
+
+const char* enable_overhead_governor(cmd_parms* cmd, void* /* cfg */,
+                                     int value) {
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+
+  module_conf->governor.enabled = value != 0;
+  return NULL;
+}
+
+const char* set_overhead_governor_watermarks(cmd_parms* cmd, void* /* cfg */,
+                                             const char* high,
+                                             const char* low) {
+  char* high_end = NULL;
+  char* low_end = NULL;
+  errno = 0;
+  long high_percent = strtol(high, &high_end, 10);
+  long low_percent = strtol(low, &low_end, 10);
+  if (errno == ERANGE || *high_end != 0 || *low_end != 0 || low_percent < 1 ||
+      high_percent > 100 || low_percent >= high_percent) {
+    char* err_msg = new char[256];
+    fmt::format_to_n(err_msg, 256,
+                     "{}: \"{} {}\" are not percentages of busy workers, "
+                     "the high one first",
+                     cmd->directive->directive, high, low);
+    return err_msg;
+  }
+
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+
+  module_conf->governor.high_watermark =
+      static_cast<double>(high_percent) / 100.0;
+  module_conf->governor.low_watermark =
+      static_cast<double>(low_percent) / 100.0;
+  return NULL;
+}
+
+const char* set_overhead_governor_sampling_rate(cmd_parms* cmd,
+                                                void* /* cfg */,
+                                                const char* arg) {
+  char* end = NULL;
+  errno = 0;
+  double rate = strtod(arg, &end);
+  if (errno == ERANGE || *end != 0 || !(rate >= 0.0) || rate > 1.0) {
+    char* err_msg = new char[256];
+    fmt::format_to_n(err_msg, 256, "{}: \"{}\" is not a rate between 0 and 1",
+                     cmd->directive->directive, arg);
+    return err_msg;
+  }
+
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+
+  module_conf->governor.sampling_rate = rate;
+  return NULL;
+}
+
+const char* set_cache_hit_sampling(cmd_parms* cmd, void* /* cfg */,
+                                   const char* arg) {
+  using CacheHits = datadog::tracing::conf::CacheHits;
+
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+
+  CacheHits cache_hits;
+  if (ap_cstr_casecmp(arg, "Aggregate") == 0) {
+    cache_hits.mode = CacheHits::Mode::aggregate;
+  } else {
+    char* end = NULL;
+    errno = 0;
+    double rate = strtod(arg, &end);
+    if (errno == ERANGE || *end != 0 || rate < 0.0 || rate > 1.0) {
+      char* err_msg = new char[256];
+      fmt::format_to_n(err_msg, 256,
+                       "{}: \"{}\" is neither a rate between 0 and 1 nor "
+                       "Aggregate",
+                       cmd->directive->directive, arg);
+      return err_msg;
+    }
+    cache_hits.mode = CacheHits::Mode::sample;
+    cache_hits.sampling_rate = rate;
+  }
+
+  module_conf->cache_hits = cache_hits;
+  return NULL;
+}
+
+const char* set_span_collection(cmd_parms* cmd, void* /* cfg */,
+                                const char* arg) {
+  using SpanCollection = datadog::tracing::conf::SpanCollection;
+
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+
+  if (ap_cstr_casecmp(arg, "Direct") == 0) {
+    module_conf->span_collection = SpanCollection::direct;
+  } else if (ap_cstr_casecmp(arg, "PerThread") == 0) {
+    module_conf->span_collection = SpanCollection::per_thread;
+  } else {
+    char* err_msg = new char[256];
+    fmt::format_to_n(err_msg, 256,
+                     "{}: \"{}\" is not one of Direct or PerThread",
+                     cmd->directive->directive, arg);
+    return err_msg;
+  }
+
+  return NULL;
+}
+
+const char* enable_tail_retention(cmd_parms* cmd, void* /* cfg */,
+                                  int value) {
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+
+  module_conf->tail_retention.enabled = value != 0;
+  return NULL;
+}
+
+const char* set_tail_retention_latency(cmd_parms* cmd, void* /* cfg */,
+                                       const char* arg) {
+  char* end = NULL;
+  errno = 0;
+  long milliseconds = strtol(arg, &end, 10);
+  if (errno == ERANGE || *end != 0 || milliseconds < 0) {
+    char* err_msg = new char[256];
+    fmt::format_to_n(err_msg, 256,
+                     "{}: \"{}\" is not a positive number of milliseconds",
+                     cmd->directive->directive, arg);
+    return err_msg;
+  }
+
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+
+  module_conf->tail_retention.latency_threshold =
+      std::chrono::milliseconds(milliseconds);
+  return NULL;
+}
+
+const char* set_tail_retention_base_rate(cmd_parms* cmd, void* /* cfg */,
+                                         const char* arg) {
+  char* end = NULL;
+  errno = 0;
+  double rate = strtod(arg, &end);
+  if (errno == ERANGE || *end != 0 || rate < 0.0 || rate > 1.0) {
+    char* err_msg = new char[256];
+    fmt::format_to_n(err_msg, 256,
+                     "{}: \"{}\" input is not in the [0;1] expected range",
+                     cmd->directive->directive, arg);
+    return err_msg;
+  }
+
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+
+  module_conf->tail_retention.base_rate = rate;
+  return NULL;
+}
+
 const char* enable_tracing(cmd_parms* /* cmd */, void* cfg, int value) {
   auto* dir_conf = static_cast<datadog::conf::Directory*>(cfg);
   dir_conf->tracing_enabled = value != 0;
@@ -274,40 +890,215 @@ const char* enable_inbound_span(cmd_parms* /* cmd */, void* cfg, int value) {
   return NULL;
 }
 
-void init_tracer(datadog::tracing::TracerConfig& tracer_conf) {
-  const bool is_service_set = tracer_conf.service.has_value();
-  if (!is_service_set) {
-    // NOTE: Could use s->process->short_name for the default service name.
-    tracer_conf.service = "httpd";
+const char* set_http_header_tags(cmd_parms* cmd, void* cfg, const char* arg) {
+  auto* header_tags = new dd::HeaderTags(dd::parse_http_header_tags(arg));
+  apr_pool_cleanup_register(
+      cmd->pool, header_tags,
+      [](void* data) -> apr_status_t {
+        delete static_cast<dd::HeaderTags*>(data);
+        return APR_SUCCESS;
+      },
+      apr_pool_cleanup_null);
+
+  auto* dir_conf = static_cast<datadog::conf::Directory*>(cfg);
+  dir_conf->header_tags = header_tags;
+  return NULL;
+}
+
+const char* enable_subrequest_aggregation(cmd_parms* /* cmd */, void* cfg,
+                                          int value) {
+  auto* dir_conf = static_cast<datadog::conf::Directory*>(cfg);
+  dir_conf->subrequest_aggregation = value != 0;
+  return NULL;
+}
+
+const char* set_subrequest_span_threshold(cmd_parms* cmd, void* cfg,
+                                          const char* arg) {
+  char* end = NULL;
+  errno = 0;
+  long milliseconds = strtol(arg, &end, 10);
+  if (errno == ERANGE || *end != 0 || milliseconds < 0) {
+    char* err_msg = new char[256];
+    fmt::format_to_n(err_msg, 256,
+                     "{}: \"{}\" is not a positive number of milliseconds",
+                     cmd->directive->directive, arg);
+    return err_msg;
   }
 
-  auto validated_config = datadog::tracing::finalize_config(tracer_conf);
-  if (auto error = validated_config.if_error()) {
-    tracer_conf.logger->log_error(*error);
+  auto* dir_conf = static_cast<datadog::conf::Directory*>(cfg);
+  dir_conf->subrequest_span_threshold = std::chrono::milliseconds(milliseconds);
+  return NULL;
+}
+
+const char* enable_long_requests(cmd_parms* /* cmd */, void* cfg, int value) {
+  auto* dir_conf = static_cast<datadog::conf::Directory*>(cfg);
+  dir_conf->long_requests = value != 0;
+  return NULL;
+}
+
+const char* enable_server_timing(cmd_parms* /* cmd */, void* cfg, int value) {
+  auto* dir_conf = static_cast<datadog::conf::Directory*>(cfg);
+  dir_conf->server_timing = value != 0;
+  return NULL;
+}
+
+const char* enable_resource_accounting(cmd_parms* /* cmd */, void* cfg,
+                                       int value) {
+  auto* dir_conf = static_cast<datadog::conf::Directory*>(cfg);
+  dir_conf->resource_accounting = value != 0;
+  return NULL;
+}
+
+const char* set_long_request_checkpoint_interval(cmd_parms* cmd,
+                                                 void* /* cfg */,
+                                                 const char* arg) {
+  char* end = NULL;
+  errno = 0;
+  long seconds = strtol(arg, &end, 10);
+  if (errno == ERANGE || *end != 0 || seconds <= 0) {
+    char* err_msg = new char[256];
+    fmt::format_to_n(err_msg, 256,
+                     "{}: \"{}\" is not a positive number of seconds",
+                     cmd->directive->directive, arg);
+    return err_msg;
+  }
+
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(cmd->server->module_config, &datadog_module));
+
+  module_conf->long_request_checkpoint_interval = std::chrono::seconds(seconds);
+  return NULL;
+}
+
+void init_metrics(server_rec* s) {
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(s->module_config, &datadog_module));
+  if (module_conf == nullptr || !module_conf->metrics.url) return;
+
+  auto scheduler = g_tracer_registry->event_scheduler();
+  if (scheduler == nullptr) {
+    ap_log_error(APLOG_MARK, APLOG_ERR, 0, s,
+                 "Request metrics are disabled: no tracer could be created");
     return;
   }
 
-  if (!is_service_set) {
-    // Trick: change the service name origin to default as "httpd" is the
-    // default value when no service name has been provided.
-    auto& service_name_metadata =
-        validated_config->metadata[datadog::tracing::ConfigName::SERVICE_NAME];
-    service_name_metadata.back().origin =
-        datadog::tracing::ConfigMetadata::Origin::DEFAULT;
+  // The URL has been validated by the directive.
+  auto endpoint = datadog::metrics::parse_endpoint(*module_conf->metrics.url);
+  auto client = datadog::metrics::DogStatsDClient::open(*endpoint);
+  if (client == nullptr) {
+    ap_log_error(APLOG_MARK, APLOG_ERR, errno, s,
+                 "Request metrics are disabled: could not connect to \"%s\"",
+                 module_conf->metrics.url->c_str());
+    return;
   }
 
-  g_tracer = std::make_unique<datadog::tracing::Tracer>(*validated_config);
+  g_metrics_reporter = std::make_unique<datadog::metrics::Reporter>(
+      std::move(client), *scheduler,
+      module_conf->metrics.flush_interval.value_or(std::chrono::seconds(10)));
 }
 
-void on_child_init(apr_pool_t* pool, server_rec* s) {
+void init_trace_stats(server_rec* s) {
+  if (g_trace_stats == nullptr) return;
+
+  const auto* main_entry = g_tracer_registry->find_entry(s);
+  auto scheduler = g_tracer_registry->event_scheduler();
+  if (main_entry == nullptr || scheduler == nullptr) {
+    ap_log_error(APLOG_MARK, APLOG_ERR, 0, s,
+                 "Trace stats are not exported: no tracer could be created");
+    return;
+  }
+
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(s->module_config, &datadog_module));
+
+  g_trace_stats_exporter = std::make_unique<dd::stats::StatsExporter>(
+      *g_trace_stats, g_tracer_registry->http_client(),
+      g_tracer_registry->agent_url(), *scheduler, module_conf->tracing.logger,
+      main_entry->defaults.service, g_runtime_id->string());
+}
+
+void init_span_collection(server_rec* s) {
   auto* module_conf = static_cast<datadog::conf::Module*>(
       ap_get_module_config(s->module_config, &datadog_module));
-  if (module_conf == nullptr) {
-    ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, "Missing datadog configuration");
+  if (module_conf == nullptr || module_conf->span_collection !=
+                                    dd::conf::SpanCollection::per_thread) {
     return;
   }
 
-  init_tracer(module_conf->tracing);
+  auto scheduler = g_tracer_registry->event_scheduler();
+  if (scheduler == nullptr) return;
+
+  g_deferred_spans = std::make_unique<dd::DeferredSpans>(*scheduler);
+}
+
+void init_live_control(server_rec* s) {
+  if (g_live_control == nullptr) return;
+
+  auto scheduler = g_tracer_registry->event_scheduler();
+  if (scheduler == nullptr) return;
+
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(s->module_config, &datadog_module));
+  g_live_control_watcher = std::make_unique<dd::LiveControlWatcher>(
+      *g_live_control, *module_conf->live_control_path, s, *scheduler);
+}
+
+void init_governor(server_rec* s) {
+  if (g_governor == nullptr) return;
+
+  auto scheduler = g_tracer_registry->event_scheduler();
+  if (scheduler == nullptr) return;
+
+  g_governor_watcher =
+      std::make_unique<dd::GovernorWatcher>(*g_governor, s, *scheduler);
+}
+
+void init_profiler(server_rec* s) {
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(s->module_config, &datadog_module));
+  if (module_conf == nullptr || !module_conf->profiling.directory) return;
+
+  auto scheduler = g_tracer_registry->event_scheduler();
+  if (scheduler == nullptr) return;
+
+  g_profiler = datadog::profiling::Profiler::create(module_conf->profiling, s,
+                                                   *scheduler);
+}
+
+void init_long_requests(server_rec* s) {
+  auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(s->module_config, &datadog_module));
+  if (module_conf == nullptr) return;
+
+  auto scheduler = g_tracer_registry->event_scheduler();
+  if (scheduler == nullptr) return;
+
+  g_long_requests = std::make_unique<dd::LongRequests>(
+      *scheduler, module_conf->long_request_checkpoint_interval,
+      g_trace_stats);
+}
+
+void on_child_init(apr_pool_t* pool, server_rec* s) {
+  if (g_scoreboard != nullptr) {
+    auto* slot = g_scoreboard->acquire();
+    if (slot == nullptr) {
+      ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s,
+                   "No free scoreboard slot: the counters of this child are "
+                   "not reported in server-status");
+    }
+    datadog::status::attach(slot);
+  }
+
+  g_tracer_registry = std::make_unique<dd::TracerRegistry>();
+  g_tracer_registry->init(s, &datadog_module, g_trace_stats != nullptr,
+                          g_spool);
+  init_span_collection(s);
+  init_live_control(s);
+  init_governor(s);
+  init_metrics(s);
+  init_trace_stats(s);
+  init_profiler(s);
+  init_long_requests(s);
 
   // Register cleanup hook to prevent crashes during shutdown
   apr_pool_cleanup_register(pool, nullptr, on_child_exit,
@@ -317,11 +1108,36 @@ void on_child_init(apr_pool_t* pool, server_rec* s) {
 apr_status_t on_child_exit(void*) {
   // Explicitly clean up global objects to prevent crashes during process
   // shutdown
-  g_tracer.reset();
+  g_metrics_reporter.reset();
+  g_trace_stats_exporter.reset();
+  g_live_control_watcher.reset();
+  g_governor_watcher.reset();
+  g_profiler.reset();
+  g_long_requests.reset();
+  // Queued spans are handed to their tracer before it flushes for the last
+  // time.
+  g_deferred_spans.reset();
+  g_tracer_registry.reset();
   g_runtime_id.reset();
+
+  if (auto* slot = datadog::status::detach(); slot != nullptr) {
+    g_scoreboard->release(*slot);
+  }
   return APR_SUCCESS;
 }
 
+int on_pre_connection(conn_rec* c, void*) {
+  // Secondary connections of HTTP/2 streams are always followed.
+  if (!g_connection_tracing && c->master == nullptr) return DECLINED;
+  if (g_tracer_registry == nullptr) return DECLINED;
+
+  const auto* entry = g_tracer_registry->find_entry(c->base_server);
+  if (entry == nullptr) return DECLINED;
+  return datadog::tracing::on_pre_connection(
+      c, *entry->tracer, entry->defaults, g_connection_tracing, g_trace_stats,
+      g_rate_limiter, g_live_control, g_governor, &datadog_module);
+}
+
 int on_fixups(request_rec* r) {
 #if defined(HTTPD_DD_RUM)
   auto* dir_conf = static_cast<datadog::conf::Directory*>(
@@ -332,10 +1148,89 @@ int on_fixups(request_rec* r) {
   }
 #endif
 
-  if (g_tracer == nullptr) return DECLINED;
-  return datadog::tracing::on_fixups(r, *g_tracer, &datadog_module);
+  // Also feeds the metrics of the request, with or without a span.
+  dd::start_resource_usage(r, &datadog_module);
+
+  if (g_tracer_registry == nullptr) return DECLINED;
+
+  const auto* entry = g_tracer_registry->find_entry(r->server);
+  if (entry == nullptr) return DECLINED;
+  dd::Tracer* tracer = entry->tracer.get();
+  const auto start = std::chrono::steady_clock::now();
+  const int result = datadog::tracing::on_fixups(
+      r, *tracer, g_rate_limiter, g_deferred_spans.get(), g_live_control,
+      g_governor, &datadog_module);
+
+  // CPU samples are attributed to the span of the top-level request.
+  if (g_profiler != nullptr && r->main == nullptr) {
+    if (const auto* span = static_cast<const dd::Span*>(
+            ap_get_module_config(r->request_config, &datadog_module))) {
+      g_profiler->enter(r, span->id());
+    }
+  }
+
+  if (g_long_requests != nullptr && r->main == nullptr &&
+      r->prev == nullptr) {
+    const auto* dir_conf = static_cast<const datadog::conf::Directory*>(
+        ap_get_module_config(r->per_dir_config, &datadog_module));
+    auto* span = static_cast<dd::Span*>(
+        ap_get_module_config(r->request_config, &datadog_module));
+    if (dir_conf != nullptr && dir_conf->long_requests.value_or(false) &&
+        span != nullptr) {
+      g_long_requests->start(r, *span, *tracer, entry->defaults);
+    }
+  }
+
+  if (g_governor_watcher != nullptr) {
+    g_governor_watcher->add_module_time(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start));
+  }
+  return result;
 }
 
 int on_log_transaction(request_rec* r) {
-  return datadog::tracing::on_log_transaction(r, &datadog_module);
+  const auto start = std::chrono::steady_clock::now();
+  if (g_tracer_registry != nullptr) {
+    datadog::tracing::trace_cache_lookup(
+        r, g_tracer_registry->find(r->server), g_deferred_spans.get(),
+        g_live_control, &datadog_module);
+  }
+
+  if (g_connection_tracing || r->connection->master != nullptr) {
+    datadog::tracing::record_connection_request(r, &datadog_module);
+  }
+
+  const auto usage = dd::finish_resource_usage(r, &datadog_module);
+
+  if (g_metrics_reporter != nullptr && r->main == nullptr) {
+    g_metrics_reporter->on_log_transaction(r, usage ? &*usage : nullptr,
+                                           &datadog_module);
+  }
+
+  if (g_trace_stats != nullptr && g_tracer_registry != nullptr) {
+    if (const auto* entry = g_tracer_registry->find_entry(r->server)) {
+      datadog::tracing::record_trace_stats(r, *g_trace_stats, entry->defaults,
+                                           &datadog_module);
+    }
+  }
+
+  const int result = datadog::tracing::on_log_transaction(
+      r, g_rate_limiter, g_live_control, g_governor, &datadog_module);
+
+  if (g_governor_watcher != nullptr) {
+    g_governor_watcher->add_module_time(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start));
+    if (r->main == nullptr) {
+      g_governor_watcher->add_request_time(
+          std::chrono::microseconds(apr_time_now() - r->request_time));
+    }
+  }
+  return result;
+}
+
+int on_status(request_rec* r, int flags) {
+  if (g_scoreboard == nullptr) return OK;
+  return datadog::status::render(r, flags, *g_scoreboard);
 }
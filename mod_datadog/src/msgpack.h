@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// Minimal MessagePack encoder for the payloads the module builds itself.
+// <https://github.com/msgpack/msgpack/blob/master/spec.md>
+namespace datadog::common::msgpack {
+
+namespace detail {
+
+template <typename Integer>
+void append_big_endian(std::string& destination, Integer value) {
+  for (int shift = (sizeof(Integer) - 1) * 8; shift >= 0; shift -= 8) {
+    destination += static_cast<char>((value >> shift) & 0xFF);
+  }
+}
+
+}  // namespace detail
+
+inline void pack_nil(std::string& destination) { destination += '\xC0'; }
+
+inline void pack_bool(std::string& destination, bool value) {
+  destination += value ? '\xC3' : '\xC2';
+}
+
+inline void pack_uint(std::string& destination, std::uint64_t value) {
+  if (value < 128) {
+    destination += static_cast<char>(value);
+  } else if (value <= UINT8_MAX) {
+    destination += '\xCC';
+    detail::append_big_endian(destination, static_cast<std::uint8_t>(value));
+  } else if (value <= UINT16_MAX) {
+    destination += '\xCD';
+    detail::append_big_endian(destination, static_cast<std::uint16_t>(value));
+  } else if (value <= UINT32_MAX) {
+    destination += '\xCE';
+    detail::append_big_endian(destination, static_cast<std::uint32_t>(value));
+  } else {
+    destination += '\xCF';
+    detail::append_big_endian(destination, value);
+  }
+}
+
+inline void pack_int(std::string& destination, std::int64_t value) {
+  if (value >= 0) {
+    pack_uint(destination, static_cast<std::uint64_t>(value));
+  } else if (value >= -32) {
+    destination += static_cast<char>(value);
+  } else {
+    destination += '\xD3';
+    detail::append_big_endian(destination, static_cast<std::uint64_t>(value));
+  }
+}
+
+inline void pack_double(std::string& destination, double value) {
+  std::uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  destination += '\xCB';
+  detail::append_big_endian(destination, bits);
+}
+
+inline void pack_string(std::string& destination, std::string_view value) {
+  const std::size_t size = value.size();
+  if (size < 32) {
+    destination += static_cast<char>(0xA0 | size);
+  } else if (size <= UINT8_MAX) {
+    destination += '\xD9';
+    detail::append_big_endian(destination, static_cast<std::uint8_t>(size));
+  } else if (size <= UINT16_MAX) {
+    destination += '\xDA';
+    detail::append_big_endian(destination, static_cast<std::uint16_t>(size));
+  } else {
+    destination += '\xDB';
+    detail::append_big_endian(destination, static_cast<std::uint32_t>(size));
+  }
+  destination += value;
+}
+
+inline void pack_binary(std::string& destination, std::string_view value) {
+  const std::size_t size = value.size();
+  if (size <= UINT8_MAX) {
+    destination += '\xC4';
+    detail::append_big_endian(destination, static_cast<std::uint8_t>(size));
+  } else if (size <= UINT16_MAX) {
+    destination += '\xC5';
+    detail::append_big_endian(destination, static_cast<std::uint16_t>(size));
+  } else {
+    destination += '\xC6';
+    detail::append_big_endian(destination, static_cast<std::uint32_t>(size));
+  }
+  destination += value;
+}
+
+inline void pack_array(std::string& destination, std::uint32_t size) {
+  if (size < 16) {
+    destination += static_cast<char>(0x90 | size);
+  } else if (size <= UINT16_MAX) {
+    destination += '\xDC';
+    detail::append_big_endian(destination, static_cast<std::uint16_t>(size));
+  } else {
+    destination += '\xDD';
+    detail::append_big_endian(destination, size);
+  }
+}
+
+inline void pack_map(std::string& destination, std::uint32_t size) {
+  if (size < 16) {
+    destination += static_cast<char>(0x80 | size);
+  } else if (size <= UINT16_MAX) {
+    destination += '\xDE';
+    detail::append_big_endian(destination, static_cast<std::uint16_t>(size));
+  } else {
+    destination += '\xDF';
+    detail::append_big_endian(destination, size);
+  }
+}
+
+}  // namespace datadog::common::msgpack
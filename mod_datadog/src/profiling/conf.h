@@ -0,0 +1,16 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+namespace datadog::profiling::conf {
+
+struct Module final {
+  // Directory receiving the pprof files. The profiler is disabled when unset.
+  std::optional<std::string> directory;
+  // CPU samples per second and per thread. Not a round number, so that
+  // sampling does not run in lockstep with periodic activity.
+  int frequency = 99;
+};
+
+}  // namespace datadog::profiling::conf
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Minimal encoder of pprof profiles, the protocol buffers message described
+// in <https://github.com/google/pprof/blob/main/proto/profile.proto>.
+namespace datadog::profiling {
+
+namespace protobuf {
+
+inline void write_varint(std::string& out, std::uint64_t value) {
+  while (value >= 0x80) {
+    out += static_cast<char>((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+inline void write_key(std::string& out, std::uint32_t field,
+                      std::uint32_t wire_type) {
+  write_varint(out, (static_cast<std::uint64_t>(field) << 3) | wire_type);
+}
+
+inline void write_uint(std::string& out, std::uint32_t field,
+                       std::uint64_t value) {
+  if (value == 0) return;
+  write_key(out, field, 0);
+  write_varint(out, value);
+}
+
+inline void write_int(std::string& out, std::uint32_t field,
+                      std::int64_t value) {
+  write_uint(out, field, static_cast<std::uint64_t>(value));
+}
+
+inline void write_bytes(std::string& out, std::uint32_t field,
+                        std::string_view value) {
+  write_key(out, field, 2);
+  write_varint(out, value.size());
+  out += value;
+}
+
+template <typename Integer>
+void write_packed(std::string& out, std::uint32_t field,
+                  const std::vector<Integer>& values) {
+  if (values.empty()) return;
+  std::string packed;
+  for (const auto value : values) {
+    write_varint(packed, static_cast<std::uint64_t>(value));
+  }
+  write_bytes(out, field, packed);
+}
+
+}  // namespace protobuf
+
+// Accumulate the samples of a CPU profile, then serialize it.
+//
+// Each sample has two values: a count, and the CPU time it stands for in
+// nanoseconds. Locations are deduplicated by address and attributed to the
+// mapping containing them; function names are optional, as pprof can
+// symbolize addresses from the mapped files.
+class PprofBuilder final {
+ public:
+  struct Label final {
+    std::string key;
+    std::string str;        ///< Either a string...
+    std::int64_t num = 0;  ///< ...or a number
+  };
+
+ private:
+  struct Mapping final {
+    std::uint64_t start;
+    std::uint64_t limit;
+    std::uint64_t offset;
+    std::int64_t filename;
+  };
+
+  struct Location final {
+    std::uint64_t mapping_id;
+    std::uint64_t address;
+    std::uint64_t function_id;
+  };
+
+  std::int64_t period_ns_;
+  std::vector<std::string> strings_{""};
+  std::unordered_map<std::string, std::int64_t> string_ids_{{"", 0}};
+  std::vector<Mapping> mappings_;
+  std::map<std::uint64_t, std::uint64_t> mapping_by_start_;
+  std::vector<Location> locations_;
+  std::unordered_map<std::uint64_t, std::uint64_t> location_ids_;
+  std::vector<std::int64_t> functions_;  ///< Name of each function
+  std::unordered_map<std::string, std::uint64_t> function_ids_;
+  std::string samples_;  ///< Encoded `Sample` fields
+
+ public:
+  // @param period_ns  CPU time between two samples
+  explicit PprofBuilder(std::int64_t period_ns) : period_ns_(period_ns) {}
+
+  std::int64_t intern(std::string_view value) {
+    auto [found, inserted] = string_ids_.try_emplace(
+        std::string(value), static_cast<std::int64_t>(strings_.size()));
+    if (inserted) strings_.emplace_back(value);
+    return found->second;
+  }
+
+  // Declare the memory range [start, limit) mapped from `filename` at
+  // `offset`. Ranges must not overlap.
+  void add_mapping(std::uint64_t start, std::uint64_t limit,
+                   std::uint64_t offset, std::string_view filename) {
+    mappings_.push_back(Mapping{start, limit, offset, intern(filename)});
+    mapping_by_start_[start] = mappings_.size();
+  }
+
+  // Return the ID of the location of `address`, creating it if needed.
+  // `function` may be empty if the function name is unknown.
+  std::uint64_t add_location(std::uint64_t address,
+                             std::string_view function) {
+    if (auto found = location_ids_.find(address);
+        found != location_ids_.end()) {
+      return found->second;
+    }
+
+    Location location{0, address, 0};
+    if (auto mapping = mapping_by_start_.upper_bound(address);
+        mapping != mapping_by_start_.begin()) {
+      --mapping;
+      if (address < mappings_[mapping->second - 1].limit) {
+        location.mapping_id = mapping->second;
+      }
+    }
+    if (!function.empty()) {
+      auto [found, inserted] = function_ids_.try_emplace(
+          std::string(function), functions_.size() + 1);
+      if (inserted) functions_.push_back(intern(function));
+      location.function_id = found->second;
+    }
+
+    locations_.push_back(location);
+    const std::uint64_t id = locations_.size();
+    location_ids_.emplace(address, id);
+    return id;
+  }
+
+  // Add `count` samples of the stack `location_ids`, innermost frame first.
+  void add_sample(const std::vector<std::uint64_t>& location_ids,
+                  std::int64_t count, const std::vector<Label>& labels) {
+    std::string sample;
+    protobuf::write_packed(sample, 1, location_ids);
+    protobuf::write_packed(
+        sample, 2, std::vector<std::int64_t>{count, count * period_ns_});
+    for (const auto& label : labels) {
+      std::string encoded;
+      protobuf::write_int(encoded, 1, intern(label.key));
+      if (label.str.empty()) {
+        protobuf::write_int(encoded, 3, label.num);
+      } else {
+        protobuf::write_int(encoded, 2, intern(label.str));
+      }
+      protobuf::write_bytes(sample, 3, encoded);
+    }
+    protobuf::write_bytes(samples_, 2, sample);
+  }
+
+  // @param time_ns      Start of the profile, in nanoseconds since the epoch
+  // @param duration_ns  Duration of the profile
+  std::string serialize(std::int64_t time_ns, std::int64_t duration_ns) {
+    const auto value_type = [this](std::string_view type,
+                                   std::string_view unit) {
+      std::string encoded;
+      protobuf::write_int(encoded, 1, intern(type));
+      protobuf::write_int(encoded, 2, intern(unit));
+      return encoded;
+    };
+
+    std::string out;
+    protobuf::write_bytes(out, 1, value_type("samples", "count"));
+    protobuf::write_bytes(out, 1, value_type("cpu", "nanoseconds"));
+    out += samples_;
+
+    for (std::size_t i = 0; i < mappings_.size(); ++i) {
+      const auto& mapping = mappings_[i];
+      std::string encoded;
+      protobuf::write_uint(encoded, 1, i + 1);
+      protobuf::write_uint(encoded, 2, mapping.start);
+      protobuf::write_uint(encoded, 3, mapping.limit);
+      protobuf::write_uint(encoded, 4, mapping.offset);
+      protobuf::write_int(encoded, 5, mapping.filename);
+      protobuf::write_bytes(out, 3, encoded);
+    }
+
+    for (std::size_t i = 0; i < locations_.size(); ++i) {
+      const auto& location = locations_[i];
+      std::string encoded;
+      protobuf::write_uint(encoded, 1, i + 1);
+      protobuf::write_uint(encoded, 2, location.mapping_id);
+      protobuf::write_uint(encoded, 3, location.address);
+      if (location.function_id != 0) {
+        std::string line;
+        protobuf::write_uint(line, 1, location.function_id);
+        protobuf::write_bytes(encoded, 4, line);
+      }
+      protobuf::write_bytes(out, 4, encoded);
+    }
+
+    for (std::size_t i = 0; i < functions_.size(); ++i) {
+      std::string encoded;
+      protobuf::write_uint(encoded, 1, i + 1);
+      protobuf::write_int(encoded, 2, functions_[i]);
+      protobuf::write_int(encoded, 3, functions_[i]);
+      protobuf::write_bytes(out, 5, encoded);
+    }
+
+    // Interned last: the string table must hold every string used above.
+    const std::string period_type = value_type("cpu", "nanoseconds");
+    for (const auto& value : strings_) protobuf::write_bytes(out, 6, value);
+    protobuf::write_int(out, 9, time_ns);
+    protobuf::write_int(out, 10, duration_ns);
+    protobuf::write_bytes(out, 11, period_type);
+    protobuf::write_int(out, 12, period_ns_);
+    return out;
+  }
+};
+
+}  // namespace datadog::profiling
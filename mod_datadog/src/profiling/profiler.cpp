@@ -0,0 +1,525 @@
+#include "profiler.h"
+
+#include <http_log.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <utility>
+
+#include "pprof.h"
+#include "status/scoreboard.h"
+#include "tracing/hooks.h"
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+#define HTTPD_DD_PROFILER_SUPPORTED 1
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+// Older C libraries only expose the union member.
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+#endif
+
+APLOG_USE_MODULE(datadog);
+
+namespace datadog::profiling {
+namespace {
+
+constexpr std::chrono::seconds k_collect_interval{1};
+constexpr std::chrono::seconds k_profile_duration{60};
+
+// Frames kept per sample. Deeper stacks are truncated at the outermost
+// frames.
+constexpr std::size_t k_max_depth = 32;
+
+// Samples a thread keeps until the next collection: a thread using a whole
+// CPU for a second takes `frequency` samples.
+constexpr std::size_t k_ring_size = 128;
+
+// Distinct (span, stack) pairs per profile. Samples of new pairs beyond this
+// are dropped.
+constexpr std::size_t k_max_stacks = 16384;
+
+// Endpoints of sampled requests queued per request thread between two
+// collections.
+constexpr std::size_t k_max_endpoints_per_thread = 256;
+
+std::uint64_t next_generation() {
+  static std::atomic<std::uint64_t> next{1};
+  return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+struct Sample final {
+  std::uint64_t span_id;
+  std::uint32_t depth;
+  std::uintptr_t pcs[k_max_depth];  ///< Innermost frame first
+};
+
+// Samples of a request thread. The signal handler of the thread is the only
+// writer of `head` and of the ring; the exporter thread is the only writer
+// of `tail`.
+struct ThreadState final {
+  std::atomic<std::uint64_t> span_id{0};  ///< 0 between requests
+  std::uintptr_t stack_high = 0;          ///< End of the thread stack
+#if defined(HTTPD_DD_PROFILER_SUPPORTED)
+  timer_t timer{};
+#endif
+  std::atomic<bool> timer_armed{false};
+  std::atomic<bool> exited{false};
+  std::atomic<std::uint64_t> head{0};
+  std::atomic<std::uint64_t> tail{0};
+  std::atomic<std::uint64_t> dropped{0};
+  Sample ring[k_ring_size];
+};
+
+namespace {
+
+// Profiled state of the calling thread. Read by the signal handler: it is
+// first accessed by `Profiler::enter`, before the timer of the thread is
+// armed, so that the handler never allocates thread-local storage.
+thread_local ThreadState* t_state = nullptr;
+
+void disarm(ThreadState& state) {
+#if defined(HTTPD_DD_PROFILER_SUPPORTED)
+  if (state.timer_armed.exchange(false)) timer_delete(state.timer);
+#else
+  (void)state;
+#endif
+}
+
+// Keeps the state of the calling thread alive until the thread exits, then
+// stops its timer.
+struct ThreadHolder final {
+  std::uint64_t generation = 0;  ///< Of the profiler the thread is known to
+  std::shared_ptr<ThreadState> state;
+
+  void release() {
+    if (state == nullptr) return;
+    t_state = nullptr;
+    disarm(*state);
+    state->exited.store(true, std::memory_order_release);
+    state.reset();
+  }
+
+  ~ThreadHolder() { release(); }
+};
+
+thread_local ThreadHolder t_holder;
+
+// Generation of the running profiler; a thread registers again when it
+// differs from the one of its holder.
+std::atomic<std::uint64_t> g_generation{0};
+
+#if defined(HTTPD_DD_PROFILER_SUPPORTED)
+
+// Return the number of frames of the interrupted stack written to `pcs`.
+//
+// Frames are found by following the frame pointers, from the interrupted
+// frame up to the end of the stack. Every frame read is checked to lie
+// between the interrupted stack pointer and the end of the stack, so that
+// code built without frame pointers ends the walk instead of faulting.
+std::uint32_t walk_stack(const ucontext_t& context, const ThreadState& state,
+                         std::uintptr_t* pcs) {
+#if defined(__x86_64__)
+  const auto* registers = context.uc_mcontext.gregs;
+  const auto pc = static_cast<std::uintptr_t>(registers[REG_RIP]);
+  const auto sp = static_cast<std::uintptr_t>(registers[REG_RSP]);
+  auto fp = static_cast<std::uintptr_t>(registers[REG_RBP]);
+#else
+  const auto pc = static_cast<std::uintptr_t>(context.uc_mcontext.pc);
+  const auto sp = static_cast<std::uintptr_t>(context.uc_mcontext.sp);
+  auto fp = static_cast<std::uintptr_t>(context.uc_mcontext.regs[29]);
+#endif
+
+  std::uint32_t depth = 0;
+  pcs[depth++] = pc;
+  while (depth < k_max_depth) {
+    if (fp < sp || fp % sizeof(std::uintptr_t) != 0 ||
+        fp + 2 * sizeof(std::uintptr_t) > state.stack_high) {
+      break;
+    }
+    // A frame record is the caller frame pointer, then the return address.
+    const auto* frame = reinterpret_cast<const std::uintptr_t*>(fp);
+    if (frame[1] == 0) break;
+    pcs[depth++] = frame[1];
+    if (frame[0] <= fp) break;  // Stacks grow down
+    fp = frame[0];
+  }
+  return depth;
+}
+
+void on_sigprof(int, siginfo_t*, void* context) {
+  ThreadState* state = t_state;
+  if (state == nullptr) return;
+
+  const int saved_errno = errno;
+  const std::uint64_t head = state->head.load(std::memory_order_relaxed);
+  if (head - state->tail.load(std::memory_order_acquire) >= k_ring_size) {
+    state->dropped.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    Sample& sample = state->ring[head % k_ring_size];
+    sample.span_id = state->span_id.load(std::memory_order_relaxed);
+    sample.depth = walk_stack(*static_cast<const ucontext_t*>(context),
+                              *state, sample.pcs);
+    state->head.store(head + 1, std::memory_order_release);
+  }
+  errno = saved_errno;
+}
+
+// Return an error message, or `nullptr` on success.
+const char* install_signal_handler() {
+  struct sigaction previous;
+  if (sigaction(SIGPROF, nullptr, &previous) != 0) {
+    return "cannot read the SIGPROF handler";
+  }
+  const bool has_handler = (previous.sa_flags & SA_SIGINFO)
+                               ? previous.sa_sigaction != on_sigprof
+                               : previous.sa_handler != SIG_DFL &&
+                                     previous.sa_handler != SIG_IGN;
+  if (has_handler) return "SIGPROF is already handled by another profiler";
+
+  struct sigaction action;
+  std::memset(&action, 0, sizeof(action));
+  action.sa_sigaction = on_sigprof;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGPROF, &action, nullptr) != 0) {
+    return "cannot install the SIGPROF handler";
+  }
+  return nullptr;
+}
+
+// Find the end of the stack of the calling thread, and start its CPU timer.
+bool start_thread(ThreadState& state, int frequency) {
+  pthread_attr_t attributes;
+  if (pthread_getattr_np(pthread_self(), &attributes) != 0) return false;
+  void* stack = nullptr;
+  std::size_t stack_size = 0;
+  const bool found =
+      pthread_attr_getstack(&attributes, &stack, &stack_size) == 0;
+  pthread_attr_destroy(&attributes);
+  if (!found) return false;
+  state.stack_high = reinterpret_cast<std::uintptr_t>(stack) + stack_size;
+
+  // The worker and event MPMs block every asynchronous signal in their
+  // worker threads (`apr_setup_signal_thread`), which would leave the
+  // signals of the timer pending forever.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGPROF);
+  if (pthread_sigmask(SIG_UNBLOCK, &signals, nullptr) != 0) return false;
+
+  struct sigevent event;
+  std::memset(&event, 0, sizeof(event));
+  event.sigev_notify = SIGEV_THREAD_ID;
+  event.sigev_signo = SIGPROF;
+  event.sigev_notify_thread_id = static_cast<pid_t>(syscall(SYS_gettid));
+  if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &state.timer) != 0) {
+    return false;
+  }
+  state.timer_armed = true;
+
+  const long period_ns = 1'000'000'000L / frequency;
+  struct itimerspec spec;
+  spec.it_interval.tv_sec = period_ns / 1'000'000'000L;
+  spec.it_interval.tv_nsec = period_ns % 1'000'000'000L;
+  spec.it_value = spec.it_interval;
+  if (timer_settime(state.timer, 0, &spec, nullptr) != 0) {
+    disarm(state);
+    return false;
+  }
+  return true;
+}
+
+// Add the executable mappings of the process to `profile`.
+void add_mappings(PprofBuilder& profile) {
+  std::ifstream maps("/proc/self/maps");
+  std::string line;
+  while (std::getline(maps, line)) {
+    unsigned long long start = 0, end = 0, offset = 0;
+    char permissions[5] = {};
+    int path_start = 0;
+    if (std::sscanf(line.c_str(), "%llx-%llx %4s %llx %*s %*s %n", &start,
+                    &end, permissions, &offset, &path_start) < 4 ||
+        permissions[2] != 'x' || path_start == 0 ||
+        static_cast<std::size_t>(path_start) >= line.size()) {
+      continue;
+    }
+    profile.add_mapping(start, end, offset, line.c_str() + path_start);
+  }
+}
+
+// Name of the function containing `pc`, or an empty string.
+std::string function_name(std::uintptr_t pc) {
+  Dl_info info;
+  if (dladdr(reinterpret_cast<void*>(pc), &info) == 0 ||
+      info.dli_sname == nullptr) {
+    return {};
+  }
+  int status = 0;
+  char* demangled =
+      abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+  if (status != 0 || demangled == nullptr) return info.dli_sname;
+  std::string name{demangled};
+  std::free(demangled);
+  return name;
+}
+
+#endif
+
+}  // namespace
+
+std::size_t Profiler::StackKeyHash::operator()(const StackKey& key) const {
+  std::size_t hash = std::hash<std::uint64_t>{}(key.span_id);
+  for (const auto pc : key.pcs) {
+    hash ^= std::hash<std::uintptr_t>{}(pc) + 0x9E3779B97F4A7C15u +
+            (hash << 6) + (hash >> 2);
+  }
+  return hash;
+}
+
+Profiler::Profiler(const conf::Module& conf, server_rec* server)
+    : directory_(*conf.directory),
+      frequency_(conf.frequency),
+      server_(server),
+      finished_endpoints_(k_max_endpoints_per_thread),
+      profile_start_(std::chrono::system_clock::now()) {}
+
+std::unique_ptr<Profiler> Profiler::create(
+    const conf::Module& conf, server_rec* server,
+    tracing::EventScheduler& scheduler) {
+#if defined(HTTPD_DD_PROFILER_SUPPORTED)
+  if (const char* error = install_signal_handler()) {
+    ap_log_error(APLOG_MARK, APLOG_ERR, 0, server,
+                 "CPU profiler disabled: %s", error);
+    return nullptr;
+  }
+
+  std::unique_ptr<Profiler> profiler{new Profiler(conf, server)};
+  g_generation = next_generation();
+  profiler->cancel_collect_ = scheduler.schedule_recurring_event(
+      k_collect_interval, [raw = profiler.get()] { raw->collect(); });
+  return profiler;
+#else
+  (void)conf;
+  (void)scheduler;
+  ap_log_error(APLOG_MARK, APLOG_ERR, 0, server,
+               "CPU profiler disabled: only supported on Linux, on x86_64 "
+               "and aarch64");
+  return nullptr;
+#endif
+}
+
+Profiler::~Profiler() {
+  cancel_collect_();
+  g_generation = 0;
+  {
+    std::lock_guard<std::mutex> lock(threads_mutex_);
+    for (const auto& state : threads_) disarm(*state);
+  }
+  collect();
+  write();
+}
+
+namespace {
+
+// Request in which the samples of a thread are attributed to a span.
+struct ProfiledRequest final {
+  request_rec* r;
+  ThreadState* state;
+  tracing::ShardedQueue<Profiler::Endpoint>* endpoints;
+  std::uint64_t span_id;
+  std::uint64_t first_sample;  ///< `head` of the thread when entered
+};
+
+apr_status_t leave_request(void* data) {
+  auto* request = static_cast<ProfiledRequest*>(data);
+  std::uint64_t span_id = request->span_id;
+  request->state->span_id.compare_exchange_strong(span_id, 0,
+                                                  std::memory_order_relaxed);
+
+  // Resource names are only needed for the requests that were sampled.
+  if (request->state->head.load(std::memory_order_relaxed) !=
+      request->first_sample) {
+    request->endpoints->push(Profiler::Endpoint{
+        request->span_id, tracing::make_resource_name(request->r)});
+  }
+  return APR_SUCCESS;
+}
+
+}  // namespace
+
+void Profiler::enter(request_rec* r, std::uint64_t span_id) {
+#if defined(HTTPD_DD_PROFILER_SUPPORTED)
+  const std::uint64_t generation = g_generation.load();
+  if (t_holder.generation != generation) {
+    t_holder.release();
+    t_holder.generation = generation;
+
+    auto state = std::make_shared<ThreadState>();
+    t_state = state.get();
+    if (!start_thread(*state, frequency_)) {
+      t_state = nullptr;
+      return;
+    }
+    t_holder.state = state;
+    std::lock_guard<std::mutex> lock(threads_mutex_);
+    threads_.emplace_back(std::move(state));
+  }
+
+  ThreadState* state = t_holder.state.get();
+  if (state == nullptr) return;
+
+  state->span_id.store(span_id, std::memory_order_relaxed);
+  void* buffer = apr_palloc(r->pool, sizeof(ProfiledRequest));
+  auto* request = new (buffer)
+      ProfiledRequest{r, state, &finished_endpoints_, span_id,
+                      state->head.load(std::memory_order_relaxed)};
+  apr_pool_cleanup_register(r->pool, request, leave_request,
+                            apr_pool_cleanup_null);
+#else
+  (void)r;
+  (void)span_id;
+#endif
+}
+
+void Profiler::collect() {
+  std::vector<std::shared_ptr<ThreadState>> threads;
+  {
+    std::lock_guard<std::mutex> lock(threads_mutex_);
+    threads = threads_;
+  }
+
+  std::uint64_t samples = 0;
+  std::uint64_t dropped = 0;
+  for (const auto& state : threads) {
+    const std::uint64_t head = state->head.load(std::memory_order_acquire);
+    std::uint64_t tail = state->tail.load(std::memory_order_relaxed);
+    for (; tail != head; ++tail) {
+      const Sample& sample = state->ring[tail % k_ring_size];
+      StackKey key{sample.span_id,
+                   {sample.pcs, sample.pcs + sample.depth}};
+      if (auto found = stacks_.find(key); found != stacks_.end()) {
+        ++found->second;
+      } else if (stacks_.size() < k_max_stacks) {
+        stacks_.emplace(std::move(key), 1);
+      } else {
+        ++dropped;
+        continue;
+      }
+      ++samples;
+    }
+    state->tail.store(tail, std::memory_order_release);
+    dropped += state->dropped.exchange(0, std::memory_order_relaxed);
+  }
+  status::add(status::Counter::profiler_samples, samples);
+  status::add(status::Counter::profiler_samples_dropped, dropped);
+
+  // States of exited threads are only freed once their samples are taken.
+  {
+    std::lock_guard<std::mutex> lock(threads_mutex_);
+    auto end = std::remove_if(
+        threads_.begin(), threads_.end(), [](const auto& state) {
+          return state->exited.load(std::memory_order_acquire) &&
+                 state->head.load(std::memory_order_acquire) ==
+                     state->tail.load(std::memory_order_relaxed);
+        });
+    threads_.erase(end, threads_.end());
+  }
+
+  finished_endpoints_.drain([this](Endpoint endpoint) {
+    endpoints_[endpoint.span_id] = std::move(endpoint.resource);
+  });
+
+  if (std::chrono::system_clock::now() - profile_start_ >=
+      k_profile_duration) {
+    write();
+  }
+}
+
+void Profiler::write() {
+  const auto now = std::chrono::system_clock::now();
+  const auto start = profile_start_;
+  profile_start_ = now;
+  if (stacks_.empty()) return;
+
+#if defined(HTTPD_DD_PROFILER_SUPPORTED)
+  PprofBuilder profile{1'000'000'000 / frequency_};
+  add_mappings(profile);
+
+  std::vector<std::uint64_t> locations;
+  for (const auto& [key, count] : stacks_) {
+    locations.clear();
+    for (std::size_t i = 0; i < key.pcs.size(); ++i) {
+      // Return addresses point after the call: use the call instruction.
+      const std::uintptr_t pc = i == 0 ? key.pcs[i] : key.pcs[i] - 1;
+      locations.push_back(profile.add_location(pc, function_name(pc)));
+    }
+
+    std::vector<PprofBuilder::Label> labels;
+    if (key.span_id != 0) {
+      const auto span_id = static_cast<std::int64_t>(key.span_id);
+      // Request spans are the local roots of their trace in this process.
+      labels.push_back({"span id", {}, span_id});
+      labels.push_back({"local root span id", {}, span_id});
+      if (auto endpoint = endpoints_.find(key.span_id);
+          endpoint != endpoints_.end()) {
+        labels.push_back({"trace endpoint", endpoint->second, 0});
+      }
+    }
+    profile.add_sample(locations, count, labels);
+  }
+  stacks_.clear();
+  endpoints_.clear();
+
+  const auto to_ns = [](auto duration) {
+    return static_cast<std::int64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+  };
+  const std::string content =
+      profile.serialize(to_ns(start.time_since_epoch()), to_ns(now - start));
+
+  const std::string path =
+      directory_ + "/httpd-" + std::to_string(getpid()) + "-" +
+      std::to_string(
+          std::chrono::duration_cast<std::chrono::seconds>(
+              start.time_since_epoch())
+              .count()) +
+      ".pprof";
+  // Written aside then renamed, so that readers never see partial files.
+  const std::string temporary_path = path + ".tmp";
+  std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+  file.write(content.data(), static_cast<std::streamsize>(content.size()));
+  file.close();
+  if (!file || std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+    std::remove(temporary_path.c_str());
+    if (!write_error_logged_) {
+      ap_log_error(APLOG_MARK, APLOG_ERR, errno, server_,
+                   "Cannot write the CPU profile %s", path.c_str());
+      write_error_logged_ = true;
+    }
+    return;
+  }
+  write_error_logged_ = false;
+#else
+  stacks_.clear();
+  endpoints_.clear();
+  (void)start;
+#endif
+}
+
+}  // namespace datadog::profiling
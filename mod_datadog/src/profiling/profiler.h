@@ -0,0 +1,97 @@
+#pragma once
+
+#include <datadog/event_scheduler.h>
+#include <httpd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "conf.h"
+#include "tracing/sharded_queue.h"
+
+namespace datadog::profiling {
+
+struct ThreadState;
+
+// CPU profiler of the request threads of a child process.
+//
+// Each request thread gets a timer on its own CPU clock, which interrupts it
+// with `SIGPROF` `frequency` times per CPU second. The signal handler walks
+// the stack along the frame pointers and appends it, with the ID of the
+// request span of the thread, to a ring owned by the thread. Every second,
+// the exporter thread takes the samples of every ring; every minute, it
+// writes them to a pprof file named `httpd-<pid>-<unix time>.pprof`.
+//
+// Samples carry the "span id" and "local root span id" labels, and the
+// "trace endpoint" label (the resource name of the request) when the request
+// is done, so that profiles are linked to the traces of the requests.
+//
+// Only supported on Linux, on x86_64 and aarch64.
+class Profiler final {
+ public:
+  // Resource name of a request span that was sampled.
+  struct Endpoint final {
+    std::uint64_t span_id;
+    std::string resource;
+  };
+
+ private:
+  struct StackKey final {
+    std::uint64_t span_id;
+    std::vector<std::uintptr_t> pcs;
+
+    bool operator==(const StackKey& other) const {
+      return span_id == other.span_id && pcs == other.pcs;
+    }
+  };
+
+  struct StackKeyHash final {
+    std::size_t operator()(const StackKey& key) const;
+  };
+
+  std::string directory_;
+  int frequency_;
+  server_rec* server_;
+
+  std::mutex threads_mutex_;
+  std::vector<std::shared_ptr<ThreadState>> threads_;
+
+  // Only accessed by the exporter thread, and on destruction.
+  std::unordered_map<StackKey, std::int64_t, StackKeyHash> stacks_;
+  std::unordered_map<std::uint64_t, std::string> endpoints_;
+  tracing::ShardedQueue<Endpoint> finished_endpoints_;
+  std::chrono::system_clock::time_point profile_start_;
+  bool write_error_logged_ = false;
+
+  tracing::EventScheduler::Cancel cancel_collect_;
+
+  Profiler(const conf::Module& conf, server_rec* server);
+
+  void collect();
+  void write();
+
+ public:
+  // Start profiling, or return `nullptr` and log an error if the platform
+  // does not support it.
+  //
+  // @param server  Server used for logging
+  static std::unique_ptr<Profiler> create(const conf::Module& conf,
+                                          server_rec* server,
+                                          tracing::EventScheduler& scheduler);
+  ~Profiler();
+
+  Profiler(const Profiler&) = delete;
+  Profiler& operator=(const Profiler&) = delete;
+
+  // Attribute the samples of the calling thread to the span `span_id` until
+  // the request `r` is destroyed. Starts the timer of the thread on its
+  // first request.
+  void enter(request_rec* r, std::uint64_t span_id);
+};
+
+}  // namespace datadog::profiling
@@ -82,6 +82,12 @@ const char* enable_rum_ddog(cmd_parms* /* cmd */, void* cfg, int value) {
   return NULL;
 }
 
+const char* enable_rum_span_tags(cmd_parms* /* cmd */, void* cfg, int value) {
+  auto* dir_conf = static_cast<Directory*>(cfg);
+  dir_conf->rum.span_tags = value != 0;
+  return NULL;
+}
+
 const char* set_rum_option(cmd_parms* cmd, void* cfg, int argc,
                            const char* argv[]) {
   if (cmd->directive->parent == nullptr ||
@@ -187,6 +193,7 @@ void merge_directory_configuration(Directory& out, const Directory& parent,
   out.remote_config_tag = child.remote_config_tag.empty()
                               ? parent.remote_config_tag
                               : child.remote_config_tag;
+  out.span_tags = child.span_tags ? child.span_tags : parent.span_tags;
 
   return;
 }
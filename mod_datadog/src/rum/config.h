@@ -11,6 +11,8 @@ inline const char* rum_filter_name = "mod_rum_inject";
 
 const char* enable_rum_ddog(cmd_parms* cmd, void* cfg, int value);
 
+const char* enable_rum_span_tags(cmd_parms* cmd, void* cfg, int value);
+
 const char* set_rum_option(cmd_parms* cmd, void* cfg, int argc,
                            const char* argv[]);
 
@@ -20,6 +22,7 @@ const char* datadog_rum_settings_section(cmd_parms* cmd, void* cfg,
 // clang-format off
 #define RUM_MODULE_CMDS \
 AP_INIT_FLAG("DatadogRum", reinterpret_cast<cmd_func>(enable_rum_ddog), NULL, RSRC_CONF | ACCESS_CONF, "Enable or disable Datadog RUM module"), \
+AP_INIT_FLAG("DatadogRumSpanTags", reinterpret_cast<cmd_func>(enable_rum_span_tags), NULL, RSRC_CONF | ACCESS_CONF, "Report the cost of RUM injection on the request span"), \
 AP_INIT_RAW_ARGS("<DatadogRumSettings", reinterpret_cast<cmd_func>(datadog_rum_settings_section), NULL, RSRC_CONF | ACCESS_CONF, "Container for Datadog RUM settings"), \
 AP_INIT_TAKE_ARGV("DatadogRumOption", reinterpret_cast<cmd_func>(set_rum_option), NULL, RSRC_CONF | ACCESS_CONF, "Set options on the RUM SDK"),
 // clang-format on
@@ -33,6 +36,8 @@ struct Directory final {
   std::unordered_map<std::string, std::string> config;
   std::string app_id_tag;
   std::string remote_config_tag;
+  // Report the cost of the injection as metrics of the request span.
+  std::optional<bool> span_tags;
 
   ~Directory() {
     if (snippet != nullptr) {
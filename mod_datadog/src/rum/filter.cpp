@@ -1,11 +1,15 @@
 #include "rum/filter.h"
 
+#include <datadog/span.h>
 #include <datadog/telemetry/telemetry.h>
 
+#include <chrono>
+#include <optional>
 #include <string_view>
 
 #include "common_conf.h"
 #include "http_log.h"
+#include "status/scoreboard.h"
 #include "telemetry.h"
 #include "util_filter.h"
 #include "utils.h"
@@ -46,6 +50,7 @@ bool should_inject(rum_filter_ctx& ctx, request_rec& r,
   const char* const already_injected =
       apr_table_get(r.headers_out, k_injected_header.data());
   if (already_injected && std::string_view(already_injected) == "1") {
+    datadog::status::add(datadog::status::Counter::rum_skipped);
     datadog::telemetry::counter::increment(
         telemetry::injection_skipped,
         telemetry::build_tags("reason:already_injected", rum_conf.app_id_tag,
@@ -62,6 +67,7 @@ bool should_inject(rum_filter_ctx& ctx, request_rec& r,
         APLOG_MARK, APLOG_DEBUG, 0, &r,
         "[RUM] Skip injection: \"Content-Type: %s\" does not match text/html.",
         content_type);
+    datadog::status::add(datadog::status::Counter::rum_skipped);
     datadog::telemetry::counter::increment(
         telemetry::injection_skipped,
         telemetry::build_tags("reason:content-type", rum_conf.app_id_tag,
@@ -72,6 +78,7 @@ bool should_inject(rum_filter_ctx& ctx, request_rec& r,
   const char* const content_encoding =
       apr_table_get(r.headers_out, "Content-Encoding");
   if (content_encoding) {
+    datadog::status::add(datadog::status::Counter::rum_skipped);
     datadog::telemetry::counter::increment(
         telemetry::injection_skipped,
         telemetry::build_tags("reason:compressed_html", rum_conf.app_id_tag,
@@ -82,6 +89,41 @@ bool should_inject(rum_filter_ctx& ctx, request_rec& r,
   return true;
 }
 
+// Report the work done for the response of `r`, as telemetry and, if
+// `DatadogRumSpanTags` is on, as metrics of the request span.
+static void report_cost(const rum_filter_cost& cost, request_rec* r,
+                        const datadog::rum::conf::Directory& rum_conf,
+                        const char* outcome) {
+  const auto tags = telemetry::build_tags(outcome, rum_conf.app_id_tag,
+                                          rum_conf.remote_config_tag);
+  datadog::telemetry::distribution::add(telemetry::bytes_scanned,
+                                        cost.bytes_scanned, tags);
+  datadog::telemetry::distribution::add(telemetry::injector_time,
+                                        cost.injector_ns, tags);
+  datadog::telemetry::distribution::add(telemetry::buckets_read,
+                                        cost.buckets_read, tags);
+  datadog::telemetry::distribution::add(telemetry::buckets_split,
+                                        cost.buckets_split, tags);
+  datadog::telemetry::distribution::add(telemetry::file_buckets_read,
+                                        cost.file_buckets_read, tags);
+
+  if (!rum_conf.span_tags.value_or(false)) return;
+  auto* span = static_cast<datadog::tracing::Span*>(
+      ap_get_module_config(r->request_config, &datadog_module));
+  if (span == nullptr) return;
+
+  span->set_metric("httpd.rum.bytes_scanned",
+                   static_cast<double>(cost.bytes_scanned));
+  span->set_metric("httpd.rum.injector_time_ms",
+                   static_cast<double>(cost.injector_ns) / 1e6);
+  span->set_metric("httpd.rum.buckets_read",
+                   static_cast<double>(cost.buckets_read));
+  span->set_metric("httpd.rum.buckets_split",
+                   static_cast<double>(cost.buckets_split));
+  span->set_metric("httpd.rum.file_buckets_read",
+                   static_cast<double>(cost.file_buckets_read));
+}
+
 /* TODO:
  *   - use AddOutputFilterByType. In theory the scanner can be run on
  *     everything.
@@ -114,6 +156,7 @@ int rum_output_filter(ap_filter_t* f, apr_bucket_brigade* bb) {
   }
 
   auto* ctx = static_cast<rum_filter_ctx*>(f->ctx);
+  rum_filter_cost& cost = ctx->cost;
 
   if (!should_inject(*ctx, *r, dir_conf->rum)) {
     return ap_pass_brigade(f->next, bb);
@@ -126,19 +169,32 @@ int rum_output_filter(ap_filter_t* f, apr_bucket_brigade* bb) {
        b = APR_BUCKET_NEXT(b)) {
     if (APR_BUCKET_IS_EOS(b)) {
       injector_end(ctx->injector);
+      datadog::status::add(datadog::status::Counter::rum_failed);
       datadog::telemetry::counter::increment(
           telemetry::injection_failed,
           telemetry::build_tags("reason:missing_header_tag",
                                 dir_conf->rum.app_id_tag,
                                 dir_conf->rum.remote_config_tag));
+      report_cost(cost, r, dir_conf->rum, "outcome:failed");
     } else if (APR_BUCKET_IS_METADATA(b)) {
       // TODO: Handle metadata bucket like flush
-    } else if (apr_bucket_read(b, &buffer, &bytes, APR_BLOCK_READ) ==
+    } else if (const bool is_file = APR_BUCKET_IS_FILE(b);
+               apr_bucket_read(b, &buffer, &bytes, APR_BLOCK_READ) ==
                APR_SUCCESS) {
+      // Reading a file bucket loads the file into memory.
+      ++cost.buckets_read;
+      if (is_file) ++cost.file_buckets_read;
+
+      const auto start = std::chrono::steady_clock::now();
       InjectorResult result =
           injector_write(ctx->injector, (const uint8_t*)buffer, bytes);
+      cost.injector_ns += static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - start)
+              .count());
 
       size_t offset = 0;
+      std::optional<size_t> injection_offset;
       for (size_t i = 0; i < result.slices_length; i++) {
         const BytesSlice* slice = result.slices + i;
         if (slice->from_incoming_chunk) {
@@ -149,20 +205,25 @@ int rum_output_filter(ap_filter_t* f, apr_bucket_brigade* bb) {
               f->r->connection->bucket_alloc);
 
           apr_bucket_split(b, offset);
+          ++cost.buckets_split;
           APR_BUCKET_INSERT_AFTER(b, b_snippet);
+          if (!injection_offset) injection_offset = offset;
           offset += slice->length;
         }
       }
+      cost.bytes_scanned += injection_offset.value_or(bytes);
       if (result.injected) {
         ctx->state = InjectionState::done;
         apr_table_set(r->headers_out, k_injected_header.data(), "1");
 
         ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r,
                       "[RUM] successfully injected the browser SDK.");
+        datadog::status::add(datadog::status::Counter::rum_injected);
         datadog::telemetry::counter::increment(
             telemetry::injection_succeed,
             telemetry::build_tags(dir_conf->rum.app_id_tag,
                                   dir_conf->rum.remote_config_tag));
+        report_cost(cost, r, dir_conf->rum, "outcome:injected");
 
         return ap_pass_brigade(f->next, bb);
       }
@@ -1,14 +1,27 @@
 #pragma once
 
+#include <cstdint>
+
 #include "httpd.h"
 #include "injectbrowsersdk.h"
 
 enum class InjectionState : char { init, pending, error, done };
 
+// Work done by the filter for a response, reported once the injection
+// succeeded or failed.
+struct rum_filter_cost final {
+  uint64_t bytes_scanned = 0;  ///< Up to the injection point, if injected
+  uint64_t injector_ns = 0;    ///< Spent in `injector_write`
+  uint32_t buckets_read = 0;
+  uint32_t buckets_split = 0;
+  uint32_t file_buckets_read = 0;  ///< Read into heap buckets
+};
+
 struct rum_filter_ctx final {
   Snippet* snippet = nullptr;
   Injector* injector = nullptr;
   InjectionState state = InjectionState::init;
+  rum_filter_cost cost;
 };
 
 // Output Filter for injecting the RUM SDK
@@ -10,4 +10,11 @@ const Counter injection_failed{"injection.failed", "rum", true};
 const Counter content_security_policy{"injection.content_security_policy",
                                       "rum", true};
 
+const Distribution bytes_scanned{"injection.bytes_scanned", "rum", false};
+const Distribution injector_time{"injection.injector_time_ns", "rum", false};
+const Distribution buckets_read{"injection.buckets_read", "rum", false};
+const Distribution buckets_split{"injection.buckets_split", "rum", false};
+const Distribution file_buckets_read{"injection.file_buckets_read", "rum",
+                                     false};
+
 }  // namespace datadog::rum::telemetry
@@ -25,4 +25,11 @@ const extern datadog::telemetry::Counter injection_succeed;
 const extern datadog::telemetry::Counter injection_failed;
 const extern datadog::telemetry::Counter content_security_policy;
 
+// Cost of the injection, per response.
+const extern datadog::telemetry::Distribution bytes_scanned;
+const extern datadog::telemetry::Distribution injector_time;
+const extern datadog::telemetry::Distribution buckets_read;
+const extern datadog::telemetry::Distribution buckets_split;
+const extern datadog::telemetry::Distribution file_buckets_read;
+
 }  // namespace datadog::rum::telemetry
@@ -0,0 +1,23 @@
+#include "shared_memory.h"
+
+#include <http_log.h>
+
+APLOG_USE_MODULE(datadog);
+
+namespace datadog::common::detail {
+
+void* create_shared_memory(apr_pool_t* pool, server_rec* server,
+                           const char* name, apr_size_t size) {
+  apr_shm_t* shm = nullptr;
+  if (apr_status_t status = apr_shm_create(&shm, size, nullptr, pool);
+      status != APR_SUCCESS) {
+    ap_log_error(APLOG_MARK, APLOG_ERR, status, server,
+                 "Failed to create the %s shared memory segment (%zu bytes)",
+                 name, static_cast<size_t>(size));
+    return nullptr;
+  }
+
+  return apr_shm_baseaddr_get(shm);
+}
+
+}  // namespace datadog::common::detail
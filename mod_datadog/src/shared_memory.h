@@ -0,0 +1,43 @@
+#pragma once
+
+#include <apr_pools.h>
+#include <apr_shm.h>
+#include <httpd.h>
+
+#include <new>
+#include <type_traits>
+
+namespace datadog::common {
+
+// Allocate an anonymous shared memory segment holding a `T`.
+//
+// The segment must be created in the parent process, during `post_config`,
+// so that every child forked afterwards maps the same memory. It lives as
+// long as `pool`, which should be the configuration pool. The memory is
+// zero-filled and `T` is never destroyed.
+//
+// Return `nullptr` and log an error if the segment could not be created.
+//
+// @param pool    Configuration pool
+// @param server  Server used for logging
+// @param name    Human readable name of the segment, used for logging
+template <typename T>
+T* make_shared_memory(apr_pool_t* pool, server_rec* server, const char* name);
+
+namespace detail {
+
+void* create_shared_memory(apr_pool_t* pool, server_rec* server,
+                           const char* name, apr_size_t size);
+
+}  // namespace detail
+
+template <typename T>
+T* make_shared_memory(apr_pool_t* pool, server_rec* server, const char* name) {
+  static_assert(std::is_trivially_destructible_v<T>);
+
+  void* base = detail::create_shared_memory(pool, server, name, sizeof(T));
+  if (base == nullptr) return nullptr;
+  return new (base) T;
+}
+
+}  // namespace datadog::common
@@ -0,0 +1,74 @@
+#include "http_client.h"
+
+#include <datadog/dict_writer.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <string_view>
+
+#include "scoreboard.h"
+
+namespace datadog::status {
+namespace {
+
+bool ends_with(std::string_view value, std::string_view suffix) {
+  return value.size() >= suffix.size() &&
+         value.substr(value.size() - suffix.size()) == suffix;
+}
+
+// State of a request, shared by its response and error handlers.
+struct Request final {
+  bool is_flush = false;
+  std::chrono::steady_clock::time_point start;
+  std::atomic<bool> done = false;
+
+  void finish(bool failed) {
+    if (done.exchange(true)) return;
+
+    subtract(Counter::export_queue_depth);
+    // Traces of a failed flush may still be spooled or sent again. Those
+    // which are not are counted as dropped by `BufferedHTTPClient`.
+    if (failed) add(Counter::agent_errors);
+    if (is_flush) {
+      const auto latency =
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - start)
+              .count();
+      add(Counter::flushes);
+      add(Counter::flush_latency_us, static_cast<std::uint64_t>(latency));
+      update_max(Counter::flush_latency_max_us,
+                 static_cast<std::uint64_t>(latency));
+    }
+  }
+};
+
+}  // namespace
+
+tracing::Expected<void> ScoreboardHTTPClient::post(
+    const URL& url, HeadersSetter set_headers, std::string body,
+    ResponseHandler on_response, ErrorHandler on_error,
+    std::chrono::steady_clock::time_point deadline) {
+  auto request = std::make_shared<Request>();
+  request->is_flush = ends_with(url.path, "/traces");
+  request->start = std::chrono::steady_clock::now();
+
+  on_response = [on_response = std::move(on_response), request](
+                    int status, const tracing::DictReader& headers,
+                    std::string response_body) {
+    request->finish(status < 200 || status >= 300);
+    on_response(status, headers, std::move(response_body));
+  };
+  on_error = [on_error = std::move(on_error), request](tracing::Error error) {
+    request->finish(true);
+    on_error(std::move(error));
+  };
+
+  add(Counter::export_queue_depth);
+  auto result = next_->post(url, std::move(set_headers), std::move(body),
+                            std::move(on_response), std::move(on_error),
+                            deadline);
+  if (result.if_error() != nullptr) request->finish(true);
+  return result;
+}
+
+}  // namespace datadog::status
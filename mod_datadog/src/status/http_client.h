@@ -0,0 +1,32 @@
+#pragma once
+
+#include <datadog/http_client.h>
+
+#include <memory>
+#include <string>
+
+namespace datadog::status {
+
+// HTTP client decorator recording the requests sent to the Datadog Agent in
+// the scoreboard: requests in flight, trace flush round trip times, errors
+// and the number of traces lost with a failed payload.
+class ScoreboardHTTPClient final : public tracing::HTTPClient {
+  std::shared_ptr<HTTPClient> next_;
+
+ public:
+  explicit ScoreboardHTTPClient(std::shared_ptr<HTTPClient> next)
+      : next_(std::move(next)) {}
+
+  tracing::Expected<void> post(
+      const URL& url, HeadersSetter set_headers, std::string body,
+      ResponseHandler on_response, ErrorHandler on_error,
+      std::chrono::steady_clock::time_point deadline) override;
+
+  void drain(std::chrono::steady_clock::time_point deadline) override {
+    next_->drain(deadline);
+  }
+
+  std::string config() const override { return next_->config(); }
+};
+
+}  // namespace datadog::status
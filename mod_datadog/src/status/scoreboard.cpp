@@ -0,0 +1,253 @@
+#include "scoreboard.h"
+
+#include <http_log.h>
+#include <http_protocol.h>
+#include <mod_status.h>
+#include <signal.h>
+
+#include <cerrno>
+#include <new>
+#include <type_traits>
+
+#include "shared_memory.h"
+
+APLOG_USE_MODULE(datadog);
+
+namespace datadog::status {
+namespace {
+
+std::atomic<Scoreboard::Slot*> g_slot = nullptr;
+
+bool is_gauge(Counter counter) {
+  return counter == Counter::export_queue_depth ||
+         counter == Counter::buffer_bytes;
+}
+
+bool is_max(Counter counter) {
+  return counter == Counter::flush_latency_max_us;
+}
+
+bool is_alive(pid_t pid) { return kill(pid, 0) == 0 || errno != ESRCH; }
+
+void store_max(std::atomic<std::uint64_t>& target, std::uint64_t value) {
+  std::uint64_t current = target.load(std::memory_order_relaxed);
+  while (current < value &&
+         !target.compare_exchange_weak(current, value,
+                                       std::memory_order_relaxed)) {
+  }
+}
+
+}  // namespace
+
+std::string_view name(Counter counter) {
+  switch (counter) {
+    case Counter::spans_started:
+      return "SpansStarted";
+    case Counter::spans_finished:
+      return "SpansFinished";
+    case Counter::flushes:
+      return "Flushes";
+    case Counter::flush_latency_us:
+      return "FlushLatencyTotalUs";
+    case Counter::flush_latency_max_us:
+      return "FlushLatencyMaxUs";
+    case Counter::traces_dropped:
+      return "TracesDropped";
+    case Counter::agent_errors:
+      return "AgentErrors";
+    case Counter::export_queue_depth:
+      return "ExportQueueDepth";
+    case Counter::buffer_bytes:
+      return "BufferBytes";
+    case Counter::buffer_dropped_payloads:
+      return "BufferDroppedPayloads";
+    case Counter::buffer_dropped_traces:
+      return "BufferDroppedTraces";
+    case Counter::export_backoffs:
+      return "ExportBackoffs";
+    case Counter::spool_written:
+      return "SpoolWritten";
+    case Counter::spool_replayed:
+      return "SpoolReplayed";
+    case Counter::spool_dropped:
+      return "SpoolDropped";
+    case Counter::cache_hits:
+      return "CacheHits";
+    case Counter::cache_misses:
+      return "CacheMisses";
+    case Counter::rum_injected:
+      return "RumInjected";
+    case Counter::rum_skipped:
+      return "RumSkipped";
+    case Counter::rum_failed:
+      return "RumFailed";
+    case Counter::profiler_samples:
+      return "ProfilerSamples";
+    case Counter::profiler_samples_dropped:
+      return "ProfilerSamplesDropped";
+    case Counter::governor_transitions:
+      return "GovernorTransitions";
+    case Counter::compressed_payloads:
+      return "CompressedPayloads";
+    case Counter::compression_saved_bytes:
+      return "CompressionSavedBytes";
+    case Counter::compression_time_us:
+      return "CompressionTimeUs";
+    case Counter::retention_dropped_traces:
+      return "RetentionDroppedTraces";
+    case Counter::count_:
+      break;
+  }
+  return "Unknown";
+}
+
+Scoreboard* Scoreboard::create(apr_pool_t* pool, server_rec* server,
+                               std::size_t capacity) {
+  static_assert(std::is_trivially_destructible_v<Scoreboard>);
+
+  if (capacity == 0) capacity = 1;
+  const apr_size_t size =
+      offsetof(Scoreboard, slots_) + capacity * sizeof(Slot);
+  void* base = common::detail::create_shared_memory(pool, server,
+                                                    "status scoreboard", size);
+  if (base == nullptr) return nullptr;
+
+  auto* scoreboard = new (base) Scoreboard;
+  scoreboard->capacity_ = capacity;
+  return scoreboard;
+}
+
+Scoreboard::Slot* Scoreboard::acquire() {
+  const pid_t self = getpid();
+  for (std::size_t i = 0; i < capacity_; ++i) {
+    Slot& slot = slots_[i];
+    pid_t pid = slot.pid.load(std::memory_order_acquire);
+    if (pid == 0 &&
+        slot.pid.compare_exchange_strong(pid, self,
+                                         std::memory_order_acq_rel)) {
+      return &slot;
+    }
+
+    // Left behind by a child that did not exit cleanly.
+    if (pid != 0 && !is_alive(pid) &&
+        slot.pid.compare_exchange_strong(pid, self,
+                                         std::memory_order_acq_rel)) {
+      retire(slot);
+      return &slot;
+    }
+  }
+
+  return nullptr;
+}
+
+void Scoreboard::release(Slot& slot) {
+  retire(slot);
+  slot.pid.store(0, std::memory_order_release);
+}
+
+void Scoreboard::retire(Slot& slot) {
+  for (std::size_t i = 0; i < counter_count; ++i) {
+    const auto counter = static_cast<Counter>(i);
+    const std::uint64_t value =
+        slot.counters[i].exchange(0, std::memory_order_relaxed);
+    if (is_gauge(counter)) continue;
+    if (is_max(counter)) {
+      store_max(retired_.counters[i], value);
+    } else {
+      retired_.counters[i].fetch_add(value, std::memory_order_relaxed);
+    }
+  }
+}
+
+std::array<std::uint64_t, counter_count> Scoreboard::totals() const {
+  std::array<std::uint64_t, counter_count> totals;
+  for (std::size_t i = 0; i < counter_count; ++i) {
+    totals[i] = retired_.counters[i].load(std::memory_order_relaxed);
+  }
+
+  for (std::size_t s = 0; s < capacity_; ++s) {
+    const Slot& slot = slots_[s];
+    if (slot.pid.load(std::memory_order_acquire) == 0) continue;
+    for (std::size_t i = 0; i < counter_count; ++i) {
+      const std::uint64_t value =
+          slot.counters[i].load(std::memory_order_relaxed);
+      if (is_max(static_cast<Counter>(i))) {
+        if (value > totals[i]) totals[i] = value;
+      } else {
+        totals[i] += value;
+      }
+    }
+  }
+
+  return totals;
+}
+
+void attach(Scoreboard::Slot* slot) {
+  g_slot.store(slot, std::memory_order_release);
+}
+
+Scoreboard::Slot* detach() {
+  return g_slot.exchange(nullptr, std::memory_order_acq_rel);
+}
+
+void add(Counter counter, std::uint64_t value) {
+  if (auto* slot = g_slot.load(std::memory_order_acquire)) {
+    slot->counters[static_cast<std::size_t>(counter)].fetch_add(
+        value, std::memory_order_relaxed);
+  }
+}
+
+void subtract(Counter counter, std::uint64_t value) {
+  if (auto* slot = g_slot.load(std::memory_order_acquire)) {
+    slot->counters[static_cast<std::size_t>(counter)].fetch_sub(
+        value, std::memory_order_relaxed);
+  }
+}
+
+void update_max(Counter counter, std::uint64_t value) {
+  if (auto* slot = g_slot.load(std::memory_order_acquire)) {
+    store_max(slot->counters[static_cast<std::size_t>(counter)], value);
+  }
+}
+
+int render(request_rec* r, int flags, const Scoreboard& scoreboard) {
+  const auto totals = scoreboard.totals();
+
+  if (flags & AP_STATUS_SHORT) {
+    for (std::size_t i = 0; i < counter_count; ++i) {
+      ap_rprintf(r, "Datadog%s: %" APR_UINT64_T_FMT "\n",
+                 name(static_cast<Counter>(i)).data(), totals[i]);
+    }
+    return OK;
+  }
+
+  ap_rputs("<hr />\n<h2>Datadog</h2>\n", r);
+  ap_rputs("<table border=\"0\">\n<tr><th>PID</th>", r);
+  for (std::size_t i = 0; i < counter_count; ++i) {
+    ap_rprintf(r, "<th>%s</th>", name(static_cast<Counter>(i)).data());
+  }
+  ap_rputs("</tr>\n", r);
+
+  for (std::size_t s = 0; s < scoreboard.capacity(); ++s) {
+    const Scoreboard::Slot& slot = scoreboard.slot(s);
+    const pid_t pid = slot.pid.load(std::memory_order_acquire);
+    if (pid == 0) continue;
+
+    ap_rprintf(r, "<tr><td>%" APR_PID_T_FMT "</td>", pid);
+    for (std::size_t i = 0; i < counter_count; ++i) {
+      ap_rprintf(r, "<td>%" APR_UINT64_T_FMT "</td>",
+                 slot.counters[i].load(std::memory_order_relaxed));
+    }
+    ap_rputs("</tr>\n", r);
+  }
+
+  ap_rputs("<tr><th>Total</th>", r);
+  for (std::size_t i = 0; i < counter_count; ++i) {
+    ap_rprintf(r, "<th>%" APR_UINT64_T_FMT "</th>", totals[i]);
+  }
+  ap_rputs("</tr>\n</table>\n", r);
+
+  return OK;
+}
+
+}  // namespace datadog::status
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <apr_pools.h>
+#include <httpd.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace datadog::status {
+
+enum class Counter : std::size_t {
+  spans_started,
+  spans_finished,
+  flushes,           ///< Trace payloads sent to the Agent
+  flush_latency_us,  ///< Sum of the trace payloads round trip times
+  flush_latency_max_us,
+  traces_dropped,      ///< Traces the Agent did not accept and not kept
+  agent_errors,        ///< Failed or rejected requests to the Agent
+  export_queue_depth,  ///< Requests to the Agent in flight (gauge)
+  buffer_bytes,        ///< Trace payloads waiting for the Agent (gauge)
+  buffer_dropped_payloads,  ///< Trace payloads over the buffer budget
+  buffer_dropped_traces,    ///< Traces of the payloads over the budget
+  export_backoffs,          ///< Pauses after a failed trace payload
+  spool_written,            ///< Trace payloads written to the spool
+  spool_replayed,           ///< Spooled payloads the Agent accepted
+  spool_dropped,            ///< Spooled payloads given up after retries
+  cache_hits,               ///< Requests served from mod_cache
+  cache_misses,
+  rum_injected,
+  rum_skipped,
+  rum_failed,
+  profiler_samples,          ///< CPU samples taken by the profiler
+  profiler_samples_dropped,  ///< CPU samples lost to full buffers
+  governor_transitions,      ///< Overhead governor mode changes
+  compressed_payloads,       ///< Trace payloads sent compressed
+  compression_saved_bytes,   ///< Bytes saved by compressing them
+  compression_time_us,       ///< Time spent compressing them
+  retention_dropped_traces,  ///< Traces tail retention did not serialize
+  count_
+};
+
+inline constexpr std::size_t counter_count =
+    static_cast<std::size_t>(Counter::count_);
+
+// Name of `counter` in the `server-status` report, e.g. "SpansStarted".
+std::string_view name(Counter counter);
+
+// Per-child counters of the module, shared between every process.
+//
+// The scoreboard is allocated by the parent process in `post_config`. Each
+// child claims a slot in `child_init` and releases it on exit; a slot left by
+// a crashed child is reclaimed by the next child. Counters of released slots
+// are folded into `retired` totals, so that the totals reported are monotonic
+// across child recycling.
+class Scoreboard final {
+ public:
+  struct Slot final {
+    std::atomic<pid_t> pid;  ///< 0 when the slot is free
+    std::array<std::atomic<std::uint64_t>, counter_count> counters;
+  };
+
+  // Allocate a scoreboard with a slot for up to `capacity` children.
+  //
+  // Return `nullptr` and log an error if the shared memory segment could not
+  // be created.
+  static Scoreboard* create(apr_pool_t* pool, server_rec* server,
+                            std::size_t capacity);
+
+  // Claim a slot for the calling process, or return `nullptr` if every slot
+  // is held by a live process.
+  Slot* acquire();
+  void release(Slot& slot);
+
+  std::size_t capacity() const { return capacity_; }
+  const Slot& slot(std::size_t index) const { return slots_[index]; }
+
+  // Sum of the counters of every live and retired child. Gauges only cover
+  // live children.
+  std::array<std::uint64_t, counter_count> totals() const;
+
+ private:
+  std::size_t capacity_;
+  Slot retired_;
+  Slot slots_[1];
+
+  void retire(Slot& slot);
+};
+
+// Counters of the current process. Recording is a no-op until `attach` is
+// called, or if the process could not claim a slot.
+void attach(Scoreboard::Slot* slot);
+Scoreboard::Slot* detach();
+
+void add(Counter counter, std::uint64_t value = 1);
+void subtract(Counter counter, std::uint64_t value = 1);
+void update_max(Counter counter, std::uint64_t value);
+
+// `ap_hook_status_hook` callback: render `scoreboard` into the `server-status`
+// page, as a table or as `Key: value` lines for `?auto`.
+int render(request_rec* r, int flags, const Scoreboard& scoreboard);
+
+}  // namespace datadog::status
@@ -0,0 +1,512 @@
+#include "apr_http_client.h"
+
+#include <apr_network_io.h>
+#include <apr_portable.h>
+#include <datadog/dict_reader.h>
+#include <datadog/dict_writer.h>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+
+#include "http_response_parser.h"
+
+namespace datadog::tracing {
+namespace {
+
+constexpr std::size_t k_read_size = 16 * 1024;
+
+std::string to_lower(std::string_view value) {
+  std::string result{value};
+  std::transform(result.begin(), result.end(), result.begin(),
+                 [](unsigned char ch) { return std::tolower(ch); });
+  return result;
+}
+
+// Where to connect for a given URL.
+struct Origin final {
+  bool is_unix = false;
+  std::string host;  ///< Host name or address, or socket path
+  apr_port_t port = 80;
+  std::string host_header;
+};
+
+std::optional<Origin> parse_origin(const HTTPClient::URL& url) {
+  Origin origin;
+  if (url.scheme == "unix" || url.scheme == "http+unix") {
+    origin.is_unix = true;
+    origin.host = url.authority;
+    origin.host_header = "localhost";
+    return origin;
+  }
+
+  if (url.scheme != "http") return std::nullopt;
+
+  std::string_view authority = url.authority;
+  std::string_view host = authority;
+  std::string_view port;
+  if (!authority.empty() && authority.front() == '[') {
+    const auto end = authority.find(']');
+    if (end == std::string_view::npos) return std::nullopt;
+    host = authority.substr(1, end - 1);
+    if (end + 1 < authority.size()) {
+      if (authority[end + 1] != ':') return std::nullopt;
+      port = authority.substr(end + 2);
+    }
+  } else if (const auto colon = authority.rfind(':');
+             colon != std::string_view::npos) {
+    host = authority.substr(0, colon);
+    port = authority.substr(colon + 1);
+  }
+
+  if (!port.empty()) {
+    unsigned long value = 0;
+    for (const char ch : port) {
+      if (ch < '0' || ch > '9') return std::nullopt;
+      value = value * 10 + (ch - '0');
+      if (value > 65535) return std::nullopt;
+    }
+    origin.port = static_cast<apr_port_t>(value);
+  }
+
+  if (host.empty()) return std::nullopt;
+  origin.host = host;
+  origin.host_header = url.authority;
+  return origin;
+}
+
+class RequestHeaderWriter final : public DictWriter {
+  std::string& request_;
+
+ public:
+  explicit RequestHeaderWriter(std::string& request) : request_(request) {}
+
+  void set(StringView key, StringView value) override {
+    request_ += key;
+    request_ += ": ";
+    request_ += value;
+    request_ += "\r\n";
+  }
+};
+
+// Headers of a response, as handed to its handler.
+class ResponseHeaders final : public DictReader {
+  const std::unordered_map<std::string, std::string>& headers_;
+
+ public:
+  explicit ResponseHeaders(
+      const std::unordered_map<std::string, std::string>& headers)
+      : headers_(headers) {}
+
+  Optional<StringView> lookup(StringView key) const override {
+    auto found = headers_.find(to_lower(key));
+    if (found == headers_.end()) return nullopt;
+    return StringView{found->second};
+  }
+
+  void visit(const std::function<void(StringView key, StringView value)>&
+                 visitor) const override {
+    for (const auto& [name, value] : headers_) visitor(name, value);
+  }
+};
+
+struct PendingRequest final {
+  std::string bytes;
+  HTTPClient::ResponseHandler on_response;
+  HTTPClient::ErrorHandler on_error;
+  std::chrono::steady_clock::time_point deadline;
+  bool retried = false;
+};
+
+// Keep-alive connection to one Agent address, only used from the loop
+// thread.
+class Connection final : public EventLoop::Watcher,
+                         public std::enable_shared_from_this<Connection> {
+  enum class State { CLOSED, CONNECTING, IDLE, WRITING, READING };
+
+  EventLoop& loop_;
+  Origin origin_;
+  std::function<void()> on_request_done_;
+
+  State state_ = State::CLOSED;
+  apr_pool_t* pool_ = nullptr;
+  apr_socket_t* socket_ = nullptr;
+  bool is_reused_ = false;
+
+  std::deque<PendingRequest> queue_;
+  std::optional<PendingRequest> current_;
+  std::uint64_t current_serial_ = 0;
+  EventLoop::TimerID deadline_timer_ = 0;
+  std::size_t written_ = 0;
+  ResponseParser parser_;
+
+ public:
+  Connection(EventLoop& loop, Origin origin,
+             std::function<void()> on_request_done)
+      : loop_(loop),
+        origin_(std::move(origin)),
+        on_request_done_(std::move(on_request_done)) {}
+
+  ~Connection() { close(); }
+
+  void enqueue(PendingRequest request) {
+    queue_.emplace_back(std::move(request));
+    pump();
+  }
+
+  void on_ready(apr_int16_t events) override {
+    switch (state_) {
+      case State::CONNECTING:
+        on_connected(events);
+        break;
+      case State::WRITING:
+        write_some();
+        break;
+      case State::READING:
+        read_some();
+        break;
+      case State::IDLE:
+        // Nothing is expected on an idle connection: the Agent closed it.
+        close();
+        break;
+      case State::CLOSED:
+        break;
+    }
+  }
+
+  void close() {
+    if (socket_ != nullptr) {
+      loop_.unwatch(socket_);
+      apr_socket_close(socket_);
+      socket_ = nullptr;
+    }
+    if (pool_ != nullptr) {
+      apr_pool_destroy(pool_);
+      pool_ = nullptr;
+    }
+    state_ = State::CLOSED;
+    is_reused_ = false;
+  }
+
+ private:
+  // Start the next request, if idle.
+  void pump() {
+    while (!current_ && !queue_.empty()) {
+      PendingRequest request = std::move(queue_.front());
+      queue_.pop_front();
+
+      const auto now = std::chrono::steady_clock::now();
+      if (request.deadline <= now) {
+        request.on_error(Error{Error::OTHER, "Request timed out"});
+        on_request_done_();
+        continue;
+      }
+
+      current_ = std::move(request);
+      const std::uint64_t serial = ++current_serial_;
+      deadline_timer_ = loop_.add_timer(
+          current_->deadline - now, std::chrono::steady_clock::duration::zero(),
+          [weak_self = weak_from_this(), serial] {
+            if (auto self = weak_self.lock()) self->on_timeout(serial);
+          });
+    }
+
+    if (!current_) return;
+    if (state_ == State::CLOSED) {
+      open();
+    } else if (state_ == State::IDLE) {
+      send();
+    }
+  }
+
+  void open() {
+    if (apr_pool_create(&pool_, loop_.pool()) != APR_SUCCESS) {
+      fail("Could not allocate a connection pool", false);
+      return;
+    }
+
+    apr_status_t status;
+    if (origin_.is_unix) {
+      sockaddr_un address{};
+      address.sun_family = AF_UNIX;
+      if (origin_.host.size() >= sizeof(address.sun_path)) {
+        fail("Unix domain socket path is too long", false);
+        return;
+      }
+      std::memcpy(address.sun_path, origin_.host.data(), origin_.host.size());
+
+      apr_os_sock_t fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (fd < 0 || apr_os_sock_put(&socket_, &fd, pool_) != APR_SUCCESS) {
+        if (fd >= 0) ::close(fd);
+        fail("Could not create a socket", false);
+        return;
+      }
+      apr_socket_timeout_set(socket_, 0);
+      status = ::connect(fd, reinterpret_cast<sockaddr*>(&address),
+                         sizeof(address)) == 0
+                   ? APR_SUCCESS
+                   : APR_FROM_OS_ERROR(errno);
+    } else {
+      apr_sockaddr_t* address = nullptr;
+      status = apr_sockaddr_info_get(&address, origin_.host.c_str(),
+                                     APR_UNSPEC, origin_.port, 0, pool_);
+      if (status == APR_SUCCESS) {
+        status = apr_socket_create(&socket_, address->family, SOCK_STREAM,
+                                   APR_PROTO_TCP, pool_);
+      }
+      if (status != APR_SUCCESS) {
+        fail(describe("Could not resolve or create a socket for", status),
+             false);
+        return;
+      }
+      apr_socket_timeout_set(socket_, 0);
+      apr_socket_opt_set(socket_, APR_TCP_NODELAY, 1);
+      status = apr_socket_connect(socket_, address);
+    }
+
+    if (status == APR_SUCCESS) {
+      state_ = State::IDLE;
+      send();
+    } else if (APR_STATUS_IS_EINPROGRESS(status) ||
+               APR_STATUS_IS_EAGAIN(status)) {
+      state_ = State::CONNECTING;
+      loop_.watch(socket_, APR_POLLOUT, *this);
+    } else {
+      fail(describe("Could not connect to", status), false);
+    }
+  }
+
+  void on_connected(apr_int16_t) {
+    apr_os_sock_t fd;
+    int error = 0;
+    socklen_t size = sizeof(error);
+    if (apr_os_sock_get(&fd, socket_) != APR_SUCCESS ||
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &size) != 0) {
+      error = errno;
+    }
+    if (error != 0) {
+      fail(describe("Could not connect to", APR_FROM_OS_ERROR(error)), false);
+      return;
+    }
+
+    state_ = State::IDLE;
+    if (current_) {
+      send();
+    } else {
+      loop_.watch(socket_, APR_POLLIN, *this);
+    }
+  }
+
+  void send() {
+    state_ = State::WRITING;
+    written_ = 0;
+    parser_.reset();
+    write_some();
+  }
+
+  void write_some() {
+    const std::string& bytes = current_->bytes;
+    while (written_ < bytes.size()) {
+      apr_size_t size = bytes.size() - written_;
+      const apr_status_t status =
+          apr_socket_send(socket_, bytes.data() + written_, &size);
+      written_ += size;
+      if (APR_STATUS_IS_EAGAIN(status)) {
+        loop_.watch(socket_, APR_POLLOUT, *this);
+        return;
+      }
+      if (status != APR_SUCCESS) {
+        // A reused connection may have been closed by the Agent.
+        fail(describe("Could not send a request to", status), is_reused_);
+        return;
+      }
+    }
+
+    state_ = State::READING;
+    loop_.watch(socket_, APR_POLLIN, *this);
+  }
+
+  void read_some() {
+    char buffer[k_read_size];
+    for (;;) {
+      apr_size_t size = sizeof(buffer);
+      const apr_status_t status = apr_socket_recv(socket_, buffer, &size);
+
+      if (size != 0) {
+        switch (parser_.feed({buffer, size})) {
+          case ResponseParser::Result::COMPLETE:
+            complete();
+            return;
+          case ResponseParser::Result::INVALID:
+            fail("Invalid HTTP response from " + address(), false);
+            return;
+          case ResponseParser::Result::INCOMPLETE:
+            break;
+        }
+      }
+
+      if (APR_STATUS_IS_EAGAIN(status)) return;
+      if (status != APR_SUCCESS) {
+        if (APR_STATUS_IS_EOF(status) &&
+            parser_.finish() == ResponseParser::Result::COMPLETE) {
+          complete();
+          return;
+        }
+        fail(describe("Connection closed by", status),
+             is_reused_ && !parser_.received_anything());
+        return;
+      }
+    }
+  }
+
+  void complete() {
+    loop_.cancel_timer(deadline_timer_);
+    PendingRequest request = std::move(*current_);
+    current_.reset();
+
+    if (parser_.keep_alive) {
+      state_ = State::IDLE;
+      is_reused_ = true;
+      loop_.watch(socket_, APR_POLLIN, *this);
+    } else {
+      close();
+    }
+
+    request.on_response(parser_.status, ResponseHeaders{parser_.headers},
+                        std::move(parser_.body));
+    on_request_done_();
+    pump();
+  }
+
+  void fail(const std::string& message, bool retry) {
+    loop_.cancel_timer(deadline_timer_);
+    close();
+
+    PendingRequest request = std::move(*current_);
+    current_.reset();
+
+    if (retry && !request.retried) {
+      request.retried = true;
+      queue_.emplace_front(std::move(request));
+    } else {
+      request.on_error(Error{Error::OTHER, message});
+      on_request_done_();
+    }
+
+    pump();
+  }
+
+  void on_timeout(std::uint64_t serial) {
+    if (!current_ || serial != current_serial_) return;
+    fail(fmt::format("Request to {} timed out", address()), false);
+  }
+
+  std::string address() const {
+    return origin_.is_unix ? "unix://" + origin_.host : origin_.host_header;
+  }
+
+  std::string describe(std::string_view what, apr_status_t status) const {
+    char reason[256];
+    apr_strerror(status, reason, sizeof(reason));
+    return fmt::format("{} {}: {}", what, address(), reason);
+  }
+};
+
+}  // namespace
+
+struct AprHTTPClient::State final {
+  EventLoop& loop;
+
+  // Loop thread only.
+  std::unordered_map<std::string, std::shared_ptr<Connection>> connections;
+
+  std::mutex mutex;
+  std::condition_variable drained;
+  std::size_t pending = 0;
+
+  explicit State(EventLoop& loop) : loop(loop) {}
+
+  void on_request_done() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--pending == 0) drained.notify_all();
+  }
+};
+
+AprHTTPClient::AprHTTPClient(std::shared_ptr<EventLoop> loop)
+    : loop_(std::move(loop)), state_(std::make_shared<State>(*loop_)) {}
+
+AprHTTPClient::~AprHTTPClient() {
+  // Connections are closed on the loop thread, which owns them.
+  loop_->post([state = std::move(state_)] {});
+}
+
+Expected<void> AprHTTPClient::post(
+    const URL& url, HeadersSetter set_headers, std::string body,
+    ResponseHandler on_response, ErrorHandler on_error,
+    std::chrono::steady_clock::time_point deadline) {
+  auto origin = parse_origin(url);
+  if (!origin) {
+    return Error{Error::URL_UNSUPPORTED_SCHEME,
+                 fmt::format("Unsupported Datadog Agent URL \"{}://{}\": "
+                             "only http:// and unix:// are supported",
+                             url.scheme, url.authority)};
+  }
+
+  PendingRequest request;
+  request.bytes = fmt::format(
+      "POST {} HTTP/1.1\r\nHost: {}\r\nContent-Length: {}\r\n",
+      url.path.empty() ? "/" : url.path, origin->host_header, body.size());
+  RequestHeaderWriter writer{request.bytes};
+  set_headers(writer);
+  request.bytes += "\r\n";
+  request.bytes += body;
+  request.on_response = std::move(on_response);
+  request.on_error = std::move(on_error);
+  request.deadline = deadline;
+
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    ++state_->pending;
+  }
+
+  loop_->post([state = state_, key = url.scheme + "://" + url.authority,
+               origin = std::move(*origin),
+               request = std::move(request)]() mutable {
+    auto& connection = state->connections[key];
+    if (connection == nullptr) {
+      connection = std::make_shared<Connection>(
+          state->loop, std::move(origin),
+          [raw = state.get()] { raw->on_request_done(); });
+    }
+    connection->enqueue(std::move(request));
+  });
+
+  return nullopt;
+}
+
+void AprHTTPClient::drain(std::chrono::steady_clock::time_point deadline) {
+  // Handlers run on the loop thread: waiting there would never end.
+  if (loop_->in_loop_thread()) return;
+
+  std::unique_lock<std::mutex> lock(state_->mutex);
+  state_->drained.wait_until(lock, deadline,
+                             [&] { return state_->pending == 0; });
+}
+
+std::string AprHTTPClient::config() const {
+  return R"({"type":"httpd_datadog::AprHTTPClient"})";
+}
+
+}  // namespace datadog::tracing
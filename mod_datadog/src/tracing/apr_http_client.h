@@ -0,0 +1,46 @@
+#pragma once
+
+#include <datadog/http_client.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "event_loop.h"
+
+namespace datadog::tracing {
+
+// HTTP/1.1 client sending requests to the Datadog Agent from an `EventLoop`
+// thread, over TCP (`http://`) or a Unix domain socket (`unix://`).
+//
+// Connections are kept alive and reused, one per Agent address. Requests to
+// the same address are sent one after the other. A request failing on a
+// reused connection before any response byte is received is retried once on
+// a new connection, as the Agent may have closed it in the meantime.
+// Responses are parsed by a `ResponseParser`: bodies over 1 MB fail the
+// request.
+//
+// TLS is not supported: `https://` URLs are rejected.
+class AprHTTPClient final : public HTTPClient {
+ public:
+  struct State;
+
+ private:
+  std::shared_ptr<EventLoop> loop_;
+  std::shared_ptr<State> state_;
+
+ public:
+  explicit AprHTTPClient(std::shared_ptr<EventLoop> loop);
+  ~AprHTTPClient();
+
+  Expected<void> post(const URL& url, HeadersSetter set_headers,
+                      std::string body, ResponseHandler on_response,
+                      ErrorHandler on_error,
+                      std::chrono::steady_clock::time_point deadline) override;
+
+  void drain(std::chrono::steady_clock::time_point deadline) override;
+
+  std::string config() const override;
+};
+
+}  // namespace datadog::tracing
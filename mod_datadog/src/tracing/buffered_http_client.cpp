@@ -0,0 +1,399 @@
+#include "buffered_http_client.h"
+
+#include <datadog/dict_writer.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "status/scoreboard.h"
+
+namespace datadog::tracing {
+namespace {
+
+constexpr std::chrono::seconds k_min_backoff{1};
+constexpr std::chrono::seconds k_max_backoff{32};
+
+// How often payloads held back by a backoff, and spooled ones, are
+// reconsidered.
+constexpr std::chrono::milliseconds k_resume_interval{250};
+
+// Timeout of the payloads replayed from the spool.
+constexpr std::chrono::seconds k_replay_timeout{2};
+
+bool ends_with(std::string_view value, std::string_view suffix) {
+  return value.size() >= suffix.size() &&
+         value.substr(value.size() - suffix.size()) == suffix;
+}
+
+bool is_failure(int status) { return status == 429 || status >= 500; }
+
+bool is_success(int status) { return status >= 200 && status < 300; }
+
+// Remember the number of traces of a payload from its headers, and the
+// headers themselves if they are to be spooled.
+class HeaderRecorder final : public DictWriter {
+  std::uint64_t& trace_count_;
+  std::vector<std::pair<std::string, std::string>>* headers_;
+
+ public:
+  HeaderRecorder(std::uint64_t& trace_count,
+                 std::vector<std::pair<std::string, std::string>>* headers)
+      : trace_count_(trace_count), headers_(headers) {}
+
+  void set(StringView key, StringView value) override {
+    if (key == "X-Datadog-Trace-Count") {
+      trace_count_ = std::strtoull(std::string(value).c_str(), nullptr, 10);
+    }
+    if (headers_ != nullptr) headers_->emplace_back(key, value);
+  }
+};
+
+struct Payload final {
+  HTTPClient::URL url;
+  HTTPClient::HeadersSetter set_headers;
+  std::string body;
+  HTTPClient::ResponseHandler on_response;
+  HTTPClient::ErrorHandler on_error;
+  std::chrono::steady_clock::duration timeout;
+  std::uint64_t trace_count = 0;
+  std::vector<std::pair<std::string, std::string>> headers;  ///< If spooled
+  std::optional<std::uint64_t> spool_offset;  ///< If replayed from the spool
+};
+
+Payload make_payload(Spool::Lease lease) {
+  Spool::Record& record = lease.record;
+  Payload payload;
+  payload.url = std::move(record.url);
+  payload.set_headers = [headers = record.headers](DictWriter& writer) {
+    for (const auto& [name, value] : headers) writer.set(name, value);
+  };
+  payload.body = std::move(record.body);
+  payload.timeout = k_replay_timeout;
+  payload.trace_count = record.trace_count;
+  payload.headers = std::move(record.headers);
+  payload.spool_offset = lease.offset;
+  return payload;
+}
+
+}  // namespace
+
+struct BufferedHTTPClient::State final {
+  std::shared_ptr<HTTPClient> next;
+  conf::TraceBuffer conf;
+  Spool* spool = nullptr;
+
+  std::mutex mutex;
+  std::condition_variable done;
+  std::deque<Payload> queue;
+  std::size_t queued_bytes = 0;
+  bool in_flight = false;
+  bool draining = false;
+  std::chrono::steady_clock::duration backoff{0};
+  std::chrono::steady_clock::time_point resume_at;
+
+  // Forward the oldest payload, or replay one from the spool, unless one is
+  // in flight or the Agent is being backed off.
+  static void send_next(const std::shared_ptr<State>& state);
+  void finish(bool failed);
+
+  // Keep a payload the Agent could not take in the spool, if any, or drop
+  // it. Return whether it was kept.
+  bool keep(const Spool::Record& record);
+  bool keep(const Payload& payload);
+
+  // Leave a replayed payload the Agent could not take at the head of the
+  // spool, unless it has been attempted too many times.
+  void retry(std::uint64_t spool_offset, std::uint64_t trace_count);
+};
+
+void BufferedHTTPClient::State::send_next(const std::shared_ptr<State>& state) {
+  Payload payload;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->in_flight) return;
+
+    const auto now = std::chrono::steady_clock::now();
+    if (!state->draining && now < state->resume_at) return;
+
+    if (!state->queue.empty()) {
+      payload = std::move(state->queue.front());
+      state->queue.pop_front();
+      state->queued_bytes -= payload.body.size();
+      status::subtract(status::Counter::buffer_bytes, payload.body.size());
+    } else if (state->spool != nullptr && !state->draining) {
+      auto lease = state->spool->peek(now);
+      if (!lease) return;
+      payload = make_payload(std::move(*lease));
+    } else {
+      return;
+    }
+    state->in_flight = true;
+  }
+
+  // A copy of the payload, to spool it if the Agent cannot take it. Replayed
+  // payloads stay in the spool until the Agent takes them.
+  std::shared_ptr<Spool::Record> retained;
+  if (state->spool != nullptr && !payload.spool_offset) {
+    retained = std::make_shared<Spool::Record>();
+    retained->url = payload.url;
+    retained->headers = std::move(payload.headers);
+    retained->body = payload.body;
+    retained->trace_count = payload.trace_count;
+  }
+
+  auto on_response = [state, retained, spool_offset = payload.spool_offset,
+                      trace_count = payload.trace_count,
+                      on_response = std::move(payload.on_response)](
+                         int status_code, const DictReader& headers,
+                         std::string body) {
+    const bool failed = is_failure(status_code);
+    state->finish(failed);
+    if (failed && spool_offset) {
+      state->retry(*spool_offset, trace_count);
+    } else if (failed && retained != nullptr) {
+      state->keep(*retained);
+    } else {
+      if (spool_offset) state->spool->commit(*spool_offset);
+      if (!is_success(status_code)) {
+        // Rejected for good, e.g. too large: sending it again would not
+        // help.
+        status::add(status::Counter::traces_dropped, trace_count);
+      } else if (spool_offset) {
+        status::add(status::Counter::spool_replayed);
+      }
+    }
+    if (on_response) on_response(status_code, headers, std::move(body));
+    // Unless backing off, the next payload goes out right away.
+    send_next(state);
+  };
+
+  // Invoked either by the wrapped client or below, if it rejects the request.
+  auto on_error = std::make_shared<ErrorHandler>(
+      [state, retained, spool_offset = payload.spool_offset,
+       trace_count = payload.trace_count,
+       on_error = std::move(payload.on_error)](Error error) {
+        state->finish(true);
+        if (spool_offset) {
+          state->retry(*spool_offset, trace_count);
+        } else if (retained != nullptr) {
+          state->keep(*retained);
+        }
+        if (on_error) on_error(std::move(error));
+        send_next(state);
+      });
+
+  auto result = state->next->post(
+      payload.url, std::move(payload.set_headers), std::move(payload.body),
+      std::move(on_response),
+      [on_error](Error error) { (*on_error)(std::move(error)); },
+      std::chrono::steady_clock::now() + payload.timeout);
+  if (auto* error = result.if_error()) (*on_error)(*error);
+}
+
+void BufferedHTTPClient::State::finish(bool failed) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    in_flight = false;
+    if (failed) {
+      backoff = backoff.count() == 0
+                    ? std::chrono::steady_clock::duration{k_min_backoff}
+                    : std::min<std::chrono::steady_clock::duration>(
+                          backoff * 2, k_max_backoff);
+      resume_at = std::chrono::steady_clock::now() + backoff;
+    } else {
+      backoff = std::chrono::steady_clock::duration{0};
+      resume_at = std::chrono::steady_clock::time_point{};
+    }
+  }
+  done.notify_all();
+  if (failed) status::add(status::Counter::export_backoffs);
+}
+
+bool BufferedHTTPClient::State::keep(const Spool::Record& record) {
+  if (spool == nullptr || !spool->push(record)) {
+    status::add(status::Counter::buffer_dropped_payloads);
+    status::add(status::Counter::buffer_dropped_traces, record.trace_count);
+    status::add(status::Counter::traces_dropped, record.trace_count);
+    return false;
+  }
+
+  status::add(status::Counter::spool_written);
+  return true;
+}
+
+void BufferedHTTPClient::State::retry(std::uint64_t spool_offset,
+                                      std::uint64_t trace_count) {
+  if (spool->release(spool_offset)) return;
+
+  status::add(status::Counter::spool_dropped);
+  status::add(status::Counter::traces_dropped, trace_count);
+}
+
+bool BufferedHTTPClient::State::keep(const Payload& payload) {
+  Spool::Record record;
+  if (spool != nullptr) {
+    record.url = payload.url;
+    record.headers = payload.headers;
+    record.body = payload.body;
+  }
+  record.trace_count = payload.trace_count;
+  return keep(record);
+}
+
+BufferedHTTPClient::BufferedHTTPClient(std::shared_ptr<HTTPClient> next,
+                                       EventScheduler& scheduler,
+                                       const conf::TraceBuffer& conf,
+                                       Spool* spool)
+    : state_(std::make_shared<State>()) {
+  state_->next = std::move(next);
+  state_->conf = conf;
+  state_->spool = spool;
+
+  // Payloads queued behind a request in flight are sent by its handlers.
+  // Those held back by a backoff, and spooled ones, are sent from here.
+  cancel_resume_ = scheduler.schedule_recurring_event(
+      k_resume_interval, [weak_state = std::weak_ptr<State>(state_)] {
+        if (auto state = weak_state.lock()) State::send_next(state);
+      });
+}
+
+BufferedHTTPClient::~BufferedHTTPClient() { cancel_resume_(); }
+
+Expected<void> BufferedHTTPClient::post(
+    const URL& url, HeadersSetter set_headers, std::string body,
+    ResponseHandler on_response, ErrorHandler on_error,
+    std::chrono::steady_clock::time_point deadline) {
+  if (!ends_with(url.path, "/traces")) {
+    return state_->next->post(url, std::move(set_headers), std::move(body),
+                              std::move(on_response), std::move(on_error),
+                              deadline);
+  }
+
+  if (state_->conf.max_bytes == 0) {
+    // Without a buffer, the traces of a payload the Agent did not take are
+    // lost. Counted once, whichever handler reports it.
+    std::uint64_t trace_count = 0;
+    HeaderRecorder recorder{trace_count, nullptr};
+    set_headers(recorder);
+    auto dropped = std::make_shared<std::once_flag>();
+    auto drop = [dropped, trace_count] {
+      std::call_once(*dropped, [trace_count] {
+        status::add(status::Counter::traces_dropped, trace_count);
+      });
+    };
+
+    auto result = state_->next->post(
+        url, std::move(set_headers), std::move(body),
+        [drop, on_response = std::move(on_response)](
+            int status_code, const DictReader& headers, std::string body) {
+          if (!is_success(status_code)) drop();
+          if (on_response) on_response(status_code, headers, std::move(body));
+        },
+        [drop, on_error = std::move(on_error)](Error error) {
+          drop();
+          if (on_error) on_error(std::move(error));
+        },
+        deadline);
+    if (result.if_error()) drop();
+    return result;
+  }
+
+  Payload payload;
+  HeaderRecorder recorder{
+      payload.trace_count,
+      state_->spool != nullptr ? &payload.headers : nullptr};
+  set_headers(recorder);
+
+  payload.url = url;
+  payload.set_headers = std::move(set_headers);
+  payload.body = std::move(body);
+  payload.on_response = std::move(on_response);
+  payload.on_error = std::move(on_error);
+  payload.timeout = std::max<std::chrono::steady_clock::duration>(
+      deadline - std::chrono::steady_clock::now(),
+      std::chrono::steady_clock::duration{0});
+
+  const std::size_t size = payload.body.size();
+  std::vector<Payload> evicted;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    const auto& conf = state_->conf;
+    if (size > conf.max_bytes ||
+        (conf.policy == conf::TraceBuffer::Policy::drop_new &&
+         state_->queued_bytes + size > conf.max_bytes)) {
+      if (state_->keep(payload)) return nullopt;
+      return Error{Error::OTHER,
+                   "Trace buffer is full: dropping the new payload"};
+    }
+
+    while (state_->queued_bytes + size > conf.max_bytes) {
+      state_->queued_bytes -= state_->queue.front().body.size();
+      evicted.emplace_back(std::move(state_->queue.front()));
+      state_->queue.pop_front();
+    }
+
+    state_->queued_bytes += size;
+    state_->queue.emplace_back(std::move(payload));
+  }
+  status::add(status::Counter::buffer_bytes, size);
+
+  for (auto& dropped : evicted) {
+    status::subtract(status::Counter::buffer_bytes, dropped.body.size());
+    if (!state_->keep(dropped)) {
+      dropped.on_error(Error{
+          Error::OTHER, "Trace buffer is full: dropping the oldest payload"});
+    }
+  }
+
+  State::send_next(state_);
+  return nullopt;
+}
+
+void BufferedHTTPClient::drain(std::chrono::steady_clock::time_point deadline) {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->draining = true;
+  }
+
+  for (;;) {
+    State::send_next(state_);
+
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    if (!state_->done.wait_until(lock, deadline, [&] {
+          return !state_->in_flight;
+        })) {
+      break;
+    }
+    if (state_->queue.empty()) break;
+  }
+
+  // Payloads that could not be sent in time are left to the other children.
+  if (state_->spool != nullptr) {
+    std::deque<Payload> left;
+    {
+      std::lock_guard<std::mutex> lock(state_->mutex);
+      left.swap(state_->queue);
+      state_->queued_bytes = 0;
+    }
+    for (const auto& payload : left) {
+      status::subtract(status::Counter::buffer_bytes, payload.body.size());
+      state_->keep(payload);
+    }
+  }
+
+  state_->next->drain(deadline);
+}
+
+std::string BufferedHTTPClient::config() const {
+  return state_->next->config();
+}
+
+}  // namespace datadog::tracing
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <datadog/event_scheduler.h>
+#include <datadog/http_client.h>
+
+#include <memory>
+#include <string>
+
+#include "conf.h"
+#include "spool.h"
+
+namespace datadog::tracing {
+
+// HTTP client decorator holding trace payloads in memory, within a byte
+// budget, while the Datadog Agent is slow or unreachable.
+//
+// Payloads sent to `/traces` are queued and forwarded one at a time. Once the
+// budget is reached, the oldest queued payload or the new one is dropped,
+// depending on the policy. After a failed request or a response telling the
+// Agent is overloaded, payloads are held back for a delay doubling from 1 up
+// to 32 seconds, and reset by the first successful request. Other requests
+// (telemetry, remote configuration, stats) are forwarded as they come.
+//
+// With a `Spool`, payloads dropped from the budget or that the Agent could
+// not take are written to it instead, and replayed in order whenever nothing
+// else is waiting to be sent. A replayed payload stays at the head of the
+// spool until the Agent takes it, and is dropped after 5 failed attempts. A
+// successful replay ends the backoff like any other request, so the spool
+// drains as soon as the Agent is back.
+//
+// Queued bytes, dropped payloads and traces, backoffs and spooled payloads
+// are reported in the scoreboard.
+class BufferedHTTPClient final : public HTTPClient {
+ public:
+  struct State;
+
+ private:
+  std::shared_ptr<State> state_;
+  EventScheduler::Cancel cancel_resume_;
+
+ public:
+  // @param spool  Spool shared by the children of the host, or `nullptr`
+  BufferedHTTPClient(std::shared_ptr<HTTPClient> next,
+                     EventScheduler& scheduler, const conf::TraceBuffer& conf,
+                     Spool* spool);
+  ~BufferedHTTPClient();
+
+  Expected<void> post(const URL& url, HeadersSetter set_headers,
+                      std::string body, ResponseHandler on_response,
+                      ErrorHandler on_error,
+                      std::chrono::steady_clock::time_point deadline) override;
+
+  // Send the queued payloads regardless of the backoff, then drain the
+  // wrapped client.
+  void drain(std::chrono::steady_clock::time_point deadline) override;
+
+  std::string config() const override;
+};
+
+}  // namespace datadog::tracing
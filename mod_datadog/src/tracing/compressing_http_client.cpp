@@ -0,0 +1,56 @@
+#include "compressing_http_client.h"
+
+#include <datadog/dict_writer.h>
+
+#include <string_view>
+
+#include "status/scoreboard.h"
+
+namespace datadog::tracing {
+namespace {
+
+bool is_traces_path(std::string_view path) {
+  constexpr std::string_view suffix = "/traces";
+  return path.size() >= suffix.size() &&
+         path.substr(path.size() - suffix.size()) == suffix;
+}
+
+}  // namespace
+
+CompressingHTTPClient::CompressingHTTPClient(
+    std::shared_ptr<HTTPClient> next, const conf::TraceCompression& conf)
+    : next_(std::move(next)),
+      conf_(conf),
+      level_(conf.level.value_or(default_level(conf.codec))) {}
+
+Expected<void> CompressingHTTPClient::post(
+    const URL& url, HeadersSetter set_headers, std::string body,
+    ResponseHandler on_response, ErrorHandler on_error,
+    std::chrono::steady_clock::time_point deadline) {
+  if (body.size() >= conf_.min_bytes && is_traces_path(url.path)) {
+    const auto start = std::chrono::steady_clock::now();
+    auto compressed = compress(conf_.codec, level_, body);
+    status::add(status::Counter::compression_time_us,
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count());
+
+    if (compressed && compressed->size() < body.size()) {
+      status::add(status::Counter::compressed_payloads);
+      status::add(status::Counter::compression_saved_bytes,
+                  body.size() - compressed->size());
+      body = std::move(*compressed);
+      set_headers = [set_headers = std::move(set_headers),
+                     encoding = content_encoding(conf_.codec)](
+                        DictWriter& headers) {
+        set_headers(headers);
+        headers.set("Content-Encoding", encoding);
+      };
+    }
+  }
+
+  return next_->post(url, std::move(set_headers), std::move(body),
+                     std::move(on_response), std::move(on_error), deadline);
+}
+
+}  // namespace datadog::tracing
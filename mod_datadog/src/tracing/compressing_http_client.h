@@ -0,0 +1,39 @@
+#pragma once
+
+#include <datadog/http_client.h>
+
+#include <memory>
+#include <string>
+
+#include "compression.h"
+
+namespace datadog::tracing {
+
+// HTTP client decorator compressing the trace payloads sent to `/traces`,
+// and telling the Datadog Agent with a `Content-Encoding` header.
+//
+// Payloads under the size threshold, and those that would not get smaller,
+// are sent as they are. Compressed payloads, the bytes saved and the time
+// spent compressing are reported in the scoreboard.
+class CompressingHTTPClient final : public HTTPClient {
+  std::shared_ptr<HTTPClient> next_;
+  conf::TraceCompression conf_;
+  int level_;
+
+ public:
+  CompressingHTTPClient(std::shared_ptr<HTTPClient> next,
+                        const conf::TraceCompression& conf);
+
+  Expected<void> post(const URL& url, HeadersSetter set_headers,
+                      std::string body, ResponseHandler on_response,
+                      ErrorHandler on_error,
+                      std::chrono::steady_clock::time_point deadline) override;
+
+  void drain(std::chrono::steady_clock::time_point deadline) override {
+    next_->drain(deadline);
+  }
+
+  std::string config() const override { return next_->config(); }
+};
+
+}  // namespace datadog::tracing
@@ -0,0 +1,124 @@
+#include "compression.h"
+
+#include <zlib.h>
+
+#if defined(HTTPD_DD_ZSTD)
+#include <zstd.h>
+#endif
+
+namespace datadog::tracing {
+namespace {
+
+// Window of 2^15 bytes, plus 16 for a gzip header and trailer rather than a
+// zlib one.
+constexpr int k_gzip_window_bits = 15 + 16;
+constexpr int k_gzip_memory_level = 8;
+
+std::optional<std::string> gzip(int level, std::string_view data) {
+  z_stream stream{};
+  if (deflateInit2(&stream, level, Z_DEFLATED, k_gzip_window_bits,
+                   k_gzip_memory_level, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return std::nullopt;
+  }
+
+  std::string result;
+  result.resize(deflateBound(&stream, static_cast<uLong>(data.size())));
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream.avail_in = static_cast<uInt>(data.size());
+  stream.next_out = reinterpret_cast<Bytef*>(result.data());
+  stream.avail_out = static_cast<uInt>(result.size());
+
+  // The output buffer is large enough for a single call.
+  const int status = deflate(&stream, Z_FINISH);
+  const uLong size = stream.total_out;
+  deflateEnd(&stream);
+  if (status != Z_STREAM_END) return std::nullopt;
+
+  result.resize(size);
+  return result;
+}
+
+#if defined(HTTPD_DD_ZSTD)
+std::optional<std::string> zstd(int level, std::string_view data) {
+  std::string result;
+  result.resize(ZSTD_compressBound(data.size()));
+  const std::size_t size = ZSTD_compress(result.data(), result.size(),
+                                         data.data(), data.size(), level);
+  if (ZSTD_isError(size)) return std::nullopt;
+
+  result.resize(size);
+  return result;
+}
+#endif
+
+}  // namespace
+
+bool is_supported(Codec codec) {
+  switch (codec) {
+    case Codec::none:
+    case Codec::gzip:
+      return true;
+    case Codec::zstd:
+#if defined(HTTPD_DD_ZSTD)
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+const char* content_encoding(Codec codec) {
+  switch (codec) {
+    case Codec::gzip:
+      return "gzip";
+    case Codec::zstd:
+      return "zstd";
+    case Codec::none:
+      break;
+  }
+  return "identity";
+}
+
+int default_level(Codec codec) {
+  switch (codec) {
+    case Codec::gzip:
+      return 6;
+    case Codec::zstd:
+      return 3;
+    case Codec::none:
+      break;
+  }
+  return 0;
+}
+
+std::pair<int, int> level_range(Codec codec) {
+  switch (codec) {
+    case Codec::gzip:
+      return {1, 9};
+    case Codec::zstd:
+      return {1, 19};
+    case Codec::none:
+      break;
+  }
+  return {0, 0};
+}
+
+std::optional<std::string> compress(Codec codec, int level,
+                                    std::string_view data) {
+  switch (codec) {
+    case Codec::gzip:
+      return gzip(level, data);
+    case Codec::zstd:
+#if defined(HTTPD_DD_ZSTD)
+      return zstd(level, data);
+#else
+      break;
+#endif
+    case Codec::none:
+      break;
+  }
+  return std::nullopt;
+}
+
+}  // namespace datadog::tracing
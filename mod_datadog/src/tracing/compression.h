@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace datadog::tracing {
+namespace conf {
+
+// Compression of the trace payloads sent to a Datadog Agent reached over
+// TCP. Main server only.
+struct TraceCompression final {
+  enum class Codec { none, gzip, zstd };
+
+  Codec codec = Codec::none;
+  // Compression level of the codec. Defaults to `default_level(codec)`.
+  std::optional<int> level;
+  // Payloads smaller than this are sent as they are.
+  std::size_t min_bytes = 1024;
+};
+
+}  // namespace conf
+
+using Codec = conf::TraceCompression::Codec;
+
+// Whether the module was built with `codec`. zstd requires
+// `HTTPD_DATADOG_ENABLE_ZSTD`.
+bool is_supported(Codec codec);
+
+// Value of the `Content-Encoding` header of a payload compressed with
+// `codec`, e.g. "gzip".
+const char* content_encoding(Codec codec);
+
+// Level balancing speed and size: 6 for gzip, 3 for zstd.
+int default_level(Codec codec);
+
+// Range of the levels of `codec`, as a pair of the lowest and highest.
+std::pair<int, int> level_range(Codec codec);
+
+// Compress `data` with `codec` at `level`. Return `std::nullopt` if the codec
+// is not supported or failed.
+std::optional<std::string> compress(Codec codec, int level,
+                                    std::string_view data);
+
+}  // namespace datadog::tracing
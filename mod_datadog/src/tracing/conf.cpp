@@ -18,4 +18,26 @@ void init(TracerConfig& conf, RuntimeID& runtime_id, server_rec* s,
   conf.integration_version = common::utils::make_httpd_version();
 }
 
+void merge(TracerConfig& conf, const TracerConfig& parent) {
+  if (!conf.service) conf.service = parent.service;
+  if (!conf.environment) conf.environment = parent.environment;
+  if (!conf.version) conf.version = parent.version;
+  if (!conf.agent.url) conf.agent.url = parent.agent.url;
+  if (!conf.trace_sampler.sample_rate) {
+    conf.trace_sampler.sample_rate = parent.trace_sampler.sample_rate;
+  }
+  if (!conf.injection_styles) conf.injection_styles = parent.injection_styles;
+  if (!conf.extraction_styles) {
+    conf.extraction_styles = parent.extraction_styles;
+  }
+}
+
+void merge(TailRetention& conf, const TailRetention& parent) {
+  if (!conf.enabled) conf.enabled = parent.enabled;
+  if (!conf.latency_threshold) {
+    conf.latency_threshold = parent.latency_threshold;
+  }
+  if (!conf.base_rate) conf.base_rate = parent.base_rate;
+}
+
 }  // namespace datadog::tracing::conf
@@ -1,8 +1,53 @@
+#pragma once
+
 #include <datadog/tracer_config.h>
 #include <http_core.h>
 
+#include <chrono>
+#include <cstddef>
+#include <optional>
+
 namespace datadog::tracing::conf {
 
+// Keep or drop a trace once its request is done, rather than when its span
+// is created.
+struct TailRetention final {
+  std::optional<bool> enabled;
+  // Requests lasting at least this long are kept.
+  std::optional<std::chrono::milliseconds> latency_threshold;
+  // Probability to keep any other request without an error.
+  std::optional<double> base_rate;
+};
+
+// Trace payloads held in memory while the Datadog Agent is slow or
+// unreachable.
+struct TraceBuffer final {
+  enum class Policy { drop_oldest, drop_new };
+
+  // Budget of pending trace payloads, in bytes. 0 disables the buffer.
+  std::size_t max_bytes = 8 * 1024 * 1024;
+  // Payload dropped once the budget is reached.
+  Policy policy = Policy::drop_oldest;
+};
+
+// Tracing of the requests mod_cache serves from its cache.
+struct CacheHits final {
+  enum class Mode {
+    trace,      ///< Like any other request
+    sample,     ///< Keep `sampling_rate` of their traces
+    aggregate,  ///< Only count them
+  };
+
+  Mode mode = Mode::trace;
+  double sampling_rate = 1.0;
+};
+
+// How request threads hand their finished traces to the tracer.
+enum class SpanCollection {
+  direct,      ///< When the request is destroyed
+  per_thread,  ///< Queued per thread, handed over by the flush task
+};
+
 // Initialize configuration for Tracing
 //
 // @param conf            Tracer configuration
@@ -12,4 +57,12 @@ namespace datadog::tracing::conf {
 void init(TracerConfig& conf, RuntimeID& runtime_id, server_rec* server,
           module* datadog_module);
 
+// Fill the settings a virtual host did not set with the ones of its parent
+// server
+//
+// @param conf    Virtual host tracer configuration
+// @param parent  Parent server tracer configuration
+void merge(TracerConfig& conf, const TracerConfig& parent);
+void merge(TailRetention& conf, const TailRetention& parent);
+
 }  // namespace datadog::tracing::conf
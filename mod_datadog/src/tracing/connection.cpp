@@ -0,0 +1,363 @@
+#include "connection.h"
+
+#include <apr_optional.h>
+#include <apr_pools.h>
+#include <datadog/clock.h>
+#include <datadog/span.h>
+#include <datadog/span_config.h>
+#include <http_config.h>
+#include <util_filter.h>
+
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <optional>
+#include <string>
+
+#include "hooks.h"
+#include "status/scoreboard.h"
+
+// Functions of mod_ssl, as declared by mod_ssl.h.
+APR_DECLARE_OPTIONAL_FN(int, ssl_is_https, (conn_rec*));
+APR_DECLARE_OPTIONAL_FN(char*, ssl_var_lookup,
+                        (apr_pool_t*, server_rec*, conn_rec*, request_rec*,
+                         char*));
+// Function of mod_http2, as declared by mod_http2.h.
+APR_DECLARE_OPTIONAL_FN(char*, http2_var_lookup,
+                        (apr_pool_t*, server_rec*, conn_rec*, request_rec*,
+                         char*));
+
+namespace datadog::tracing {
+namespace {
+
+constexpr const char* k_tls_start_filter = "DATADOG_TLS_START";
+constexpr const char* k_tls_end_filter = "DATADOG_TLS_END";
+
+// `nullptr` if mod_ssl is not loaded.
+APR_OPTIONAL_FN_TYPE(ssl_is_https)* ssl_is_https_fn = nullptr;
+APR_OPTIONAL_FN_TYPE(ssl_var_lookup)* ssl_var_lookup_fn = nullptr;
+// `nullptr` if mod_http2 is not loaded.
+APR_OPTIONAL_FN_TYPE(http2_var_lookup)* http2_var_lookup_fn = nullptr;
+
+// HTTP/2 streams of a connection. Updated by the worker threads serving
+// them, concurrently.
+struct StreamStats final {
+  std::atomic<std::uint64_t> streams{0};
+  std::atomic<std::uint32_t> active{0};
+  std::atomic<std::uint32_t> max_active{0};
+  std::atomic<std::uint64_t> queue_delay_total_us{0};
+  std::atomic<std::uint64_t> queue_delay_max_us{0};
+};
+
+// Span of a connection, allocated from the connection pool.
+//
+// Only the thread serving the connection updates it, except `streams`.
+struct ConnectionSpan final {
+  conn_rec* c;
+  Span* span;
+  apr_time_t start;
+  // Where the span is counted when it finishes, if anywhere.
+  stats::SharedTable* trace_stats;
+  const SpanDefaults* defaults;
+  std::uint64_t requests = 0;
+  apr_time_t last_request_end = 0;  ///< 0 until the first request is done
+  apr_time_t idle_total = 0;
+  apr_time_t idle_max = 0;
+  std::optional<TimePoint> tls_start;  ///< First encrypted byte received
+  StreamStats streams;
+};
+
+// Secondary connection serving an HTTP/2 stream, allocated from its pool.
+struct StreamConnection final {
+  // When a worker thread picked up the stream.
+  apr_time_t start;
+  // Span of the master connection, if connections are traced, or `nullptr`.
+  ConnectionSpan* master;
+};
+
+double to_ms(apr_time_t duration) {
+  return static_cast<double>(duration) / 1000.0;
+}
+
+template <typename T>
+void update_max(std::atomic<T>& max, T value) {
+  T current = max.load(std::memory_order_relaxed);
+  while (current < value &&
+         !max.compare_exchange_weak(current, value,
+                                    std::memory_order_relaxed)) {
+  }
+}
+
+// Local address and port of `c`.
+std::string span_resource(const conn_rec* c) {
+  return std::string(c->local_ip) + ":" + std::to_string(c->local_addr->port);
+}
+
+apr_status_t finish_connection_span(void* data) {
+  auto* connection = static_cast<ConnectionSpan*>(data);
+  Span* span = connection->span;
+
+  span->set_metric("httpd.connection.requests",
+                   static_cast<double>(connection->requests));
+  if (connection->requests > 1) {
+    span->set_metric("httpd.connection.idle_total_ms",
+                     to_ms(connection->idle_total));
+    span->set_metric("httpd.connection.idle_max_ms",
+                     to_ms(connection->idle_max));
+  }
+  // Time kept open after the last request, until the client or
+  // `KeepAliveTimeout` closed it.
+  if (connection->last_request_end != 0) {
+    span->set_metric("httpd.connection.idle_before_close_ms",
+                     to_ms(apr_time_now() - connection->last_request_end));
+  }
+  if (connection->c->aborted) span->set_tag("httpd.connection.aborted", "true");
+
+  const StreamStats& streams = connection->streams;
+  if (const auto count = streams.streams.load(); count != 0) {
+    span->set_metric("http2.streams", static_cast<double>(count));
+    span->set_metric("http2.streams.max_concurrent",
+                     static_cast<double>(streams.max_active.load()));
+    span->set_metric(
+        "http2.stream.queue_delay_avg_ms",
+        to_ms(static_cast<apr_time_t>(streams.queue_delay_total_us.load() /
+                                      count)));
+    span->set_metric(
+        "http2.stream.queue_delay_max_ms",
+        to_ms(static_cast<apr_time_t>(streams.queue_delay_max_us.load())));
+  }
+
+  if (connection->trace_stats != nullptr) {
+    record_span_stats(*connection->trace_stats, *connection->defaults,
+                      "httpd.connection", span_resource(connection->c),
+                      "server",
+                      std::chrono::microseconds(apr_time_now() -
+                                                connection->start));
+  }
+
+  delete span;
+  status::add(status::Counter::spans_finished);
+  return APR_SUCCESS;
+}
+
+// Below mod_ssl: sees the first bytes of the TLS handshake.
+apr_status_t tls_start_filter(ap_filter_t* f, apr_bucket_brigade* bb,
+                              ap_input_mode_t mode, apr_read_type_e block,
+                              apr_off_t readbytes) {
+  const apr_status_t result =
+      ap_get_brigade(f->next, bb, mode, block, readbytes);
+  if (result == APR_SUCCESS && !APR_BRIGADE_EMPTY(bb)) {
+    static_cast<ConnectionSpan*>(f->ctx)->tls_start = default_clock();
+    ap_remove_input_filter(f);
+  }
+  return result;
+}
+
+std::string ssl_variable(conn_rec* c, const char* name) {
+  std::string variable{name};
+  const char* value = ssl_var_lookup_fn(c->pool, c->base_server, c, nullptr,
+                                        variable.data());
+  return value != nullptr ? value : "";
+}
+
+// Above mod_ssl: sees the first decrypted bytes, once the handshake is done.
+apr_status_t tls_end_filter(ap_filter_t* f, apr_bucket_brigade* bb,
+                            ap_input_mode_t mode, apr_read_type_e block,
+                            apr_off_t readbytes) {
+  const apr_status_t result =
+      ap_get_brigade(f->next, bb, mode, block, readbytes);
+  if (result != APR_SUCCESS) return result;
+
+  auto* connection = static_cast<ConnectionSpan*>(f->ctx);
+  ap_remove_input_filter(f);
+  if (!connection->tls_start) return result;
+
+  SpanConfig options;
+  options.name = "httpd.tls.handshake";
+  options.start = *connection->tls_start;
+  Span handshake = connection->span->create_child(options);
+  status::add(status::Counter::spans_started);
+  if (ssl_var_lookup_fn != nullptr) {
+    handshake.set_tag("tls.protocol", ssl_variable(f->c, "SSL_PROTOCOL"));
+    handshake.set_tag(
+        "tls.session.resumed",
+        ssl_variable(f->c, "SSL_SESSION_RESUMED") == "Resumed" ? "true"
+                                                                : "false");
+  }
+
+  const std::chrono::duration<double, std::milli> duration =
+      std::chrono::steady_clock::now() - connection->tls_start->tick;
+  connection->span->set_metric("httpd.tls.handshake_duration_ms",
+                               duration.count());
+  // Finished as it goes out of scope.
+  status::add(status::Counter::spans_finished);
+  return result;
+}
+
+void retrieve_optional_functions() {
+  ssl_is_https_fn = APR_RETRIEVE_OPTIONAL_FN(ssl_is_https);
+  ssl_var_lookup_fn = APR_RETRIEVE_OPTIONAL_FN(ssl_var_lookup);
+  http2_var_lookup_fn = APR_RETRIEVE_OPTIONAL_FN(http2_var_lookup);
+}
+
+apr_status_t finish_stream(void* data) {
+  auto* stream = static_cast<StreamConnection*>(data);
+  stream->master->streams.active.fetch_sub(1, std::memory_order_relaxed);
+  return APR_SUCCESS;
+}
+
+// Secondary connections are set up by the worker thread which picked up
+// their stream.
+int on_pre_stream_connection(conn_rec* c, module* datadog_module) {
+  auto* master = static_cast<ConnectionSpan*>(
+      ap_get_module_config(c->master->conn_config, datadog_module));
+
+  void* buffer = apr_palloc(c->pool, sizeof(StreamConnection));
+  auto* stream = new (buffer) StreamConnection{apr_time_now(), master};
+  ap_set_module_config(c->conn_config, datadog_module, stream);
+
+  if (master != nullptr) {
+    StreamStats& streams = master->streams;
+    const auto active =
+        streams.active.fetch_add(1, std::memory_order_relaxed) + 1;
+    update_max(streams.max_active, active);
+    apr_pool_cleanup_register(c->pool, stream, finish_stream,
+                              apr_pool_cleanup_null);
+  }
+  return OK;
+}
+
+// Tag the span of `r`, served on the secondary connection of an HTTP/2
+// stream, and count the stream in the span of its master connection.
+void record_stream_request(request_rec* r, Span* span,
+                           module* datadog_module) {
+  const auto* stream = static_cast<const StreamConnection*>(
+      ap_get_module_config(r->connection->conn_config, datadog_module));
+  if (stream == nullptr) return;
+
+  // Requests of streams are dated when their headers were received by the
+  // master connection.
+  const apr_time_t queue_delay =
+      stream->start > r->request_time ? stream->start - r->request_time : 0;
+
+  if (span != nullptr) {
+    span->set_metric("http2.stream.queue_delay_ms", to_ms(queue_delay));
+    span->set_tag("http2.connection.id",
+                  std::to_string(r->connection->master->id));
+    if (http2_var_lookup_fn != nullptr) {
+      char name[] = "H2_STREAM_ID";
+      if (const char* id = http2_var_lookup_fn(r->pool, r->server,
+                                               r->connection, r, name);
+          id != nullptr && *id != '\0') {
+        span->set_tag("http2.stream.id", id);
+      }
+    }
+    if (stream->master != nullptr) {
+      span->set_tag("httpd.connection.span_id",
+                    std::to_string(stream->master->span->id()));
+    }
+  }
+
+  if (stream->master != nullptr) {
+    StreamStats& streams = stream->master->streams;
+    streams.streams.fetch_add(1, std::memory_order_relaxed);
+    const auto delay_us = static_cast<std::uint64_t>(queue_delay);
+    streams.queue_delay_total_us.fetch_add(delay_us,
+                                           std::memory_order_relaxed);
+    update_max(streams.queue_delay_max_us, delay_us);
+  }
+}
+
+}  // namespace
+
+void register_connection_hooks() {
+  ap_hook_optional_fn_retrieve(retrieve_optional_functions, NULL, NULL,
+                               APR_HOOK_MIDDLE);
+  // mod_ssl filters at AP_FTYPE_CONNECTION + 5.
+  ap_register_input_filter(
+      k_tls_start_filter, tls_start_filter, NULL,
+      static_cast<ap_filter_type>(AP_FTYPE_CONNECTION + 6));
+  ap_register_input_filter(
+      k_tls_end_filter, tls_end_filter, NULL,
+      static_cast<ap_filter_type>(AP_FTYPE_CONNECTION + 4));
+}
+
+int on_pre_connection(conn_rec* c, Tracer& tracer, const SpanDefaults& defaults,
+                      bool connection_tracing, stats::SharedTable* trace_stats,
+                      SharedRateLimiter* rate_limiter,
+                      const LiveControl* live_control, const Governor* governor,
+                      module* datadog_module) {
+  if (c->master != nullptr) {
+    return on_pre_stream_connection(c, datadog_module);
+  }
+  if (!connection_tracing) return DECLINED;
+
+  const LiveControl::State live =
+      live_control != nullptr ? live_control->load() : LiveControl::State{};
+  if (live.settings.tracing_disabled) return DECLINED;
+  // Like subrequests, connections are not traced while the governor sheds.
+  if (governor != nullptr && governor->shedding()) return DECLINED;
+
+  SpanConfig options;
+  options.name = "httpd.connection";
+  options.resource = span_resource(c);
+  options.tags = {{"component", "httpd"},
+                  {"span.kind", "server"},
+                  {"network.client.ip", c->client_ip},
+                  {"network.destination.port",
+                   std::to_string(c->local_addr->port)}};
+
+  auto* span = new Span(tracer.create_span(options));
+  status::add(status::Counter::spans_started);
+  // Connection traces count against the same rates and limit as the traces
+  // of requests.
+  apply_head_sampling(*span, current_sampling_rate(live, governor, false),
+                      rate_limiter);
+
+  void* buffer = apr_palloc(c->pool, sizeof(ConnectionSpan));
+  auto* connection = new (buffer)
+      ConnectionSpan{c, span, apr_time_now(), trace_stats, &defaults};
+  ap_set_module_config(c->conn_config, datadog_module, connection);
+  apr_pool_cleanup_register(c->pool, connection, finish_connection_span,
+                            apr_pool_cleanup_null);
+
+  if (ssl_is_https_fn != nullptr && ssl_is_https_fn(c)) {
+    ap_add_input_filter(k_tls_start_filter, connection, NULL, c);
+    ap_add_input_filter(k_tls_end_filter, connection, NULL, c);
+  }
+  return OK;
+}
+
+void record_connection_request(request_rec* r, module* datadog_module) {
+  if (r->main != nullptr) return;
+
+  auto* span = static_cast<Span*>(
+      ap_get_module_config(r->request_config, datadog_module));
+  if (r->connection->master != nullptr) {
+    record_stream_request(r, span, datadog_module);
+    return;
+  }
+
+  auto* connection = static_cast<ConnectionSpan*>(
+      ap_get_module_config(r->connection->conn_config, datadog_module));
+  if (connection == nullptr) return;
+
+  if (span != nullptr) {
+    span->set_tag("httpd.connection.span_id",
+                  std::to_string(connection->span->id()));
+  }
+
+  ++connection->requests;
+  if (connection->last_request_end != 0 &&
+      r->request_time > connection->last_request_end) {
+    const apr_time_t idle = r->request_time - connection->last_request_end;
+    connection->idle_total += idle;
+    if (idle > connection->idle_max) connection->idle_max = idle;
+    if (span != nullptr) {
+      span->set_metric("httpd.connection.idle_ms", to_ms(idle));
+    }
+  }
+  connection->last_request_end = apr_time_now();
+}
+
+}  // namespace datadog::tracing
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <datadog/span_defaults.h>
+#include <datadog/tracer.h>
+#include <httpd.h>
+
+#include "governor.h"
+#include "live_control.h"
+#include "rate_limiter.h"
+#include "stats.h"
+
+namespace datadog::tracing {
+
+// Spans of client connections, for `DatadogConnectionTracing`.
+//
+// Each connection has a `httpd.connection` span, from its acceptance to its
+// close, in a trace of its own. The TLS handshake done by mod_ssl is a
+// `httpd.tls.handshake` child span, timed by input filters around the one of
+// mod_ssl: from the first encrypted byte received to the first decrypted
+// one. The requests of the connection and the time it spent idle between
+// them are metrics of the connection span, and the span of each request
+// holds the ID of the span of its connection.
+//
+// With mod_http2, each stream is served on a secondary connection, set up
+// by the worker thread which picked the stream up. Whether or not
+// connections are traced, the span of the request of a stream has the
+// stream ID, the ID of the master connection, and the time the stream
+// waited for a worker thread. The span of the master connection has the
+// number of streams, how many were served at once, and their wait times.
+
+// Register the TLS handshake filters, and retrieve the functions of mod_ssl
+// and mod_http2. Called from `register_hooks`.
+void register_connection_hooks();
+
+// Start the span of `c`, or the timing of the HTTP/2 stream `c` serves.
+//
+// @param tracer              Tracer of the default server of `c`
+// @param defaults            Span defaults of `tracer`
+// @param connection_tracing  Whether `DatadogConnectionTracing` is on
+// @param trace_stats         Trace statistics computed by the module, which
+//                            count connection spans, or `nullptr`
+// @param rate_limiter        Server-wide limit of kept traces, or `nullptr`
+// @param live_control        Settings changed while the server runs, or
+//                            `nullptr`
+// @param governor            Overhead governor, or `nullptr`. While it sheds,
+//                            connections are not traced.
+int on_pre_connection(conn_rec* c, Tracer& tracer, const SpanDefaults& defaults,
+                      bool connection_tracing, stats::SharedTable* trace_stats,
+                      SharedRateLimiter* rate_limiter,
+                      const LiveControl* live_control, const Governor* governor,
+                      module* datadog_module);
+
+// Count the top-level request `r` in the span of its connection, and tag the
+// span of `r` with the ID of the connection span, or with its HTTP/2 stream.
+void record_connection_request(request_rec* r, module* datadog_module);
+
+}  // namespace datadog::tracing
@@ -0,0 +1,41 @@
+#include "deferred_spans.h"
+
+#include <chrono>
+
+#include "status/scoreboard.h"
+
+namespace datadog::tracing {
+namespace {
+
+// Latency added to the export of a trace, well below the Agent flush
+// interval.
+constexpr std::chrono::milliseconds k_flush_interval{100};
+
+// Spans queued per request thread between two flushes.
+constexpr std::size_t k_max_spans_per_thread = 1024;
+
+}  // namespace
+
+DeferredSpans::DeferredSpans(EventScheduler& scheduler)
+    : spans_(k_max_spans_per_thread) {
+  cancel_flush_ =
+      scheduler.schedule_recurring_event(k_flush_interval, [this] { flush(); });
+}
+
+DeferredSpans::~DeferredSpans() {
+  cancel_flush_();
+  flush();
+}
+
+bool DeferredSpans::finish(std::unique_ptr<Span>& span) {
+  span->set_end_time(std::chrono::steady_clock::now());
+  return spans_.push(std::move(span));
+}
+
+void DeferredSpans::flush() {
+  const std::size_t count =
+      spans_.drain([](std::unique_ptr<Span> span) { span.reset(); });
+  status::add(status::Counter::spans_finished, count);
+}
+
+}  // namespace datadog::tracing
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <datadog/event_scheduler.h>
+#include <datadog/span.h>
+
+#include <memory>
+
+#include "sharded_queue.h"
+
+namespace datadog::tracing {
+
+// Request spans finished by request threads and handed to their tracer from
+// the flush task, for `DatadogSpanCollection PerThread`.
+//
+// Destroying the local root span of a trace sends the trace to the collector
+// of the tracer, which every request thread of the process shares. Instead,
+// request threads set the end time of the span and queue it in their own
+// shard; the flush task, on the exporter thread, destroys the queued spans
+// in batches. Once a thread's shard is full, its spans are finished inline.
+class DeferredSpans final {
+  ShardedQueue<std::unique_ptr<Span>> spans_;
+  EventScheduler::Cancel cancel_flush_;
+
+ public:
+  explicit DeferredSpans(EventScheduler& scheduler);
+  ~DeferredSpans();
+
+  // Finish `span` now and queue it for the flush task. Return false, leaving
+  // `span` untouched, if the queue of the calling thread is full.
+  bool finish(std::unique_ptr<Span>& span);
+
+  // Hand every queued span to its tracer.
+  void flush();
+};
+
+}  // namespace datadog::tracing
@@ -0,0 +1,181 @@
+#include "event_loop.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace datadog::tracing {
+namespace {
+
+// Sockets a loop can watch at once.
+constexpr apr_uint32_t k_max_watched_sockets = 16;
+
+// Upper bound of a poll, so that a lost wakeup only delays the loop.
+constexpr std::chrono::seconds k_max_poll_timeout{1};
+
+}  // namespace
+
+std::shared_ptr<EventLoop> EventLoop::create() {
+  auto loop = std::make_shared<EventLoop>();
+
+  // Unmanaged: the pool is only used by the loop thread, not by httpd.
+  if (apr_pool_create_unmanaged_ex(&loop->pool_, nullptr, nullptr) !=
+      APR_SUCCESS) {
+    return nullptr;
+  }
+
+  if (apr_pollset_create(&loop->pollset_, k_max_watched_sockets, loop->pool_,
+                         APR_POLLSET_WAKEABLE) != APR_SUCCESS) {
+    return nullptr;
+  }
+
+  // `run` waits for `thread_` to be assigned before using `in_loop_thread`.
+  std::lock_guard<std::mutex> lock(loop->mutex_);
+  loop->thread_ = std::thread([raw = loop.get()] { raw->run(); });
+  return loop;
+}
+
+EventLoop::~EventLoop() {
+  if (thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    apr_pollset_wakeup(pollset_);
+
+    // The loop must be released by its owners, never from its own callbacks.
+    assert(!in_loop_thread());
+    thread_.join();
+  }
+
+  // Pending tasks and timers may own resources allocated from `pool_`.
+  tasks_.clear();
+  timers_.clear();
+  if (pool_ != nullptr) apr_pool_destroy(pool_);
+}
+
+void EventLoop::post(Task task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.emplace_back(std::move(task));
+  }
+  if (!in_loop_thread()) apr_pollset_wakeup(pollset_);
+}
+
+EventLoop::TimerID EventLoop::add_timer(
+    std::chrono::steady_clock::duration delay,
+    std::chrono::steady_clock::duration interval, Task callback) {
+  TimerID id;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    id = next_timer_id_++;
+    timers_.emplace(id, Timer{std::chrono::steady_clock::now() + delay,
+                              interval, std::move(callback)});
+  }
+  if (!in_loop_thread()) apr_pollset_wakeup(pollset_);
+  return id;
+}
+
+void EventLoop::cancel_timer(TimerID id) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  timers_.erase(id);
+  if (!in_loop_thread()) {
+    timer_done_.wait(lock, [&] { return running_timer_ != id; });
+  }
+}
+
+apr_status_t EventLoop::watch(apr_socket_t* socket, apr_int16_t events,
+                              Watcher& watcher) {
+  apr_pollfd_t descriptor{};
+  descriptor.p = pool_;
+  descriptor.desc_type = APR_POLL_SOCKET;
+  descriptor.desc.s = socket;
+  descriptor.reqevents = events;
+  descriptor.client_data = &watcher;
+
+  // Changing the events of a watched socket means removing it first.
+  apr_pollset_remove(pollset_, &descriptor);
+  return apr_pollset_add(pollset_, &descriptor);
+}
+
+void EventLoop::unwatch(apr_socket_t* socket) {
+  apr_pollfd_t descriptor{};
+  descriptor.desc_type = APR_POLL_SOCKET;
+  descriptor.desc.s = socket;
+  apr_pollset_remove(pollset_, &descriptor);
+}
+
+void EventLoop::run() {
+  std::vector<Task> tasks;
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_) return;
+      tasks.swap(tasks_);
+    }
+
+    for (auto& task : tasks) task();
+    tasks.clear();
+
+    const auto timeout = run_due_timers();
+
+    apr_int32_t count = 0;
+    const apr_pollfd_t* ready = nullptr;
+    const apr_status_t status = apr_pollset_poll(
+        pollset_,
+        std::chrono::duration_cast<std::chrono::microseconds>(timeout).count(),
+        &count, &ready);
+    if (status != APR_SUCCESS) continue;  // Timeout, wakeup or signal
+
+    for (apr_int32_t i = 0; i < count; ++i) {
+      static_cast<Watcher*>(ready[i].client_data)->on_ready(ready[i].rtnevents);
+    }
+  }
+}
+
+std::chrono::steady_clock::duration EventLoop::run_due_timers() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    const auto now = std::chrono::steady_clock::now();
+    auto due = std::min_element(
+        timers_.begin(), timers_.end(), [](const auto& lhs, const auto& rhs) {
+          return lhs.second.next < rhs.second.next;
+        });
+    if (due == timers_.end()) return k_max_poll_timeout;
+    if (due->second.next > now) {
+      return std::min<std::chrono::steady_clock::duration>(
+          due->second.next - now, k_max_poll_timeout);
+    }
+
+    const TimerID id = due->first;
+    Task callback;
+    if (due->second.interval.count() == 0) {
+      callback = std::move(due->second.callback);
+      timers_.erase(due);
+    } else {
+      due->second.next = now + due->second.interval;
+      callback = due->second.callback;
+    }
+
+    running_timer_ = id;
+    lock.unlock();
+    callback();
+    lock.lock();
+    running_timer_ = 0;
+    timer_done_.notify_all();
+  }
+}
+
+EventScheduler::Cancel EventLoopScheduler::schedule_recurring_event(
+    std::chrono::steady_clock::duration interval,
+    std::function<void()> callback) {
+  const auto id = loop_->add_timer(interval, interval, std::move(callback));
+  return [weak_loop = std::weak_ptr<EventLoop>(loop_), id] {
+    if (auto loop = weak_loop.lock()) loop->cancel_timer(id);
+  };
+}
+
+std::string EventLoopScheduler::config() const {
+  return R"({"type":"httpd_datadog::EventLoopScheduler"})";
+}
+
+}  // namespace datadog::tracing
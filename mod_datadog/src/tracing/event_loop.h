@@ -0,0 +1,111 @@
+#pragma once
+
+#include <apr_poll.h>
+#include <apr_pools.h>
+#include <datadog/event_scheduler.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace datadog::tracing {
+
+// Single thread running the timers and the socket I/O of a child process.
+//
+// Timers and tasks can be added from any thread. Sockets are watched through
+// an APR pollset and must only be handled from the loop thread, that is from
+// a task, a timer or a watcher callback.
+class EventLoop final {
+ public:
+  using Task = std::function<void()>;
+  using TimerID = std::uint64_t;
+
+  // Socket readiness callback, invoked on the loop thread with the returned
+  // events (`APR_POLLIN`, `APR_POLLOUT`...).
+  class Watcher {
+   public:
+    virtual ~Watcher() = default;
+    virtual void on_ready(apr_int16_t events) = 0;
+  };
+
+ private:
+  struct Timer final {
+    std::chrono::steady_clock::time_point next;
+    std::chrono::steady_clock::duration interval;  ///< Zero for one-shot
+    Task callback;
+  };
+
+  apr_pool_t* pool_ = nullptr;
+  apr_pollset_t* pollset_ = nullptr;
+
+  std::mutex mutex_;
+  std::condition_variable timer_done_;
+  std::vector<Task> tasks_;
+  std::map<TimerID, Timer> timers_;
+  TimerID next_timer_id_ = 1;
+  TimerID running_timer_ = 0;
+  bool stopping_ = false;
+
+  std::thread thread_;
+
+ public:
+  // Return a running loop, or `nullptr` if the pollset could not be created.
+  static std::shared_ptr<EventLoop> create();
+
+  EventLoop() = default;
+  ~EventLoop();
+
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+
+  // Run `task` on the loop thread.
+  void post(Task task);
+
+  // Invoke `callback` on the loop thread after `delay`, then every `interval`
+  // if it is not zero.
+  TimerID add_timer(std::chrono::steady_clock::duration delay,
+                    std::chrono::steady_clock::duration interval,
+                    Task callback);
+
+  // Remove a timer. Once it returns, the callback is not running and will not
+  // run again, unless called from the callback itself.
+  void cancel_timer(TimerID id);
+
+  bool in_loop_thread() const {
+    return std::this_thread::get_id() == thread_.get_id();
+  }
+
+  // Loop thread only.
+  apr_pool_t* pool() const { return pool_; }
+  apr_status_t watch(apr_socket_t* socket, apr_int16_t events,
+                     Watcher& watcher);
+  void unwatch(apr_socket_t* socket);
+
+ private:
+  void run();
+  std::chrono::steady_clock::duration run_due_timers();
+};
+
+// `EventScheduler` running recurring events on an `EventLoop` thread instead
+// of a dedicated one.
+class EventLoopScheduler final : public EventScheduler {
+  std::shared_ptr<EventLoop> loop_;
+
+ public:
+  explicit EventLoopScheduler(std::shared_ptr<EventLoop> loop)
+      : loop_(std::move(loop)) {}
+
+  Cancel schedule_recurring_event(std::chrono::steady_clock::duration interval,
+                                  std::function<void()> callback) override;
+
+  std::string config() const override;
+};
+
+}  // namespace datadog::tracing
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+namespace datadog::tracing {
+namespace conf {
+
+// Shedding of tracing work while the server is saturated. Main server only.
+struct Governor final {
+  bool enabled = false;
+  // Share of `MaxRequestWorkers` busy from which tracing work is shed.
+  double high_watermark = 0.9;
+  // Share of `MaxRequestWorkers` busy under which tracing work resumes, once
+  // it stayed there for `recovery_delay`.
+  double low_watermark = 0.75;
+  std::chrono::seconds recovery_delay{30};
+  // Share of the request time spent by the module from which tracing work is
+  // shed, above the low watermark.
+  double max_overhead = 0.05;
+  // Ratio of the new traces kept while shedding.
+  double sampling_rate = 0.1;
+};
+
+}  // namespace conf
+
+// Load of the server, as measured by a child.
+struct ServerLoad final {
+  // Busy workers of every child, over `MaxRequestWorkers`.
+  double busy_ratio = 0.0;
+  // A child of the event MPM stopped accepting connections: its queue is
+  // full.
+  bool not_accepting = false;
+  // Share of the request time spent by the module in the child.
+  double overhead = 0.0;
+};
+
+// Mode of the overhead governor (`DatadogOverheadGovernor`), shared by every
+// child process, in shared memory created by the parent process (see
+// `common::make_shared_memory`). A zero-filled block is in normal mode.
+//
+// Every child measures the load every second and calls `update`. Shedding
+// starts as soon as the load crosses the high watermark, and stops once it
+// stayed under the low watermark for the recovery delay. The first child to
+// see a condition makes the transition, once for all.
+class Governor final {
+ public:
+  enum class Mode : std::uint32_t { normal, shedding };
+  enum class Reason { busy_workers, not_accepting, overhead, recovered };
+
+  struct Transition final {
+    Mode mode;  ///< New mode
+    Reason reason;
+  };
+
+ private:
+  conf::Governor conf_;  ///< Set by the parent process
+  std::atomic<std::uint32_t> mode_;
+  // Since when the load is under the low watermark while shedding, on the
+  // steady clock. 0 while it is not.
+  std::atomic<std::int64_t> calm_since_ms_;
+
+ public:
+  // Called by the parent process, before children are forked.
+  void configure(const conf::Governor& conf) { conf_ = conf; }
+
+  const conf::Governor& conf() const { return conf_; }
+
+  Mode mode() const {
+    return static_cast<Mode>(mode_.load(std::memory_order_relaxed));
+  }
+
+  bool shedding() const { return mode() == Mode::shedding; }
+
+  // Apply `load`, measured at `now`. Return the transition made by this
+  // call, if any.
+  std::optional<Transition> update(const ServerLoad& load,
+                                   std::chrono::steady_clock::time_point now) {
+    const auto now_ms = std::max<std::int64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            now.time_since_epoch())
+            .count(),
+        1);
+
+    if (mode() == Mode::normal) {
+      std::optional<Reason> reason;
+      if (load.not_accepting) {
+        reason = Reason::not_accepting;
+      } else if (load.busy_ratio >= conf_.high_watermark) {
+        reason = Reason::busy_workers;
+      } else if (load.busy_ratio >= conf_.low_watermark &&
+                 load.overhead >= conf_.max_overhead) {
+        reason = Reason::overhead;
+      }
+      if (!reason) return std::nullopt;
+
+      calm_since_ms_.store(0, std::memory_order_relaxed);
+      return transition(Mode::normal, Transition{Mode::shedding, *reason});
+    }
+
+    if (load.not_accepting || load.busy_ratio > conf_.low_watermark) {
+      calm_since_ms_.store(0, std::memory_order_relaxed);
+      return std::nullopt;
+    }
+
+    std::int64_t since = calm_since_ms_.load(std::memory_order_relaxed);
+    if (since == 0) {
+      calm_since_ms_.compare_exchange_strong(since, now_ms,
+                                             std::memory_order_relaxed);
+      return std::nullopt;
+    }
+    if (now_ms - since <
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            conf_.recovery_delay)
+            .count()) {
+      return std::nullopt;
+    }
+    return transition(Mode::shedding,
+                      Transition{Mode::normal, Reason::recovered});
+  }
+
+ private:
+  std::optional<Transition> transition(Mode from, Transition to) {
+    auto expected = static_cast<std::uint32_t>(from);
+    if (!mode_.compare_exchange_strong(expected,
+                                       static_cast<std::uint32_t>(to.mode),
+                                       std::memory_order_relaxed)) {
+      return std::nullopt;
+    }
+    return to;
+  }
+};
+
+}  // namespace datadog::tracing
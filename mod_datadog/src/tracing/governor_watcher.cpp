@@ -0,0 +1,122 @@
+#include "governor_watcher.h"
+
+#include <ap_mpm.h>
+#include <datadog/telemetry/metrics.h>
+#include <fmt/core.h>
+#include <http_log.h>
+#include <scoreboard.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "status/scoreboard.h"
+#include "version.h"
+
+APLOG_USE_MODULE(datadog);
+
+namespace datadog::tracing {
+namespace {
+
+constexpr std::chrono::seconds k_poll_interval{1};
+
+const datadog::telemetry::Counter governor_transitions{"governor.transitions",
+                                                       "tracers", false};
+
+int mpm_query(int code) {
+  int result = 0;
+  if (ap_mpm_query(code, &result) != APR_SUCCESS) return 0;
+  return result;
+}
+
+const char* describe(Governor::Reason reason) {
+  switch (reason) {
+    case Governor::Reason::busy_workers:
+      return "busy_workers";
+    case Governor::Reason::not_accepting:
+      return "not_accepting";
+    case Governor::Reason::overhead:
+      return "overhead";
+    case Governor::Reason::recovered:
+      return "recovered";
+  }
+  return "unknown";
+}
+
+}  // namespace
+
+GovernorWatcher::GovernorWatcher(Governor& governor, server_rec* server,
+                                 EventScheduler& scheduler)
+    : governor_(governor),
+      server_(server),
+      max_workers_(std::max(mpm_query(AP_MPMQ_MAX_DAEMONS), 1) *
+                   std::max(mpm_query(AP_MPMQ_MAX_THREADS), 1)) {
+  cancel_poll_ =
+      scheduler.schedule_recurring_event(k_poll_interval, [this] { poll(); });
+}
+
+GovernorWatcher::~GovernorWatcher() { cancel_poll_(); }
+
+ServerLoad GovernorWatcher::measure() {
+  ServerLoad load;
+
+  const std::uint64_t module_us = module_us_.exchange(0);
+  const std::uint64_t request_us = request_us_.exchange(0);
+  if (request_us != 0) {
+    load.overhead =
+        static_cast<double>(module_us) / static_cast<double>(request_us);
+  }
+
+  if (!ap_exists_scoreboard_image()) return load;
+
+  // Counted like mod_status does.
+  const int server_limit =
+      std::max(mpm_query(AP_MPMQ_HARD_LIMIT_DAEMONS), 1);
+  const int thread_limit =
+      std::max(mpm_query(AP_MPMQ_HARD_LIMIT_THREADS), 1);
+  int busy = 0;
+  for (int i = 0; i < server_limit; ++i) {
+    const process_score* process = ap_get_scoreboard_process(i);
+    if (process->pid != 0 && !process->quiescing && process->not_accepting) {
+      load.not_accepting = true;
+    }
+    for (int j = 0; j < thread_limit; ++j) {
+      const worker_score* worker = ap_get_scoreboard_worker_from_indexes(i, j);
+      switch (worker->status) {
+        case SERVER_DEAD:
+        case SERVER_STARTING:
+        case SERVER_READY:
+        case SERVER_IDLE_KILL:
+          break;
+        default:
+          ++busy;
+      }
+    }
+  }
+  load.busy_ratio =
+      static_cast<double>(busy) / static_cast<double>(max_workers_);
+  return load;
+}
+
+void GovernorWatcher::poll() {
+  const ServerLoad load = measure();
+  const auto transition =
+      governor_.update(load, std::chrono::steady_clock::now());
+  if (!transition) return;
+
+  const bool shedding = transition->mode == Governor::Mode::shedding;
+  const char* reason = describe(transition->reason);
+  ap_log_error(APLOG_MARK, APLOG_NOTICE, 0, server_,
+               "Overhead governor: %s tracing work (%s: %.0f%% of %d workers "
+               "busy, module overhead %.1f%%)",
+               shedding ? "shedding" : "resuming", reason,
+               load.busy_ratio * 100.0, max_workers_, load.overhead * 100.0);
+  status::add(status::Counter::governor_transitions);
+  datadog::telemetry::counter::increment(
+      governor_transitions,
+      {shedding ? "mode:shedding" : "mode:normal",
+       fmt::format("reason:{}", reason), "integration_name:httpd",
+       fmt::format("integration_version:{}", mod_datadog_version)});
+}
+
+}  // namespace datadog::tracing
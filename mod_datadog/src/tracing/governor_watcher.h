@@ -0,0 +1,52 @@
+#pragma once
+
+#include <datadog/event_scheduler.h>
+#include <httpd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "governor.h"
+
+namespace datadog::tracing {
+
+// Measure the load of the server for the shared `Governor`, from the
+// exporter thread of a child.
+//
+// The busy workers of every child are read from the scoreboard of httpd.
+// The time the module spends in the request hooks of this child is reported
+// by the request threads. Transitions are logged, counted in
+// `server-status` and reported to telemetry.
+class GovernorWatcher final {
+  Governor& governor_;
+  server_rec* server_;
+  int max_workers_;
+  std::atomic<std::uint64_t> module_us_{0};
+  std::atomic<std::uint64_t> request_us_{0};
+  EventScheduler::Cancel cancel_poll_;
+
+  ServerLoad measure();
+
+ public:
+  // @param server  Server used for logging
+  GovernorWatcher(Governor& governor, server_rec* server,
+                  EventScheduler& scheduler);
+  ~GovernorWatcher();
+
+  // Count `duration` spent by the module in a request hook.
+  void add_module_time(std::chrono::microseconds duration) {
+    module_us_.fetch_add(static_cast<std::uint64_t>(duration.count()),
+                         std::memory_order_relaxed);
+  }
+
+  // Count a top-level request which lasted `duration`.
+  void add_request_time(std::chrono::microseconds duration) {
+    request_us_.fetch_add(static_cast<std::uint64_t>(duration.count()),
+                          std::memory_order_relaxed);
+  }
+
+  void poll();
+};
+
+}  // namespace datadog::tracing
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace datadog::tracing {
+
+// Parse a comma separated list of `header[:tag]` entries, as accepted by
+// `DatadogHttpHeaderTags` and `DD_TRACE_HEADER_TAGS`, into a map of header
+// names to tag names. Spaces around entries are ignored. An entry without a
+// tag maps to an empty tag name.
+inline std::unordered_map<std::string, std::string> parse_http_header_tags(
+    std::string_view in) {
+  const auto trim = [](std::string_view text) {
+    const auto beg = text.find_first_not_of(' ');
+    if (beg == text.npos) return std::string_view{};
+    return text.substr(beg, text.find_last_not_of(' ') - beg + 1);
+  };
+
+  std::unordered_map<std::string, std::string> res;
+  for (std::size_t beg = 0; beg <= in.size();) {
+    std::size_t comma_idx = in.find(',', beg);
+    if (comma_idx == std::string_view::npos) comma_idx = in.size();
+
+    const auto kv = in.substr(beg, comma_idx - beg);
+    beg = comma_idx + 1;
+
+    const std::size_t colon_idx = kv.find(':');
+    const auto http_header = trim(kv.substr(0, colon_idx));
+    if (http_header.empty()) continue;
+
+    const auto tag = colon_idx == std::string_view::npos
+                         ? std::string_view{}
+                         : trim(kv.substr(colon_idx + 1));
+    res[std::string(http_header)] = tag;
+  }
+
+  return res;
+}
+
+// Set of headers to report as span tags, compiled once at configuration
+// time.
+//
+// Headers are kept sorted by lowercase name, and `find` is a binary search
+// comparing names case-insensitively without copying them. Most headers of a
+// request are not configured: a bitmap of the configured name lengths
+// rejects them before any comparison.
+class HeaderTags final {
+ public:
+  struct Entry final {
+    std::string header;  ///< Lowercase
+    std::string request_tag;
+    std::string response_tag;
+  };
+
+ private:
+  std::vector<Entry> entries_;
+  std::uint64_t lengths_ = 0;  ///< Bit `n` set if a name has length `n`
+  bool has_long_names_ = false;
+
+  static int compare(std::string_view lower, std::string_view name) {
+    const std::size_t size = std::min(lower.size(), name.size());
+    for (std::size_t i = 0; i < size; ++i) {
+      const auto lhs = static_cast<unsigned char>(lower[i]);
+      const auto rhs = static_cast<unsigned char>(
+          std::tolower(static_cast<unsigned char>(name[i])));
+      if (lhs != rhs) return lhs < rhs ? -1 : 1;
+    }
+    if (lower.size() == name.size()) return 0;
+    return lower.size() < name.size() ? -1 : 1;
+  }
+
+  // Tag name of a header configured without one, e.g.
+  // `http.request.headers.x-tenant-id`.
+  static std::string default_tag(std::string_view prefix,
+                                 std::string_view header) {
+    std::string tag{prefix};
+    for (const char c : header) {
+      const auto ch = static_cast<unsigned char>(c);
+      tag += (std::isalnum(ch) || c == '-' || c == '_' || c == '/') ? c : '_';
+    }
+    return tag;
+  }
+
+ public:
+  HeaderTags() = default;
+
+  // @param config  Map of header names to tag names, as returned by
+  //                `parse_http_header_tags`
+  explicit HeaderTags(
+      const std::unordered_map<std::string, std::string>& config) {
+    entries_.reserve(config.size());
+    for (const auto& [header, tag] : config) {
+      Entry entry;
+      entry.header = header;
+      std::transform(entry.header.begin(), entry.header.end(),
+                     entry.header.begin(),
+                     [](unsigned char ch) { return std::tolower(ch); });
+      if (tag.empty()) {
+        entry.request_tag = default_tag("http.request.headers.", entry.header);
+        entry.response_tag =
+            default_tag("http.response.headers.", entry.header);
+      } else {
+        entry.request_tag = tag;
+        entry.response_tag = tag;
+      }
+
+      if (entry.header.size() < 64) {
+        lengths_ |= std::uint64_t{1} << entry.header.size();
+      } else {
+        has_long_names_ = true;
+      }
+      entries_.emplace_back(std::move(entry));
+    }
+
+    std::sort(entries_.begin(), entries_.end(),
+              [](const Entry& lhs, const Entry& rhs) {
+                return lhs.header < rhs.header;
+              });
+  }
+
+  bool empty() const { return entries_.empty(); }
+  const std::vector<Entry>& entries() const { return entries_; }
+
+  // Return the entry of `header`, whatever its case, or `nullptr`.
+  const Entry* find(std::string_view header) const {
+    if (header.size() < 64) {
+      if ((lengths_ & (std::uint64_t{1} << header.size())) == 0) {
+        return nullptr;
+      }
+    } else if (!has_long_names_) {
+      return nullptr;
+    }
+
+    std::size_t low = 0;
+    std::size_t high = entries_.size();
+    while (low < high) {
+      const std::size_t mid = low + (high - low) / 2;
+      const int order = compare(entries_[mid].header, header);
+      if (order == 0) return &entries_[mid];
+      if (order < 0) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    return nullptr;
+  }
+};
+
+}  // namespace datadog::tracing
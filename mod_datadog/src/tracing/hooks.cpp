@@ -1,97 +1,470 @@
 #include "hooks.h"
 
+#include <apr_pools.h>
+#include <apr_tables.h>
+#include <datadog/clock.h>
+#include <datadog/dict_writer.h>
 #include <datadog/injection_options.h>
+#include <datadog/sampling_decision.h>
+#include <datadog/sampling_priority.h>
 #include <datadog/span.h>
 #include <datadog/span_config.h>
 #include <datadog/string_view.h>
 #include <datadog/tracer.h>
 #include <fmt/core.h>
 
-#include "../utils.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <optional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "common_conf.h"
+#include "header_tags.h"
+#include "status/scoreboard.h"
 #include "utils.h"
 
 namespace datadog::tracing {
 namespace {
 
-std::string protocol(int protocol_number) {
-  switch (protocol_number) {
-    case 9:
-      return "0.9";
-    case 1000:
-      return "1.0";
-    case 1001:
-      return "1.1";
-    case 2000:
-      return "2.0";
-    case 3000:
-      return "3.0";
-    default:
-      return "";
-  }
-}
-
-static SpanConfig make_span_config(
-    request_rec* r, std::unordered_map<std::string, std::string> tags) {
-  static const std::string httpd_version = common::utils::make_httpd_version();
-
-  std::string resource_name{r->method};
-  resource_name += " ";
-  resource_name += r->uri;
-  resource_name += " ";
-  resource_name += r->protocol;
-
-  tags.emplace("component", "httpd");
-  tags.emplace("httpd.version", httpd_version);
-  tags.emplace("httpd.virtual_host", r->server->is_virtual ? "true" : "false");
-  tags.emplace("http.version", protocol(r->proto_num));
-  tags.emplace("http.request.content_length", std::to_string(r->clength));
-  tags.emplace("http.method", r->method);
-
-  if (r->hostname != nullptr) tags.emplace("http.host", r->hostname);
-  if (r->unparsed_uri != nullptr) tags.emplace("http.url", r->unparsed_uri);
-  if (r->useragent_ip != nullptr)
-    tags.emplace("http.client_ip", r->useragent_ip);
-
-  if (auto mpm_name = ap_show_mpm(); mpm_name != nullptr) {
-    tags.emplace("httpd.mpm", mpm_name);
-  }
-
-  if (auto user_agent = apr_table_get(r->headers_in, "User-Agent");
-      user_agent != nullptr) {
-    tags.emplace("http.useragent", user_agent);
-  }
-
-  datadog::tracing::SpanConfig options;
-  if (r->proxyreq != PROXYREQ_NONE) {
-    options.name = "httpd.proxy";
-    tags.emplace("span.kind", "client");
-  } else {
-    options.name = "httpd.request";
-    tags.emplace("span.kind", "server");
-  }
-  options.resource = resource_name;
-  options.tags = std::move(tags);
-
-  return options;
-}
-
 apr_status_t delete_span(void* data) {
   auto* span = static_cast<datadog::tracing::Span*>(data);
   delete span;
+  status::add(status::Counter::spans_finished);
 
   return 0;
 }
 
+// Span of a top-level request, handed to the flush task when spans are
+// collected per thread.
+struct RequestSpan final {
+  Span* span;
+  DeferredSpans* deferred_spans;
+};
+
+apr_status_t finish_request_span(void* data) {
+  auto* request_span = static_cast<RequestSpan*>(data);
+  std::unique_ptr<Span> span{request_span->span};
+  if (request_span->deferred_spans->finish(span)) return 0;
+
+  span.reset();
+  status::add(status::Counter::spans_finished);
+  return 0;
+}
+
+// Subrequests of a request, collapsed into metrics of its span. Stored in
+// the request pool, which internal redirections share.
+class SubrequestAggregate final {
+  static constexpr const char* pool_key = "datadog-subrequest-aggregate";
+  static constexpr std::size_t max_slowest = 5;
+
+  std::uint64_t count_ = 0;
+  std::chrono::microseconds total_{0};
+  std::chrono::microseconds max_{0};
+  // Slowest subrequests, slowest first.
+  std::vector<std::pair<std::chrono::microseconds, std::string>> slowest_;
+
+ public:
+  static SubrequestAggregate* find(apr_pool_t* pool) {
+    void* data = nullptr;
+    apr_pool_userdata_get(&data, pool_key, pool);
+    return static_cast<SubrequestAggregate*>(data);
+  }
+
+  static SubrequestAggregate& find_or_create(apr_pool_t* pool) {
+    if (auto* aggregate = find(pool)) return *aggregate;
+
+    auto* aggregate = new SubrequestAggregate;
+    apr_pool_userdata_setn(
+        aggregate, pool_key,
+        [](void* data) -> apr_status_t {
+          delete static_cast<SubrequestAggregate*>(data);
+          return APR_SUCCESS;
+        },
+        pool);
+    return *aggregate;
+  }
+
+  void add(std::chrono::microseconds duration, request_rec* r) {
+    ++count_;
+    total_ += duration;
+    max_ = std::max(max_, duration);
+
+    if (slowest_.size() == max_slowest && slowest_.back().first >= duration) {
+      return;
+    }
+    if (slowest_.size() == max_slowest) slowest_.pop_back();
+
+    auto position = std::find_if(
+        slowest_.begin(), slowest_.end(),
+        [&](const auto& sample) { return sample.first < duration; });
+    slowest_.emplace(position, duration, make_resource_name(r));
+  }
+
+  void tag(Span& span) const {
+    const auto to_ms = [](std::chrono::microseconds duration) {
+      return std::chrono::duration<double, std::milli>(duration).count();
+    };
+
+    span.set_metric("httpd.subrequests.count", static_cast<double>(count_));
+    span.set_metric("httpd.subrequests.total_duration_ms", to_ms(total_));
+    span.set_metric("httpd.subrequests.max_duration_ms", to_ms(max_));
+
+    std::string slowest;
+    for (const auto& [duration, resource] : slowest_) {
+      if (!slowest.empty()) slowest += ", ";
+      slowest += fmt::format("{} ({:.3f}ms)", resource, to_ms(duration));
+    }
+    span.set_tag("httpd.subrequests.slowest", slowest);
+  }
+};
+
+// An aggregated subrequest in flight, allocated from its own pool.
+struct AggregatedSubrequest final {
+  request_rec* r;
+  const datadog::conf::Directory* dir_conf;
+  Span* parent_span;
+  SubrequestAggregate* aggregate;
+  TimePoint start;
+};
+
+// Runs when the subrequest is destroyed, that is once it has been served.
+apr_status_t finish_aggregated_subrequest(void* data) {
+  auto* subrequest = static_cast<AggregatedSubrequest*>(data);
+  const auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - subrequest->start.tick);
+
+  subrequest->aggregate->add(duration, subrequest->r);
+
+  const auto& threshold = subrequest->dir_conf->subrequest_span_threshold;
+  if (threshold && duration >= *threshold) {
+    SpanConfig options =
+        make_span_config(subrequest->r, subrequest->dir_conf->tags,
+                         subrequest->dir_conf->header_tags, false, false);
+    options.name = "httpd.subrequests";
+    options.start = subrequest->start;
+    // Finished as it goes out of scope.
+    Span span = subrequest->parent_span->create_child(options);
+    status::add(status::Counter::spans_started);
+    status::add(status::Counter::spans_finished);
+  }
+
+  return APR_SUCCESS;
+}
+
+constexpr std::chrono::milliseconds k_default_retention_latency{1000};
+constexpr double k_default_retention_base_rate = 0.01;
+
+class NullWriter final : public DictWriter {
+ public:
+  void set(StringView, StringView) override {}
+};
+
+// Drop the trace of `span` if it was to be kept but the server-wide limit
+// has been reached. Decisions made upstream are left untouched.
+void apply_rate_limit(Span& span, SharedRateLimiter& rate_limiter) {
+  TraceSegment& segment = span.trace_segment();
+  auto decision = segment.sampling_decision();
+  if (!decision) {
+    // The sampler decides when the trace context is first injected.
+    NullWriter writer;
+    span.inject(writer);
+    decision = segment.sampling_decision();
+  }
+
+  if (!decision || decision->origin == SamplingDecision::Origin::EXTRACTED ||
+      decision->priority <= 0) {
+    return;
+  }
+
+  if (!rate_limiter.allow(std::chrono::steady_clock::now())) {
+    segment.override_sampling_priority(
+        static_cast<int>(SamplingPriority::AUTO_DROP));
+  }
+}
+
+// Keep or drop the trace of `span`, as sampled at `rate`, rather than as
+// decided by the sampler of the tracer. The priority is automatic and the
+// rate is reported as `_dd.rule_psr`, for the backend to account for the
+// traces dropped. The tracer has no API to decide through its sampling rules:
+// the decision is recorded with the manual mechanism (`_dd.p.dm=-4`), not as
+// a rule. Decisions made upstream are left untouched.
+void set_sampling_decision(Span& span, bool keep, double rate) {
+  TraceSegment& segment = span.trace_segment();
+  if (auto decision = segment.sampling_decision();
+      decision && decision->origin == SamplingDecision::Origin::EXTRACTED) {
+    return;
+  }
+
+  const auto priority =
+      keep ? SamplingPriority::AUTO_KEEP : SamplingPriority::AUTO_DROP;
+  segment.override_sampling_priority(static_cast<int>(priority));
+  span.set_metric("_dd.rule_psr", rate);
+}
+
+// Keep the trace of `span` with probability `rate`.
+void apply_sampling_rate(Span& span, double rate) {
+  thread_local std::mt19937_64 generator{std::random_device{}()};
+  std::uniform_real_distribution<double> distribution{0.0, 1.0};
+  set_sampling_decision(span, distribution(generator) < rate, rate);
+}
+
+// Base rate of tail retention, lowered to `sampling_rate` if any.
+double retention_base_rate(const conf::TailRetention& retention,
+                           std::optional<double> sampling_rate) {
+  double base_rate =
+      retention.base_rate.value_or(k_default_retention_base_rate);
+  if (sampling_rate) base_rate = std::min(base_rate, *sampling_rate);
+  return base_rate;
+}
+
+// With tail retention, keep the trace of `span` at the base rate when its
+// request starts, before it is forwarded downstream. The services it is
+// forwarded to are told this decision, and keep the same traces as with a
+// head sample at that rate, all of which `httpd` keeps too.
+void apply_retention_base_rate(Span& span, double base_rate,
+                               SharedRateLimiter* rate_limiter) {
+  apply_sampling_rate(span, base_rate);
+  if (rate_limiter != nullptr) apply_rate_limit(span, *rate_limiter);
+}
+
+// Once the request of `span` is done, also keep its trace if it was slow or
+// failed. Traces left dropped are discarded by the `RetentionCollector` of
+// the tracer. Decisions made upstream are left untouched.
+void apply_tail_retention(request_rec* r, Span& span,
+                          const conf::TailRetention& retention,
+                          std::optional<double> sampling_rate,
+                          SharedRateLimiter* rate_limiter) {
+  TraceSegment& segment = span.trace_segment();
+  auto decision = segment.sampling_decision();
+  if (decision && decision->origin == SamplingDecision::Origin::EXTRACTED) {
+    return;
+  }
+
+  if (!decision) {
+    // Span started after `on_fixups`, by the quick handler of mod_cache.
+    apply_retention_base_rate(
+        span, retention_base_rate(retention, sampling_rate), rate_limiter);
+    decision = segment.sampling_decision();
+  }
+
+  if (decision && decision->priority > 0) {
+    span.set_tag("httpd.retention.reason", "base_rate");
+    return;
+  }
+
+  const std::chrono::microseconds duration{apr_time_now() - r->request_time};
+  const char* reason = nullptr;
+  if (r->status >= 500) {
+    reason = "error";
+  } else if (duration >=
+             retention.latency_threshold.value_or(k_default_retention_latency)) {
+    reason = "latency";
+  }
+
+  if (reason == nullptr ||
+      (rate_limiter != nullptr &&
+       !rate_limiter->allow(std::chrono::steady_clock::now()))) {
+    return;
+  }
+
+  span.set_tag("httpd.retention.reason", reason);
+  segment.override_sampling_priority(
+      static_cast<int>(SamplingPriority::USER_KEEP));
+}
+
+void aggregate_subrequest(request_rec* r,
+                          const datadog::conf::Directory& dir_conf,
+                          module* datadog_module) {
+  // Nested subrequests roll up to the outermost request.
+  request_rec* top = r->main;
+  while (top->main != nullptr) top = top->main;
+
+  void* data = ap_get_module_config(top->request_config, datadog_module);
+  if (data == nullptr) return;
+
+  void* buffer = apr_palloc(r->pool, sizeof(AggregatedSubrequest));
+  auto* subrequest = new (buffer) AggregatedSubrequest{
+      r, &dir_conf, static_cast<Span*>(data),
+      &SubrequestAggregate::find_or_create(top->pool), default_clock()};
+  apr_pool_cleanup_register(r->pool, subrequest, finish_aggregated_subrequest,
+                            apr_pool_cleanup_null);
+}
+
+// Start the span of the top-level request `r`, continuing the trace of the
+// inbound request if trusted.
+Span* start_request_span(request_rec* r, Tracer& tracer,
+                         const datadog::conf::Directory& dir_conf,
+                         const SpanConfig& options) {
+  if (!dir_conf.trust_inbound_span.value_or(true)) {
+    return new Span(tracer.create_span(options));
+  }
+
+  // In case we fail to use the inbound span, then, start a new trace
+  // ¯\_(ツ)_/¯ There is nothing we can do about it.
+  auto extracted_span =
+      tracer.extract_span(utils::HeaderReader(r->headers_in), options);
+  if (auto error = extracted_span.if_error()) {
+    auto* span = new Span(tracer.create_span(options));
+    if (error->code != Error::NO_SPAN_TO_EXTRACT) {
+      span->set_error(error->message.c_str());
+    }
+    return span;
+  }
+  return new Span(std::move(*extracted_span));
+}
+
+// Register `span` as the span of `r`, finished with the request.
+void attach_span(request_rec* r, Span* span, DeferredSpans* deferred_spans,
+                 module* datadog_module) {
+  status::add(status::Counter::spans_started);
+
+  // Register to the request pool to have the same lifecycle as
+  // the request.
+  ap_set_module_config(r->request_config, datadog_module, (void*)span);
+  if (deferred_spans != nullptr && r->main == nullptr && r->prev == nullptr) {
+    void* buffer = apr_palloc(r->pool, sizeof(RequestSpan));
+    auto* request_span = new (buffer) RequestSpan{span, deferred_spans};
+    apr_pool_cleanup_register(r->pool, request_span, finish_request_span,
+                              apr_pool_cleanup_null);
+  } else {
+    apr_pool_cleanup_register(r->pool, (void*)span, delete_span,
+                              apr_pool_cleanup_null);
+  }
+}
+
+// Outcome of the cache lookup of `r`, as reported by mod_cache, or
+// `nullptr` if the request did not go through mod_cache.
+const char* cache_status(const request_rec* r) {
+  if (apr_table_get(r->subprocess_env, "cache-hit") != nullptr) return "hit";
+  if (apr_table_get(r->subprocess_env, "cache-revalidate") != nullptr) {
+    return "revalidate";
+  }
+  if (apr_table_get(r->subprocess_env, "cache-miss") != nullptr) {
+    return "miss";
+  }
+  if (apr_table_get(r->subprocess_env, "cache-invalidate") != nullptr) {
+    return "invalidate";
+  }
+  return nullptr;
+}
+
+// Time `r` was received, as the start of its span.
+TimePoint request_start(const request_rec* r) {
+  TimePoint start = default_clock();
+  const std::chrono::microseconds elapsed{apr_time_now() - r->request_time};
+  start.wall -= elapsed;
+  start.tick -= elapsed;
+  return start;
+}
+
 }  // namespace
 
-int on_fixups(request_rec* r, Tracer& g_tracer, module* datadog_module) {
+std::optional<double> current_sampling_rate(const LiveControl::State& live,
+                                            const Governor* governor,
+                                            bool shedding) {
+  std::optional<double> sampling_rate = live.settings.sampling_rate;
+  if (shedding) {
+    sampling_rate = std::min(sampling_rate.value_or(1.0),
+                             governor->conf().sampling_rate);
+  }
+  return sampling_rate;
+}
+
+void apply_head_sampling(Span& span, std::optional<double> sampling_rate,
+                         SharedRateLimiter* rate_limiter) {
+  if (sampling_rate) apply_sampling_rate(span, *sampling_rate);
+  if (rate_limiter != nullptr) apply_rate_limit(span, *rate_limiter);
+}
+
+void trace_cache_lookup(request_rec* r, Tracer* tracer,
+                        DeferredSpans* deferred_spans,
+                        const LiveControl* live_control,
+                        module* datadog_module) {
+  if (r->main) return;
+
+  const char* cache = cache_status(r);
+  if (cache == nullptr) return;
+
+  const bool is_hit = std::string_view(cache) == "hit";
+  if (is_hit) {
+    status::add(status::Counter::cache_hits);
+  } else if (std::string_view(cache) == "miss") {
+    status::add(status::Counter::cache_misses);
+  }
+
+  const auto* module_conf = static_cast<datadog::conf::Module*>(
+      ap_get_module_config(r->server->module_config, datadog_module));
+  const conf::CacheHits sampling = module_conf != nullptr
+                                       ? module_conf->cache_hits.value_or(
+                                             conf::CacheHits{})
+                                       : conf::CacheHits{};
+
+  if (auto* span = static_cast<Span*>(
+          ap_get_module_config(r->request_config, datadog_module))) {
+    span->set_tag("httpd.cache.status", cache);
+    if (is_hit && sampling.mode != conf::CacheHits::Mode::trace) {
+      apply_sampling_rate(*span, sampling.mode == conf::CacheHits::Mode::sample
+                                     ? sampling.sampling_rate
+                                     : 0.0);
+    }
+    return;
+  }
+
+  // The quick handler of mod_cache served the request before `on_fixups`:
+  // start its span now, unless it is not to be kept anyway.
+  if (tracer == nullptr || sampling.mode == conf::CacheHits::Mode::aggregate) {
+    return;
+  }
+  if (live_control != nullptr &&
+      live_control->load().settings.tracing_disabled) {
+    return;
+  }
+
+  const auto* dir_conf = static_cast<datadog::conf::Directory*>(
+      ap_get_module_config(r->per_dir_config, datadog_module));
+  if (dir_conf == nullptr || !dir_conf->tracing_enabled.value_or(true)) {
+    return;
+  }
+
+  bool keep = false;
+  if (is_hit && sampling.mode == conf::CacheHits::Mode::sample) {
+    thread_local std::mt19937_64 generator{std::random_device{}()};
+    std::uniform_real_distribution<double> distribution{0.0, 1.0};
+    if (distribution(generator) >= sampling.sampling_rate) return;
+    keep = true;
+  }
+
+  SpanConfig options =
+      make_span_config(r, dir_conf->tags, dir_conf->header_tags, true, false);
+  options.start = request_start(r);
+  Span* span = start_request_span(r, *tracer, *dir_conf, options);
+  attach_span(r, span, deferred_spans, datadog_module);
+  span->set_tag("httpd.cache.status", cache);
+  if (keep) set_sampling_decision(*span, true, sampling.sampling_rate);
+}
+
+int on_fixups(request_rec* r, Tracer& g_tracer,
+              SharedRateLimiter* rate_limiter, DeferredSpans* deferred_spans,
+              const LiveControl* live_control, const Governor* governor,
+              module* datadog_module) {
   // NOTE(@dmehala): do not trace `mod_status` handler.
   if (r->handler != nullptr &&
       std::string_view(r->handler) == "server-status") {
     return DECLINED;
   }
 
+  const LiveControl::State live =
+      live_control != nullptr ? live_control->load() : LiveControl::State{};
+  if (live.settings.tracing_disabled) return DECLINED;
+
+  const bool shedding = governor != nullptr && governor->shedding();
+  if (shedding && r->main != nullptr) return DECLINED;
+
   Span* span = nullptr;
   InjectionOptions injection_opts;
 
@@ -107,11 +480,18 @@ int on_fixups(request_rec* r, Tracer& g_tracer, module* datadog_module) {
       return DECLINED;
     }
 
+    if (r->main != nullptr && dir_conf->subrequest_aggregation.value_or(false)) {
+      aggregate_subrequest(r, *dir_conf, datadog_module);
+      return DECLINED;
+    }
+
     void* data = ap_get_module_config(main_r->request_config, datadog_module);
     if (!data) return DECLINED;
 
     Span* parent_span = static_cast<Span*>(data);
-    SpanConfig options = make_span_config(r, dir_conf->tags);
+    SpanConfig options = make_span_config(r, dir_conf->tags,
+                                          dir_conf->header_tags, false,
+                                          shedding);
     options.name = "httpd.subrequests";
     span = new Span(parent_span->create_child(options));
   } else {
@@ -127,33 +507,15 @@ int on_fixups(request_rec* r, Tracer& g_tracer, module* datadog_module) {
       return DECLINED;  ///< `start_span` can not be called twice on the same
                         ///< request
 
-    SpanConfig options = make_span_config(r, dir_conf->tags);
-
-    // In case we fail to use the inbound span, then, start a new trace
-    // ¯\_(ツ)_/¯ There is nothing we can do about it.
-    if (dir_conf->trust_inbound_span.value_or(true)) {
-      auto extracted_span =
-          g_tracer.extract_span(utils::HeaderReader(r->headers_in), options);
-      if (auto error = extracted_span.if_error()) {
-        span = new Span(g_tracer.create_span(options));
-        if (error->code != Error::NO_SPAN_TO_EXTRACT) {
-          span->set_error(error->message.c_str());
-        }
-      } else {
-        span = new Span(std::move(*extracted_span));
-      }
-    } else {
-      span = new Span(g_tracer.create_span(options));
-    }
+    SpanConfig options = make_span_config(r, dir_conf->tags,
+                                          dir_conf->header_tags, true,
+                                          shedding);
+    if (shedding) options.tags.emplace("httpd.governor.mode", "shedding");
+    span = start_request_span(r, g_tracer, *dir_conf, options);
   }
 
   assert(span != nullptr);
-
-  // Register to the request pool to have the same lifecycle as
-  // the request.
-  ap_set_module_config(r->request_config, datadog_module, (void*)span);
-  apr_pool_cleanup_register(r->pool, (void*)span, delete_span,
-                            apr_pool_cleanup_null);
+  attach_span(r, span, deferred_spans, datadog_module);
 
   // Add environment variables for log injection
   apr_table_set(r->subprocess_env, "Datadog-Trace-ID",
@@ -161,13 +523,34 @@ int on_fixups(request_rec* r, Tracer& g_tracer, module* datadog_module) {
   apr_table_set(r->subprocess_env, "Datadog-Span-ID",
                 std::to_string(span->id()).c_str());
 
+  // While the governor sheds, the lowest sampling rate applies.
+  const std::optional<double> sampling_rate =
+      current_sampling_rate(live, governor, shedding);
+
+  // With tail retention, slow and failed requests are kept too once done.
+  if (r->main == nullptr && r->prev == nullptr) {
+    const auto* module_conf = static_cast<datadog::conf::Module*>(
+        ap_get_module_config(r->server->module_config, datadog_module));
+    if (module_conf != nullptr &&
+        module_conf->tail_retention.enabled.value_or(false)) {
+      apply_retention_base_rate(
+          *span, retention_base_rate(module_conf->tail_retention,
+                                     sampling_rate),
+          rate_limiter);
+    } else {
+      apply_head_sampling(*span, sampling_rate, rate_limiter);
+    }
+  }
+
   utils::HeaderWriter header_injector(r->headers_in);
   span->inject(header_injector, injection_opts);
 
   return DECLINED;
 }
 
-int on_log_transaction(request_rec* r, module* datadog_module) {
+int on_log_transaction(request_rec* r, SharedRateLimiter* rate_limiter,
+                       const LiveControl* live_control,
+                       const Governor* governor, module* datadog_module) {
   if (r->main) return DECLINED;
 
   void* data = ap_get_module_config(r->request_config, datadog_module);
@@ -179,6 +562,19 @@ int on_log_transaction(request_rec* r, module* datadog_module) {
   span->set_tag("http.status_code", std::to_string(r->status));
   span->set_tag("http.response.content_length", std::to_string(r->bytes_sent));
 
+  const bool shedding = governor != nullptr && governor->shedding();
+  if (const auto* dir_conf = static_cast<datadog::conf::Directory*>(
+          ap_get_module_config(r->per_dir_config, datadog_module));
+      !shedding && dir_conf != nullptr && dir_conf->header_tags != nullptr &&
+      !dir_conf->header_tags->empty()) {
+    std::unordered_map<std::string, std::string> tags;
+    collect_header_tags(r->headers_out, *dir_conf->header_tags,
+                        &HeaderTags::Entry::response_tag, tags);
+    collect_header_tags(r->err_headers_out, *dir_conf->header_tags,
+                        &HeaderTags::Entry::response_tag, tags);
+    for (const auto& [key, value] : tags) span->set_tag(key, value);
+  }
+
   if (r->status >= 500) {
     span->set_error(true);
 
@@ -188,7 +584,63 @@ int on_log_transaction(request_rec* r, module* datadog_module) {
     }
   }
 
+  if (const auto* aggregate = SubrequestAggregate::find(r->pool)) {
+    aggregate->tag(*span);
+  }
+
+  if (const auto* module_conf = static_cast<datadog::conf::Module*>(
+          ap_get_module_config(r->server->module_config, datadog_module));
+      module_conf != nullptr &&
+      module_conf->tail_retention.enabled.value_or(false)) {
+    const LiveControl::State live =
+        live_control != nullptr ? live_control->load() : LiveControl::State{};
+    apply_tail_retention(r, *span, module_conf->tail_retention,
+                         current_sampling_rate(live, governor, shedding),
+                         rate_limiter);
+  }
+
   return DECLINED;
 }
 
+void record_trace_stats(request_rec* r, stats::SharedTable& table,
+                        const SpanDefaults& defaults, module* datadog_module) {
+  if (r->main) return;
+  if (ap_get_module_config(r->request_config, datadog_module) == nullptr) {
+    return;
+  }
+
+  const bool is_proxy = r->proxyreq != PROXYREQ_NONE;
+  const std::string resource_name = make_resource_name(r);
+
+  stats::Key key;
+  key.service = defaults.service;
+  key.name = is_proxy ? "httpd.proxy" : "httpd.request";
+  key.resource = resource_name;
+  key.type = defaults.service_type;
+  key.span_kind = is_proxy ? "client" : "server";
+  key.environment = defaults.environment;
+  key.version = defaults.version;
+  key.http_status_code = static_cast<std::uint32_t>(r->status);
+
+  const std::chrono::microseconds duration{apr_time_now() - r->request_time};
+  table.record(key, duration, r->status >= 500,
+               std::chrono::system_clock::now());
+}
+
+void record_span_stats(stats::SharedTable& table, const SpanDefaults& defaults,
+                       std::string_view name, std::string_view resource,
+                       std::string_view span_kind,
+                       std::chrono::microseconds duration) {
+  stats::Key key;
+  key.service = defaults.service;
+  key.name = name;
+  key.resource = resource;
+  key.type = defaults.service_type;
+  key.span_kind = span_kind;
+  key.environment = defaults.environment;
+  key.version = defaults.version;
+
+  table.record(key, duration, false, std::chrono::system_clock::now());
+}
+
 }  // namespace datadog::tracing
@@ -1,9 +1,78 @@
+#include <datadog/span_defaults.h>
 #include <datadog/tracer.h>
 #include <http_core.h>
 
+#include <chrono>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "deferred_spans.h"
+#include "governor.h"
+#include "live_control.h"
+#include "rate_limiter.h"
+#include "request_span.h"
+#include "stats.h"
+
 namespace datadog::tracing {
 
-int on_fixups(request_rec* r, Tracer& g_tracer, module* datadog_module);
-int on_log_transaction(request_rec* r, module* datadog_module);
+// Sampling rate of `DatadogLiveControl`, lowered to the one of the governor
+// while it sheds, if any.
+std::optional<double> current_sampling_rate(const LiveControl::State& live,
+                                            const Governor* governor,
+                                            bool shedding);
+
+// Keep or drop the trace started by `span` as the module does for the traces
+// of requests: at `sampling_rate`, if any, rather than as decided by the
+// sampler of the tracer, then within the server-wide limit of `rate_limiter`,
+// if not `nullptr`. Decisions made upstream are left untouched.
+void apply_head_sampling(Span& span, std::optional<double> sampling_rate,
+                         SharedRateLimiter* rate_limiter);
+
+// @param rate_limiter    Server-wide limit of kept traces, or `nullptr`
+// @param deferred_spans  Queue of the finished request spans, if spans are
+//                        collected per thread, or `nullptr`
+// @param live_control    Settings changed while the server runs, or
+//                        `nullptr`
+// @param governor        Overhead governor, or `nullptr`. While it sheds,
+//                        subrequests are not traced, request spans only have
+//                        the tags identifying the request, and its sampling
+//                        rate applies.
+int on_fixups(request_rec* r, Tracer& g_tracer,
+              SharedRateLimiter* rate_limiter, DeferredSpans* deferred_spans,
+              const LiveControl* live_control, const Governor* governor,
+              module* datadog_module);
+// With `DatadogTailRetention`, the traces of slow and failed requests are
+// kept, on top of the ones kept at the base rate by `on_fixups`. The sampling
+// rates of `live_control` and of `governor` lower the base rate.
+int on_log_transaction(request_rec* r, SharedRateLimiter* rate_limiter,
+                       const LiveControl* live_control,
+                       const Governor* governor, module* datadog_module);
+
+// Tag the span of `r` with its mod_cache status, and apply
+// `DatadogCacheHitSampling` to cache hits. Requests answered by the quick
+// handler of mod_cache never reach `on_fixups`: their span, if any, is
+// started here, back-dated to the start of the request.
+//
+// Must be called before `record_trace_stats` and `on_log_transaction`.
+//
+// @param tracer  Tracer of the server of `r`, or `nullptr`
+void trace_cache_lookup(request_rec* r, Tracer* tracer,
+                        DeferredSpans* deferred_spans,
+                        const LiveControl* live_control,
+                        module* datadog_module);
+
+// Count the request span of `r` in the shared trace statistics, whether or
+// not its trace will be kept by the sampler.
+void record_trace_stats(request_rec* r, stats::SharedTable& table,
+                        const SpanDefaults& defaults, module* datadog_module);
+
+// Count another top-level span of the module, such as the span of a
+// connection, in the shared trace statistics. The Agent computes none for
+// the payloads of the module, which tell it they are computed already.
+void record_span_stats(stats::SharedTable& table, const SpanDefaults& defaults,
+                       std::string_view name, std::string_view resource,
+                       std::string_view span_kind,
+                       std::chrono::microseconds duration);
 
 }  // namespace datadog::tracing
@@ -0,0 +1,245 @@
+#include "http_response_parser.h"
+
+#include <algorithm>
+#include <cctype>
+#include <limits>
+
+namespace datadog::tracing {
+namespace {
+
+std::string to_lower(std::string_view value) {
+  std::string result{value};
+  std::transform(result.begin(), result.end(), result.begin(),
+                 [](unsigned char ch) { return std::tolower(ch); });
+  return result;
+}
+
+std::string_view trim(std::string_view value) {
+  while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+    value.remove_prefix(1);
+  }
+  while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+    value.remove_suffix(1);
+  }
+  return value;
+}
+
+// Parse a non-empty number of digits of `base`, 10 or 16. Unlike `strtoull`,
+// reject signs, prefixes and overflows.
+std::optional<std::size_t> parse_size(std::string_view text,
+                                      std::size_t base) {
+  if (text.empty()) return std::nullopt;
+
+  constexpr std::size_t max = std::numeric_limits<std::size_t>::max();
+  std::size_t value = 0;
+  for (const char ch : text) {
+    std::size_t digit;
+    if (ch >= '0' && ch <= '9') {
+      digit = ch - '0';
+    } else if (base == 16 && ch >= 'a' && ch <= 'f') {
+      digit = ch - 'a' + 10;
+    } else if (base == 16 && ch >= 'A' && ch <= 'F') {
+      digit = ch - 'A' + 10;
+    } else {
+      return std::nullopt;
+    }
+    if (value > (max - digit) / base) return std::nullopt;
+    value = value * base + digit;
+  }
+  return value;
+}
+
+}  // namespace
+
+void ResponseParser::reset() {
+  state_ = State::STATUS_LINE;
+  buffer_.clear();
+  position_ = 0;
+  remaining_ = 0;
+  received_ = false;
+  is_http_1_0_ = false;
+  status = 0;
+  headers.clear();
+  body.clear();
+  keep_alive = true;
+}
+
+ResponseParser::Result ResponseParser::feed(std::string_view data) {
+  received_ = received_ || !data.empty();
+  buffer_.append(data);
+  const Result result = parse();
+
+  buffer_.erase(0, position_);
+  position_ = 0;
+  return result;
+}
+
+ResponseParser::Result ResponseParser::finish() {
+  if (state_ == State::BODY_UNTIL_CLOSE) state_ = State::DONE;
+  return state_ == State::DONE ? Result::COMPLETE : Result::INVALID;
+}
+
+const std::string* ResponseParser::find_header(std::string_view name) const {
+  auto found = headers.find(std::string(name));
+  return found == headers.end() ? nullptr : &found->second;
+}
+
+std::optional<std::string_view> ResponseParser::next_line() {
+  const auto end = buffer_.find('\n', position_);
+  if (end == std::string::npos) return std::nullopt;
+
+  std::string_view line{buffer_.data() + position_, end - position_};
+  if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+  position_ = end + 1;
+  return line;
+}
+
+bool ResponseParser::is_line_too_long() const {
+  return buffer_.size() - position_ > max_line_size;
+}
+
+void ResponseParser::take_body() {
+  const std::size_t size = std::min(remaining_, buffer_.size() - position_);
+  body.append(buffer_, position_, size);
+  position_ += size;
+  remaining_ -= size;
+}
+
+ResponseParser::Result ResponseParser::on_headers_end() {
+  // Interim responses, e.g. "100 Continue", precede the final one.
+  if (status < 200) {
+    headers.clear();
+    state_ = State::STATUS_LINE;
+    return Result::INCOMPLETE;
+  }
+
+  if (const auto* connection = find_header("connection")) {
+    const std::string value = to_lower(*connection);
+    if (value.find("close") != std::string::npos) keep_alive = false;
+    if (is_http_1_0_ && value.find("keep-alive") == std::string::npos) {
+      keep_alive = false;
+    }
+  } else if (is_http_1_0_) {
+    keep_alive = false;
+  }
+
+  if (status == 204 || status == 304) {
+    state_ = State::DONE;
+  } else if (const auto* encoding = find_header("transfer-encoding");
+             encoding != nullptr &&
+             to_lower(*encoding).find("chunked") != std::string::npos) {
+    state_ = State::CHUNK_SIZE;
+  } else if (const auto* length = find_header("content-length")) {
+    const auto size = parse_size(*length, 10);
+    if (!size || *size > max_body_size_) return Result::INVALID;
+    remaining_ = *size;
+    state_ = remaining_ == 0 ? State::DONE : State::BODY_LENGTH;
+  } else {
+    keep_alive = false;
+    state_ = State::BODY_UNTIL_CLOSE;
+  }
+
+  return Result::INCOMPLETE;
+}
+
+ResponseParser::Result ResponseParser::parse() {
+  for (;;) {
+    switch (state_) {
+      case State::STATUS_LINE: {
+        auto line = next_line();
+        if (!line) {
+          return is_line_too_long() ? Result::INVALID : Result::INCOMPLETE;
+        }
+        // HTTP/1.1 200 OK
+        if (line->size() < 12 || line->substr(0, 5) != "HTTP/" ||
+            (*line)[8] != ' ') {
+          return Result::INVALID;
+        }
+        is_http_1_0_ = line->substr(0, 8) == "HTTP/1.0";
+        status = 0;
+        for (const char ch : line->substr(9, 3)) {
+          if (ch < '0' || ch > '9') return Result::INVALID;
+          status = status * 10 + (ch - '0');
+        }
+        state_ = State::HEADERS;
+      } break;
+
+      case State::HEADERS: {
+        auto line = next_line();
+        if (!line) {
+          return is_line_too_long() ? Result::INVALID : Result::INCOMPLETE;
+        }
+        if (line->empty()) {
+          if (on_headers_end() == Result::INVALID) return Result::INVALID;
+          break;
+        }
+        const auto colon = line->find(':');
+        if (colon == std::string_view::npos) return Result::INVALID;
+        const std::string_view value = trim(line->substr(colon + 1));
+        auto [it, inserted] =
+            headers.emplace(to_lower(trim(line->substr(0, colon))), value);
+        if (!inserted) {
+          it->second += ", ";
+          it->second += value;
+        }
+      } break;
+
+      case State::BODY_LENGTH:
+        take_body();
+        if (remaining_ != 0) return Result::INCOMPLETE;
+        state_ = State::DONE;
+        break;
+
+      case State::CHUNK_SIZE: {
+        auto line = next_line();
+        if (!line) {
+          return is_line_too_long() ? Result::INVALID : Result::INCOMPLETE;
+        }
+        // Chunk extensions, after ';', are ignored.
+        const auto size =
+            parse_size(trim(line->substr(0, line->find(';'))), 16);
+        if (!size || *size > max_body_size_ - body.size()) {
+          return Result::INVALID;
+        }
+        remaining_ = *size;
+        state_ = remaining_ == 0 ? State::TRAILERS : State::CHUNK_DATA;
+      } break;
+
+      case State::CHUNK_DATA:
+        take_body();
+        if (remaining_ != 0) return Result::INCOMPLETE;
+        state_ = State::CHUNK_END;
+        break;
+
+      case State::CHUNK_END: {
+        auto line = next_line();
+        if (!line) {
+          return is_line_too_long() ? Result::INVALID : Result::INCOMPLETE;
+        }
+        if (!line->empty()) return Result::INVALID;
+        state_ = State::CHUNK_SIZE;
+      } break;
+
+      case State::TRAILERS: {
+        auto line = next_line();
+        if (!line) {
+          return is_line_too_long() ? Result::INVALID : Result::INCOMPLETE;
+        }
+        if (line->empty()) state_ = State::DONE;
+      } break;
+
+      case State::BODY_UNTIL_CLOSE: {
+        const std::size_t size = buffer_.size() - position_;
+        if (size > max_body_size_ - body.size()) return Result::INVALID;
+        body.append(buffer_, position_, size);
+        position_ = buffer_.size();
+        return Result::INCOMPLETE;
+      }
+
+      case State::DONE:
+        return Result::COMPLETE;
+    }
+  }
+}
+
+}  // namespace datadog::tracing
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace datadog::tracing {
+
+// Incremental HTTP/1.1 response parser of `AprHTTPClient`.
+//
+// Bytes are fed as they are received, in pieces of any size. Bodies are
+// delimited by `Content-Length`, by chunked transfer encoding, or by the end
+// of the connection. Interim responses, such as `100 Continue`, are skipped.
+class ResponseParser final {
+ public:
+  enum class Result { INCOMPLETE, COMPLETE, INVALID };
+
+  // Longest status line, header or chunk size line accepted.
+  static constexpr std::size_t max_line_size = 64 * 1024;
+  // Largest body accepted by default. Agent responses are a few KB of JSON.
+  static constexpr std::size_t default_max_body_size = 1024 * 1024;
+
+ private:
+  enum class State {
+    STATUS_LINE,
+    HEADERS,
+    BODY_LENGTH,
+    CHUNK_SIZE,
+    CHUNK_DATA,
+    CHUNK_END,
+    TRAILERS,
+    BODY_UNTIL_CLOSE,
+    DONE
+  };
+
+  std::size_t max_body_size_;
+  State state_ = State::STATUS_LINE;
+  std::string buffer_;
+  std::size_t position_ = 0;
+  std::size_t remaining_ = 0;
+  bool received_ = false;
+  bool is_http_1_0_ = false;
+
+ public:
+  int status = 0;
+  // Header names are lower case. Values of repeated headers are joined with
+  // ", ".
+  std::unordered_map<std::string, std::string> headers;
+  std::string body;
+  bool keep_alive = true;
+
+  explicit ResponseParser(std::size_t max_body_size = default_max_body_size)
+      : max_body_size_(max_body_size) {}
+
+  // Get ready for the response to another request.
+  void reset();
+
+  // Whether any byte of the response was received.
+  bool received_anything() const { return received_; }
+
+  Result feed(std::string_view data);
+
+  // The peer closed the connection.
+  Result finish();
+
+  // Value of the header `name`, in lower case, or `nullptr`.
+  const std::string* find_header(std::string_view name) const;
+
+ private:
+  Result parse();
+  Result on_headers_end();
+  std::optional<std::string_view> next_line();
+  bool is_line_too_long() const;
+  void take_body();
+};
+
+}  // namespace datadog::tracing
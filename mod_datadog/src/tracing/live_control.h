@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace datadog::tracing {
+
+// Overrides of the tracing configuration, changed while the server runs.
+struct LiveSettings final {
+  // Stop tracing every virtual host. Otherwise, `DatadogTracing` applies.
+  bool tracing_disabled = false;
+  // Ratio of new traces to keep, instead of the sampler of the tracer.
+  std::optional<double> sampling_rate;
+
+  bool operator==(const LiveSettings& other) const {
+    return tracing_disabled == other.tracing_disabled &&
+           sampling_rate == other.sampling_rate;
+  }
+};
+
+// Parse the content of a `DatadogLiveControl` file: one `key value` setting
+// per line, among
+//   tracing on|off
+//   sampling_rate <0..1>|default
+// Empty lines and lines starting with `#` are ignored. Return false and set
+// `error` on the first invalid line.
+inline bool parse_live_settings(std::string_view text, LiveSettings& settings,
+                                std::string& error) {
+  const auto trim = [](std::string_view value) {
+    const auto beg = value.find_first_not_of(" \t\r");
+    if (beg == value.npos) return std::string_view{};
+    return value.substr(beg, value.find_last_not_of(" \t\r") - beg + 1);
+  };
+
+  settings = LiveSettings{};
+  std::size_t line_number = 0;
+  while (!text.empty()) {
+    ++line_number;
+    const auto end = text.find('\n');
+    const auto line = trim(text.substr(0, end));
+    text = end == text.npos ? std::string_view{} : text.substr(end + 1);
+    if (line.empty() || line.front() == '#') continue;
+
+    const auto separator = line.find_first_of(" \t");
+    const auto key = line.substr(0, separator);
+    const auto value = separator == line.npos
+                           ? std::string_view{}
+                           : trim(line.substr(separator));
+
+    if (key == "tracing" && (value == "on" || value == "off")) {
+      settings.tracing_disabled = value == "off";
+    } else if (key == "sampling_rate" && value == "default") {
+      settings.sampling_rate.reset();
+    } else if (key == "sampling_rate" && !value.empty()) {
+      const std::string number{value};
+      char* number_end = nullptr;
+      errno = 0;
+      const double rate = std::strtod(number.c_str(), &number_end);
+      if (errno == ERANGE || *number_end != '\0' || !(rate >= 0.0) ||
+          rate > 1.0) {
+        error = "line " + std::to_string(line_number) +
+                ": sampling_rate must be between 0 and 1, or default";
+        return false;
+      }
+      settings.sampling_rate = rate;
+    } else {
+      error = "line " + std::to_string(line_number) + ": unknown setting \"" +
+              std::string(line) + "\"";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Live settings shared by every child process, in shared memory created by
+// the parent process (see `common::make_shared_memory`).
+//
+// The settings and an epoch, incremented by every change, are packed into a
+// single word, so that request threads read a consistent state with a single
+// atomic load. A zero-filled block holds the defaults.
+//
+// Word layout: epoch on bits 0-31, tracing disabled on bit 32, sampling rate
+// set on bit 33, sampling rate in millionths on bits 34-63.
+class LiveControl final {
+  std::atomic<std::uint64_t> word_;
+  // Identity of the last control file version applied, so that only one
+  // child applies each change.
+  std::atomic<std::uint64_t> source_stamp_;
+
+  static constexpr std::uint64_t k_epoch_mask = 0xFFFFFFFFu;
+  static constexpr std::uint64_t k_tracing_disabled = std::uint64_t{1} << 32;
+  static constexpr std::uint64_t k_has_sampling_rate = std::uint64_t{1} << 33;
+  static constexpr int k_sampling_rate_shift = 34;
+  static constexpr double k_sampling_rate_unit = 1e6;
+
+ public:
+  struct State final {
+    std::uint32_t epoch = 0;  ///< 0 until the settings are first changed
+    LiveSettings settings;
+  };
+
+  State load() const {
+    const std::uint64_t word = word_.load(std::memory_order_relaxed);
+    State state;
+    state.epoch = static_cast<std::uint32_t>(word & k_epoch_mask);
+    state.settings.tracing_disabled = (word & k_tracing_disabled) != 0;
+    if (word & k_has_sampling_rate) {
+      state.settings.sampling_rate =
+          static_cast<double>(word >> k_sampling_rate_shift) /
+          k_sampling_rate_unit;
+    }
+    return state;
+  }
+
+  // Replace the settings and return the new epoch. The sampling rate is
+  // rounded to the millionth.
+  std::uint32_t store(const LiveSettings& settings) {
+    std::uint64_t flags = 0;
+    if (settings.tracing_disabled) flags |= k_tracing_disabled;
+    if (settings.sampling_rate) {
+      flags |= k_has_sampling_rate;
+      flags |= static_cast<std::uint64_t>(
+                   std::lround(*settings.sampling_rate * k_sampling_rate_unit))
+               << k_sampling_rate_shift;
+    }
+
+    std::uint64_t word = word_.load(std::memory_order_relaxed);
+    std::uint64_t next;
+    do {
+      const std::uint64_t epoch = ((word & k_epoch_mask) + 1) & k_epoch_mask;
+      next = flags | (epoch == 0 ? 1 : epoch);
+    } while (!word_.compare_exchange_weak(word, next,
+                                          std::memory_order_relaxed));
+    return static_cast<std::uint32_t>(next & k_epoch_mask);
+  }
+
+  // Claim the application of the control file version `stamp`. Return false
+  // if it was already applied, by this process or another one.
+  bool claim(std::uint64_t stamp) {
+    std::uint64_t current = source_stamp_.load(std::memory_order_relaxed);
+    while (current != stamp) {
+      if (source_stamp_.compare_exchange_weak(current, stamp,
+                                              std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+}  // namespace datadog::tracing
@@ -0,0 +1,84 @@
+#include "live_control_watcher.h"
+
+#include <http_log.h>
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+APLOG_USE_MODULE(datadog);
+
+namespace datadog::tracing {
+namespace {
+
+constexpr std::chrono::seconds k_poll_interval{1};
+
+// Stamp of a missing file. 0 means "never polled".
+constexpr std::uint64_t k_missing_stamp = 1;
+
+std::uint64_t make_stamp(const struct stat& status) {
+  const auto mtime_ns =
+      static_cast<std::uint64_t>(status.st_mtim.tv_sec) * 1'000'000'000u +
+      static_cast<std::uint64_t>(status.st_mtim.tv_nsec);
+  std::uint64_t stamp = mtime_ns * 0x9E3779B97F4A7C15u ^
+                        static_cast<std::uint64_t>(status.st_size) ^
+                        (static_cast<std::uint64_t>(status.st_ino) << 17);
+  return stamp <= k_missing_stamp ? stamp + 2 : stamp;
+}
+
+std::string describe(const LiveSettings& settings) {
+  std::string description =
+      settings.tracing_disabled ? "tracing off" : "tracing on";
+  description += ", sampling rate ";
+  description += settings.sampling_rate
+                     ? std::to_string(*settings.sampling_rate)
+                     : std::string("default");
+  return description;
+}
+
+}  // namespace
+
+LiveControlWatcher::LiveControlWatcher(LiveControl& control, std::string path,
+                                       server_rec* server,
+                                       EventScheduler& scheduler)
+    : control_(control), path_(std::move(path)), server_(server) {
+  poll();
+  cancel_poll_ =
+      scheduler.schedule_recurring_event(k_poll_interval, [this] { poll(); });
+}
+
+LiveControlWatcher::~LiveControlWatcher() { cancel_poll_(); }
+
+void LiveControlWatcher::poll() {
+  struct stat status;
+  const bool exists = stat(path_.c_str(), &status) == 0;
+  if (!exists && errno != ENOENT) return;
+
+  if (!control_.claim(exists ? make_stamp(status) : k_missing_stamp)) return;
+
+  LiveSettings settings;
+  if (exists) {
+    std::ifstream file(path_);
+    std::ostringstream content;
+    content << file.rdbuf();
+    std::string error;
+    if (!file || !parse_live_settings(content.str(), settings, error)) {
+      ap_log_error(APLOG_MARK, APLOG_ERR, 0, server_,
+                   "Ignoring live control file %s: %s", path_.c_str(),
+                   error.empty() ? "could not read it" : error.c_str());
+      return;
+    }
+  }
+
+  if (settings == control_.load().settings) return;
+
+  const std::uint32_t epoch = control_.store(settings);
+  ap_log_error(APLOG_MARK, APLOG_NOTICE, 0, server_,
+               "Live control updated from %s (epoch %u): %s", path_.c_str(),
+               epoch, describe(settings).c_str());
+}
+
+}  // namespace datadog::tracing
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <datadog/event_scheduler.h>
+#include <httpd.h>
+
+#include <cstdint>
+#include <string>
+
+#include "live_control.h"
+
+namespace datadog::tracing {
+
+// Apply the content of a `DatadogLiveControl` file to the shared
+// `LiveControl` block.
+//
+// Every child polls the file from the exporter thread; the first one to see
+// a new version of it parses it and publishes the settings for all. Removing
+// the file restores the configured behavior. An invalid file is reported in
+// the error log and leaves the settings unchanged.
+class LiveControlWatcher final {
+  LiveControl& control_;
+  std::string path_;
+  server_rec* server_;
+  EventScheduler::Cancel cancel_poll_;
+
+ public:
+  // @param server  Server used for logging
+  LiveControlWatcher(LiveControl& control, std::string path,
+                     server_rec* server, EventScheduler& scheduler);
+  ~LiveControlWatcher();
+
+  void poll();
+};
+
+}  // namespace datadog::tracing
@@ -0,0 +1,251 @@
+#include "long_requests.h"
+
+#include <apr_pools.h>
+#include <datadog/dict_reader.h>
+#include <datadog/dict_writer.h>
+#include <datadog/span_config.h>
+
+#include <functional>
+#include <new>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hooks.h"
+#include "request_traffic.h"
+#include "status/scoreboard.h"
+
+namespace datadog::tracing {
+namespace {
+
+using Context = std::vector<std::pair<std::string, std::string>>;
+
+class ContextWriter final : public DictWriter {
+  Context& context_;
+
+ public:
+  explicit ContextWriter(Context& context) : context_(context) {}
+
+  void set(StringView key, StringView value) override {
+    context_.emplace_back(std::string(key), std::string(value));
+  }
+};
+
+class ContextReader final : public DictReader {
+  const Context& context_;
+
+ public:
+  explicit ContextReader(const Context& context) : context_(context) {}
+
+  Optional<StringView> lookup(StringView key) const override {
+    for (const auto& [name, value] : context_) {
+      if (name == key) return StringView(value);
+    }
+    return nullopt;
+  }
+
+  void visit(const std::function<void(StringView key, StringView value)>&
+                 visitor) const override {
+    for (const auto& [name, value] : context_) visitor(name, value);
+  }
+};
+
+// Values sent by the previous checkpoint.
+struct Reported final {
+  std::uint64_t bytes_in = 0;
+  std::uint64_t bytes_out = 0;
+  std::uint64_t messages_in = 0;
+  std::uint64_t messages_out = 0;
+  std::uint64_t checkpoints = 0;
+};
+
+// A checkpoint to send, copied while the lock is held.
+struct Checkpoint final {
+  Tracer* tracer;
+  const SpanDefaults* defaults;
+  stats::SharedTable* trace_stats;
+  std::string resource;
+  Context context;
+  apr_time_t start;
+  Reported previous;
+  Reported current;
+};
+
+double to_ms(apr_time_t duration) {
+  return static_cast<double>(duration) / 1000.0;
+}
+
+// Span continuing the trace of a long request from its propagated context.
+// Its parent is in another payload: for the Agent, it is a top-level span,
+// counted in `trace_stats` if not `nullptr`.
+std::optional<Span> make_span(Tracer& tracer, const SpanDefaults& defaults,
+                              stats::SharedTable* trace_stats,
+                              const Context& context, const char* name,
+                              const std::string& resource) {
+  SpanConfig options;
+  options.name = name;
+  options.resource = resource;
+  options.tags = {{"component", "httpd"}};
+  auto span = tracer.extract_span(ContextReader(context), options);
+  if (span.if_error()) return std::nullopt;
+  status::add(status::Counter::spans_started);
+  // Finished right away.
+  if (trace_stats != nullptr) {
+    record_span_stats(*trace_stats, defaults, name, resource, "",
+                      std::chrono::microseconds{0});
+  }
+  return std::move(*span);
+}
+
+void send(const Checkpoint& checkpoint) {
+  auto span = make_span(*checkpoint.tracer, *checkpoint.defaults,
+                        checkpoint.trace_stats, checkpoint.context,
+                        "httpd.long_request.checkpoint", checkpoint.resource);
+  if (!span) return;
+
+  const Reported& previous = checkpoint.previous;
+  const Reported& current = checkpoint.current;
+  span->set_metric("httpd.long_request.checkpoint",
+                   static_cast<double>(current.checkpoints));
+  span->set_metric("httpd.long_request.elapsed_ms",
+                   to_ms(apr_time_now() - checkpoint.start));
+  span->set_metric("httpd.long_request.bytes_in",
+                   static_cast<double>(current.bytes_in - previous.bytes_in));
+  span->set_metric(
+      "httpd.long_request.bytes_out",
+      static_cast<double>(current.bytes_out - previous.bytes_out));
+  span->set_metric(
+      "httpd.long_request.messages_in",
+      static_cast<double>(current.messages_in - previous.messages_in));
+  span->set_metric(
+      "httpd.long_request.messages_out",
+      static_cast<double>(current.messages_out - previous.messages_out));
+  span->set_metric("httpd.long_request.bytes_in.total",
+                   static_cast<double>(current.bytes_in));
+  span->set_metric("httpd.long_request.bytes_out.total",
+                   static_cast<double>(current.bytes_out));
+  // Finished as it goes out of scope.
+  status::add(status::Counter::spans_finished);
+}
+
+}  // namespace
+
+// A long request in flight, allocated from its pool.
+struct LongRequests::Entry final {
+  LongRequests* owner;
+  apr_time_t start;  ///< When the request was received
+  Span* span;
+  Tracer* tracer;
+  const SpanDefaults* defaults;
+  std::string resource;
+  Context context;
+  const RequestTraffic* traffic = nullptr;  ///< Read by the exporter thread
+  Reported reported;  ///< Guarded by the mutex of `owner`
+  Entry* prev = nullptr;
+  Entry* next = nullptr;
+};
+
+LongRequests::LongRequests(EventScheduler& scheduler,
+                           std::chrono::seconds checkpoint_interval,
+                           stats::SharedTable* trace_stats)
+    : checkpoint_interval_(checkpoint_interval), trace_stats_(trace_stats) {
+  cancel_checkpoint_ = scheduler.schedule_recurring_event(
+      checkpoint_interval_, [this] { checkpoint(); });
+}
+
+LongRequests::~LongRequests() { cancel_checkpoint_(); }
+
+void LongRequests::start(request_rec* r, Span& span, Tracer& tracer,
+                         const SpanDefaults& defaults) {
+  void* buffer = apr_palloc(r->pool, sizeof(Entry));
+  auto* entry =
+      new (buffer) Entry{this, r->request_time, &span, &tracer, &defaults};
+  entry->resource = make_resource_name(r);
+  ContextWriter writer{entry->context};
+  span.inject(writer);
+
+  if (auto start_span = make_span(tracer, defaults, trace_stats_,
+                                  entry->context, "httpd.long_request.start",
+                                  entry->resource)) {
+    // Finished as it goes out of scope.
+    status::add(status::Counter::spans_finished);
+  }
+
+  // Shared with `DatadogResourceAccounting`, and freed with `r`.
+  entry->traffic = &count_request_traffic(r);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entry->next = entries_;
+    if (entries_ != nullptr) entries_->prev = entry;
+    entries_ = entry;
+  }
+
+  // Registered after the cleanup finishing the span: runs before it.
+  apr_pool_cleanup_register(r->pool, entry, finish, apr_pool_cleanup_null);
+}
+
+apr_status_t LongRequests::finish(void* data) {
+  auto* entry = static_cast<Entry*>(data);
+
+  std::uint64_t checkpoints = 0;
+  {
+    std::lock_guard<std::mutex> lock(entry->owner->mutex_);
+    if (entry->prev != nullptr) entry->prev->next = entry->next;
+    if (entry->next != nullptr) entry->next->prev = entry->prev;
+    if (entry->owner->entries_ == entry) entry->owner->entries_ = entry->next;
+    checkpoints = entry->reported.checkpoints;
+  }
+
+  Span* span = entry->span;
+  const RequestTraffic& traffic = *entry->traffic;
+  span->set_metric("httpd.long_request.checkpoints",
+                   static_cast<double>(checkpoints));
+  span->set_metric("httpd.long_request.bytes_in",
+                   static_cast<double>(traffic.in.bytes.load()));
+  span->set_metric("httpd.long_request.bytes_out",
+                   static_cast<double>(traffic.out.bytes.load()));
+  span->set_metric("httpd.long_request.messages_in",
+                   static_cast<double>(traffic.in.messages.load()));
+  span->set_metric("httpd.long_request.messages_out",
+                   static_cast<double>(traffic.out.messages.load()));
+
+  entry->~Entry();
+  return APR_SUCCESS;
+}
+
+void LongRequests::checkpoint() {
+  const apr_time_t now = apr_time_now();
+  const auto interval = apr_time_from_sec(checkpoint_interval_.count());
+
+  std::vector<Checkpoint> checkpoints;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Entry* entry = entries_; entry != nullptr; entry = entry->next) {
+      // Requests shorter than the interval only have their span.
+      if (now - entry->start < interval) continue;
+
+      const RequestTraffic& traffic = *entry->traffic;
+      Reported current;
+      current.bytes_in = traffic.in.bytes.load(std::memory_order_relaxed);
+      current.bytes_out = traffic.out.bytes.load(std::memory_order_relaxed);
+      current.messages_in =
+          traffic.in.messages.load(std::memory_order_relaxed);
+      current.messages_out =
+          traffic.out.messages.load(std::memory_order_relaxed);
+      current.checkpoints = entry->reported.checkpoints + 1;
+
+      checkpoints.push_back(Checkpoint{entry->tracer, entry->defaults,
+                                       trace_stats_, entry->resource,
+                                       entry->context, entry->start,
+                                       entry->reported, current});
+      entry->reported = current;
+    }
+  }
+
+  // Sent without the lock, which requests starting and finishing take.
+  for (const auto& checkpoint : checkpoints) send(checkpoint);
+}
+
+}  // namespace datadog::tracing
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <datadog/event_scheduler.h>
+#include <datadog/span.h>
+#include <datadog/span_defaults.h>
+#include <datadog/tracer.h>
+#include <httpd.h>
+
+#include <chrono>
+#include <mutex>
+
+#include "stats.h"
+
+namespace datadog::tracing {
+
+// Requests lasting minutes or hours, for `DatadogLongRequests`: WebSocket
+// tunnels, server-sent events, long polling.
+//
+// The span of a request only reaches the Agent once the request is done.
+// For these requests, a `httpd.long_request.start` span is sent as soon as
+// the request starts, then the exporter thread sends a
+// `httpd.long_request.checkpoint` span every checkpoint interval, with the
+// bytes and reads and writes of each direction since the previous one. Both
+// continue the trace of the request span from its propagation headers, as a
+// downstream service would: they are finished and sent right away, so that
+// the memory held by a request does not grow with its duration. The request
+// span closes the request as usual, with the totals.
+//
+// Bytes are counted by the `RequestTraffic` connection filters.
+class LongRequests final {
+ public:
+  struct Entry;
+
+ private:
+  std::chrono::seconds checkpoint_interval_;
+  stats::SharedTable* trace_stats_;
+  std::mutex mutex_;
+  Entry* entries_ = nullptr;  ///< Requests in flight
+  EventScheduler::Cancel cancel_checkpoint_;
+
+  static apr_status_t finish(void* data);
+
+ public:
+  // @param trace_stats  Trace statistics computed by the module, which count
+  //                     the start and checkpoint spans, or `nullptr`
+  LongRequests(EventScheduler& scheduler,
+               std::chrono::seconds checkpoint_interval,
+               stats::SharedTable* trace_stats);
+  ~LongRequests();
+
+  // Follow the top-level request `r` until it is destroyed.
+  //
+  // @param span      Span of `r`
+  // @param tracer    Tracer of the server of `r`
+  // @param defaults  Span defaults of `tracer`
+  void start(request_rec* r, Span& span, Tracer& tracer,
+             const SpanDefaults& defaults);
+
+  void checkpoint();
+};
+
+}  // namespace datadog::tracing
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace datadog::tracing {
+
+// Token bucket shared by every child process, allowing `per_second` traces
+// per second on average and bursts of up to one second worth of traces.
+//
+// It lives in shared memory created by the parent process (see
+// `common::make_shared_memory`), so that the limit applies to the whole
+// server regardless of the number of children. The bucket is implemented as
+// a generic cell rate algorithm: a single atomic holds the theoretical
+// arrival time of the next trace, updated with a compare-and-swap.
+//
+// `std::chrono::steady_clock` is `CLOCK_MONOTONIC`, whose time is the same
+// in every process.
+class SharedRateLimiter final {
+  std::atomic<std::int64_t> next_ns_;
+  std::int64_t interval_ns_;
+  std::int64_t burst_ns_;  ///< Tolerance, in nanoseconds
+
+ public:
+  // Set the limit. Must be called before children are forked.
+  void configure(double per_second) {
+    interval_ns_ = per_second > 0
+                       ? static_cast<std::int64_t>(1'000'000'000.0 / per_second)
+                       : INT64_MAX;
+    // How far ahead of `now` the next arrival may be: one token less than a
+    // second worth of them.
+    const auto burst = std::max<std::int64_t>(
+        1, static_cast<std::int64_t>(per_second));
+    burst_ns_ = interval_ns_ == INT64_MAX ? 0 : (burst - 1) * interval_ns_;
+    next_ns_.store(0, std::memory_order_relaxed);
+  }
+
+  // Take a token, if any is available at `now`.
+  bool allow(std::chrono::steady_clock::time_point now) {
+    if (interval_ns_ == INT64_MAX) return false;
+
+    const std::int64_t now_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            now.time_since_epoch())
+            .count();
+
+    std::int64_t next_ns = next_ns_.load(std::memory_order_relaxed);
+    for (;;) {
+      const std::int64_t start_ns = std::max(next_ns, now_ns);
+      if (start_ns - now_ns > burst_ns_) return false;
+
+      if (next_ns_.compare_exchange_weak(next_ns, start_ns + interval_ns_,
+                                         std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+  }
+};
+
+}  // namespace datadog::tracing
@@ -0,0 +1,199 @@
+#include "registry.h"
+
+#include <datadog/datadog_agent_config.h>
+#include <fmt/core.h>
+#include <http_log.h>
+
+#include <cstdlib>
+#include <string_view>
+#include <variant>
+
+#include "apr_http_client.h"
+#include "buffered_http_client.h"
+#include "common_conf.h"
+#include "compressing_http_client.h"
+#include "event_loop.h"
+#include "retention_collector.h"
+#include "stats_exporter.h"
+#include "status/http_client.h"
+
+APLOG_USE_MODULE(datadog);
+
+namespace datadog::tracing {
+namespace {
+
+std::string make_config_key(const TracerConfig& conf) {
+  std::string key = fmt::format(
+      "{}|{}|{}|{}|{}", conf.service.value_or(""),
+      conf.environment.value_or(""), conf.version.value_or(""),
+      conf.agent.url.value_or(""),
+      conf.trace_sampler.sample_rate ? *conf.trace_sampler.sample_rate : -1.0);
+
+  if (conf.injection_styles) {
+    for (const auto style : *conf.injection_styles) {
+      key += fmt::format("|{}", static_cast<int>(style));
+    }
+  }
+
+  return key;
+}
+
+// The built-in client does not speak TLS; such Agent URLs keep the libcurl
+// based default.
+bool uses_tls(const TracerConfig& conf) {
+  const char* env_url = std::getenv("DD_TRACE_AGENT_URL");
+  const std::string_view url =
+      env_url != nullptr ? std::string_view{env_url}
+                         : std::string_view{conf.agent.url.value_or("")};
+  return url.substr(0, 5) == "https";
+}
+
+// Compression is not worth its CPU time over a Unix domain socket.
+bool uses_tcp(const HTTPClient::URL& url) {
+  return url.scheme == "http" || url.scheme == "https";
+}
+
+}  // namespace
+
+void TracerRegistry::init(server_rec* main_server, module* datadog_module,
+                          bool client_computed_stats, Spool* spool) {
+  spool_ = spool;
+  if (const auto* main_conf = static_cast<datadog::conf::Module*>(
+          ap_get_module_config(main_server->module_config, datadog_module))) {
+    trace_buffer_ = main_conf->trace_buffer;
+    trace_compression_ = main_conf->trace_compression;
+  }
+
+  // Every tracer shares the client of the first one: a single virtual host
+  // reaching its Agent over TLS keeps them all on libcurl.
+  uses_tls_ = false;
+  for (server_rec* server = main_server; server != nullptr;
+       server = server->next) {
+    if (const auto* module_conf = static_cast<datadog::conf::Module*>(
+            ap_get_module_config(server->module_config, datadog_module))) {
+      uses_tls_ = uses_tls_ || uses_tls(module_conf->tracing);
+    }
+  }
+
+  for (server_rec* server = main_server; server != nullptr;
+       server = server->next) {
+    auto* module_conf = static_cast<datadog::conf::Module*>(
+        ap_get_module_config(server->module_config, datadog_module));
+    if (module_conf == nullptr) {
+      ap_log_error(APLOG_MARK, APLOG_ERR, 0, server,
+                   "Missing datadog configuration");
+      continue;
+    }
+
+    TracerConfig& tracer_conf = module_conf->tracing;
+    const bool tail_retention =
+        module_conf->tail_retention.enabled.value_or(false);
+    std::string config_key = make_config_key(tracer_conf);
+    if (tail_retention) config_key += "|tail_retention";
+
+    auto found = entries_by_config_.find(config_key);
+    if (found == entries_by_config_.end()) {
+      auto entry = make_entry(tracer_conf, server == main_server,
+                              client_computed_stats, tail_retention);
+      if (!entry) continue;
+      found = entries_by_config_.emplace(config_key, std::move(*entry)).first;
+    }
+
+    entries_by_server_.emplace(server, &found->second);
+  }
+}
+
+Tracer* TracerRegistry::find(const server_rec* server) const {
+  const Entry* entry = find_entry(server);
+  return entry == nullptr ? nullptr : entry->tracer.get();
+}
+
+const TracerRegistry::Entry* TracerRegistry::find_entry(
+    const server_rec* server) const {
+  auto found = entries_by_server_.find(server);
+  if (found == entries_by_server_.end()) return nullptr;
+  return found->second;
+}
+
+std::optional<TracerRegistry::Entry> TracerRegistry::make_entry(
+    TracerConfig& tracer_conf, bool is_main_server,
+    bool client_computed_stats, bool tail_retention) {
+  const bool is_service_set = tracer_conf.service.has_value();
+  if (!is_service_set) {
+    // NOTE: Could use s->process->short_name for the default service name.
+    tracer_conf.service = "httpd";
+  }
+
+  // Every tracer after the first one reuses the exporter pipeline of the
+  // first one instead of spawning its own HTTP client and scheduler thread.
+  tracer_conf.agent.http_client = http_client_;
+  tracer_conf.agent.event_scheduler = event_scheduler_;
+  if (http_client_ == nullptr && !uses_tls_) {
+    // Timers and Agent requests share a single thread.
+    if (auto loop = EventLoop::create()) {
+      tracer_conf.agent.http_client = std::make_shared<AprHTTPClient>(loop);
+      tracer_conf.agent.event_scheduler =
+          std::make_shared<EventLoopScheduler>(loop);
+    }
+  }
+
+  auto validated_config = finalize_config(tracer_conf);
+  if (auto error = validated_config.if_error()) {
+    tracer_conf.logger->log_error(*error);
+    return std::nullopt;
+  }
+
+  if (!is_service_set) {
+    // Trick: change the service name origin to default as "httpd" is the
+    // default value when no service name has been provided.
+    auto& service_name_metadata =
+        validated_config->metadata[ConfigName::SERVICE_NAME];
+    service_name_metadata.back().origin = ConfigMetadata::Origin::DEFAULT;
+  }
+
+  auto* agent_conf =
+      std::get_if<FinalizedDatadogAgentConfig>(&validated_config->collector);
+  if (agent_conf != nullptr && !is_main_server) {
+    // Remote configuration is polled once per process, by the main server.
+    // Set after finalization: `DD_REMOTE_CONFIGURATION_ENABLED` would
+    // otherwise turn it back on for every virtual host.
+    agent_conf->remote_configuration_enabled = false;
+  }
+
+  if (agent_conf != nullptr && http_client_ == nullptr) {
+    http_client_ = std::make_shared<status::ScoreboardHTTPClient>(
+        agent_conf->http_client);
+    http_client_ = std::make_shared<BufferedHTTPClient>(
+        std::move(http_client_), *agent_conf->event_scheduler, trace_buffer_,
+        spool_);
+    if (trace_compression_.codec != conf::TraceCompression::Codec::none &&
+        uses_tcp(agent_conf->url)) {
+      // Outside of the buffer, which then holds compressed payloads.
+      http_client_ = std::make_shared<CompressingHTTPClient>(
+          std::move(http_client_), trace_compression_);
+    }
+    if (client_computed_stats) {
+      http_client_ = std::make_shared<stats::ClientComputedStatsHTTPClient>(
+          std::move(http_client_));
+    }
+    agent_conf->http_client = http_client_;
+    event_scheduler_ = agent_conf->event_scheduler;
+    agent_url_ = agent_conf->url;
+  }
+
+  if (agent_conf != nullptr && tail_retention) {
+    // Same Agent and pipeline, but dropped traces are never serialized.
+    auto collector = std::make_shared<RetentionCollector>(
+        agent_conf->http_client, agent_conf->url,
+        *agent_conf->event_scheduler, agent_conf->flush_interval,
+        validated_config->logger);
+    validated_config->collector = std::move(collector);
+  }
+
+  Entry entry;
+  entry.defaults = validated_config->defaults;
+  entry.tracer = std::make_unique<Tracer>(*validated_config);
+  return entry;
+}
+
+}  // namespace datadog::tracing
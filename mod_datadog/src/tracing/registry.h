@@ -0,0 +1,89 @@
+#pragma once
+
+#include <datadog/event_scheduler.h>
+#include <datadog/http_client.h>
+#include <datadog/span_defaults.h>
+#include <datadog/tracer.h>
+#include <http_core.h>
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "compression.h"
+#include "conf.h"
+#include "spool.h"
+
+namespace datadog::tracing {
+
+// Owns the tracers of a child process, one per distinct virtual host
+// configuration.
+//
+// All tracers share a single HTTP client and a single event scheduler, so the
+// number of exporter threads does not grow with the number of virtual hosts.
+// Unless the Agent of any virtual host is reached over TLS, both run on one
+// `EventLoop` thread.
+// Trace payloads go through a `BufferedHTTPClient`, and a
+// `CompressingHTTPClient` for an Agent reached over TCP, configured by the
+// main server.
+// Virtual hosts whose effective tracer configuration is identical share the
+// same tracer. Tracers of servers with `DatadogTailRetention` send their
+// traces through a `RetentionCollector`.
+class TracerRegistry final {
+ public:
+  struct Entry final {
+    std::unique_ptr<Tracer> tracer;
+    SpanDefaults defaults;  ///< Finalized service, environment, version...
+  };
+
+ private:
+  std::shared_ptr<HTTPClient> http_client_;
+  std::shared_ptr<EventScheduler> event_scheduler_;
+  HTTPClient::URL agent_url_;
+  conf::TraceBuffer trace_buffer_;
+  conf::TraceCompression trace_compression_;
+  Spool* spool_ = nullptr;
+  bool uses_tls_ = false;  ///< Whether any server reaches its Agent over TLS
+  std::unordered_map<std::string, Entry> entries_by_config_;
+  std::unordered_map<const server_rec*, const Entry*> entries_by_server_;
+
+ public:
+  // Create the tracers of `main_server` and every virtual host chained to it.
+  //
+  // @param main_server            Main server. Virtual hosts are reached
+  //                               through `server_rec::next`.
+  // @param datadog_module         Datadog module
+  // @param client_computed_stats  Tell the Agent that trace statistics are
+  //                               computed by the module
+  // @param spool                  Spool of the trace payloads the Agent
+  //                               could not take, or `nullptr`
+  void init(server_rec* main_server, module* datadog_module,
+            bool client_computed_stats, Spool* spool);
+
+  // Return the tracer of `server`, or `nullptr` if it could not be created.
+  Tracer* find(const server_rec* server) const;
+
+  // Return the tracer and defaults of `server`, or `nullptr`.
+  const Entry* find_entry(const server_rec* server) const;
+
+  std::size_t tracer_count() const { return entries_by_config_.size(); }
+
+  // Scheduler shared by every tracer, or `nullptr` if no tracer was created.
+  std::shared_ptr<EventScheduler> event_scheduler() const {
+    return event_scheduler_;
+  }
+
+  std::shared_ptr<HTTPClient> http_client() const { return http_client_; }
+
+  // Datadog Agent URL of the main server, without path.
+  const HTTPClient::URL& agent_url() const { return agent_url_; }
+
+ private:
+  std::optional<Entry> make_entry(TracerConfig& tracer_conf,
+                                  bool is_main_server,
+                                  bool client_computed_stats,
+                                  bool tail_retention);
+};
+
+}  // namespace datadog::tracing
@@ -0,0 +1,116 @@
+#include "request_span.h"
+
+#include <ap_mpm.h>
+#include <apr_tables.h>
+
+#include <utility>
+
+#include "../utils.h"
+
+namespace datadog::tracing {
+namespace {
+
+std::string protocol(int protocol_number) {
+  switch (protocol_number) {
+    case 9:
+      return "0.9";
+    case 1000:
+      return "1.0";
+    case 1001:
+      return "1.1";
+    case 2000:
+      return "2.0";
+    case 3000:
+      return "3.0";
+    default:
+      return "";
+  }
+}
+
+}  // namespace
+
+std::string make_resource_name(request_rec* r) {
+  std::string resource_name{r->method};
+  resource_name += " ";
+  resource_name += r->uri;
+  resource_name += " ";
+  resource_name += r->protocol;
+  return resource_name;
+}
+
+void collect_header_tags(const apr_table_t* headers,
+                         const HeaderTags& header_tags,
+                         std::string HeaderTags::Entry::*tag,
+                         std::unordered_map<std::string, std::string>& tags) {
+  struct Visit final {
+    const HeaderTags& header_tags;
+    std::string HeaderTags::Entry::*tag;
+    std::unordered_map<std::string, std::string>& tags;
+  } visit{header_tags, tag, tags};
+
+  apr_table_do(
+      [](void* rec, const char* key, const char* value) -> int {
+        auto* visit = static_cast<Visit*>(rec);
+        if (const auto* entry = visit->header_tags.find(key)) {
+          visit->tags.emplace(entry->*(visit->tag), value);
+        }
+        return 1;
+      },
+      &visit, headers, nullptr);
+}
+
+SpanConfig make_span_config(
+    request_rec* r, std::unordered_map<std::string, std::string> tags,
+    const HeaderTags* header_tags, bool is_local_root, bool minimal) {
+  // Tags identical for every request of the process or of the virtual host
+  // are set on the local root span only. The spans of subrequests and
+  // internal redirects are always sent in the same trace chunk as it.
+  if (is_local_root) {
+    static const std::string httpd_version =
+        common::utils::make_httpd_version();
+    static const char* const mpm_name = ap_show_mpm();
+
+    tags.emplace("component", "httpd");
+    tags.emplace("httpd.version", httpd_version);
+    tags.emplace("httpd.virtual_host",
+                 r->server->is_virtual ? "true" : "false");
+    if (mpm_name != nullptr) tags.emplace("httpd.mpm", mpm_name);
+  }
+
+  tags.emplace("http.method", r->method);
+  if (r->unparsed_uri != nullptr) tags.emplace("http.url", r->unparsed_uri);
+
+  if (!minimal) {
+    tags.emplace("http.version", protocol(r->proto_num));
+    tags.emplace("http.request.content_length", std::to_string(r->clength));
+
+    if (r->hostname != nullptr) tags.emplace("http.host", r->hostname);
+    if (r->useragent_ip != nullptr)
+      tags.emplace("http.client_ip", r->useragent_ip);
+
+    if (auto user_agent = apr_table_get(r->headers_in, "User-Agent");
+        user_agent != nullptr) {
+      tags.emplace("http.useragent", user_agent);
+    }
+
+    if (header_tags != nullptr && !header_tags->empty()) {
+      collect_header_tags(r->headers_in, *header_tags,
+                          &HeaderTags::Entry::request_tag, tags);
+    }
+  }
+
+  datadog::tracing::SpanConfig options;
+  if (r->proxyreq != PROXYREQ_NONE) {
+    options.name = "httpd.proxy";
+    tags.emplace("span.kind", "client");
+  } else {
+    options.name = "httpd.request";
+    tags.emplace("span.kind", "server");
+  }
+  options.resource = make_resource_name(r);
+  options.tags = std::move(tags);
+
+  return options;
+}
+
+}  // namespace datadog::tracing
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <datadog/span_config.h>
+#include <httpd.h>
+
+#include <string>
+#include <unordered_map>
+
+#include "header_tags.h"
+
+namespace datadog::tracing {
+
+// Resource name of the span of `r`, e.g. "GET /index.html HTTP/1.1".
+std::string make_resource_name(request_rec* r);
+
+// Add the tags of the headers configured in `header_tags`, in a single pass
+// over `headers`. A repeated header is reported with its first value.
+void collect_header_tags(const apr_table_t* headers,
+                         const HeaderTags& header_tags,
+                         std::string HeaderTags::Entry::*tag,
+                         std::unordered_map<std::string, std::string>& tags);
+
+// Options of the span of the request, subrequest or internal redirect `r`,
+// with the `tags` configured for its directory.
+//
+// The tags identical for every request of the process or of the virtual
+// host, such as `component` and `httpd.version`, are only set with
+// `is_local_root`. With `minimal`, only the tags identifying the request are
+// set, to save the work of the others while the overhead governor sheds.
+SpanConfig make_span_config(request_rec* r,
+                            std::unordered_map<std::string, std::string> tags,
+                            const HeaderTags* header_tags, bool is_local_root,
+                            bool minimal);
+
+}  // namespace datadog::tracing
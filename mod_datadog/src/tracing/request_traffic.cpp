@@ -0,0 +1,85 @@
+#include "request_traffic.h"
+
+#include <apr_pools.h>
+#include <util_filter.h>
+
+#include <new>
+
+namespace datadog::tracing {
+namespace {
+
+constexpr const char* k_input_filter = "DATADOG_TRAFFIC_IN";
+constexpr const char* k_output_filter = "DATADOG_TRAFFIC_OUT";
+constexpr const char* k_pool_key = "datadog-request-traffic";
+
+// Counters of a request and their filters, allocated from its pool.
+struct Counting final {
+  RequestTraffic traffic;
+  ap_filter_t* input_filter = nullptr;
+  ap_filter_t* output_filter = nullptr;
+};
+
+void count(RequestTraffic::Direction& direction, apr_bucket_brigade* bb) {
+  apr_off_t length = 0;
+  // Buckets of unknown length, such as pipes, are not read to count them.
+  if (apr_brigade_length(bb, 0, &length) != APR_SUCCESS || length <= 0) {
+    return;
+  }
+  direction.bytes.fetch_add(static_cast<std::uint64_t>(length),
+                            std::memory_order_relaxed);
+  direction.messages.fetch_add(1, std::memory_order_relaxed);
+}
+
+apr_status_t input_filter(ap_filter_t* f, apr_bucket_brigade* bb,
+                          ap_input_mode_t mode, apr_read_type_e block,
+                          apr_off_t readbytes) {
+  const apr_status_t result =
+      ap_get_brigade(f->next, bb, mode, block, readbytes);
+  if (result == APR_SUCCESS && mode != AP_MODE_SPECULATIVE) {
+    count(static_cast<Counting*>(f->ctx)->traffic.in, bb);
+  }
+  return result;
+}
+
+apr_status_t output_filter(ap_filter_t* f, apr_bucket_brigade* bb) {
+  count(static_cast<Counting*>(f->ctx)->traffic.out, bb);
+  return ap_pass_brigade(f->next, bb);
+}
+
+// Connection filters outlive the request: remove them with it.
+apr_status_t remove_filters(void* data) {
+  auto* counting = static_cast<Counting*>(data);
+  ap_remove_input_filter(counting->input_filter);
+  ap_remove_output_filter(counting->output_filter);
+  return APR_SUCCESS;
+}
+
+}  // namespace
+
+void register_request_traffic_filters() {
+  // mod_ssl filters at AP_FTYPE_CONNECTION + 5.
+  ap_register_input_filter(
+      k_input_filter, input_filter, NULL,
+      static_cast<ap_filter_type>(AP_FTYPE_CONNECTION + 3));
+  ap_register_output_filter(
+      k_output_filter, output_filter, NULL,
+      static_cast<ap_filter_type>(AP_FTYPE_CONNECTION + 3));
+}
+
+RequestTraffic& count_request_traffic(request_rec* r) {
+  void* data = nullptr;
+  apr_pool_userdata_get(&data, k_pool_key, r->pool);
+  if (data != nullptr) return static_cast<Counting*>(data)->traffic;
+
+  auto* counting = new (apr_palloc(r->pool, sizeof(Counting))) Counting;
+  counting->input_filter =
+      ap_add_input_filter(k_input_filter, counting, nullptr, r->connection);
+  counting->output_filter =
+      ap_add_output_filter(k_output_filter, counting, nullptr, r->connection);
+  apr_pool_cleanup_register(r->pool, counting, remove_filters,
+                            apr_pool_cleanup_null);
+  apr_pool_userdata_setn(counting, k_pool_key, nullptr, r->pool);
+  return counting->traffic;
+}
+
+}  // namespace datadog::tracing
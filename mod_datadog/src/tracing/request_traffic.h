@@ -0,0 +1,33 @@
+#pragma once
+
+#include <httpd.h>
+
+#include <atomic>
+#include <cstdint>
+
+namespace datadog::tracing {
+
+// Traffic of the connection of a request while it is in flight, counted by
+// connection filters above mod_ssl: decrypted bytes, including the ones of
+// tunnels. Shared by `DatadogResourceAccounting` and `DatadogLongRequests`,
+// which then count each byte once.
+struct RequestTraffic final {
+  // Updated by the thread serving the request, possibly read by another.
+  struct Direction final {
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> messages{0};  ///< Non-empty brigades
+  };
+
+  Direction in;   ///< Read from the client
+  Direction out;  ///< Written to the client
+};
+
+// Register the byte counting filters. Called from `register_hooks`.
+void register_request_traffic_filters();
+
+// Start counting the traffic of the top-level request `r`, unless already
+// started, and return its counters. They and the filters live as long as
+// `r`.
+RequestTraffic& count_request_traffic(request_rec* r);
+
+}  // namespace datadog::tracing
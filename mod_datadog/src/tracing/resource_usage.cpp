@@ -0,0 +1,91 @@
+#include "resource_usage.h"
+
+#include <apr_pools.h>
+#include <datadog/span.h>
+#include <http_config.h>
+
+#include <ctime>
+#include <new>
+#include <thread>
+
+#include "common_conf.h"
+#include "request_traffic.h"
+
+namespace datadog::tracing {
+namespace {
+
+constexpr const char* k_pool_key = "datadog-resource-usage";
+
+// Accounting of a request, allocated from its pool.
+struct Accounting final {
+  std::thread::id thread;
+  std::chrono::nanoseconds cpu_start;
+  const RequestTraffic* traffic = nullptr;
+};
+
+std::chrono::nanoseconds thread_cpu_time() {
+  timespec now{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return std::chrono::seconds(now.tv_sec) +
+         std::chrono::nanoseconds(now.tv_nsec);
+}
+
+}  // namespace
+
+void start_resource_usage(request_rec* r, module* datadog_module) {
+  // Internal redirects share the pool, and the accounting, of the request
+  // they come from.
+  if (r->main != nullptr || r->prev != nullptr) return;
+
+  const auto* dir_conf = static_cast<const datadog::conf::Directory*>(
+      ap_get_module_config(r->per_dir_config, datadog_module));
+  if (dir_conf == nullptr || !dir_conf->resource_accounting.value_or(false)) {
+    return;
+  }
+
+  auto* accounting = new (apr_palloc(r->pool, sizeof(Accounting)))
+      Accounting{std::this_thread::get_id(), thread_cpu_time(),
+                 &count_request_traffic(r)};
+  apr_pool_userdata_setn(accounting, k_pool_key, nullptr, r->pool);
+}
+
+std::optional<ResourceUsage> finish_resource_usage(request_rec* r,
+                                                   module* datadog_module) {
+  if (r->main != nullptr) return std::nullopt;
+
+  void* data = nullptr;
+  apr_pool_userdata_get(&data, k_pool_key, r->pool);
+  if (data == nullptr) return std::nullopt;
+  const auto* accounting = static_cast<const Accounting*>(data);
+
+  ResourceUsage usage;
+  if (accounting->thread == std::this_thread::get_id()) {
+    usage.cpu_time = std::chrono::duration_cast<std::chrono::microseconds>(
+        thread_cpu_time() - accounting->cpu_start);
+  }
+#if APR_POOL_DEBUG
+  usage.pool_bytes = apr_pool_num_bytes(r->pool, 1);
+#endif
+  usage.bytes_read = accounting->traffic->in.bytes.load();
+  usage.bytes_written = accounting->traffic->out.bytes.load();
+
+  if (auto* span = static_cast<Span*>(
+          ap_get_module_config(r->request_config, datadog_module))) {
+    if (usage.cpu_time) {
+      span->set_metric("httpd.resources.cpu_time_ms",
+                       static_cast<double>(usage.cpu_time->count()) / 1000.0);
+    }
+    if (usage.pool_bytes) {
+      span->set_metric("httpd.resources.pool_bytes",
+                       static_cast<double>(*usage.pool_bytes));
+    }
+    span->set_metric("httpd.resources.bytes_read",
+                     static_cast<double>(usage.bytes_read));
+    span->set_metric("httpd.resources.bytes_written",
+                     static_cast<double>(usage.bytes_written));
+  }
+
+  return usage;
+}
+
+}  // namespace datadog::tracing
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <httpd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+namespace datadog::tracing {
+
+// Resources used to serve a request, for `DatadogResourceAccounting`.
+//
+// Accounting starts in `fixups` and ends in `log_transaction`, so it covers
+// the handler and the output filters but not the reading of the request
+// headers.
+struct ResourceUsage final {
+  // CPU time of the thread serving the request. Unknown when the request
+  // did not end on the thread which started it, as with the write completion
+  // of the event MPM.
+  std::optional<std::chrono::microseconds> cpu_time;
+  // Bytes allocated from the request pool and its subpools by the time the
+  // request is logged. Only known when APR is built with pool debugging: it
+  // does not count them otherwise.
+  std::optional<std::uint64_t> pool_bytes;
+  // Bytes read from and written to the client, above mod_ssl: the request
+  // body, and the response with its headers.
+  std::uint64_t bytes_read = 0;
+  std::uint64_t bytes_written = 0;
+};
+
+// Start accounting for the top-level request `r`, if
+// `DatadogResourceAccounting` applies to it. Called from `fixups`.
+void start_resource_usage(request_rec* r, module* datadog_module);
+
+// Stop accounting for `r` and set the resources it used on its span. Return
+// `std::nullopt` if it was not accounted for. Called from `log_transaction`.
+std::optional<ResourceUsage> finish_resource_usage(request_rec* r,
+                                                   module* datadog_module);
+
+}  // namespace datadog::tracing
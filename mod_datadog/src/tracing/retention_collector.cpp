@@ -0,0 +1,128 @@
+#include "retention_collector.h"
+
+#include <datadog/dict_writer.h>
+#include <datadog/version.h>
+#include <fmt/core.h>
+
+#include <utility>
+
+#include "msgpack.h"
+#include "status/scoreboard.h"
+
+namespace datadog::tracing {
+namespace {
+
+namespace msgpack = common::msgpack;
+
+constexpr std::chrono::seconds k_request_timeout{2};
+
+// Sampling priority set on the local root span of a chunk when its trace
+// segment is finished.
+constexpr const char* k_sampling_priority = "_sampling_priority_v1";
+
+bool is_dropped(const std::vector<std::unique_ptr<SpanData>>& chunk) {
+  for (const auto& span : chunk) {
+    auto found = span->numeric_tags.find(k_sampling_priority);
+    if (found != span->numeric_tags.end()) return found->second <= 0;
+  }
+  return false;
+}
+
+}  // namespace
+
+RetentionCollector::RetentionCollector(
+    std::shared_ptr<HTTPClient> http_client, HTTPClient::URL agent_url,
+    EventScheduler& scheduler,
+    std::chrono::steady_clock::duration flush_interval,
+    std::shared_ptr<Logger> logger)
+    : http_client_(std::move(http_client)),
+      traces_url_(std::move(agent_url)),
+      logger_(std::move(logger)) {
+  traces_url_.path += "/v0.4/traces";
+  cancel_flush_ =
+      scheduler.schedule_recurring_event(flush_interval, [this] { flush(); });
+}
+
+RetentionCollector::~RetentionCollector() {
+  cancel_flush_();
+  flush();
+  http_client_->drain(std::chrono::steady_clock::now() + k_request_timeout);
+}
+
+Expected<void> RetentionCollector::send(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const std::shared_ptr<TraceSampler>&) {
+  if (is_dropped(spans)) {
+    status::add(status::Counter::retention_dropped_traces);
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++dropped_traces_;
+    dropped_spans_ += spans.size();
+    return nullopt;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  chunks_.push_back(std::move(spans));
+  return nullopt;
+}
+
+std::string RetentionCollector::config() const {
+  return fmt::format(
+      R"({{"type":"datadog::tracing::RetentionCollector","url":"{}://{}{}"}})",
+      traces_url_.scheme, traces_url_.authority, traces_url_.path);
+}
+
+void RetentionCollector::flush() {
+  std::vector<std::vector<std::unique_ptr<SpanData>>> chunks;
+  std::uint64_t dropped_traces;
+  std::uint64_t dropped_spans;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (chunks_.empty()) return;
+    chunks.swap(chunks_);
+    dropped_traces = std::exchange(dropped_traces_, 0);
+    dropped_spans = std::exchange(dropped_spans_, 0);
+  }
+
+  std::string body;
+  msgpack::pack_array(body, static_cast<std::uint32_t>(chunks.size()));
+  for (const auto& chunk : chunks) {
+    auto encoded = msgpack_encode(body, chunk);
+    if (auto* error = encoded.if_error()) {
+      logger_->log_error(*error);
+      return;
+    }
+  }
+
+  // Called when the payload is sent, which the buffer may delay.
+  auto set_headers = [trace_count = std::to_string(chunks.size()),
+                      dropped_traces, dropped_spans](DictWriter& headers) {
+    headers.set("Content-Type", "application/msgpack");
+    headers.set("Datadog-Meta-Lang", "cpp");
+    headers.set("Datadog-Meta-Tracer-Version", tracer_version);
+    headers.set("X-Datadog-Trace-Count", trace_count);
+    if (dropped_traces != 0) {
+      headers.set("Datadog-Client-Dropped-P0-Traces",
+                  std::to_string(dropped_traces));
+      headers.set("Datadog-Client-Dropped-P0-Spans",
+                  std::to_string(dropped_spans));
+    }
+  };
+
+  auto result = http_client_->post(
+      traces_url_, set_headers, std::move(body),
+      [logger = logger_](int status, const DictReader&, std::string body) {
+        if (status < 200 || status >= 300) {
+          logger->log_error([&](std::ostream& log) {
+            log << "Tail retention: unexpected response status " << status
+                << " from the Datadog Agent: " << body;
+          });
+        }
+      },
+      [logger = logger_](Error error) { logger->log_error(error); },
+      std::chrono::steady_clock::now() + k_request_timeout);
+  if (auto* error = result.if_error()) {
+    logger_->log_error(*error);
+  }
+}
+
+}  // namespace datadog::tracing
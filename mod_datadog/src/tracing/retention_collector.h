@@ -0,0 +1,59 @@
+#pragma once
+
+#include <datadog/collector.h>
+#include <datadog/event_scheduler.h>
+#include <datadog/http_client.h>
+#include <datadog/logger.h>
+#include <datadog/span_data.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace datadog::tracing {
+
+// Collector of the tracers of the servers with `DatadogTailRetention`.
+//
+// The collector of the tracer serializes every trace chunk it is handed,
+// whatever its sampling decision, and the Agent discards the dropped ones.
+// Tail retention drops most traces once their request is done: this
+// collector discards the chunks whose sampling priority is to drop before
+// they are serialized, and sends the others to the Agent `/v0.4/traces`
+// endpoint at every flush interval. The number of chunks and spans discarded
+// is reported to the Agent with the next payload.
+//
+// The sampling rates returned by the Agent are not applied: with tail
+// retention, the module decides for the traces it starts.
+class RetentionCollector final : public Collector {
+  std::shared_ptr<HTTPClient> http_client_;
+  HTTPClient::URL traces_url_;
+  std::shared_ptr<Logger> logger_;
+
+  std::mutex mutex_;
+  std::vector<std::vector<std::unique_ptr<SpanData>>> chunks_;
+  std::uint64_t dropped_traces_ = 0;
+  std::uint64_t dropped_spans_ = 0;
+
+  EventScheduler::Cancel cancel_flush_;
+
+ public:
+  RetentionCollector(std::shared_ptr<HTTPClient> http_client,
+                     HTTPClient::URL agent_url, EventScheduler& scheduler,
+                     std::chrono::steady_clock::duration flush_interval,
+                     std::shared_ptr<Logger> logger);
+  ~RetentionCollector();
+
+  Expected<void> send(
+      std::vector<std::unique_ptr<SpanData>>&& spans,
+      const std::shared_ptr<TraceSampler>& response_handler) override;
+
+  std::string config() const override;
+
+  // Send the chunks kept since the previous flush.
+  void flush();
+};
+
+}  // namespace datadog::tracing
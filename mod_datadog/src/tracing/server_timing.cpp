@@ -0,0 +1,102 @@
+#include "server_timing.h"
+
+#include <apr_pools.h>
+#include <apr_strings.h>
+#include <apr_tables.h>
+#include <datadog/sampling_decision.h>
+#include <datadog/span.h>
+#include <datadog/trace_segment.h>
+#include <fmt/core.h>
+#include <http_config.h>
+#include <util_filter.h>
+
+#include <new>
+#include <string>
+
+#include "common_conf.h"
+
+namespace datadog::tracing {
+namespace {
+
+constexpr const char* k_filter_name = "DATADOG_SERVER_TIMING";
+constexpr const char* k_pool_key = "datadog-server-timing";
+
+// Timing of a request, allocated from its pool. Shared by the filter added
+// for the response and the one added for an error response.
+struct ServerTiming final {
+  Span* span;
+  apr_time_t handler_start;
+};
+
+double to_ms(apr_time_t duration) {
+  return static_cast<double>(duration) / 1000.0;
+}
+
+// W3C trace context of `span`.
+std::string traceparent(Span& span) {
+  bool sampled = true;
+  if (auto decision = span.trace_segment().sampling_decision()) {
+    sampled = decision->priority > 0;
+  }
+  return fmt::format("00-{}-{:016x}-{}", span.trace_id().hex_padded(),
+                     span.id(), sampled ? "01" : "00");
+}
+
+apr_status_t server_timing_filter(ap_filter_t* f, apr_bucket_brigade* bb) {
+  request_rec* r = f->r;
+  const auto* timing = static_cast<const ServerTiming*>(f->ctx);
+  const apr_time_t now = apr_time_now();
+
+  const apr_time_t handler =
+      now > timing->handler_start ? now - timing->handler_start : 0;
+  // The handler of proxied requests is mostly waiting for the backend.
+  const char* handler_metric =
+      r->proxyreq != PROXYREQ_NONE ? "upstream" : "handler";
+
+  const std::string value = fmt::format(
+      "total;dur={:.3f}, {};dur={:.3f}, traceparent;desc=\"{}\"",
+      to_ms(now - r->request_time), handler_metric, to_ms(handler),
+      traceparent(*timing->span));
+  // Also sent with error responses. A `Server-Timing` header of a backend
+  // stays in `headers_out`.
+  apr_table_setn(r->err_headers_out, "Server-Timing",
+                 apr_pstrdup(r->pool, value.c_str()));
+
+  ap_remove_output_filter(f);
+  return ap_pass_brigade(f->next, bb);
+}
+
+}  // namespace
+
+void register_server_timing_filter() {
+  // Ahead of HTTP_HEADER, which writes the response headers at
+  // AP_FTYPE_PROTOCOL.
+  ap_register_output_filter(k_filter_name, server_timing_filter, NULL,
+                            AP_FTYPE_CONTENT_SET);
+}
+
+void insert_server_timing_filter(request_rec* r, module* datadog_module) {
+  if (r->main != nullptr) return;
+
+  const auto* dir_conf = static_cast<const datadog::conf::Directory*>(
+      ap_get_module_config(r->per_dir_config, datadog_module));
+  if (dir_conf == nullptr || !dir_conf->server_timing.value_or(false)) return;
+
+  auto* span = static_cast<Span*>(
+      ap_get_module_config(r->request_config, datadog_module));
+  if (span == nullptr) return;
+
+  // The handler starts right after `insert_filter`. Error responses keep the
+  // timing of the handler which failed.
+  void* data = nullptr;
+  apr_pool_userdata_get(&data, k_pool_key, r->pool);
+  if (data == nullptr) {
+    data = new (apr_palloc(r->pool, sizeof(ServerTiming)))
+        ServerTiming{span, apr_time_now()};
+    apr_pool_userdata_setn(data, k_pool_key, nullptr, r->pool);
+  }
+
+  ap_add_output_filter(k_filter_name, data, r, r->connection);
+}
+
+}  // namespace datadog::tracing
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <httpd.h>
+
+namespace datadog::tracing {
+
+// `Server-Timing` response header, for `DatadogServerTiming`.
+//
+// An output filter, ahead of the one writing the response headers, adds the
+// time the request took until then and the part of it spent by the handler,
+// or by the backend of proxied requests. It also adds the trace context of
+// the request span as `traceparent`, for the browser to link the page to its
+// trace.
+
+// Register the output filter. Called from `register_hooks`.
+void register_server_timing_filter();
+
+// Add the filter to the top-level request `r`, if `DatadogServerTiming`
+// applies to it. Called from `insert_filter` and `insert_error_filter`.
+void insert_server_timing_filter(request_rec* r, module* datadog_module);
+
+}  // namespace datadog::tracing
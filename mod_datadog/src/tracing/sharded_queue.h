@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace datadog::tracing {
+
+// Items handed off by request threads and consumed by a single thread.
+//
+// Each thread pushes into its own shard, so pushing never contends with
+// other request threads. As in `metrics::Aggregator`, the owning thread
+// empties the shard slot while it appends, and the consumer takes a shard's
+// items with a single compare-and-swap, leaving an empty vector behind.
+// Shards hold a bounded number of items: once full, `push` fails and the
+// caller handles the item itself.
+template <typename T>
+class ShardedQueue final {
+  struct Shard final {
+    std::thread::id owner;
+    std::atomic<std::vector<T>*> items{new std::vector<T>};
+    ~Shard() { delete items.load(); }
+  };
+
+  const std::uint64_t generation_;
+  const std::size_t max_items_per_shard_;
+  std::mutex shards_mutex_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  static std::uint64_t next_generation() {
+    static std::atomic<std::uint64_t> next{1};
+    return next.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Shard of the calling thread. The last one used is cached per thread;
+  // a thread switching between queues finds its shard again by thread ID.
+  Shard& current_shard() {
+    thread_local std::uint64_t t_generation = 0;
+    thread_local void* t_shard = nullptr;
+    if (t_generation == generation_) return *static_cast<Shard*>(t_shard);
+
+    const auto self = std::this_thread::get_id();
+    std::lock_guard<std::mutex> lock(shards_mutex_);
+    Shard* shard = nullptr;
+    for (const auto& candidate : shards_) {
+      if (candidate->owner == self) shard = candidate.get();
+    }
+    if (shard == nullptr) {
+      shard = shards_.emplace_back(std::make_unique<Shard>()).get();
+      shard->owner = self;
+    }
+    t_shard = shard;
+    t_generation = generation_;
+    return *shard;
+  }
+
+ public:
+  explicit ShardedQueue(std::size_t max_items_per_shard)
+      : generation_(next_generation()),
+        max_items_per_shard_(max_items_per_shard) {}
+
+  ShardedQueue(const ShardedQueue&) = delete;
+  ShardedQueue& operator=(const ShardedQueue&) = delete;
+
+  // Append `item` to the shard of the calling thread. Return false, leaving
+  // `item` untouched, if the shard is full.
+  bool push(T&& item) {
+    Shard& shard = current_shard();
+
+    // Only the owning thread ever empties the slot, so the vector is always
+    // there. Emptying it tells the consumer to wait until we are done.
+    std::vector<T>* items =
+        shard.items.exchange(nullptr, std::memory_order_acquire);
+    const bool accepted = items->size() < max_items_per_shard_;
+    if (accepted) items->push_back(std::move(item));
+    shard.items.store(items, std::memory_order_release);
+    return accepted;
+  }
+
+  // Take the items of every shard, in the order each thread pushed them,
+  // and call `consume` with each of them. Return the number of items.
+  template <typename Consume>
+  std::size_t drain(Consume&& consume) {
+    std::vector<std::vector<T>*> taken;
+    {
+      std::lock_guard<std::mutex> lock(shards_mutex_);
+      taken.reserve(shards_.size());
+      for (auto& shard : shards_) {
+        auto* fresh_items = new std::vector<T>;
+        std::vector<T>* items = shard->items.load(std::memory_order_acquire);
+        while (items == nullptr || !shard->items.compare_exchange_weak(
+                                       items, fresh_items,
+                                       std::memory_order_acq_rel)) {
+          std::this_thread::yield();
+          items = shard->items.load(std::memory_order_acquire);
+        }
+        taken.push_back(items);
+      }
+    }
+
+    // Items are consumed without holding the lock, so that threads pushing
+    // for the first time are not held back.
+    std::size_t count = 0;
+    for (auto* items : taken) {
+      for (auto& item : *items) consume(std::move(item));
+      count += items->size();
+      delete items;
+    }
+    return count;
+  }
+};
+
+}  // namespace datadog::tracing
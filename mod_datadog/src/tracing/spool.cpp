@@ -0,0 +1,425 @@
+#include "spool.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+
+namespace datadog::tracing {
+namespace {
+
+constexpr char k_magic[8] = {'D', 'D', 'S', 'P', 'O', 'O', 'L', '\0'};
+constexpr std::uint32_t k_version = 2;
+constexpr std::size_t k_header_size = 4096;
+
+// Records are 8 bytes aligned. Padding records fill the end of the ring when
+// the next record does not fit there.
+constexpr std::uint32_t k_padding_flag = 0x80000000u;
+
+// Records replayed per second by the whole host.
+constexpr std::chrono::milliseconds k_replay_interval{100};
+
+// A leased record is replayed again after this long if its lease is neither
+// committed nor released, e.g. if the child holding it died.
+constexpr std::chrono::seconds k_lease_duration{10};
+
+// Replays of a record before it is dropped.
+constexpr std::uint32_t k_max_attempts = 5;
+
+struct RecordHeader final {
+  std::uint32_t size;  ///< With this header and the alignment padding
+  std::uint32_t crc;   ///< CRC-32 of the rest of the record
+};
+
+std::size_t align(std::size_t size) { return (size + 7) & ~std::size_t{7}; }
+
+std::uint32_t crc32(const unsigned char* data, std::size_t size) {
+  static const auto table = [] {
+    std::array<std::uint32_t, 256> table{};
+    for (std::uint32_t i = 0; i < 256; ++i) {
+      std::uint32_t c = i;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      table[i] = c;
+    }
+    return table;
+  }();
+
+  std::uint32_t crc = 0xFFFFFFFFu;
+  for (std::size_t i = 0; i < size; ++i) {
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc ^ 0xFFFFFFFFu;
+}
+
+// Record content: trace count, then length prefixed strings: URL scheme,
+// authority and path, header names and values, and the body.
+void append(std::string& out, const void* data, std::size_t size) {
+  out.append(static_cast<const char*>(data), size);
+}
+
+void append_string(std::string& out, const std::string& value) {
+  const auto size = static_cast<std::uint32_t>(value.size());
+  append(out, &size, sizeof(size));
+  out += value;
+}
+
+std::string encode(const Spool::Record& record) {
+  std::string out;
+  out.reserve(64 + record.body.size());
+  append(out, &record.trace_count, sizeof(record.trace_count));
+  const auto count = static_cast<std::uint32_t>(record.headers.size());
+  append(out, &count, sizeof(count));
+  append_string(out, record.url.scheme);
+  append_string(out, record.url.authority);
+  append_string(out, record.url.path);
+  for (const auto& [name, value] : record.headers) {
+    append_string(out, name);
+    append_string(out, value);
+  }
+  append_string(out, record.body);
+  return out;
+}
+
+class Decoder final {
+  const unsigned char* data_;
+  std::size_t size_;
+
+ public:
+  Decoder(const unsigned char* data, std::size_t size)
+      : data_(data), size_(size) {}
+
+  bool read(void* out, std::size_t size) {
+    if (size > size_) return false;
+    std::memcpy(out, data_, size);
+    data_ += size;
+    size_ -= size;
+    return true;
+  }
+
+  bool read_string(std::string& out) {
+    std::uint32_t size = 0;
+    if (!read(&size, sizeof(size)) || size > size_) return false;
+    out.assign(reinterpret_cast<const char*>(data_), size);
+    data_ += size;
+    size_ -= size;
+    return true;
+  }
+};
+
+std::optional<Spool::Record> decode(const unsigned char* data,
+                                    std::size_t size) {
+  Decoder decoder{data, size};
+  Spool::Record record;
+  std::uint32_t count = 0;
+  if (!decoder.read(&record.trace_count, sizeof(record.trace_count)) ||
+      !decoder.read(&count, sizeof(count)) ||
+      !decoder.read_string(record.url.scheme) ||
+      !decoder.read_string(record.url.authority) ||
+      !decoder.read_string(record.url.path)) {
+    return std::nullopt;
+  }
+  for (std::uint32_t i = 0; i < count; ++i) {
+    auto& [name, value] = record.headers.emplace_back();
+    if (!decoder.read_string(name) || !decoder.read_string(value)) {
+      return std::nullopt;
+    }
+  }
+  if (!decoder.read_string(record.body)) return std::nullopt;
+  return record;
+}
+
+}  // namespace
+
+struct Spool::Header final {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t reserved;
+  std::uint64_t capacity;  ///< Bytes of records
+  // Offsets of the oldest record and of the end of the newest one. They only
+  // grow; their position in the ring is modulo `capacity`.
+  std::uint64_t head;
+  std::uint64_t tail;
+  std::int64_t next_replay_ns;  ///< `steady_clock` time of the next replay
+  // Lease of the oldest record, and its failed replays.
+  std::int64_t lease_expiry_ns;  ///< `steady_clock` time, 0 if not leased
+  std::uint32_t head_attempts;
+  std::uint32_t reserved2;
+};
+
+static_assert(sizeof(Spool::Header) <= k_header_size);
+
+namespace {
+
+// Drop the records before `head`, and with them the lease of the oldest one.
+void move_head(Spool::Header& header, std::uint64_t head) {
+  header.head = head;
+  header.lease_expiry_ns = 0;
+  header.head_attempts = 0;
+}
+
+// Drop the oldest record, found valid when it was leased.
+void drop_head(Spool::Header& header, const unsigned char* data) {
+  RecordHeader record_header;
+  std::memcpy(&record_header, data + header.head % header.capacity,
+              sizeof(record_header));
+  const std::uint64_t size = record_header.size & ~k_padding_flag;
+  move_head(header, size <= header.tail - header.head ? header.head + size
+                                                      : header.tail);
+}
+
+}  // namespace
+
+std::unique_ptr<Spool> Spool::open(const char* path, std::size_t size,
+                                   Opened& opened, std::string& error) {
+  size = align(size);
+  const std::size_t file_size = k_header_size + size;
+
+  auto is_valid = [&](const Header& header) {
+    return std::memcmp(header.magic, k_magic, sizeof(k_magic)) == 0 &&
+           header.version == k_version && header.capacity == size &&
+           header.head <= header.tail &&
+           header.tail - header.head <= header.capacity &&
+           header.head % 8 == 0 && header.tail % 8 == 0;
+  };
+
+  auto fail = [&](const char* what) {
+    error = std::string("Failed to ") + what + " the trace spool file " +
+            path + ": " + std::strerror(errno);
+    return nullptr;
+  };
+
+  auto spool = std::unique_ptr<Spool>(new Spool);
+  spool->fd_ = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  struct stat status;
+  if (spool->fd_ < 0 || fstat(spool->fd_, &status) != 0) return fail("open");
+
+  // A file of another size may still be mapped by the children of the
+  // previous generation: replace it rather than truncate it under them.
+  bool is_new = static_cast<std::size_t>(status.st_size) != file_size;
+  if (is_new && status.st_size != 0) {
+    ::close(spool->fd_);
+    unlink(path);
+    spool->fd_ = ::open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  }
+  if (spool->fd_ < 0 ||
+      (is_new && ftruncate(spool->fd_, static_cast<off_t>(file_size)) != 0)) {
+    return fail("create");
+  }
+
+  spool->base_ = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      spool->fd_, 0);
+  if (spool->base_ == MAP_FAILED) {
+    spool->base_ = nullptr;
+    return fail("map");
+  }
+  spool->mapped_size_ = file_size;
+
+  spool->lock();
+  Header& header = spool->header();
+  opened = is_new ? Opened::CREATED : Opened::KEPT;
+  if (!is_valid(header)) {
+    if (!is_new) opened = Opened::RESET;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, k_magic, sizeof(k_magic));
+    header.version = k_version;
+    header.capacity = size;
+  }
+  // `steady_clock` restarts with the host.
+  header.next_replay_ns = 0;
+  header.lease_expiry_ns = 0;
+  spool->unlock();
+  return spool;
+}
+
+Spool::~Spool() {
+  if (base_ != nullptr) munmap(base_, mapped_size_);
+  if (fd_ >= 0) ::close(fd_);
+}
+
+std::size_t Spool::pending_bytes() {
+  lock();
+  const Header& header = this->header();
+  const auto size = static_cast<std::size_t>(header.tail - header.head);
+  unlock();
+  return size;
+}
+
+Spool::Header& Spool::header() const { return *static_cast<Header*>(base_); }
+
+unsigned char* Spool::data() const {
+  return static_cast<unsigned char*>(base_) + k_header_size;
+}
+
+void Spool::lock() {
+  mutex_.lock();
+  struct flock lock {};
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  lock.l_len = k_header_size;
+  while (fcntl(fd_, F_SETLKW, &lock) != 0 && errno == EINTR) {
+  }
+}
+
+void Spool::unlock() {
+  struct flock lock {};
+  lock.l_type = F_UNLCK;
+  lock.l_whence = SEEK_SET;
+  lock.l_len = k_header_size;
+  fcntl(fd_, F_SETLK, &lock);
+  mutex_.unlock();
+}
+
+bool Spool::push(const Record& record) {
+  const std::string content = encode(record);
+  const std::size_t needed = align(sizeof(RecordHeader) + content.size());
+
+  lock();
+  Header& header = this->header();
+  const std::uint64_t capacity = header.capacity;
+  if (needed > capacity || needed >= k_padding_flag) {
+    unlock();
+    return false;
+  }
+
+  std::size_t position = header.tail % capacity;
+  std::size_t padding = capacity - position < needed ? capacity - position : 0;
+
+  // The padding and the record take more than the whole ring: every record
+  // goes, and the ring restarts at its next boundary.
+  if (padding + needed > capacity) {
+    header.tail += padding;
+    move_head(header, header.tail);
+    position = 0;
+    padding = 0;
+  }
+
+  // Drop the oldest records until both the padding and the record fit.
+  while (capacity - (header.tail - header.head) < padding + needed) {
+    RecordHeader oldest;
+    std::memcpy(&oldest, data() + header.head % capacity, sizeof(oldest));
+    const std::uint64_t oldest_size = oldest.size & ~k_padding_flag;
+    if (oldest_size == 0 || oldest_size % 8 != 0 ||
+        oldest_size > header.tail - header.head) {
+      move_head(header, header.tail);  // Damaged: drop everything
+      break;
+    }
+    move_head(header, header.head + oldest_size);
+  }
+
+  if (padding != 0) {
+    const RecordHeader filler{static_cast<std::uint32_t>(padding) |
+                                  k_padding_flag,
+                              0};
+    std::memcpy(data() + position, &filler, sizeof(filler));
+    header.tail += padding;
+    position = 0;
+  }
+
+  unsigned char* out = data() + position;
+  unsigned char* body = out + sizeof(RecordHeader);
+  const std::size_t body_size = needed - sizeof(RecordHeader);
+  std::memcpy(body, content.data(), content.size());
+  std::memset(body + content.size(), 0, body_size - content.size());
+  const RecordHeader record_header{static_cast<std::uint32_t>(needed),
+                                   crc32(body, body_size)};
+  std::memcpy(out, &record_header, sizeof(record_header));
+
+  // Publish the record once it is complete.
+  header.tail += needed;
+  unlock();
+  return true;
+}
+
+std::optional<Spool::Lease> Spool::peek(
+    std::chrono::steady_clock::time_point now) {
+  const std::int64_t now_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          now.time_since_epoch())
+          .count();
+  const std::int64_t interval_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(k_replay_interval)
+          .count();
+  const std::int64_t lease_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(k_lease_duration)
+          .count();
+
+  lock();
+  Header& header = this->header();
+  if (header.head == header.tail || now_ns < header.next_replay_ns ||
+      now_ns < header.lease_expiry_ns) {
+    unlock();
+    return std::nullopt;
+  }
+  header.next_replay_ns = now_ns + interval_ns;
+
+  const std::uint64_t capacity = header.capacity;
+  std::optional<Lease> lease;
+  while (header.head != header.tail) {
+    const std::size_t position = header.head % capacity;
+    RecordHeader record_header;
+    std::memcpy(&record_header, data() + position, sizeof(record_header));
+    const std::uint64_t size = record_header.size & ~k_padding_flag;
+    if (size < sizeof(RecordHeader) || size % 8 != 0 ||
+        size > header.tail - header.head || position + size > capacity) {
+      move_head(header, header.tail);
+      break;
+    }
+
+    if (record_header.size & k_padding_flag) {
+      move_head(header, header.head + size);
+      continue;
+    }
+
+    // Trailing alignment bytes are ignored by `decode`.
+    const unsigned char* body = data() + position + sizeof(record_header);
+    const std::size_t body_size = size - sizeof(record_header);
+    std::optional<Record> record;
+    if (crc32(body, body_size) == record_header.crc) {
+      record = decode(body, body_size);
+    }
+    if (!record) {
+      move_head(header, header.tail);
+      break;
+    }
+
+    header.lease_expiry_ns = now_ns + lease_ns;
+    lease = Lease{std::move(*record), header.head};
+    break;
+  }
+
+  unlock();
+  return lease;
+}
+
+void Spool::commit(std::uint64_t offset) {
+  lock();
+  Header& header = this->header();
+  // Otherwise, it was dropped to make room for newer records.
+  if (header.head == offset && header.head != header.tail) {
+    drop_head(header, data());
+  }
+  unlock();
+}
+
+bool Spool::release(std::uint64_t offset) {
+  lock();
+  Header& header = this->header();
+  bool kept = true;
+  if (header.head == offset && header.head != header.tail) {
+    header.lease_expiry_ns = 0;
+    if (++header.head_attempts >= k_max_attempts) {
+      drop_head(header, data());
+      kept = false;
+    }
+  }
+  unlock();
+  return kept;
+}
+
+}  // namespace datadog::tracing
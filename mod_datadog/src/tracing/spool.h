@@ -0,0 +1,106 @@
+#pragma once
+
+#include <datadog/http_client.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace datadog::tracing {
+
+// Ring of trace payloads the Datadog Agent could not receive, kept in a
+// memory-mapped file shared by every child process of the host.
+//
+// The file is opened and mapped by the parent process in `post_config`, so
+// that children inherit the mapping. Writers take a POSIX record lock on the
+// file, which is released by the kernel if a child dies while holding it.
+//
+// File layout: a 4KB header followed by the ring of records. Offsets stored
+// in the header only grow; a record is written before the offset publishing
+// it, so a crashed writer leaves no partial record behind. Each record
+// carries a CRC-32 of its content: a record damaged by a power loss is
+// detected when it is read, and the records after it are dropped. When the
+// ring is full, the oldest records are dropped.
+//
+// Records are replayed in the order they were written, at a rate limited
+// for the whole host. The oldest record stays in the ring until the Agent
+// takes it: it is leased to one child at a time, and dropped after a few
+// failed attempts so that a payload the Agent keeps rejecting does not hold
+// the ring.
+class Spool final {
+ public:
+  struct Record final {
+    HTTPClient::URL url;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+    std::uint64_t trace_count = 0;
+  };
+
+  // Oldest record, leased to the caller until it is committed or released.
+  struct Lease final {
+    Record record;
+    std::uint64_t offset = 0;  ///< Identifies the record in the ring
+  };
+
+  struct Header;
+
+  // What `open` found in the file.
+  enum class Opened {
+    CREATED,  ///< No file, or a file of another size
+    RESET,    ///< An invalid file
+    KEPT      ///< A valid file, whose records are kept
+  };
+
+ private:
+  int fd_ = -1;
+  void* base_ = nullptr;
+  std::size_t mapped_size_ = 0;
+  std::mutex mutex_;  ///< Record locks do not exclude threads of a process
+
+ public:
+  // Open or create the spool file at `path`, with `size` bytes of records.
+  // Records left by a previous run are kept if the file is valid and has the
+  // same size.
+  //
+  // Return `nullptr` and set `error` on failure.
+  static std::unique_ptr<Spool> open(const char* path, std::size_t size,
+                                     Opened& opened, std::string& error);
+
+  ~Spool();
+
+  // Bytes of records waiting to be replayed.
+  std::size_t pending_bytes();
+
+  // Append `record`, dropping the oldest records to make room for it.
+  // Return false if it is larger than the whole ring.
+  bool push(const Record& record);
+
+  // Return the oldest record, if any, if the replay rate allows it at `now`
+  // and if it is not leased already. It is leased until `commit` or
+  // `release`, or for a few seconds if the caller dies first.
+  std::optional<Lease> peek(std::chrono::steady_clock::time_point now);
+
+  // Remove the leased record at `offset`, which the Agent took or rejected
+  // for good.
+  void commit(std::uint64_t offset);
+
+  // End the lease of the record at `offset`, which the Agent could not take,
+  // so that it is replayed again. Return false if it has been attempted too
+  // many times, and was removed instead.
+  bool release(std::uint64_t offset);
+
+ private:
+  Spool() = default;
+  Header& header() const;
+  unsigned char* data() const;
+  void lock();
+  void unlock();
+};
+
+}  // namespace datadog::tracing
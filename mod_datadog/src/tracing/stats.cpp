@@ -0,0 +1,268 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+namespace datadog::tracing::stats {
+namespace {
+
+constexpr std::uint64_t k_fnv_offset_basis = 14695981039346656037ULL;
+constexpr std::uint64_t k_fnv_prime = 1099511628211ULL;
+
+// Number of times a reader waits for a concurrent writer to publish an
+// entry's key before giving up. Bounded in case the writer process died.
+constexpr int k_max_ready_spins = 1024;
+
+void hash_append(std::uint64_t& hash, std::string_view value) {
+  for (const char ch : value) {
+    hash ^= static_cast<unsigned char>(ch);
+    hash *= k_fnv_prime;
+  }
+  // Separator, so that ("ab", "c") and ("a", "bc") differ.
+  hash ^= 0xFF;
+  hash *= k_fnv_prime;
+}
+
+std::uint64_t hash_key(const Key& key) {
+  std::uint64_t hash = k_fnv_offset_basis;
+  hash_append(hash, key.service);
+  hash_append(hash, key.name);
+  hash_append(hash, key.resource);
+  hash_append(hash, key.type);
+  hash_append(hash, key.span_kind);
+  hash_append(hash, key.environment);
+  hash_append(hash, key.version);
+  hash ^= key.http_status_code;
+  hash *= k_fnv_prime;
+
+  // 0 marks a free entry.
+  return hash == 0 ? 1 : hash;
+}
+
+std::uint64_t to_nanoseconds(std::chrono::system_clock::time_point time) {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          time.time_since_epoch())
+          .count());
+}
+
+}  // namespace
+
+std::size_t DurationMapping::bin(std::chrono::nanoseconds duration) {
+  static const double log_gamma = std::log(gamma());
+  const double nanoseconds =
+      std::max(static_cast<double>(duration.count()), 1.0);
+  const int index =
+      static_cast<int>(std::ceil(std::log(nanoseconds) / log_gamma));
+  return static_cast<std::size_t>(std::clamp(
+      index - first_bin_index, 0, static_cast<int>(bin_count) - 1));
+}
+
+template <std::size_t Capacity>
+void SharedTable::FixedString<Capacity>::assign(std::string_view value) {
+  size = static_cast<std::uint16_t>(std::min(value.size(), Capacity));
+  std::memcpy(data, value.data(), size);
+}
+
+void SharedTable::record(const Key& key, std::chrono::nanoseconds duration,
+                         bool is_error,
+                         std::chrono::system_clock::time_point now) {
+  const std::uint64_t bucket_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(bucket_duration)
+          .count();
+  const std::uint64_t now_ns = to_nanoseconds(now);
+  const std::uint64_t bucket_start_ns = now_ns - now_ns % bucket_ns;
+
+  Slot* slot = acquire_slot(bucket_start_ns);
+  if (slot == nullptr) return;
+
+  Entry* entry = find_or_insert(*slot, key);
+  if (entry == nullptr) {
+    slot->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  const std::size_t bin = DurationMapping::bin(duration);
+  entry->hits.fetch_add(1, std::memory_order_relaxed);
+  entry->duration_ns.fetch_add(static_cast<std::uint64_t>(duration.count()),
+                               std::memory_order_relaxed);
+  if (is_error) {
+    entry->errors.fetch_add(1, std::memory_order_relaxed);
+    entry->error_durations[bin].fetch_add(1, std::memory_order_relaxed);
+  } else {
+    entry->ok_durations[bin].fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void SharedTable::drain(std::chrono::system_clock::time_point now,
+                        const std::function<void(Bucket)>& on_bucket) {
+  const std::uint64_t now_ns = to_nanoseconds(now);
+  for (Slot& slot : slots_) {
+    Bucket bucket;
+    if (drain_slot(slot, now_ns, bucket)) {
+      on_bucket(std::move(bucket));
+    }
+  }
+}
+
+SharedTable::Slot* SharedTable::acquire_slot(std::uint64_t bucket_start_ns) {
+  const std::uint64_t bucket_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(bucket_duration)
+          .count();
+  Slot& slot = slots_[(bucket_start_ns / bucket_ns) % slots_.size()];
+
+  std::uint64_t slot_start_ns = slot.start_ns.load(std::memory_order_acquire);
+  if (slot_start_ns == 0 &&
+      slot.start_ns.compare_exchange_strong(slot_start_ns, bucket_start_ns,
+                                            std::memory_order_acq_rel)) {
+    return &slot;
+  }
+
+  // The slot still holds a bucket nobody drained in time. Its data wins over
+  // ours, rather than resetting it under concurrent writers.
+  if (slot_start_ns != bucket_start_ns) {
+    slot.dropped.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  return &slot;
+}
+
+SharedTable::Entry* SharedTable::find_or_insert(Slot& slot, const Key& key) {
+  // Hash the values as stored, so that keys differing only after the
+  // truncation point share an entry.
+  const std::uint64_t hash = hash_key(Entry::truncate(key));
+
+  for (std::size_t probe = 0; probe < max_entries; ++probe) {
+    Entry& entry = slot.entries[(hash + probe) % max_entries];
+
+    std::uint64_t entry_hash = entry.hash.load(std::memory_order_acquire);
+    if (entry_hash == 0 &&
+        entry.hash.compare_exchange_strong(entry_hash, hash,
+                                           std::memory_order_acq_rel)) {
+      entry.assign(key);
+      entry.ready.store(1, std::memory_order_release);
+      return &entry;
+    }
+
+    if (entry_hash != hash) continue;
+
+    int spins = 0;
+    while (entry.ready.load(std::memory_order_acquire) == 0) {
+      if (++spins > k_max_ready_spins) return nullptr;
+      std::this_thread::yield();
+    }
+
+    if (entry.matches(key)) return &entry;
+  }
+
+  return nullptr;
+}
+
+bool SharedTable::drain_slot(Slot& slot, std::uint64_t now_ns,
+                             Bucket& bucket) {
+  const std::uint64_t bucket_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(bucket_duration)
+          .count();
+  const std::uint64_t delay_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(drain_delay)
+          .count();
+
+  const std::uint64_t start_ns = slot.start_ns.load(std::memory_order_acquire);
+  if (start_ns == 0 || now_ns < start_ns + bucket_ns + delay_ns) return false;
+
+  std::uint32_t not_draining = 0;
+  if (!slot.draining.compare_exchange_strong(not_draining, 1,
+                                             std::memory_order_acq_rel)) {
+    return false;
+  }
+
+  // Another process may have drained the slot in between.
+  if (slot.start_ns.load(std::memory_order_acquire) != start_ns) {
+    slot.draining.store(0, std::memory_order_release);
+    return false;
+  }
+
+  bucket.start_ns = start_ns;
+  for (Entry& entry : slot.entries) {
+    if (entry.hash.load(std::memory_order_acquire) == 0) continue;
+    if (entry.ready.load(std::memory_order_acquire) != 0) {
+      bucket.stats.emplace_back(entry.snapshot());
+    }
+    entry.reset();
+  }
+  bucket.dropped = slot.dropped.exchange(0, std::memory_order_relaxed);
+
+  slot.start_ns.store(0, std::memory_order_release);
+  slot.draining.store(0, std::memory_order_release);
+  return true;
+}
+
+bool SharedTable::Entry::matches(const Key& key) const {
+  return http_status_code == key.http_status_code &&
+         service.equals(key.service) && name.equals(key.name) &&
+         resource.equals(key.resource) && type.equals(key.type) &&
+         span_kind.equals(key.span_kind) &&
+         environment.equals(key.environment) && version.equals(key.version);
+}
+
+Key SharedTable::Entry::truncate(const Key& key) {
+  Key truncated = key;
+  truncated.service = key.service.substr(0, decltype(service)::capacity);
+  truncated.name = key.name.substr(0, decltype(name)::capacity);
+  truncated.resource = key.resource.substr(0, decltype(resource)::capacity);
+  truncated.type = key.type.substr(0, decltype(type)::capacity);
+  truncated.span_kind = key.span_kind.substr(0, decltype(span_kind)::capacity);
+  truncated.environment =
+      key.environment.substr(0, decltype(environment)::capacity);
+  truncated.version = key.version.substr(0, decltype(version)::capacity);
+  return truncated;
+}
+
+void SharedTable::Entry::assign(const Key& key) {
+  service.assign(key.service);
+  name.assign(key.name);
+  resource.assign(key.resource);
+  type.assign(key.type);
+  span_kind.assign(key.span_kind);
+  environment.assign(key.environment);
+  version.assign(key.version);
+  http_status_code = key.http_status_code;
+}
+
+GroupedStats SharedTable::Entry::snapshot() const {
+  GroupedStats stats;
+  stats.service = service.view();
+  stats.name = name.view();
+  stats.resource = resource.view();
+  stats.type = type.view();
+  stats.span_kind = span_kind.view();
+  stats.environment = environment.view();
+  stats.version = version.view();
+  stats.http_status_code = http_status_code;
+  stats.hits = hits.load(std::memory_order_relaxed);
+  stats.errors = errors.load(std::memory_order_relaxed);
+  stats.duration_ns = duration_ns.load(std::memory_order_relaxed);
+  for (std::size_t i = 0; i < DurationMapping::bin_count; ++i) {
+    stats.ok_durations[i] = ok_durations[i].load(std::memory_order_relaxed);
+    stats.error_durations[i] =
+        error_durations[i].load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+void SharedTable::Entry::reset() {
+  hits.store(0, std::memory_order_relaxed);
+  errors.store(0, std::memory_order_relaxed);
+  duration_ns.store(0, std::memory_order_relaxed);
+  for (std::size_t i = 0; i < DurationMapping::bin_count; ++i) {
+    ok_durations[i].store(0, std::memory_order_relaxed);
+    error_durations[i].store(0, std::memory_order_relaxed);
+  }
+  ready.store(0, std::memory_order_relaxed);
+  hash.store(0, std::memory_order_release);
+}
+
+}  // namespace datadog::tracing::stats
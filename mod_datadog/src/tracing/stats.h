@@ -0,0 +1,154 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace datadog::tracing::stats {
+
+// Width of an aggregation bucket, as expected by the Datadog Agent.
+inline constexpr std::chrono::seconds bucket_duration{10};
+
+// Duration histogram layout shared by every process.
+//
+// Bin `i` counts durations in (gamma^(first_bin_index + i - 1),
+// gamma^(first_bin_index + i)] nanoseconds, which gives a 2% relative
+// accuracy between 1µs and 100s. Durations outside that range are clamped.
+struct DurationMapping final {
+  static constexpr double relative_accuracy = 0.02;
+  static constexpr int first_bin_index = 170;
+  static constexpr std::size_t bin_count = 480;
+
+  static double gamma() {
+    return (1.0 + relative_accuracy) / (1.0 - relative_accuracy);
+  }
+
+  static std::size_t bin(std::chrono::nanoseconds duration);
+};
+
+using DurationBins = std::array<std::uint32_t, DurationMapping::bin_count>;
+
+// Aggregation key of a top-level span. Strings longer than the shared table
+// capacity are truncated.
+struct Key final {
+  std::string_view service;
+  std::string_view name;
+  std::string_view resource;
+  std::string_view type;
+  std::string_view span_kind;
+  std::string_view environment;
+  std::string_view version;
+  std::uint32_t http_status_code = 0;
+};
+
+struct GroupedStats final {
+  std::string service;
+  std::string name;
+  std::string resource;
+  std::string type;
+  std::string span_kind;
+  std::string environment;
+  std::string version;
+  std::uint32_t http_status_code = 0;
+  std::uint64_t hits = 0;
+  std::uint64_t errors = 0;
+  std::uint64_t duration_ns = 0;
+  DurationBins ok_durations{};
+  DurationBins error_durations{};
+};
+
+struct Bucket final {
+  std::uint64_t start_ns = 0;
+  std::vector<GroupedStats> stats;
+  std::uint64_t dropped = 0;  ///< Spans not counted because the table was full
+};
+
+// Trace statistics of every child process, aggregated per 10s bucket in
+// shared memory.
+//
+// The table must be created in the parent process (see
+// `common::make_shared_memory`). Children record into it with atomic
+// operations only: an entry is claimed with a compare-and-swap on its key
+// hash, then its counters are incremented in place. Two bucket slots
+// alternate, so the previous bucket can be drained while the current one
+// fills up. Exactly one process drains each finished bucket.
+class SharedTable final {
+ public:
+  static constexpr std::size_t max_entries = 256;
+
+  // Delay after the end of a bucket before it is drained, so that requests
+  // finishing at the bucket boundary have been recorded.
+  static constexpr std::chrono::seconds drain_delay{1};
+
+  void record(const Key& key, std::chrono::nanoseconds duration, bool is_error,
+              std::chrono::system_clock::time_point now);
+
+  // Call `on_bucket` with every finished bucket not yet drained by any
+  // process, then reset it.
+  void drain(std::chrono::system_clock::time_point now,
+             const std::function<void(Bucket)>& on_bucket);
+
+ private:
+  template <std::size_t Capacity>
+  struct FixedString final {
+    static constexpr std::size_t capacity = Capacity;
+
+    std::uint16_t size;
+    char data[Capacity];
+
+    void assign(std::string_view value);
+    std::string_view view() const { return {data, size}; }
+
+    // Compare with `value` as it would be stored, that is truncated.
+    bool equals(std::string_view value) const {
+      return view() == value.substr(0, Capacity);
+    }
+  };
+
+  struct Entry final {
+    std::atomic<std::uint64_t> hash;
+    std::atomic<std::uint32_t> ready;
+    FixedString<100> service;
+    FixedString<100> name;
+    FixedString<256> resource;
+    FixedString<16> type;
+    FixedString<16> span_kind;
+    FixedString<64> environment;
+    FixedString<64> version;
+    std::uint32_t http_status_code;
+    std::atomic<std::uint64_t> hits;
+    std::atomic<std::uint64_t> errors;
+    std::atomic<std::uint64_t> duration_ns;
+    std::array<std::atomic<std::uint32_t>, DurationMapping::bin_count>
+        ok_durations;
+    std::array<std::atomic<std::uint32_t>, DurationMapping::bin_count>
+        error_durations;
+
+    static Key truncate(const Key& key);
+
+    bool matches(const Key& key) const;
+    void assign(const Key& key);
+    GroupedStats snapshot() const;
+    void reset();
+  };
+
+  struct Slot final {
+    std::atomic<std::uint64_t> start_ns;  ///< 0 when the slot is free
+    std::atomic<std::uint32_t> draining;
+    std::atomic<std::uint64_t> dropped;
+    std::array<Entry, max_entries> entries;
+  };
+
+  std::array<Slot, 2> slots_;
+
+  Slot* acquire_slot(std::uint64_t bucket_start_ns);
+  Entry* find_or_insert(Slot& slot, const Key& key);
+  bool drain_slot(Slot& slot, std::uint64_t now_ns, Bucket& bucket);
+};
+
+}  // namespace datadog::tracing::stats
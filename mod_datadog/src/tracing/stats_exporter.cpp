@@ -0,0 +1,244 @@
+#include "stats_exporter.h"
+
+#include <datadog/dict_writer.h>
+#include <datadog/version.h>
+
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "msgpack.h"
+
+namespace datadog::tracing::stats {
+namespace {
+
+namespace msgpack = common::msgpack;
+
+constexpr std::chrono::seconds k_export_interval{1};
+constexpr std::chrono::seconds k_request_timeout{2};
+
+// Protocol Buffers encoding of the DDSketch message expected by the Agent.
+// <https://github.com/DataDog/sketches-go/blob/master/ddsketch/pb/ddsketch.proto>
+namespace protobuf {
+
+enum WireType : std::uint8_t { VARINT = 0, FIXED64 = 1, LENGTH_DELIMITED = 2 };
+
+void append_varint(std::string& destination, std::uint64_t value) {
+  while (value >= 0x80) {
+    destination += static_cast<char>((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  destination += static_cast<char>(value);
+}
+
+void append_key(std::string& destination, int field, WireType wire_type) {
+  append_varint(destination,
+                (static_cast<std::uint64_t>(field) << 3) | wire_type);
+}
+
+void append_fixed_double(std::string& destination, double value) {
+  std::uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  for (int byte = 0; byte < 8; ++byte) {
+    destination += static_cast<char>((bits >> (byte * 8)) & 0xFF);
+  }
+}
+
+void append_message(std::string& destination, int field,
+                    const std::string& message) {
+  append_key(destination, field, LENGTH_DELIMITED);
+  append_varint(destination, message.size());
+  destination += message;
+}
+
+std::string encode_sketch(const DurationBins& bins) {
+  std::string mapping;
+  append_key(mapping, 1, FIXED64);  // gamma
+  append_fixed_double(mapping, DurationMapping::gamma());
+
+  std::size_t first = 0;
+  while (first < bins.size() && bins[first] == 0) ++first;
+  std::size_t last = bins.size();
+  while (last > first && bins[last - 1] == 0) --last;
+
+  std::string store;
+  if (first < last) {
+    std::string counts;
+    for (std::size_t i = first; i < last; ++i) {
+      append_fixed_double(counts, static_cast<double>(bins[i]));
+    }
+    append_message(store, 2, counts);  // contiguousBinCounts
+
+    // `DurationMapping` bins are upper-inclusive, while the Agent's
+    // logarithmic mapping bins are lower-inclusive: shift by one.
+    const std::int32_t offset =
+        DurationMapping::first_bin_index + static_cast<std::int32_t>(first) - 1;
+    append_key(store, 3, VARINT);  // contiguousBinIndexOffset (sint32)
+    append_varint(store, (static_cast<std::uint32_t>(offset) << 1) ^
+                             static_cast<std::uint32_t>(offset >> 31));
+  }
+
+  std::string sketch;
+  append_message(sketch, 1, mapping);  // mapping
+  append_message(sketch, 2, store);    // positiveValues
+  return sketch;
+}
+
+}  // namespace protobuf
+
+void pack_grouped_stats(std::string& destination, const GroupedStats& stats) {
+  msgpack::pack_map(destination, 13);
+  msgpack::pack_string(destination, "Service");
+  msgpack::pack_string(destination, stats.service);
+  msgpack::pack_string(destination, "Name");
+  msgpack::pack_string(destination, stats.name);
+  msgpack::pack_string(destination, "Resource");
+  msgpack::pack_string(destination, stats.resource);
+  msgpack::pack_string(destination, "HTTPStatusCode");
+  msgpack::pack_uint(destination, stats.http_status_code);
+  msgpack::pack_string(destination, "Type");
+  msgpack::pack_string(destination, stats.type);
+  msgpack::pack_string(destination, "Hits");
+  msgpack::pack_uint(destination, stats.hits);
+  msgpack::pack_string(destination, "Errors");
+  msgpack::pack_uint(destination, stats.errors);
+  msgpack::pack_string(destination, "Duration");
+  msgpack::pack_uint(destination, stats.duration_ns);
+  msgpack::pack_string(destination, "OkSummary");
+  msgpack::pack_binary(destination,
+                       protobuf::encode_sketch(stats.ok_durations));
+  msgpack::pack_string(destination, "ErrorSummary");
+  msgpack::pack_binary(destination,
+                       protobuf::encode_sketch(stats.error_durations));
+  msgpack::pack_string(destination, "Synthetics");
+  msgpack::pack_bool(destination, false);
+  msgpack::pack_string(destination, "TopLevelHits");
+  msgpack::pack_uint(destination, stats.hits);
+  msgpack::pack_string(destination, "SpanKind");
+  msgpack::pack_string(destination, stats.span_kind);
+}
+
+void set_stats_headers(DictWriter& headers) {
+  headers.set("Content-Type", "application/msgpack");
+  headers.set("Datadog-Meta-Lang", "cpp");
+  headers.set("Datadog-Meta-Tracer-Version", tracer_version);
+}
+
+}  // namespace
+
+StatsExporter::StatsExporter(SharedTable& table,
+                             std::shared_ptr<HTTPClient> http_client,
+                             HTTPClient::URL agent_url,
+                             EventScheduler& scheduler,
+                             std::shared_ptr<Logger> logger,
+                             std::string service, std::string runtime_id)
+    : table_(table),
+      http_client_(std::move(http_client)),
+      stats_url_(std::move(agent_url)),
+      logger_(std::move(logger)),
+      service_(std::move(service)),
+      runtime_id_(std::move(runtime_id)) {
+  stats_url_.path += "/v0.6/stats";
+  cancel_export_ = scheduler.schedule_recurring_event(
+      k_export_interval, [this] { export_finished_buckets(); });
+}
+
+StatsExporter::~StatsExporter() { cancel_export_(); }
+
+void StatsExporter::export_finished_buckets() {
+  table_.drain(std::chrono::system_clock::now(),
+               [this](Bucket bucket) { send(bucket); });
+}
+
+void StatsExporter::send(const Bucket& bucket) {
+  if (bucket.dropped != 0) {
+    logger_->log_error([&](std::ostream& log) {
+      log << "Trace stats: " << bucket.dropped
+          << " spans were not counted because the shared table was full";
+    });
+  }
+
+  // The Agent expects one payload per environment and version.
+  std::map<std::pair<std::string, std::string>,
+           std::vector<const GroupedStats*>>
+      stats_by_env;
+  for (const GroupedStats& stats : bucket.stats) {
+    stats_by_env[{stats.environment, stats.version}].push_back(&stats);
+  }
+
+  const std::uint64_t bucket_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(bucket_duration)
+          .count();
+
+  for (const auto& [env_version, grouped_stats] : stats_by_env) {
+    std::string payload;
+    msgpack::pack_map(payload, 9);
+    msgpack::pack_string(payload, "Hostname");
+    msgpack::pack_string(payload, "");
+    msgpack::pack_string(payload, "Env");
+    msgpack::pack_string(payload, env_version.first);
+    msgpack::pack_string(payload, "Version");
+    msgpack::pack_string(payload, env_version.second);
+    msgpack::pack_string(payload, "Lang");
+    msgpack::pack_string(payload, "cpp");
+    msgpack::pack_string(payload, "TracerVersion");
+    msgpack::pack_string(payload, tracer_version);
+    msgpack::pack_string(payload, "RuntimeID");
+    msgpack::pack_string(payload, runtime_id_);
+    msgpack::pack_string(payload, "Sequence");
+    msgpack::pack_uint(payload, ++sequence_);
+    msgpack::pack_string(payload, "Service");
+    msgpack::pack_string(payload, service_);
+    msgpack::pack_string(payload, "Stats");
+    msgpack::pack_array(payload, 1);
+    msgpack::pack_map(payload, 3);
+    msgpack::pack_string(payload, "Start");
+    msgpack::pack_uint(payload, bucket.start_ns);
+    msgpack::pack_string(payload, "Duration");
+    msgpack::pack_uint(payload, bucket_ns);
+    msgpack::pack_string(payload, "Stats");
+    msgpack::pack_array(payload,
+                        static_cast<std::uint32_t>(grouped_stats.size()));
+    for (const GroupedStats* stats : grouped_stats) {
+      pack_grouped_stats(payload, *stats);
+    }
+
+    auto result = http_client_->post(
+        stats_url_, set_stats_headers, std::move(payload),
+        [logger = logger_](int status, const DictReader&, std::string body) {
+          if (status < 200 || status >= 300) {
+            logger->log_error([&](std::ostream& log) {
+              log << "Trace stats: unexpected response status " << status
+                  << " from the Datadog Agent: " << body;
+            });
+          }
+        },
+        [logger = logger_](Error error) { logger->log_error(error); },
+        std::chrono::steady_clock::now() + k_request_timeout);
+    if (auto* error = result.if_error()) {
+      logger_->log_error(*error);
+    }
+  }
+}
+
+Expected<void> ClientComputedStatsHTTPClient::post(
+    const URL& url, HeadersSetter set_headers, std::string body,
+    ResponseHandler on_response, ErrorHandler on_error,
+    std::chrono::steady_clock::time_point deadline) {
+  constexpr std::string_view traces_suffix = "/traces";
+  const std::string_view path = url.path;
+  if (path.size() >= traces_suffix.size() &&
+      path.substr(path.size() - traces_suffix.size()) == traces_suffix) {
+    set_headers = [set_headers = std::move(set_headers)](DictWriter& headers) {
+      set_headers(headers);
+      headers.set("Datadog-Client-Computed-Stats", "yes");
+    };
+  }
+
+  return next_->post(url, std::move(set_headers), std::move(body),
+                     std::move(on_response), std::move(on_error), deadline);
+}
+
+}  // namespace datadog::tracing::stats
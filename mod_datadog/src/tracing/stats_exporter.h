@@ -0,0 +1,63 @@
+#pragma once
+
+#include <datadog/event_scheduler.h>
+#include <datadog/http_client.h>
+#include <datadog/logger.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "stats.h"
+
+namespace datadog::tracing::stats {
+
+// Periodically drain the finished buckets of the shared table and send them
+// to the Datadog Agent stats endpoint.
+//
+// Every child runs an exporter, but a bucket is drained by a single process,
+// so each bucket is sent exactly once.
+class StatsExporter final {
+  SharedTable& table_;
+  std::shared_ptr<HTTPClient> http_client_;
+  HTTPClient::URL stats_url_;
+  std::shared_ptr<Logger> logger_;
+  std::string service_;
+  std::string runtime_id_;
+  std::uint64_t sequence_ = 0;
+  EventScheduler::Cancel cancel_export_;
+
+ public:
+  StatsExporter(SharedTable& table, std::shared_ptr<HTTPClient> http_client,
+                HTTPClient::URL agent_url, EventScheduler& scheduler,
+                std::shared_ptr<Logger> logger, std::string service,
+                std::string runtime_id);
+  ~StatsExporter();
+
+ private:
+  void export_finished_buckets();
+  void send(const Bucket& bucket);
+};
+
+// HTTP client decorator telling the Datadog Agent that trace statistics are
+// computed by the tracer, so that it does not count them a second time.
+class ClientComputedStatsHTTPClient final : public HTTPClient {
+  std::shared_ptr<HTTPClient> next_;
+
+ public:
+  explicit ClientComputedStatsHTTPClient(std::shared_ptr<HTTPClient> next)
+      : next_(std::move(next)) {}
+
+  Expected<void> post(const URL& url, HeadersSetter set_headers,
+                      std::string body, ResponseHandler on_response,
+                      ErrorHandler on_error,
+                      std::chrono::steady_clock::time_point deadline) override;
+
+  void drain(std::chrono::steady_clock::time_point deadline) override {
+    next_->drain(deadline);
+  }
+
+  std::string config() const override { return next_->config(); }
+};
+
+}  // namespace datadog::tracing::stats
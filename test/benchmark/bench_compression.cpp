@@ -0,0 +1,163 @@
+// CPU cost against bytes saved of the trace payload codecs
+// (`DatadogTraceCompression`), on synthetic `/v0.4/traces` payloads.
+//
+// Usage: bench_compression [iterations]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "msgpack.h"
+#include "tracing/compression.h"
+
+using datadog::tracing::Codec;
+namespace msgpack = datadog::common::msgpack;
+
+namespace {
+
+constexpr const char* k_paths[] = {
+    "/",          "/index.html",     "/api/v1/users", "/api/v1/orders",
+    "/static/app.js", "/static/app.css", "/health",   "/login",
+};
+
+void pack_meta(std::string& payload, std::mt19937_64& random,
+               const char* path, unsigned status) {
+  msgpack::pack_map(payload, 7);
+  msgpack::pack_string(payload, "component");
+  msgpack::pack_string(payload, "httpd");
+  msgpack::pack_string(payload, "http.method");
+  msgpack::pack_string(payload, "GET");
+  msgpack::pack_string(payload, "http.url");
+  msgpack::pack_string(payload, std::string{"http://www.example.com"} + path +
+                                    "?id=" + std::to_string(random() % 100000));
+  msgpack::pack_string(payload, "http.status_code");
+  msgpack::pack_string(payload, std::to_string(status));
+  msgpack::pack_string(payload, "http.useragent");
+  msgpack::pack_string(payload,
+                       "Mozilla/5.0 (X11; Linux x86_64; rv:128.0) "
+                       "Gecko/20100101 Firefox/128.0");
+  msgpack::pack_string(payload, "_dd.p.tid");
+  msgpack::pack_string(payload, "66f2a1b000000000");
+  msgpack::pack_string(payload, "runtime-id");
+  msgpack::pack_string(payload, "5b1c0a3e-8f0e-4f5e-9a43-3c2b6a1d9e07");
+}
+
+// A payload of `trace_count` traces of a request span and a proxy span, like
+// the ones httpd sends.
+std::string make_payload(std::size_t trace_count, std::mt19937_64& random) {
+  std::string payload;
+  msgpack::pack_array(payload, static_cast<std::uint32_t>(trace_count));
+  for (std::size_t i = 0; i < trace_count; ++i) {
+    const std::uint64_t trace_id = random();
+    const std::uint64_t root_id = random();
+    const char* path = k_paths[random() % std::size(k_paths)];
+    const unsigned status = random() % 20 == 0 ? 500 : 200;
+    const std::int64_t start = 1729000000000000000 + random() % 1000000000;
+
+    msgpack::pack_array(payload, 2);
+    for (int span = 0; span < 2; ++span) {
+      msgpack::pack_map(payload, 12);
+      msgpack::pack_string(payload, "trace_id");
+      msgpack::pack_uint(payload, trace_id);
+      msgpack::pack_string(payload, "span_id");
+      msgpack::pack_uint(payload, span == 0 ? root_id : random());
+      msgpack::pack_string(payload, "parent_id");
+      msgpack::pack_uint(payload, span == 0 ? 0 : root_id);
+      msgpack::pack_string(payload, "name");
+      msgpack::pack_string(payload,
+                           span == 0 ? "httpd.request" : "httpd.proxy");
+      msgpack::pack_string(payload, "service");
+      msgpack::pack_string(payload, "httpd");
+      msgpack::pack_string(payload, "resource");
+      msgpack::pack_string(payload, std::string{"GET "} + path);
+      msgpack::pack_string(payload, "type");
+      msgpack::pack_string(payload, "web");
+      msgpack::pack_string(payload, "start");
+      msgpack::pack_int(payload, start + span * 1000);
+      msgpack::pack_string(payload, "duration");
+      msgpack::pack_int(payload,
+                        static_cast<std::int64_t>(random() % 50000000));
+      msgpack::pack_string(payload, "error");
+      msgpack::pack_int(payload, status >= 500 ? 1 : 0);
+      msgpack::pack_string(payload, "meta");
+      pack_meta(payload, random, path, status);
+      msgpack::pack_string(payload, "metrics");
+      msgpack::pack_map(payload, 1);
+      msgpack::pack_string(payload, "_sampling_priority_v1");
+      msgpack::pack_double(payload, 1.0);
+    }
+  }
+  return payload;
+}
+
+struct Result final {
+  double ratio;         ///< Compressed size over original size
+  double microseconds;  ///< Per payload
+  double megabytes_per_second;
+};
+
+Result run(Codec codec, int level, const std::string& payload,
+           int iterations) {
+  // Warm up the allocator and the caches.
+  datadog::tracing::compress(codec, level, payload);
+
+  std::size_t compressed_size = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    const auto compressed = datadog::tracing::compress(codec, level, payload);
+    if (!compressed) {
+      std::fprintf(stderr, "%s level %d failed\n",
+                   datadog::tracing::content_encoding(codec), level);
+      std::exit(1);
+    }
+    compressed_size = compressed->size();
+  }
+  const std::chrono::duration<double, std::micro> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  Result result;
+  result.ratio = static_cast<double>(compressed_size) /
+                 static_cast<double>(payload.size());
+  result.microseconds = elapsed.count() / iterations;
+  result.megabytes_per_second =
+      static_cast<double>(payload.size()) / result.microseconds;
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int iterations = argc > 1 ? std::max(std::atoi(argv[1]), 1) : 200;
+
+  struct Setting {
+    Codec codec;
+    int level;
+  };
+  std::vector<Setting> settings;
+  for (const int level : {1, 6, 9}) settings.push_back({Codec::gzip, level});
+  if (datadog::tracing::is_supported(Codec::zstd)) {
+    for (const int level : {1, 3, 9}) settings.push_back({Codec::zstd, level});
+  }
+
+  std::mt19937_64 random{42};
+  std::printf("%-8s %5s %8s %10s %8s %12s %10s\n", "codec", "level", "traces",
+              "bytes", "ratio", "us/payload", "MB/s");
+  for (const std::size_t trace_count : {1, 10, 100, 1000}) {
+    const std::string payload = make_payload(trace_count, random);
+    for (const auto& setting : settings) {
+      const Result result =
+          run(setting.codec, setting.level, payload, iterations);
+      std::printf("%-8s %5d %8zu %10zu %8.3f %12.1f %10.1f\n",
+                  datadog::tracing::content_encoding(setting.codec),
+                  setting.level, trace_count, payload.size(), result.ratio,
+                  result.microseconds, result.megabytes_per_second);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,409 @@
+// Throughput of the RUM injection (`rum_output_filter`, which calls
+// `injector_write`), over a corpus of HTML documents split into brigades of
+// several shapes, from heap buckets and from file buckets, memory-mapped or
+// not (`EnableMMAP`).
+//
+// For each case, checks the whole document went through, and reports the
+// throughput, the longest call of the filter and the heap allocations made by
+// the filter per response. Pathological chunking (1-byte brigades, a `<head>`
+// far into the document) is where latency spikes show up.
+//
+// Usage: bench_rum_injection [megabytes per case] [corpus directory]
+//
+// Every `*.html` file of the corpus directory is added to the built-in
+// documents.
+
+#include <apr_buckets.h>
+#include <apr_file_io.h>
+#include <apr_pools.h>
+#include <apr_strings.h>
+#include <apr_tables.h>
+#include <http_config.h>
+#include <http_log.h>
+#include <httpd.h>
+#include <util_filter.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "common_conf.h"
+#include "httpd_stubs.h"
+#include "rum/filter.h"
+
+#if defined(__GLIBC__)
+// Count the heap allocations of the whole process, the Rust injector and APR
+// included, by interposing the allocation functions of glibc.
+extern "C" {
+void* __libc_malloc(std::size_t);
+void* __libc_calloc(std::size_t, std::size_t);
+void* __libc_realloc(void*, std::size_t);
+void* __libc_memalign(std::size_t, std::size_t);
+}
+
+namespace {
+std::atomic<std::uint64_t> g_allocations{0};
+std::atomic<std::uint64_t> g_allocated_bytes{0};
+
+void count_allocation(std::size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+}  // namespace
+
+extern "C" {
+void* malloc(std::size_t size) {
+  count_allocation(size);
+  return __libc_malloc(size);
+}
+
+void* calloc(std::size_t count, std::size_t size) {
+  count_allocation(count * size);
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, std::size_t size) {
+  count_allocation(size);
+  return __libc_realloc(pointer, size);
+}
+
+int posix_memalign(void** pointer, std::size_t alignment, std::size_t size) {
+  count_allocation(size);
+  *pointer = __libc_memalign(alignment, size);
+  return *pointer == nullptr ? ENOMEM : 0;
+}
+
+void* aligned_alloc(std::size_t alignment, std::size_t size) {
+  count_allocation(size);
+  return __libc_memalign(alignment, size);
+}
+}
+#else
+namespace {
+std::atomic<std::uint64_t> g_allocations{0};
+std::atomic<std::uint64_t> g_allocated_bytes{0};
+}  // namespace
+#endif
+
+namespace {
+
+constexpr const char* k_rum_config =
+    R"({"majorVersion":6,"rum":{"applicationId":"benchmark-app-id",)"
+    R"("clientToken":"benchmark-client-token","site":"datadoghq.com",)"
+    R"("service":"benchmark","sessionSampleRate":100}})";
+
+struct Document final {
+  std::string name;
+  std::string html;
+};
+
+enum class Input {
+  heap,
+  mmap,  ///< File buckets, memory-mapped when read
+  file,  ///< File buckets, read into heap buckets
+};
+
+const char* describe(Input input) {
+  switch (input) {
+    case Input::heap:
+      return "heap";
+    case Input::mmap:
+      return "mmap";
+    case Input::file:
+      return "file";
+  }
+  return "";
+}
+
+struct Chunking final {
+  const char* name;
+  std::size_t size;  ///< 0 for random sizes up to 16KB
+};
+
+constexpr Chunking k_chunkings[] = {
+    {"whole", SIZE_MAX},
+    {"8KB", 8 * 1024},
+    {"random", 0},
+    {"1B", 1},
+};
+
+// Paragraphs of text and markup, like the body of an article.
+std::string make_body(std::size_t size, std::mt19937_64& random) {
+  static constexpr const char* k_words[] = {
+      "httpd", "request", "module", "latency", "trace",  "browser",
+      "page",  "session", "user",   "render",  "script", "resource",
+  };
+  std::string body;
+  body.reserve(size + 256);
+  while (body.size() < size) {
+    body += "<div class=\"article\"><p>";
+    for (int i = 0; i < 40; ++i) {
+      body += k_words[random() % std::size(k_words)];
+      body += ' ';
+    }
+    body += "</p><a href=\"/articles/";
+    body += std::to_string(random() % 100000);
+    body += "\">Read more</a></div>\n";
+  }
+  return body;
+}
+
+std::string make_page(std::string_view preamble, bool with_head,
+                      std::size_t body_size, std::mt19937_64& random) {
+  std::string html = "<!DOCTYPE html>\n";
+  html += preamble;
+  html += "<html lang=\"en\">\n";
+  if (with_head) {
+    html +=
+        "<head><meta charset=\"utf-8\"><title>Benchmark</title>"
+        "<link rel=\"stylesheet\" href=\"/static/app.css\"></head>\n";
+  }
+  html += "<body>\n";
+  html += make_body(body_size, random);
+  html += "</body>\n</html>\n";
+  return html;
+}
+
+std::vector<Document> make_corpus(const char* directory) {
+  std::mt19937_64 random{42};
+  // Comments and inline markup before the `<html>` element, like license
+  // banners or server-side include leftovers.
+  std::string late_preamble;
+  while (late_preamble.size() < 256 * 1024) {
+    late_preamble += "<!-- " + make_body(1024, random) + " -->\n";
+  }
+
+  std::vector<Document> corpus = {
+      {"tiny", "<!DOCTYPE html><html><head><title>t</title></head>"
+               "<body>Hello</body></html>"},
+      {"head_early_64KB", make_page("", true, 64 * 1024, random)},
+      {"head_late_320KB", make_page(late_preamble, true, 64 * 1024, random)},
+      {"no_head_64KB", make_page("", false, 64 * 1024, random)},
+      {"head_early_5MB", make_page("", true, 5 * 1024 * 1024, random)},
+      {"no_head_5MB", make_page("", false, 5 * 1024 * 1024, random)},
+  };
+
+  if (directory != nullptr) {
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+      if (entry.path().extension() != ".html") continue;
+      std::ifstream file(entry.path(), std::ios::binary);
+      std::ostringstream content;
+      content << file.rdbuf();
+      corpus.push_back({entry.path().filename().string(), content.str()});
+    }
+  }
+  return corpus;
+}
+
+struct Result final {
+  bool injected = false;
+  std::chrono::nanoseconds total{0};
+  std::chrono::nanoseconds longest_call{0};
+  std::uint64_t allocations = 0;
+  std::uint64_t allocated_bytes = 0;
+};
+
+// Everything httpd would set up for a request.
+class Request final {
+  apr_pool_t* pool_;
+  server_rec server_{};
+  conn_rec connection_{};
+  request_rec request_{};
+  void* per_dir_config_[1];
+  void* request_config_[1] = {nullptr};
+  ap_filter_t next_{};
+  ap_filter_t filter_{};
+
+ public:
+  Request(apr_pool_t* parent, datadog::conf::Directory& dir_conf) {
+    apr_pool_create(&pool_, parent);
+    server_.log.level = APLOG_EMERG;
+    connection_.pool = pool_;
+    connection_.bucket_alloc = apr_bucket_alloc_create(pool_);
+    request_.pool = pool_;
+    request_.server = &server_;
+    request_.connection = &connection_;
+    request_.headers_out = apr_table_make(pool_, 8);
+    per_dir_config_[0] = &dir_conf;
+    request_.per_dir_config =
+        reinterpret_cast<ap_conf_vector_t*>(per_dir_config_);
+    request_.request_config =
+        reinterpret_cast<ap_conf_vector_t*>(request_config_);
+    filter_.r = &request_;
+    filter_.c = &connection_;
+    filter_.next = &next_;
+  }
+
+  ~Request() { apr_pool_destroy(pool_); }
+
+  apr_pool_t* pool() { return pool_; }
+  apr_bucket_alloc_t* bucket_alloc() { return connection_.bucket_alloc; }
+  ap_filter_t* filter() { return &filter_; }
+
+  bool injected() const {
+    return apr_table_get(request_.headers_out, "x-datadog-sdk-injected") !=
+           nullptr;
+  }
+};
+
+Result run(const Document& document, apr_file_t* file, Input input,
+           const Chunking& chunking, apr_pool_t* pool,
+           datadog::conf::Directory& dir_conf, std::mt19937_64& random) {
+  Request request{pool, dir_conf};
+  apr_bucket_brigade* bb =
+      apr_brigade_create(request.pool(), request.bucket_alloc());
+
+  Result result;
+  benchmark::g_bytes_passed = 0;
+  const std::size_t size = document.html.size();
+  std::size_t offset = 0;
+  while (offset <= size) {
+    // The last brigade ends the response.
+    if (offset < size) {
+      std::size_t length = chunking.size != 0
+                               ? chunking.size
+                               : 1 + random() % (16 * 1024);
+      length = std::min(length, size - offset);
+      apr_bucket* b = nullptr;
+      if (input == Input::heap) {
+        b = apr_bucket_heap_create(document.html.data() + offset, length,
+                                   nullptr, request.bucket_alloc());
+      } else {
+        b = apr_bucket_file_create(file, offset, length, request.pool(),
+                                   request.bucket_alloc());
+        apr_bucket_file_enable_mmap(b, input == Input::mmap);
+      }
+      APR_BRIGADE_INSERT_TAIL(bb, b);
+      offset += length;
+    } else {
+      APR_BRIGADE_INSERT_TAIL(bb,
+                              apr_bucket_eos_create(request.bucket_alloc()));
+      ++offset;
+    }
+
+    const std::uint64_t allocations =
+        g_allocations.load(std::memory_order_relaxed);
+    const std::uint64_t allocated_bytes =
+        g_allocated_bytes.load(std::memory_order_relaxed);
+    const auto start = std::chrono::steady_clock::now();
+    rum_output_filter(request.filter(), bb);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    result.allocations +=
+        g_allocations.load(std::memory_order_relaxed) - allocations;
+    result.allocated_bytes +=
+        g_allocated_bytes.load(std::memory_order_relaxed) - allocated_bytes;
+
+    result.total += elapsed;
+    result.longest_call = std::max(
+        result.longest_call,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed));
+  }
+
+  result.injected = request.injected();
+  if (benchmark::g_bytes_passed < size) {
+    std::fprintf(stderr, "%s: the filter passed %llu bytes out of %zu\n",
+                 document.name.c_str(),
+                 static_cast<unsigned long long>(benchmark::g_bytes_passed),
+                 size);
+    std::exit(1);
+  }
+  return result;
+}
+
+apr_file_t* write_file(const Document& document, apr_pool_t* pool) {
+  const char* temp_dir = nullptr;
+  apr_temp_dir_get(&temp_dir, pool);
+  char* path = apr_pstrcat(pool, temp_dir, "/bench_rum_XXXXXX", nullptr);
+
+  apr_file_t* file = nullptr;
+  apr_size_t written = document.html.size();
+  if (apr_file_mktemp(&file, path, 0, pool) != APR_SUCCESS ||
+      apr_file_write_full(file, document.html.data(), document.html.size(),
+                          &written) != APR_SUCCESS) {
+    std::fprintf(stderr, "Cannot write the document %s to %s\n",
+                 document.name.c_str(), path);
+    std::exit(1);
+  }
+  return file;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const double megabytes_per_case = argc > 1 ? std::atof(argv[1]) : 16.0;
+  const auto corpus = make_corpus(argc > 2 ? argv[2] : nullptr);
+
+  apr_initialize();
+  apr_pool_t* pool = nullptr;
+  apr_pool_create(&pool, nullptr);
+  datadog_module.module_index = 0;
+
+  datadog::conf::Directory dir_conf;
+  dir_conf.rum.enabled = true;
+  dir_conf.rum.snippet = snippet_create_from_json(k_rum_config);
+  if (dir_conf.rum.snippet->error_code != 0) {
+    std::fprintf(stderr, "Cannot create the RUM snippet: %s\n",
+                 dir_conf.rum.snippet->error_message);
+    return 1;
+  }
+
+  std::mt19937_64 random{7};
+  std::printf("%-18s %9s %5s %7s %8s %9s %12s %12s %12s\n", "document",
+              "bytes", "input", "chunks", "injected", "MB/s", "longest_us",
+              "allocs/resp", "KB/resp");
+  for (const auto& document : corpus) {
+    apr_file_t* file = write_file(document, pool);
+    const double megabytes =
+        static_cast<double>(document.html.size()) / (1024 * 1024);
+    const int runs = std::max(1, static_cast<int>(megabytes_per_case /
+                                                  std::max(megabytes, 1e-3)));
+
+    for (const Input input : {Input::heap, Input::mmap, Input::file}) {
+      for (const auto& chunking : k_chunkings) {
+        // 1-byte brigades are slow by design: a single response is enough.
+        const int case_runs = chunking.size == 1 ? 1 : runs;
+
+        Result total;
+        for (int i = 0; i < case_runs; ++i) {
+          const Result result = run(document, file, input, chunking, pool,
+                                    dir_conf, random);
+          total.injected = result.injected;
+          total.total += result.total;
+          total.longest_call =
+              std::max(total.longest_call, result.longest_call);
+          total.allocations += result.allocations;
+          total.allocated_bytes += result.allocated_bytes;
+        }
+
+        const double seconds =
+            std::chrono::duration<double>(total.total).count();
+        std::printf(
+            "%-18s %9zu %5s %7s %8s %9.1f %12.1f %12.1f %12.1f\n",
+            document.name.c_str(), document.html.size(), describe(input),
+            chunking.name, total.injected ? "yes" : "no",
+            megabytes * case_runs / seconds,
+            std::chrono::duration<double, std::micro>(total.longest_call)
+                .count(),
+            static_cast<double>(total.allocations) / case_runs,
+            static_cast<double>(total.allocated_bytes) / 1024 / case_runs);
+      }
+    }
+    apr_file_close(file);
+  }
+
+  apr_pool_destroy(pool);
+  apr_terminate();
+  return 0;
+}
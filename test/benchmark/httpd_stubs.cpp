@@ -0,0 +1,44 @@
+#include "httpd_stubs.h"
+
+#include <apr_buckets.h>
+#include <http_config.h>
+#include <http_log.h>
+#include <http_protocol.h>
+#include <httpd.h>
+#include <util_filter.h>
+
+#include "mod_datadog.h"
+
+namespace benchmark {
+
+std::uint64_t g_bytes_passed = 0;
+
+}  // namespace benchmark
+
+module AP_MODULE_DECLARE_DATA datadog_module = {
+    STANDARD20_MODULE_STUFF, NULL, NULL, NULL, NULL, NULL, NULL,
+};
+
+// Sink of the filter chain: count the bytes like the core output filter
+// would send them, without reading file buckets.
+AP_DECLARE(apr_status_t)
+ap_pass_brigade(ap_filter_t* /* next */, apr_bucket_brigade* bb) {
+  apr_off_t length = 0;
+  apr_brigade_length(bb, 0, &length);
+  if (length > 0) benchmark::g_bytes_passed += length;
+  apr_brigade_cleanup(bb);
+  return APR_SUCCESS;
+}
+
+AP_DECLARE(void)
+ap_log_rerror_(const char* /* file */, int /* line */, int /* module_index */,
+               int /* level */, apr_status_t /* status */,
+               const request_rec* /* r */, const char* /* fmt */, ...) {}
+
+AP_DECLARE(int) ap_rwrite(const void* /* buf */, int nbyte,
+                          request_rec* /* r */) {
+  return nbyte;
+}
+
+AP_DECLARE_NONSTD(int)
+ap_rprintf(request_rec* /* r */, const char* /* fmt */, ...) { return 0; }
@@ -0,0 +1,14 @@
+#pragma once
+
+// Minimal stand-ins for the httpd functions the module sources linked in a
+// benchmark call. httpd exports them from its executable, not from a
+// library.
+
+#include <cstdint>
+
+namespace benchmark {
+
+// Bytes passed to the next filter by `ap_pass_brigade`.
+extern std::uint64_t g_bytes_passed;
+
+}  // namespace benchmark
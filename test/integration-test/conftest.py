@@ -154,6 +154,19 @@ class AgentSession:
 
         return []
 
+    def get_stats(self, timeout) -> typing.Any:
+        beg = datetime.now()
+        while (datetime.now() - beg).total_seconds() < timeout:
+            r = requests.get(
+                f"http://{self.agent_.host}:{self.agent_.port}/test/session/stats?test_session_token={self.token_}"
+            )
+            if r.status_code == 200 and len(r.json()) >= 1:
+                return r.json()
+
+            time.sleep(1)
+
+        return []
+
 
 class TestAgent:
     def __init__(self, host: str, port: int) -> None:
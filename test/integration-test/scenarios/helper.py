@@ -84,6 +84,63 @@ def make_temporary_configuration(config, module_path):
         yield f.name
 
 
+def _read_varint(data: bytes, offset: int) -> tuple[int, int]:
+    value = 0
+    shift = 0
+    while True:
+        byte = data[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        if byte < 0x80:
+            return value, offset
+        shift += 7
+
+
+def _read_fields(data: bytes):
+    """Yield the (field number, value) pairs of a protocol buffers message.
+    Only varint and length-delimited fields are supported."""
+    offset = 0
+    while offset < len(data):
+        key, offset = _read_varint(data, offset)
+        field, wire_type = key >> 3, key & 0x7
+        if wire_type == 0:
+            value, offset = _read_varint(data, offset)
+        elif wire_type == 2:
+            size, offset = _read_varint(data, offset)
+            value = data[offset : offset + size]
+            offset += size
+        else:
+            raise ValueError(f"unsupported wire type {wire_type}")
+        yield field, value
+
+
+def read_pprof_labels(path: str) -> list[dict]:
+    """Return the labels of every sample of a pprof file, as dictionaries of
+    their keys to their string or numeric value."""
+    with open(path, "rb") as f:
+        data = f.read()
+
+    strings = []
+    samples = []
+    for field, value in _read_fields(data):
+        if field == 6:  # string_table
+            strings.append(value.decode())
+        elif field == 2:  # sample
+            samples.append(value)
+
+    labels = []
+    for sample in samples:
+        sample_labels = {}
+        for field, value in _read_fields(sample):
+            if field != 3:  # label
+                continue
+            label = dict(_read_fields(value))
+            key = strings[label.get(1, 0)]
+            sample_labels[key] = strings[label[2]] if 2 in label else label.get(3, 0)
+        labels.append(sample_labels)
+    return labels
+
+
 def free_port() -> int:
     """Return an available TCP port on localhost."""
     with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as sock:
@@ -1,5 +1,8 @@
 #!/usr/bin/env python3
 import os
+import shutil
+import subprocess
+import time
 import requests
 import pytest
 from helper import (
@@ -7,6 +10,7 @@ from helper import (
     make_configuration,
     save_configuration,
     make_temporary_configuration,
+    read_pprof_labels,
 )
 
 
@@ -242,3 +246,590 @@ def test_trust_inbound_span_directive(server, agent, log_dir, module_path):
             assert root_span["parent_id"] == 67667974448284343
         else:
             assert root_span["parent_id"] == 0
+
+
+def test_virtual_host_service(server, agent, log_dir, module_path):
+    """
+    Verify service settings set in a `<VirtualHost>` apply to its requests, and
+    that unset settings are inherited from the main server.
+    """
+    config = {
+        "path": relpath("conf/vhost.conf"),
+        "var": {},
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    assert server.check_configuration(conf_path)
+    assert server.load_configuration(conf_path)
+
+    for host in ("main.localhost", "billing.localhost", "search.localhost"):
+        r = requests.get(server.make_url("/"), headers={"Host": host}, timeout=2)
+        assert r.status_code == 200
+
+    assert server.stop(conf_path)
+
+    traces = agent.get_traces(timeout=5)
+    assert len(traces) == 3
+
+    services = {}
+    for trace in traces:
+        root_span = trace[0]
+        services[root_span["meta"]["http.host"]] = (
+            root_span["service"],
+            root_span["meta"]["env"],
+        )
+
+    assert services["main.localhost"] == ("integration-tests", "test")
+    assert services["billing.localhost"] == ("billing", "test")
+    assert services["search.localhost"] == ("search", "staging")
+
+
+def test_trace_stats(server, agent, log_dir, module_path):
+    """
+    Verify `DatadogTraceStats` sends trace statistics covering every request,
+    including the ones whose trace is dropped by the sampler.
+    """
+    config = {
+        "path": relpath("conf/trace_stats.conf"),
+        "var": {},
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    assert server.check_configuration(conf_path)
+    assert server.load_configuration(conf_path)
+
+    for _ in range(5):
+        r = requests.get(server.make_url("/"), timeout=2)
+        assert r.status_code == 200
+
+    # Buckets are 10s wide and exported once finished.
+    payloads = agent.get_stats(timeout=25)
+    assert server.stop(conf_path)
+    assert len(payloads) >= 1
+
+    hits = 0
+    for payload in payloads:
+        assert payload["Env"] == "test"
+        for bucket in payload["Stats"]:
+            for stats in bucket["Stats"]:
+                assert stats["Service"] == "integration-tests"
+                assert stats["Name"] == "httpd.request"
+                hits += stats["Hits"]
+
+    assert hits == 5
+
+
+def test_subrequest_aggregation(server, agent, log_dir, module_path):
+    """
+    Verify `DatadogSubrequestAggregation` reports subrequests as metrics of
+    the request span instead of child spans.
+    """
+    config = {
+        "path": relpath("conf/subrequest_aggregation.conf"),
+        "var": {},
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    assert server.check_configuration(conf_path)
+    assert server.load_configuration(conf_path)
+
+    r = requests.get(server.make_url("/ssi.shtml"), timeout=2)
+    assert r.status_code == 200
+
+    assert server.stop(conf_path)
+
+    traces = agent.get_traces(timeout=5)
+    assert len(traces) == 1
+
+    spans = traces[0]
+    assert all(span["name"] != "httpd.subrequests" for span in spans)
+
+    root = spans[0]
+    assert root["metrics"]["httpd.subrequests.count"] >= 3
+    assert root["metrics"]["httpd.subrequests.max_duration_ms"] >= 0
+    assert "GET /static.html" in root["meta"]["httpd.subrequests.slowest"]
+
+
+def test_tail_retention(server, agent, log_dir, module_path):
+    """
+    Verify `DatadogTailRetention` keeps the traces of failed requests and
+    drops the others once the request is done.
+    """
+    config = {
+        "path": relpath("conf/tail_retention.conf"),
+        "var": {},
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    assert server.check_configuration(conf_path)
+    assert server.load_configuration(conf_path)
+
+    r = requests.get(server.make_url("/"), timeout=2)
+    assert r.status_code == 200
+
+    r = requests.get(server.make_url("/unavailable"), timeout=2)
+    assert r.status_code == 503
+
+    assert server.stop(conf_path)
+
+    traces = agent.get_traces(timeout=5)
+    spans = {trace[0]["meta"]["http.url"]: trace[0] for trace in traces}
+
+    kept = spans["/unavailable"]
+    assert kept["metrics"]["_sampling_priority_v1"] == 2
+    assert kept["meta"]["httpd.retention.reason"] == "error"
+
+    # Dropped before being serialized.
+    assert "/" not in spans
+
+
+def test_http_header_tags(server, agent, log_dir, module_path):
+    """
+    Verify `DatadogHttpHeaderTags` reports the configured request and response
+    headers as tags, whatever their case.
+    """
+    config = {
+        "path": relpath("conf/http_header_tags.conf"),
+        "var": {},
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    assert server.check_configuration(conf_path)
+    assert server.load_configuration(conf_path)
+
+    headers = {"x-tenant-id": "acme", "X-CANARY": "true", "X-Other": "ignored"}
+    r = requests.get(server.make_url("/"), headers=headers, timeout=2)
+    assert r.status_code == 200
+
+    assert server.stop(conf_path)
+
+    traces = agent.get_traces(timeout=5)
+    assert len(traces) == 1
+
+    meta = traces[0][0]["meta"]
+    assert meta["tenant"] == "acme"
+    assert meta["http.request.headers.x-canary"] == "true"
+    assert meta["http.content_type"].startswith("text/html")
+    assert not any("x-other" in key for key in meta)
+
+
+def test_live_control(server, agent, log_dir, module_path):
+    """
+    Verify `DatadogLiveControl` turns tracing off and on again without a
+    restart.
+    """
+    control_path = os.path.join(log_dir, "datadog-control")
+    with open(control_path, "w") as control:
+        control.write("# Incident in progress\ntracing off\n")
+
+    config = {
+        "path": relpath("conf/live_control.conf"),
+        "var": {"control_path": control_path},
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    assert server.check_configuration(conf_path)
+    assert server.load_configuration(conf_path)
+
+    r = requests.get(server.make_url("/?tracing=off"), timeout=2)
+    assert r.status_code == 200
+
+    # The file is polled every second.
+    os.remove(control_path)
+    time.sleep(3)
+
+    r = requests.get(server.make_url("/?tracing=on"), timeout=2)
+    assert r.status_code == 200
+
+    assert server.stop(conf_path)
+
+    traces = agent.get_traces(timeout=5)
+    urls = [trace[0]["meta"]["http.url"] for trace in traces]
+    assert urls == ["/?tracing=on"]
+
+
+def test_cache_hit_sampling(server, agent, log_dir, module_path):
+    """
+    Verify spans report the mod_cache status, and cache hits are only counted
+    with `DatadogCacheHitSampling Aggregate`.
+    """
+    cache_root = os.path.join(log_dir, "cache")
+    os.makedirs(cache_root, exist_ok=True)
+
+    config = {
+        "path": relpath("conf/cache_hits.conf"),
+        "var": {"cache_root": cache_root},
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    assert server.check_configuration(conf_path)
+    assert server.load_configuration(conf_path)
+
+    for _ in range(3):
+        r = requests.get(server.make_url("/"), timeout=2)
+        assert r.status_code == 200
+
+    assert server.stop(conf_path)
+
+    traces = agent.get_traces(timeout=5)
+    assert len(traces) == 1
+    assert traces[0][0]["meta"]["httpd.cache.status"] == "miss"
+
+
+def test_connection_tracing(server, agent, log_dir, module_path):
+    """
+    Verify `DatadogConnectionTracing` reports a span per connection, with the
+    requests it served, and links the request spans to it.
+    """
+    config = {
+        "path": relpath("conf/connection_tracing.conf"),
+        "var": {},
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    assert server.check_configuration(conf_path)
+    assert server.load_configuration(conf_path)
+
+    with requests.Session() as session:
+        for _ in range(2):
+            r = session.get(server.make_url("/"), timeout=2)
+            assert r.status_code == 200
+
+    assert server.stop(conf_path)
+
+    traces = agent.get_traces(timeout=5)
+    spans = [span for trace in traces for span in trace]
+    connections = [span for span in spans if span["name"] == "httpd.connection"]
+    request_spans = [span for span in spans if span["name"] == "httpd.request"]
+
+    assert len(connections) == 1
+    assert connections[0]["metrics"]["httpd.connection.requests"] == 2
+    assert "httpd.connection.idle_total_ms" in connections[0]["metrics"]
+
+    assert len(request_spans) == 2
+    for span in request_spans:
+        assert span["meta"]["httpd.connection.span_id"] == str(
+            connections[0]["span_id"]
+        )
+
+
+def test_connection_tracing_sampling(server, agent, log_dir, module_path):
+    """
+    Verify connection traces get the sampling decision of the
+    `DatadogLiveControl` rate, like request traces.
+    """
+    control_path = os.path.join(log_dir, "datadog-control")
+    with open(control_path, "w") as control:
+        control.write("sampling_rate 0\n")
+
+    config = {
+        "path": relpath("conf/connection_tracing_live_control.conf"),
+        "var": {"control_path": control_path},
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    assert server.check_configuration(conf_path)
+    assert server.load_configuration(conf_path)
+
+    with requests.Session() as session:
+        r = session.get(server.make_url("/"), timeout=2)
+        assert r.status_code == 200
+
+    assert server.stop(conf_path)
+
+    traces = agent.get_traces(timeout=5)
+    spans = [span for trace in traces for span in trace]
+    connections = [span for span in spans if span["name"] == "httpd.connection"]
+
+    assert len(connections) == 1
+    assert connections[0]["metrics"]["_sampling_priority_v1"] <= 0
+    assert connections[0]["metrics"]["_dd.rule_psr"] == 0
+
+
+def test_http2_streams(server, agent, log_dir, module_path):
+    """
+    Verify the request spans of HTTP/2 streams have the stream ID, the ID of
+    the master connection and the queueing delay, and the span of the master
+    connection the aggregates of its streams. Requests are sent over h2c.
+    """
+    curl = shutil.which("curl")
+    if curl is None:
+        pytest.skip("curl is needed to send HTTP/2 requests")
+
+    config = {
+        "path": relpath("conf/http2.conf"),
+        "var": {},
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    assert server.check_configuration(conf_path)
+    assert server.load_configuration(conf_path)
+
+    # Both requests are streams of the same connection.
+    url = server.make_url("/")
+    result = subprocess.run(
+        [
+            curl,
+            "--silent",
+            "--http2-prior-knowledge",
+            "--output",
+            "/dev/null",
+            "--output",
+            "/dev/null",
+            "--write-out",
+            "%{http_version} %{response_code}\n",
+            url,
+            url,
+        ],
+        capture_output=True,
+        text=True,
+        timeout=10,
+    )
+    assert result.returncode == 0, result.stderr
+    assert result.stdout.splitlines() == ["2 200", "2 200"]
+
+    assert server.stop(conf_path)
+
+    traces = agent.get_traces(timeout=5)
+    spans = [span for trace in traces for span in trace]
+    connections = [span for span in spans if span["name"] == "httpd.connection"]
+    request_spans = [span for span in spans if span["name"] == "httpd.request"]
+
+    assert len(connections) == 1
+    connection = connections[0]
+    assert connection["metrics"]["http2.streams"] == 2
+    assert 1 <= connection["metrics"]["http2.streams.max_concurrent"] <= 2
+    assert connection["metrics"]["http2.stream.queue_delay_avg_ms"] >= 0
+    assert (
+        connection["metrics"]["http2.stream.queue_delay_max_ms"]
+        >= connection["metrics"]["http2.stream.queue_delay_avg_ms"]
+    )
+
+    assert len(request_spans) == 2
+    for span in request_spans:
+        assert span["meta"]["httpd.connection.span_id"] == str(connection["span_id"])
+        assert span["metrics"]["http2.stream.queue_delay_ms"] >= 0
+    assert {span["meta"]["http2.stream.id"] for span in request_spans} == {"1", "3"}
+    connection_ids = {span["meta"]["http2.connection.id"] for span in request_spans}
+    assert len(connection_ids) == 1
+
+
+def test_long_requests(server, agent, log_dir, module_path):
+    """
+    Verify `DatadogLongRequests` sends a start span as the request starts, and
+    sets the traffic of the request on its span.
+    """
+    config = {
+        "path": relpath("conf/long_requests.conf"),
+        "var": {},
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    assert server.check_configuration(conf_path)
+    assert server.load_configuration(conf_path)
+
+    r = requests.get(server.make_url("/"), timeout=2)
+    assert r.status_code == 200
+
+    assert server.stop(conf_path)
+
+    traces = agent.get_traces(timeout=5)
+    spans = [span for trace in traces for span in trace]
+    request_spans = [span for span in spans if span["name"] == "httpd.request"]
+    starts = [span for span in spans if span["name"] == "httpd.long_request.start"]
+
+    assert len(request_spans) == 1
+    assert len(starts) == 1
+    assert starts[0]["trace_id"] == request_spans[0]["trace_id"]
+    assert starts[0]["parent_id"] == request_spans[0]["span_id"]
+
+    metrics = request_spans[0]["metrics"]
+    assert metrics["httpd.long_request.checkpoints"] == 0
+    assert metrics["httpd.long_request.bytes_out"] > 0
+
+
+def test_server_timing(server, agent, log_dir, module_path):
+    """
+    Verify `DatadogServerTiming` sends the timing of the request and the trace
+    context of its span in a `Server-Timing` header.
+    """
+    config = {
+        "path": relpath("conf/server_timing.conf"),
+        "var": {},
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    assert server.check_configuration(conf_path)
+    assert server.load_configuration(conf_path)
+
+    r = requests.get(server.make_url("/"), timeout=2)
+    assert r.status_code == 200
+    server_timing = r.headers["Server-Timing"]
+
+    assert server.stop(conf_path)
+
+    metrics = {}
+    for entry in server_timing.split(", "):
+        name, _, parameter = entry.partition(";")
+        metrics[name] = parameter
+
+    assert metrics["total"].startswith("dur=")
+    assert metrics["handler"].startswith("dur=")
+    assert float(metrics["handler"][4:]) <= float(metrics["total"][4:])
+
+    version, trace_id, span_id, flags = metrics["traceparent"][6:-1].split("-")
+    assert version == "00"
+
+    traces = agent.get_traces(timeout=5)
+    spans = [span for trace in traces for span in trace]
+    request_spans = [span for span in spans if span["name"] == "httpd.request"]
+    assert len(request_spans) == 1
+    assert int(span_id, 16) == request_spans[0]["span_id"]
+    assert int(trace_id[16:], 16) == request_spans[0]["trace_id"]
+
+
+def test_resource_accounting(server, agent, log_dir, module_path):
+    """
+    Verify `DatadogResourceAccounting` sets the CPU time and the traffic of
+    the request on its span.
+    """
+    config = {
+        "path": relpath("conf/resource_accounting.conf"),
+        "var": {},
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    assert server.check_configuration(conf_path)
+    assert server.load_configuration(conf_path)
+
+    r = requests.get(server.make_url("/"), timeout=2)
+    assert r.status_code == 200
+
+    assert server.stop(conf_path)
+
+    traces = agent.get_traces(timeout=5)
+    spans = [span for trace in traces for span in trace]
+    request_spans = [span for span in spans if span["name"] == "httpd.request"]
+    assert len(request_spans) == 1
+
+    metrics = request_spans[0]["metrics"]
+    assert metrics["httpd.resources.cpu_time_ms"] >= 0
+    assert metrics["httpd.resources.bytes_read"] >= 0
+    assert metrics["httpd.resources.bytes_written"] >= len(r.content)
+
+
+def test_resource_accounting_with_long_requests(server, agent, log_dir, module_path):
+    """
+    Verify `DatadogResourceAccounting` and `DatadogLongRequests` report the
+    same traffic for a request they both follow, counted once.
+    """
+    config = {
+        "path": relpath("conf/resource_accounting_long_requests.conf"),
+        "var": {},
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    assert server.check_configuration(conf_path)
+    assert server.load_configuration(conf_path)
+
+    r = requests.get(server.make_url("/"), timeout=2)
+    assert r.status_code == 200
+
+    assert server.stop(conf_path)
+
+    traces = agent.get_traces(timeout=5)
+    spans = [span for trace in traces for span in trace]
+    request_spans = [span for span in spans if span["name"] == "httpd.request"]
+    assert len(request_spans) == 1
+
+    metrics = request_spans[0]["metrics"]
+    assert metrics["httpd.resources.bytes_written"] >= len(r.content)
+    assert (
+        metrics["httpd.resources.bytes_written"]
+        == metrics["httpd.long_request.bytes_out"]
+    )
+    assert (
+        metrics["httpd.resources.bytes_read"] == metrics["httpd.long_request.bytes_in"]
+    )
+
+
+def test_profiler_event_mpm(server, agent, log_dir, module_path):
+    """
+    Verify `DatadogProfiler` samples the worker threads of the event MPM,
+    which block asynchronous signals, and labels the samples with the IDs of
+    the request spans.
+    """
+    htdoc_dir = os.path.join(log_dir, "htdocs")
+    profile_dir = os.path.join(log_dir, "profiles")
+    os.mkdir(htdoc_dir)
+    os.mkdir(profile_dir)
+    with open(os.path.join(htdoc_dir, "large.txt"), "w") as f:
+        for i in range(200_000):
+            f.write(f"line {i} of a response compressed by mod_deflate\n")
+
+    config = {
+        "path": relpath("conf/profiler.conf"),
+        "var": {"htdoc_dir": htdoc_dir, "profile_dir": profile_dir},
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    assert server.check_configuration(conf_path)
+    assert server.load_configuration(conf_path)
+
+    for _ in range(50):
+        r = requests.get(
+            server.make_url("/large.txt"),
+            headers={"Accept-Encoding": "gzip"},
+            timeout=5,
+        )
+        assert r.status_code == 200
+
+    # Profiles are written when the children exit.
+    assert server.stop(conf_path)
+    time.sleep(1)
+
+    profiles = [
+        os.path.join(profile_dir, name)
+        for name in os.listdir(profile_dir)
+        if name.endswith(".pprof")
+    ]
+    assert profiles
+
+    labels = [label for path in profiles for label in read_pprof_labels(path)]
+    assert labels
+    sampled_span_ids = {label["span id"] for label in labels if "span id" in label}
+    assert sampled_span_ids
+
+    traces = agent.get_traces(timeout=5)
+    span_ids = {span["span_id"] for trace in traces for span in trace}
+    assert sampled_span_ids <= span_ids
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+import os
+import socket
+import time
+
+import requests
+from helper import relpath, make_configuration, save_configuration, free_port
+
+
+def receive_metrics(sock: socket.socket, timeout: float) -> list[str]:
+    lines = []
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        try:
+            datagram, _ = sock.recvfrom(65535)
+        except socket.timeout:
+            continue
+        lines.extend(datagram.decode("utf-8").split("\n"))
+    return lines
+
+
+def test_request_metrics(server, agent, log_dir, module_path):
+    """
+    Verify request metrics are flushed to DogStatsD with status class tags,
+    independently of the sampling decision.
+    """
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        sock.bind(("127.0.0.1", free_port()))
+        sock.settimeout(0.5)
+
+        config = {
+            "path": relpath("conf/metrics.conf"),
+            "var": {"dogstatsd_port": str(sock.getsockname()[1])},
+        }
+
+        conf_path = os.path.join(log_dir, "httpd.conf")
+        save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+        assert server.check_configuration(conf_path)
+        assert server.load_configuration(conf_path)
+
+        for _ in range(3):
+            r = requests.get(server.make_url("/"), timeout=2)
+            assert r.status_code == 200
+
+        r = requests.get(server.make_url("/does-not-exist"), timeout=2)
+        assert r.status_code == 404
+
+        lines = receive_metrics(sock, timeout=3)
+        assert server.stop(conf_path)
+
+    hits = [line for line in lines if line.startswith("httpd.request.hits:")]
+    assert any("status_class:2xx" in line for line in hits)
+    assert any("status_class:4xx" in line for line in hits)
+    assert all("service:integration-tests" in line for line in hits)
+    assert all("env:test" in line for line in hits)
+
+    # One value per sketch bin, weighted by the inverse of its sample rate.
+    durations = [line for line in lines if line.startswith("httpd.request.duration:")]
+    assert all("|d|" in line for line in durations)
+
+    def weight(line):
+        for field in line.split("|")[2:]:
+            if field.startswith("@"):
+                return round(1 / float(field[1:]))
+        return 1
+
+    assert sum(weight(line) for line in durations if "status_class:2xx" in line) == 3
+
+
+def test_request_metrics_resource(server, agent, log_dir, module_path):
+    """
+    Verify request metrics are tagged with the resource of the request spans,
+    with the identifiers of their paths normalized.
+    """
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        sock.bind(("127.0.0.1", free_port()))
+        sock.settimeout(0.5)
+
+        config = {
+            "path": relpath("conf/metrics.conf"),
+            "var": {"dogstatsd_port": str(sock.getsockname()[1])},
+        }
+
+        conf_path = os.path.join(log_dir, "httpd.conf")
+        save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+        assert server.check_configuration(conf_path)
+        assert server.load_configuration(conf_path)
+
+        r = requests.get(server.make_url("/"), timeout=2)
+        assert r.status_code == 200
+        for user in ("123", "456", "3fa85f64-5717-4562-b3fc-2c963f66afa6"):
+            r = requests.get(server.make_url(f"/users/{user}"), timeout=2)
+            assert r.status_code == 404
+
+        lines = receive_metrics(sock, timeout=3)
+        assert server.stop(conf_path)
+
+    def resource(line):
+        for tag in line.split("|#")[1].split(","):
+            if tag.startswith("resource_name:"):
+                return tag[len("resource_name:") :]
+        return None
+
+    hits = [line for line in lines if line.startswith("httpd.request.hits:")]
+    resources = {resource(line) for line in hits}
+    assert resources == {"GET / HTTP/1.1", "GET /users/? HTTP/1.1"}
+
+    spans = [trace[0] for trace in agent.get_traces(timeout=5)]
+    assert "GET / HTTP/1.1" in {span["resource"] for span in spans}
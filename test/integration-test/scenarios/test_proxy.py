@@ -5,6 +5,7 @@ Test related to proxy
 from queue import Queue
 import requests
 import os
+import pytest
 from aiohttp import web
 from helper import relpath, make_configuration, save_configuration, AioHTTPServer, free_port
 
@@ -48,3 +49,66 @@ def test_http_proxy(server, agent, log_dir, module_path):
 
     traces = agent.get_traces(timeout=5)
     assert len(traces) == 1
+
+
+@pytest.mark.parametrize("base_rate", [0, 1])
+def test_tail_retention_propagation(server, agent, log_dir, module_path, base_rate):
+    """
+    Verify `DatadogTailRetention` tells upstream services the decision of the
+    base rate, so that they only keep traces `httpd` keeps too, and that
+    failed requests are still kept by `httpd` once done.
+    """
+    host = "127.0.0.1"
+    port = free_port()
+    q = Queue()
+
+    async def index(request):
+        q.put(request.headers)
+        return web.Response(text="Hello, Dog!")
+
+    async def fail(request):
+        q.put(request.headers)
+        return web.Response(status=500, text="Oops")
+
+    app = web.Application()
+    app.add_routes([web.get("/", index), web.get("/fail", fail)])
+
+    config = {
+        "path": relpath("conf/tail_retention_proxy.conf"),
+        "var": {"upstream_url": f"http://{host}:{port}", "base_rate": str(base_rate)},
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    with AioHTTPServer(app, host, port):
+        assert server.check_configuration(conf_path)
+        assert server.load_configuration(conf_path)
+
+        r = requests.get(server.make_url("/http/"), timeout=2)
+        assert r.status_code == 200
+        r = requests.get(server.make_url("/http/fail"), timeout=2)
+        assert r.status_code == 500
+
+        assert server.stop(conf_path)
+
+        # Both requests are forwarded with the decision of the base rate, made
+        # before their outcome is known.
+        for _ in range(2):
+            upstream_headers = q.get(timeout=2)
+            assert upstream_headers["x-datadog-sampling-priority"] == str(base_rate)
+
+    traces = agent.get_traces(timeout=5)
+    spans = {trace[0]["meta"]["http.url"]: trace[0] for trace in traces}
+
+    failed = spans["/http/fail"]
+    if base_rate == 0:
+        # Kept by `httpd` alone: upstream services dropped their spans.
+        assert failed["metrics"]["_sampling_priority_v1"] == 2
+        assert failed["meta"]["httpd.retention.reason"] == "error"
+        # Dropped by both, and never serialized.
+        assert "/http/" not in spans
+    else:
+        for span in (failed, spans["/http/"]):
+            assert span["metrics"]["_sampling_priority_v1"] == 1
+            assert span["meta"]["httpd.retention.reason"] == "base_rate"
@@ -247,6 +247,42 @@ def test_rum_proxy_injection_pending_header(server: Server, agent: AgentSession,
 
 # Helper functions
 
+@pytest.mark.requires_rum
+def test_rum_span_tags(server: Server, agent: AgentSession, log_dir: str, module_path: str) -> None:
+    """
+    Verify `DatadogRumSpanTags` reports the cost of the injection as metrics
+    of the request span.
+    """
+    config = {
+        "path": relpath("conf/rum_span_tags.conf"),
+        "var": {},
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    assert server.check_configuration(conf_path)
+    assert server.load_configuration(conf_path)
+
+    r = requests.get(server.make_url("/app.html"), timeout=2)
+    assert r.status_code == 200
+    assert_rum_injected(r)
+
+    assert server.stop(conf_path)
+
+    traces = agent.get_traces(timeout=5)
+    spans = [span for trace in traces for span in trace]
+    request_spans = [span for span in spans if span["name"] == "httpd.request"]
+    assert len(request_spans) == 1
+
+    metrics = request_spans[0]["metrics"]
+    assert metrics["httpd.rum.bytes_scanned"] > 0
+    assert metrics["httpd.rum.injector_time_ms"] >= 0
+    assert metrics["httpd.rum.buckets_read"] >= 1
+    assert metrics["httpd.rum.buckets_split"] >= 1
+    assert "httpd.rum.file_buckets_read" in metrics
+
+
 def assert_rum_injected(response: requests.Response) -> None:
     """
     Verify that RUM SDK was injected into the response.
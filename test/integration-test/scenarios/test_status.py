@@ -0,0 +1,202 @@
+#!/usr/bin/env python3
+import gzip
+import os
+import time
+
+import msgpack
+import requests
+from aiohttp import web
+from helper import (
+    relpath,
+    make_configuration,
+    save_configuration,
+    AioHTTPServer,
+    free_port,
+)
+
+
+def test_server_status(server, agent, log_dir, module_path):
+    """
+    Verify the module counters are reported by `mod_status`.
+    """
+    config = {
+        "path": relpath("conf/status.conf"),
+        "var": {},
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    assert server.check_configuration(conf_path)
+    assert server.load_configuration(conf_path)
+
+    for _ in range(3):
+        r = requests.get(server.make_url("/"), timeout=2)
+        assert r.status_code == 200
+
+    r = requests.get(server.make_url("/server-status?auto"), timeout=2)
+    assert r.status_code == 200
+
+    counters = {}
+    for line in r.text.splitlines():
+        key, _, value = line.partition(": ")
+        if key.startswith("Datadog"):
+            counters[key] = int(value)
+
+    r = requests.get(server.make_url("/server-status"), timeout=2)
+    assert r.status_code == 200
+    assert "<h2>Datadog</h2>" in r.text
+
+    assert server.stop(conf_path)
+
+    # `server-status` requests are not traced. Subrequests, like the
+    # `DirectoryIndex` lookup, have their own span.
+    assert counters["DatadogSpansStarted"] >= 3
+    assert counters["DatadogSpansFinished"] == counters["DatadogSpansStarted"]
+    assert "DatadogAgentErrors" in counters
+    assert "DatadogExportQueueDepth" in counters
+
+
+def test_trace_buffer_drops(server, agent, log_dir, module_path):
+    """
+    Verify trace payloads over the `DatadogTraceBufferSize` budget are dropped
+    and counted.
+    """
+    config = {
+        "path": relpath("conf/trace_buffer.conf"),
+        "var": {},
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    assert server.check_configuration(conf_path)
+    assert server.load_configuration(conf_path)
+
+    for _ in range(3):
+        r = requests.get(server.make_url("/"), timeout=2)
+        assert r.status_code == 200
+
+    # Wait for the tracer to flush its traces.
+    time.sleep(3)
+
+    r = requests.get(server.make_url("/server-status?auto"), timeout=2)
+    assert r.status_code == 200
+
+    counters = {}
+    for line in r.text.splitlines():
+        key, _, value = line.partition(": ")
+        if key.startswith("Datadog"):
+            counters[key] = int(value)
+
+    assert server.stop(conf_path)
+
+    assert counters["DatadogBufferDroppedPayloads"] >= 1
+    assert counters["DatadogBufferDroppedTraces"] >= 1
+    assert counters["DatadogBufferBytes"] == 0
+
+
+def test_trace_spool_replay(server, log_dir, module_path):
+    """
+    Verify traces the Agent could not receive are kept in the
+    `DatadogTraceSpool` file and replayed once it is back.
+    """
+    host = "127.0.0.1"
+    port = free_port()
+    received = []
+
+    async def traces(request):
+        received.append(int(request.headers.get("X-Datadog-Trace-Count", "0")))
+        return web.json_response({"rate_by_service": {}})
+
+    app = web.Application()
+    app.add_routes([web.put("/v0.4/traces", traces), web.post("/v0.4/traces", traces)])
+
+    config = {
+        "path": relpath("conf/trace_spool.conf"),
+        "var": {
+            "agent_url": f"http://{host}:{port}",
+            "spool_path": os.path.join(log_dir, "traces.spool"),
+        },
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    assert server.check_configuration(conf_path)
+    assert server.load_configuration(conf_path)
+
+    # The Agent is down: the flushed traces go to the spool.
+    for _ in range(3):
+        r = requests.get(server.make_url("/"), timeout=2)
+        assert r.status_code == 200
+    time.sleep(4)
+
+    with AioHTTPServer(app, host, port):
+        deadline = time.time() + 20
+        while sum(received) < 3 and time.time() < deadline:
+            time.sleep(0.5)
+
+        assert server.stop(conf_path)
+
+    assert sum(received) >= 3
+
+
+def test_trace_compression(server, log_dir, module_path):
+    """
+    Verify trace payloads are sent gzip compressed with
+    `DatadogTraceCompression`, and counted.
+    """
+    host = "127.0.0.1"
+    port = free_port()
+    encodings = []
+    traces = []
+
+    async def on_traces(request):
+        body = await request.read()
+        encoding = request.headers.get("Content-Encoding", "identity")
+        encodings.append(encoding)
+        if encoding == "gzip":
+            body = gzip.decompress(body)
+        traces.extend(msgpack.unpackb(body))
+        return web.json_response({"rate_by_service": {}})
+
+    app = web.Application()
+    app.add_routes([web.put("/v0.4/traces", on_traces), web.post("/v0.4/traces", on_traces)])
+
+    config = {
+        "path": relpath("conf/trace_compression.conf"),
+        "var": {"agent_url": f"http://{host}:{port}"},
+    }
+
+    conf_path = os.path.join(log_dir, "httpd.conf")
+    save_configuration(make_configuration(config, log_dir, module_path), conf_path)
+
+    with AioHTTPServer(app, host, port):
+        assert server.check_configuration(conf_path)
+        assert server.load_configuration(conf_path)
+
+        for _ in range(3):
+            r = requests.get(server.make_url("/"), timeout=2)
+            assert r.status_code == 200
+
+        deadline = time.time() + 10
+        while len(traces) < 3 and time.time() < deadline:
+            time.sleep(0.5)
+
+        r = requests.get(server.make_url("/server-status?auto"), timeout=2)
+        assert r.status_code == 200
+
+        assert server.stop(conf_path)
+
+    counters = {}
+    for line in r.text.splitlines():
+        key, _, value = line.partition(": ")
+        if key.startswith("Datadog"):
+            counters[key] = int(value)
+
+    assert "gzip" in encodings
+    spans = [span for trace in traces for span in trace]
+    assert any(span["name"] == "httpd.request" for span in spans)
+    assert counters["DatadogCompressedPayloads"] >= 1
+    assert counters["DatadogCompressionSavedBytes"] > 0
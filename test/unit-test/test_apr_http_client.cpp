@@ -0,0 +1,260 @@
+#include <apr_general.h>
+#include <arpa/inet.h>
+#include <catch2/catch.hpp>
+#include <datadog/dict_reader.h>
+#include <datadog/dict_writer.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "tracing/apr_http_client.h"
+#include "tracing/event_loop.h"
+
+using datadog::tracing::AprHTTPClient;
+using datadog::tracing::DictReader;
+using datadog::tracing::DictWriter;
+using datadog::tracing::Error;
+using datadog::tracing::EventLoop;
+using datadog::tracing::HTTPClient;
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr const char* k_ok =
+    "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\n{}";
+
+// Agent on a loopback port, serving one connection at a time, as the client
+// does for a given address.
+class FakeAgent final {
+ public:
+  // Return the response to the `request`th request of the `connection`th
+  // connection, both from 1, or `std::nullopt` to close the connection
+  // without answering.
+  using Respond =
+      std::function<std::optional<std::string>(int connection, int request)>;
+
+  std::atomic<int> connections{0};
+  std::atomic<int> requests{0};
+
+ private:
+  Respond respond_;
+  int listener_ = -1;
+  std::uint16_t port_ = 0;
+  std::thread thread_;
+
+ public:
+  explicit FakeAgent(Respond respond) : respond_(std::move(respond)) {
+    listener_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(listener_ >= 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size = sizeof(address);
+    REQUIRE(::bind(listener_, reinterpret_cast<sockaddr*>(&address), size) ==
+            0);
+    REQUIRE(::listen(listener_, 8) == 0);
+    REQUIRE(::getsockname(listener_, reinterpret_cast<sockaddr*>(&address),
+                          &size) == 0);
+    port_ = ntohs(address.sin_port);
+    thread_ = std::thread([this] { serve(); });
+  }
+
+  ~FakeAgent() {
+    // Wakes up `accept`.
+    ::shutdown(listener_, SHUT_RDWR);
+    ::close(listener_);
+    thread_.join();
+  }
+
+  HTTPClient::URL url() const {
+    return {"http", "127.0.0.1:" + std::to_string(port_), "/v0.4/traces"};
+  }
+
+ private:
+  void serve() {
+    for (;;) {
+      const int fd = ::accept(listener_, nullptr, nullptr);
+      if (fd < 0) return;
+      serve_connection(fd, ++connections);
+      ::close(fd);
+    }
+  }
+
+  void serve_connection(int fd, int connection) {
+    std::string buffer;
+    for (int request = 1; read_request(fd, buffer); ++request) {
+      ++requests;
+      const auto response = respond_(connection, request);
+      if (!response) return;
+      if (::send(fd, response->data(), response->size(), MSG_NOSIGNAL) !=
+          static_cast<ssize_t>(response->size())) {
+        return;
+      }
+    }
+  }
+
+  // Consume a request from `buffer`, reading from `fd` as needed. Return
+  // false once the client closed the connection.
+  static bool read_request(int fd, std::string& buffer) {
+    std::size_t headers_end;
+    while ((headers_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+      if (!receive(fd, buffer)) return false;
+    }
+
+    std::size_t length = 0;
+    const auto field = buffer.find("Content-Length: ");
+    if (field != std::string::npos && field < headers_end) {
+      length = std::strtoul(buffer.c_str() + field + 16, nullptr, 10);
+    }
+
+    const std::size_t request_size = headers_end + 4 + length;
+    while (buffer.size() < request_size) {
+      if (!receive(fd, buffer)) return false;
+    }
+    buffer.erase(0, request_size);
+    return true;
+  }
+
+  static bool receive(int fd, std::string& buffer) {
+    char data[4096];
+    const ssize_t size = ::recv(fd, data, sizeof(data), 0);
+    if (size <= 0) return false;
+    buffer.append(data, static_cast<std::size_t>(size));
+    return true;
+  }
+};
+
+struct Outcome final {
+  int status = 0;
+  std::string body;
+  std::optional<std::string> error;
+};
+
+Outcome post(AprHTTPClient& client, const HTTPClient::URL& url) {
+  auto promise = std::make_shared<std::promise<Outcome>>();
+  auto future = promise->get_future();
+
+  auto result = client.post(
+      url,
+      [](DictWriter& headers) {
+        headers.set("Content-Type", "application/msgpack");
+      },
+      "payload",
+      [promise](int status, const DictReader&, std::string body) {
+        promise->set_value(Outcome{status, std::move(body), std::nullopt});
+      },
+      [promise](Error error) {
+        promise->set_value(Outcome{0, "", std::move(error.message)});
+      },
+      std::chrono::steady_clock::now() + 5s);
+  REQUIRE_FALSE(result.if_error());
+
+  REQUIRE(future.wait_for(10s) == std::future_status::ready);
+  return future.get();
+}
+
+std::shared_ptr<EventLoop> make_loop() {
+  static const bool initialized = apr_initialize() == APR_SUCCESS;
+  REQUIRE(initialized);
+  auto loop = EventLoop::create();
+  REQUIRE(loop != nullptr);
+  return loop;
+}
+
+}  // namespace
+
+TEST_CASE("AprHTTPClient reuses kept-alive connections", "[http]") {
+  FakeAgent agent{[](int, int) { return k_ok; }};
+  auto loop = make_loop();
+  AprHTTPClient client{loop};
+
+  for (int i = 0; i != 3; ++i) {
+    const Outcome outcome = post(client, agent.url());
+    CHECK_FALSE(outcome.error);
+    CHECK(outcome.status == 200);
+    CHECK(outcome.body == "{}");
+  }
+
+  CHECK(agent.connections == 1);
+  CHECK(agent.requests == 3);
+}
+
+TEST_CASE("AprHTTPClient opens a new connection after Connection: close",
+          "[http]") {
+  FakeAgent agent{[](int, int) -> std::optional<std::string> {
+    return "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+  }};
+  auto loop = make_loop();
+  AprHTTPClient client{loop};
+
+  CHECK(post(client, agent.url()).status == 200);
+  CHECK(post(client, agent.url()).status == 200);
+  CHECK(agent.connections == 2);
+}
+
+TEST_CASE("AprHTTPClient retries once when a reused connection is closed",
+          "[http]") {
+  SECTION("the retry succeeds") {
+    // The first connection is closed instead of answering its second request.
+    FakeAgent agent{[](int connection, int request) {
+      return connection == 1 && request == 2 ? std::nullopt
+                                             : std::optional<std::string>(k_ok);
+    }};
+    auto loop = make_loop();
+    AprHTTPClient client{loop};
+
+    CHECK(post(client, agent.url()).status == 200);
+    const Outcome outcome = post(client, agent.url());
+    CHECK_FALSE(outcome.error);
+    CHECK(outcome.status == 200);
+    CHECK(agent.connections == 2);
+    CHECK(agent.requests == 3);
+  }
+
+  SECTION("the retry fails") {
+    // Every request after the first one is left unanswered.
+    FakeAgent agent{[](int connection, int request) {
+      return connection == 1 && request == 1 ? std::optional<std::string>(k_ok)
+                                             : std::nullopt;
+    }};
+    auto loop = make_loop();
+    AprHTTPClient client{loop};
+
+    CHECK(post(client, agent.url()).status == 200);
+    // Not retried again: the second connection was new.
+    const Outcome outcome = post(client, agent.url());
+    CHECK(outcome.error);
+    CHECK(agent.connections == 2);
+    CHECK(agent.requests == 3);
+  }
+}
+
+TEST_CASE("AprHTTPClient does not retry on a new connection", "[http]") {
+  FakeAgent agent{[](int, int) { return std::nullopt; }};
+  auto loop = make_loop();
+  AprHTTPClient client{loop};
+
+  CHECK(post(client, agent.url()).error);
+  CHECK(agent.connections == 1);
+  CHECK(agent.requests == 1);
+}
+
+TEST_CASE("AprHTTPClient rejects responses larger than the limit", "[http]") {
+  FakeAgent agent{[](int, int) -> std::optional<std::string> {
+    return "HTTP/1.1 200 OK\r\nContent-Length: 1073741824\r\n\r\n";
+  }};
+  auto loop = make_loop();
+  AprHTTPClient client{loop};
+
+  CHECK(post(client, agent.url()).error);
+}
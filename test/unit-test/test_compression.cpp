@@ -0,0 +1,87 @@
+#include <zlib.h>
+
+#include <catch2/catch.hpp>
+#include <string>
+
+#include "msgpack.h"
+#include "tracing/compression.h"
+
+using datadog::tracing::Codec;
+namespace msgpack = datadog::common::msgpack;
+
+namespace {
+
+// A trace payload-like document: repeated keys and similar values.
+std::string make_payload(std::size_t span_count) {
+  std::string payload;
+  for (std::size_t i = 0; i < span_count; ++i) {
+    msgpack::pack_string(payload, "name");
+    msgpack::pack_string(payload, "httpd.request");
+    msgpack::pack_string(payload, "resource");
+    msgpack::pack_string(payload, "GET /api/v1/users/" + std::to_string(i));
+    msgpack::pack_string(payload, "span_id");
+    msgpack::pack_uint(payload, 0x9e3779b97f4a7c15ULL * (i + 1));
+  }
+  return payload;
+}
+
+std::string gunzip(const std::string& data) {
+  z_stream stream{};
+  REQUIRE(inflateInit2(&stream, 15 + 16) == Z_OK);
+
+  std::string result;
+  char buffer[4096];
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream.avail_in = static_cast<uInt>(data.size());
+  int status = Z_OK;
+  while (status == Z_OK) {
+    stream.next_out = reinterpret_cast<Bytef*>(buffer);
+    stream.avail_out = sizeof(buffer);
+    status = inflate(&stream, Z_NO_FLUSH);
+    result.append(buffer, sizeof(buffer) - stream.avail_out);
+  }
+  inflateEnd(&stream);
+  REQUIRE(status == Z_STREAM_END);
+  return result;
+}
+
+}  // namespace
+
+TEST_CASE("gzip payloads decompress to the original", "[compression]") {
+  const std::string payload = make_payload(200);
+
+  for (int level = 1; level <= 9; ++level) {
+    const auto compressed =
+        datadog::tracing::compress(Codec::gzip, level, payload);
+    REQUIRE(compressed);
+    CHECK(compressed->substr(0, 2) == "\x1f\x8b");
+    CHECK(compressed->size() < payload.size() / 2);
+    CHECK(gunzip(*compressed) == payload);
+  }
+}
+
+TEST_CASE("gzip compresses empty payloads", "[compression]") {
+  const auto compressed = datadog::tracing::compress(Codec::gzip, 6, "");
+  REQUIRE(compressed);
+  CHECK(gunzip(*compressed).empty());
+}
+
+TEST_CASE("Codecs have a default level within their range", "[compression]") {
+  for (const Codec codec : {Codec::gzip, Codec::zstd}) {
+    const auto [min_level, max_level] = datadog::tracing::level_range(codec);
+    const int level = datadog::tracing::default_level(codec);
+    CHECK(min_level <= level);
+    CHECK(level <= max_level);
+  }
+  CHECK(std::string{datadog::tracing::content_encoding(Codec::gzip)} ==
+        "gzip");
+  CHECK(std::string{datadog::tracing::content_encoding(Codec::zstd)} ==
+        "zstd");
+}
+
+TEST_CASE("Unsupported codecs do not compress", "[compression]") {
+  CHECK_FALSE(datadog::tracing::compress(Codec::none, 0, "payload"));
+  if (!datadog::tracing::is_supported(Codec::zstd)) {
+    CHECK_FALSE(datadog::tracing::compress(Codec::zstd, 3, "payload"));
+  }
+}
@@ -0,0 +1,90 @@
+#include <catch2/catch.hpp>
+#include <chrono>
+
+#include "tracing/governor.h"
+
+using datadog::tracing::Governor;
+using datadog::tracing::ServerLoad;
+using namespace std::chrono_literals;
+
+namespace {
+
+ServerLoad busy(double ratio, double overhead = 0.0) {
+  ServerLoad load;
+  load.busy_ratio = ratio;
+  load.overhead = overhead;
+  return load;
+}
+
+}  // namespace
+
+TEST_CASE("Governor sheds above the high watermark", "[governor]") {
+  Governor governor{};
+  governor.configure({});
+  const auto now = std::chrono::steady_clock::now();
+
+  CHECK_FALSE(governor.update(busy(0.5), now));
+  CHECK_FALSE(governor.shedding());
+
+  const auto transition = governor.update(busy(0.95), now);
+  REQUIRE(transition);
+  CHECK(transition->mode == Governor::Mode::shedding);
+  CHECK(transition->reason == Governor::Reason::busy_workers);
+  CHECK(governor.shedding());
+
+  // Other children seeing the same load do not report it again.
+  CHECK_FALSE(governor.update(busy(0.95), now));
+}
+
+TEST_CASE("Governor sheds when the event MPM stops accepting", "[governor]") {
+  Governor governor{};
+  governor.configure({});
+
+  ServerLoad load = busy(0.2);
+  load.not_accepting = true;
+  const auto transition =
+      governor.update(load, std::chrono::steady_clock::now());
+  REQUIRE(transition);
+  CHECK(transition->reason == Governor::Reason::not_accepting);
+}
+
+TEST_CASE("Governor sheds when the module costs too much under load",
+          "[governor]") {
+  Governor governor{};
+  governor.configure({});
+  const auto now = std::chrono::steady_clock::now();
+
+  CHECK_FALSE(governor.update(busy(0.5, 0.2), now));
+  CHECK_FALSE(governor.update(busy(0.8, 0.01), now));
+
+  const auto transition = governor.update(busy(0.8, 0.06), now);
+  REQUIRE(transition);
+  CHECK(transition->reason == Governor::Reason::overhead);
+}
+
+TEST_CASE("Governor resumes after the recovery delay under the low watermark",
+          "[governor]") {
+  datadog::tracing::conf::Governor conf;
+  conf.recovery_delay = 10s;
+  Governor governor{};
+  governor.configure(conf);
+  const auto start = std::chrono::steady_clock::now();
+
+  REQUIRE(governor.update(busy(0.95), start));
+
+  // Between the watermarks: still shedding.
+  CHECK_FALSE(governor.update(busy(0.8), start + 1s));
+  CHECK_FALSE(governor.update(busy(0.5), start + 2s));
+  CHECK_FALSE(governor.update(busy(0.5), start + 11s));
+  // Back over the low watermark: the delay starts over.
+  CHECK_FALSE(governor.update(busy(0.8), start + 12s));
+  CHECK_FALSE(governor.update(busy(0.5), start + 13s));
+  CHECK_FALSE(governor.update(busy(0.5), start + 22s));
+  CHECK(governor.shedding());
+
+  const auto transition = governor.update(busy(0.5), start + 23s);
+  REQUIRE(transition);
+  CHECK(transition->mode == Governor::Mode::normal);
+  CHECK(transition->reason == Governor::Reason::recovered);
+  CHECK_FALSE(governor.shedding());
+}
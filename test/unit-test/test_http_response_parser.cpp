@@ -0,0 +1,217 @@
+#include <catch2/catch.hpp>
+#include <string>
+#include <string_view>
+
+#include "tracing/http_response_parser.h"
+
+using datadog::tracing::ResponseParser;
+using Result = ResponseParser::Result;
+
+namespace {
+
+// Feed `response` one byte at a time, and return the result of the last
+// byte.
+Result feed_bytewise(ResponseParser& parser, std::string_view response) {
+  Result result = Result::INCOMPLETE;
+  for (const char ch : response) {
+    result = parser.feed({&ch, 1});
+    if (result != Result::INCOMPLETE) break;
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST_CASE("ResponseParser reads a response split anywhere", "[http]") {
+  const std::string response =
+      "HTTP/1.1 200 OK\r\n"
+      "Content-Type: application/json\r\n"
+      "Content-Length: 27\r\n"
+      "\r\n"
+      "{\"rate_by_service\":{\"a\":1}}";
+
+  for (std::size_t split = 0; split <= response.size(); ++split) {
+    ResponseParser parser;
+    const std::string_view head = std::string_view(response).substr(0, split);
+    const Result first = parser.feed(head);
+    if (split < response.size()) {
+      REQUIRE(first == Result::INCOMPLETE);
+      REQUIRE(parser.feed(std::string_view(response).substr(split)) ==
+              Result::COMPLETE);
+    } else {
+      REQUIRE(first == Result::COMPLETE);
+    }
+    CHECK(parser.status == 200);
+    CHECK(parser.body == "{\"rate_by_service\":{\"a\":1}}");
+    REQUIRE(parser.find_header("content-type") != nullptr);
+    CHECK(*parser.find_header("content-type") == "application/json");
+    CHECK(parser.keep_alive);
+  }
+
+  ResponseParser parser;
+  CHECK(feed_bytewise(parser, response) == Result::COMPLETE);
+  CHECK(parser.body.size() == 27);
+}
+
+TEST_CASE("ResponseParser decodes chunked bodies", "[http]") {
+  ResponseParser parser;
+  const std::string response =
+      "HTTP/1.1 200 OK\r\n"
+      "Transfer-Encoding: chunked\r\n"
+      "\r\n"
+      "5;name=value\r\n"
+      "hello\r\n"
+      "7 ; quoted=\"a;b\"\r\n"
+      ", world\r\n"
+      "0\r\n"
+      "X-Trailer: yes\r\n"
+      "\r\n";
+
+  CHECK(feed_bytewise(parser, response) == Result::COMPLETE);
+  CHECK(parser.body == "hello, world");
+  CHECK(parser.keep_alive);
+
+  SECTION("uppercase hexadecimal sizes") {
+    parser.reset();
+    CHECK(parser.feed("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                      "A\r\n0123456789\r\n0\r\n\r\n") == Result::COMPLETE);
+    CHECK(parser.body == "0123456789");
+  }
+
+  SECTION("invalid chunk sizes") {
+    for (const char* size : {"", "-1", "0x5", "z", "fffffffffffffffff"}) {
+      parser.reset();
+      CHECK(parser.feed(std::string("HTTP/1.1 200 OK\r\n"
+                                    "Transfer-Encoding: chunked\r\n\r\n") +
+                        size + "\r\n") == Result::INVALID);
+    }
+  }
+
+  SECTION("missing end of chunk") {
+    parser.reset();
+    CHECK(parser.feed("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                      "2\r\nabc\r\n") == Result::INVALID);
+  }
+}
+
+TEST_CASE("ResponseParser skips interim responses", "[http]") {
+  ResponseParser parser;
+  CHECK(parser.feed("HTTP/1.1 100 Continue\r\n\r\n") == Result::INCOMPLETE);
+  CHECK(parser.feed("HTTP/1.1 100 Continue\r\nX-Interim: 1\r\n\r\n") ==
+        Result::INCOMPLETE);
+  CHECK(parser.feed("HTTP/1.1 202 Accepted\r\nContent-Length: 2\r\n\r\nOK") ==
+        Result::COMPLETE);
+  CHECK(parser.status == 202);
+  CHECK(parser.find_header("x-interim") == nullptr);
+  CHECK(parser.body == "OK");
+}
+
+TEST_CASE("ResponseParser tells whether the connection is kept alive",
+          "[http]") {
+  ResponseParser parser;
+
+  SECTION("HTTP/1.0 closes by default") {
+    CHECK(parser.feed("HTTP/1.0 200 OK\r\nContent-Length: 0\r\n\r\n") ==
+          Result::COMPLETE);
+    CHECK_FALSE(parser.keep_alive);
+  }
+
+  SECTION("HTTP/1.0 with keep-alive") {
+    CHECK(parser.feed("HTTP/1.0 200 OK\r\nConnection: Keep-Alive\r\n"
+                      "Content-Length: 0\r\n\r\n") == Result::COMPLETE);
+    CHECK(parser.keep_alive);
+  }
+
+  SECTION("HTTP/1.1 with Connection: close") {
+    CHECK(parser.feed("HTTP/1.1 200 OK\r\nConnection: close\r\n"
+                      "Content-Length: 0\r\n\r\n") == Result::COMPLETE);
+    CHECK_FALSE(parser.keep_alive);
+  }
+
+  SECTION("no content for 204") {
+    CHECK(parser.feed("HTTP/1.1 204 No Content\r\n\r\n") == Result::COMPLETE);
+    CHECK(parser.keep_alive);
+  }
+}
+
+TEST_CASE("ResponseParser reads bodies until the connection closes",
+          "[http]") {
+  ResponseParser parser;
+  CHECK(parser.feed("HTTP/1.0 200 OK\r\n\r\nhello") == Result::INCOMPLETE);
+  CHECK(parser.feed(", world") == Result::INCOMPLETE);
+  CHECK(parser.finish() == Result::COMPLETE);
+  CHECK(parser.body == "hello, world");
+  CHECK_FALSE(parser.keep_alive);
+
+  SECTION("a close before the end of the body is an error") {
+    parser.reset();
+    CHECK(parser.feed("HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nabc") ==
+          Result::INCOMPLETE);
+    CHECK(parser.received_anything());
+    CHECK(parser.finish() == Result::INVALID);
+  }
+}
+
+TEST_CASE("ResponseParser rejects invalid responses", "[http]") {
+  ResponseParser parser;
+
+  for (const char* length : {"abc", "-1", "+5", "1 2", "", "5, 6",
+                             "99999999999999999999999"}) {
+    parser.reset();
+    CHECK(parser.feed(std::string("HTTP/1.1 200 OK\r\nContent-Length: ") +
+                      length + "\r\n\r\n") == Result::INVALID);
+  }
+
+  parser.reset();
+  CHECK(parser.feed("SMTP ready\r\n") == Result::INVALID);
+  parser.reset();
+  CHECK(parser.feed("HTTP/1.1 2x0 OK\r\n") == Result::INVALID);
+  parser.reset();
+  CHECK(parser.feed("HTTP/1.1 200 OK\r\nno colon\r\n") == Result::INVALID);
+}
+
+TEST_CASE("ResponseParser bounds lines and bodies", "[http]") {
+  SECTION("over-long status line") {
+    ResponseParser parser;
+    const std::string line(ResponseParser::max_line_size + 1, 'a');
+    CHECK(parser.feed(line) == Result::INVALID);
+  }
+
+  SECTION("over-long header") {
+    ResponseParser parser;
+    CHECK(parser.feed("HTTP/1.1 200 OK\r\nX-Long: ") == Result::INCOMPLETE);
+    const std::string value(ResponseParser::max_line_size, 'a');
+    CHECK(parser.feed(value) == Result::INVALID);
+  }
+
+  SECTION("a long line received in pieces is accepted") {
+    ResponseParser parser;
+    CHECK(parser.feed("HTTP/1.1 200 OK\r\nX-Long: ") == Result::INCOMPLETE);
+    const std::string value(1000, 'a');
+    for (int i = 0; i != 10; ++i) {
+      CHECK(parser.feed(value) == Result::INCOMPLETE);
+    }
+    CHECK(parser.feed("\r\nContent-Length: 0\r\n\r\n") == Result::COMPLETE);
+    CHECK(parser.find_header("x-long")->size() == 10000);
+  }
+
+  SECTION("bodies larger than the limit") {
+    ResponseParser parser{10};
+    CHECK(parser.feed("HTTP/1.1 200 OK\r\nContent-Length: 11\r\n\r\n") ==
+          Result::INVALID);
+
+    parser.reset();
+    CHECK(parser.feed("HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\n"
+                      "0123456789") == Result::COMPLETE);
+
+    parser.reset();
+    CHECK(parser.feed("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                      "8\r\n01234567\r\n") == Result::INCOMPLETE);
+    CHECK(parser.feed("3\r\n") == Result::INVALID);
+
+    parser.reset();
+    CHECK(parser.feed("HTTP/1.0 200 OK\r\n\r\n0123456789") ==
+          Result::INCOMPLETE);
+    CHECK(parser.feed("a") == Result::INVALID);
+  }
+}
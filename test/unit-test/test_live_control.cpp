@@ -0,0 +1,86 @@
+#include <catch2/catch.hpp>
+#include <string>
+
+#include "tracing/live_control.h"
+
+using datadog::tracing::LiveControl;
+using datadog::tracing::LiveSettings;
+using datadog::tracing::parse_live_settings;
+
+TEST_CASE("Live control starts with the configured behavior",
+          "[live_control]") {
+  LiveControl control{};
+  const auto state = control.load();
+  CHECK(state.epoch == 0);
+  CHECK_FALSE(state.settings.tracing_disabled);
+  CHECK_FALSE(state.settings.sampling_rate);
+}
+
+TEST_CASE("Live control publishes settings with a new epoch",
+          "[live_control]") {
+  LiveControl control{};
+
+  LiveSettings settings;
+  settings.tracing_disabled = true;
+  settings.sampling_rate = 0.125;
+  CHECK(control.store(settings) == 1);
+
+  auto state = control.load();
+  CHECK(state.epoch == 1);
+  CHECK(state.settings.tracing_disabled);
+  REQUIRE(state.settings.sampling_rate);
+  CHECK(*state.settings.sampling_rate == Approx(0.125));
+
+  CHECK(control.store(LiveSettings{}) == 2);
+  state = control.load();
+  CHECK(state.epoch == 2);
+  CHECK(state.settings == LiveSettings{});
+
+  settings.tracing_disabled = false;
+  settings.sampling_rate = 1.0;
+  control.store(settings);
+  CHECK(*control.load().settings.sampling_rate == 1.0);
+}
+
+TEST_CASE("Live control applies each file version once", "[live_control]") {
+  LiveControl control{};
+  CHECK(control.claim(42));
+  CHECK_FALSE(control.claim(42));
+  CHECK(control.claim(43));
+}
+
+TEST_CASE("Live control file parsing", "[live_control]") {
+  LiveSettings settings;
+  std::string error;
+
+  SECTION("empty file") {
+    CHECK(parse_live_settings("", settings, error));
+    CHECK(settings == LiveSettings{});
+  }
+
+  SECTION("settings, comments and blank lines") {
+    CHECK(parse_live_settings("# incident 1234\n\ntracing off\r\n"
+                              "  sampling_rate   0.05  \n",
+                              settings, error));
+    CHECK(settings.tracing_disabled);
+    REQUIRE(settings.sampling_rate);
+    CHECK(*settings.sampling_rate == Approx(0.05));
+  }
+
+  SECTION("later lines win") {
+    CHECK(parse_live_settings("sampling_rate 0.5\nsampling_rate default\n"
+                              "tracing off\ntracing on",
+                              settings, error));
+    CHECK(settings == LiveSettings{});
+  }
+
+  SECTION("invalid values") {
+    const auto* text = GENERATE("tracing maybe", "sampling_rate 1.5",
+                                "sampling_rate -0.1", "sampling_rate 0.5x",
+                                "sampling_rate nan", "sampling_rate",
+                                "unknown 1");
+    CAPTURE(text);
+    CHECK_FALSE(parse_live_settings(text, settings, error));
+    CHECK(error.rfind("line 1: ", 0) == 0);
+  }
+}
@@ -0,0 +1,352 @@
+#include <ap_mpm.h>
+#include <apr_general.h>
+#include <apr_pools.h>
+#include <apr_strings.h>
+#include <apr_tables.h>
+#include <catch2/catch.hpp>
+#include <datadog/dict_reader.h>
+#include <datadog/event_scheduler.h>
+#include <datadog/http_client.h>
+#include <datadog/span.h>
+#include <datadog/tracer.h>
+#include <datadog/tracer_config.h>
+#include <httpd.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "msgpack.h"
+#include "tracing/request_span.h"
+
+namespace msgpack = datadog::common::msgpack;
+using datadog::tracing::DictReader;
+using datadog::tracing::EventScheduler;
+using datadog::tracing::Expected;
+using datadog::tracing::HTTPClient;
+using datadog::tracing::make_span_config;
+using datadog::tracing::nullopt;
+using datadog::tracing::Span;
+using datadog::tracing::Tracer;
+using datadog::tracing::TracerConfig;
+
+// Defined by the httpd binary, which the tests are not linked with.
+const char* ap_show_mpm(void) { return "event"; }
+
+void ap_get_server_revision(ap_version_t* version) {
+  *version = {2, 4, 62, ""};
+}
+
+namespace {
+
+// Tags identical for every request of the process or of the virtual host,
+// with the values of the functions above.
+const std::vector<std::pair<std::string, std::string>> k_root_tags = {
+    {"component", "httpd"},
+    {"httpd.version", "2.4.62"},
+    {"httpd.mpm", "event"},
+    {"httpd.virtual_host", "false"}};
+
+class EmptyReader final : public DictReader {
+ public:
+  datadog::tracing::Optional<datadog::tracing::StringView> lookup(
+      datadog::tracing::StringView) const override {
+    return nullopt;
+  }
+
+  void visit(const std::function<void(datadog::tracing::StringView,
+                                      datadog::tracing::StringView)>&)
+      const override {}
+};
+
+// Agent client keeping the bodies of the `/v0.4/traces` requests.
+class CapturingClient final : public HTTPClient {
+ public:
+  std::vector<std::string> trace_payloads;
+
+  Expected<void> post(const URL& url, HeadersSetter, std::string body,
+                      ResponseHandler on_response, ErrorHandler,
+                      std::chrono::steady_clock::time_point) override {
+    if (url.path.find("/v0.4/traces") != std::string::npos) {
+      trace_payloads.push_back(std::move(body));
+    }
+    on_response(200, EmptyReader{}, "{}");
+    return nullopt;
+  }
+
+  void drain(std::chrono::steady_clock::time_point) override {}
+
+  std::string config() const override {
+    return R"({"type":"CapturingClient"})";
+  }
+};
+
+// Scheduler running its events when told to: `run` flushes the tracer.
+class ManualScheduler final : public EventScheduler {
+  std::vector<std::function<void()>> callbacks_;
+
+ public:
+  Cancel schedule_recurring_event(std::chrono::steady_clock::duration,
+                                  std::function<void()> callback) override {
+    callbacks_.push_back(std::move(callback));
+    return [] {};
+  }
+
+  void run() {
+    for (const auto& callback : callbacks_) callback();
+  }
+
+  std::string config() const override {
+    return R"({"type":"ManualScheduler"})";
+  }
+};
+
+// Minimal MessagePack reader, for the spans of a v0.4 `/traces` payload.
+class Reader final {
+  std::string_view in_;
+
+  std::uint8_t byte() {
+    if (in_.empty()) throw std::runtime_error("truncated payload");
+    const auto value = static_cast<std::uint8_t>(in_.front());
+    in_.remove_prefix(1);
+    return value;
+  }
+
+  std::uint64_t number(int size) {
+    std::uint64_t value = 0;
+    for (int i = 0; i != size; ++i) value = value << 8 | byte();
+    return value;
+  }
+
+  std::string_view bytes(std::uint64_t size) {
+    if (in_.size() < size) throw std::runtime_error("truncated payload");
+    const auto value = in_.substr(0, size);
+    in_.remove_prefix(size);
+    return value;
+  }
+
+  // Size of an array or a map, whose fixed size variant is `fixed`.
+  std::uint64_t container_size(std::uint8_t fixed) {
+    const auto type = byte();
+    if ((type & 0xF0) == fixed) return type & 0x0F;
+    if (type == (fixed == 0x80 ? 0xDE : 0xDC)) return number(2);
+    if (type == (fixed == 0x80 ? 0xDF : 0xDD)) return number(4);
+    throw std::runtime_error("unexpected MessagePack type");
+  }
+
+ public:
+  explicit Reader(std::string_view in) : in_(in) {}
+
+  std::uint64_t array() { return container_size(0x90); }
+  std::uint64_t map() { return container_size(0x80); }
+
+  std::string string() {
+    const auto type = byte();
+    if ((type & 0xE0) == 0xA0) return std::string(bytes(type & 0x1F));
+    if (type >= 0xD9 && type <= 0xDB) {
+      return std::string(bytes(number(1 << (type - 0xD9))));
+    }
+    throw std::runtime_error("expected a MessagePack string");
+  }
+
+  std::uint64_t unsigned_integer() {
+    const auto type = byte();
+    if (type <= 0x7F) return type;
+    if (type >= 0xCC && type <= 0xCF) return number(1 << (type - 0xCC));
+    if (type >= 0xD0 && type <= 0xD3) return number(1 << (type - 0xD0));
+    throw std::runtime_error("expected a MessagePack integer");
+  }
+
+  void skip() {
+    const auto type = static_cast<std::uint8_t>(in_.at(0));
+    if ((type & 0xF0) == 0x80 || type == 0xDE || type == 0xDF) {
+      for (auto entries = map(); entries != 0; --entries) {
+        skip();
+        skip();
+      }
+    } else if ((type & 0xF0) == 0x90 || type == 0xDC || type == 0xDD) {
+      for (auto elements = array(); elements != 0; --elements) skip();
+    } else if ((type & 0xE0) == 0xA0 || (type >= 0xD9 && type <= 0xDB)) {
+      string();
+    } else if (type <= 0x7F || type >= 0xE0 ||
+               (type >= 0xC0 && type <= 0xC3)) {
+      byte();
+    } else if (type == 0xCA || type == 0xCB) {
+      byte();
+      bytes(type == 0xCA ? 4 : 8);
+    } else {
+      unsigned_integer();
+    }
+  }
+};
+
+struct SpanView final {
+  std::string name;
+  std::uint64_t parent_id = 0;
+  std::unordered_map<std::string, std::string> meta;
+};
+
+std::vector<SpanView> decode_spans(const std::string& payload) {
+  std::vector<SpanView> spans;
+  Reader reader(payload);
+  for (auto traces = reader.array(); traces != 0; --traces) {
+    for (auto count = reader.array(); count != 0; --count) {
+      SpanView& span = spans.emplace_back();
+      for (auto fields = reader.map(); fields != 0; --fields) {
+        const std::string field = reader.string();
+        if (field == "name") {
+          span.name = reader.string();
+        } else if (field == "parent_id") {
+          span.parent_id = reader.unsigned_integer();
+        } else if (field == "meta") {
+          for (auto tags = reader.map(); tags != 0; --tags) {
+            std::string key = reader.string();
+            span.meta.emplace(std::move(key), reader.string());
+          }
+        } else {
+          reader.skip();
+        }
+      }
+    }
+  }
+  return spans;
+}
+
+// Requests as httpd builds them, with the fields the spans are made from.
+class Requests final {
+  apr_pool_t* pool_ = nullptr;
+  server_rec server_{};
+
+ public:
+  Requests() {
+    static const bool initialized = apr_initialize() == APR_SUCCESS;
+    REQUIRE(initialized);
+    REQUIRE(apr_pool_create(&pool_, nullptr) == APR_SUCCESS);
+  }
+
+  ~Requests() { apr_pool_destroy(pool_); }
+
+  request_rec* make(const char* uri) {
+    auto* r =
+        static_cast<request_rec*>(apr_pcalloc(pool_, sizeof(request_rec)));
+    r->pool = pool_;
+    r->server = &server_;
+    r->method = "GET";
+    r->uri = apr_pstrdup(pool_, uri);
+    r->unparsed_uri = apr_pstrcat(pool_, uri, "?page=2", nullptr);
+    r->protocol = apr_pstrdup(pool_, "HTTP/1.1");
+    r->proto_num = 1001;
+    r->hostname = "www.example.com";
+    r->useragent_ip = apr_pstrdup(pool_, "203.0.113.42");
+    r->proxyreq = PROXYREQ_NONE;
+    r->headers_in = apr_table_make(pool_, 4);
+    apr_table_set(r->headers_in, "User-Agent",
+                  "Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 "
+                  "Firefox/128.0");
+    return r;
+  }
+};
+
+// Send a trace made of a request span and `subrequests` subrequest spans, as
+// the module builds them, and return the `/v0.4/traces` payload the tracer
+// sent. With `root_tags_everywhere`, subrequest spans get the tags of the
+// local root span too, as they used to.
+std::string send_trace(std::uint64_t subrequests, bool root_tags_everywhere) {
+  auto client = std::make_shared<CapturingClient>();
+  auto scheduler = std::make_shared<ManualScheduler>();
+
+  TracerConfig config;
+  config.service = "front";
+  config.agent.http_client = client;
+  config.agent.event_scheduler = scheduler;
+  config.agent.remote_configuration_enabled = false;
+  config.telemetry.enabled = false;
+  auto finalized = datadog::tracing::finalize_config(config);
+  REQUIRE(finalized.if_error() == nullptr);
+
+  Requests requests;
+  {
+    Tracer tracer(*finalized);
+    {
+      Span root = tracer.create_span(make_span_config(
+          requests.make("/catalog/index.shtml"), {}, nullptr, true, false));
+      for (std::uint64_t i = 0; i != subrequests; ++i) {
+        auto options =
+            make_span_config(requests.make("/catalog/header.html"), {},
+                             nullptr, root_tags_everywhere, false);
+        options.name = "httpd.subrequests";
+        // Finished as it goes out of scope.
+        Span span = root.create_child(options);
+      }
+    }
+    scheduler->run();
+  }
+
+  REQUIRE(client->trace_payloads.size() == 1);
+  return client->trace_payloads.front();
+}
+
+std::size_t root_tags_size() {
+  std::string out;
+  for (const auto& [key, value] : k_root_tags) {
+    msgpack::pack_string(out, key);
+    msgpack::pack_string(out, value);
+  }
+  return out.size();
+}
+
+}  // namespace
+
+TEST_CASE("Process-constant tags are only set on the local root span",
+          "[payload_size]") {
+  const std::uint64_t subrequests = GENERATE(0, 1, 4, 16);
+  const auto spans = decode_spans(send_trace(subrequests, false));
+  REQUIRE(spans.size() == subrequests + 1);
+
+  for (const auto& span : spans) {
+    CHECK(span.meta.at("http.method") == "GET");
+    CHECK(span.meta.count("http.useragent") == 1);
+    if (span.parent_id == 0) {
+      CHECK(span.name == "httpd.request");
+      for (const auto& [key, value] : k_root_tags) {
+        CHECK(span.meta.at(key) == value);
+      }
+    } else {
+      CHECK(span.name == "httpd.subrequests");
+      for (const auto& [key, value] : k_root_tags) {
+        CHECK(span.meta.count(key) == 0);
+      }
+    }
+  }
+}
+
+TEST_CASE("Process-constant tags are encoded once per trace",
+          "[payload_size]") {
+  const std::uint64_t subrequests = GENERATE(1, 4, 16);
+  const auto before = send_trace(subrequests, true).size();
+  const auto after = send_trace(subrequests, false).size();
+
+  // The tags of each subrequest span, and possibly the size of its `meta`
+  // map header: 1 byte under 16 tags, 3 bytes from 16.
+  CHECK(before - after >= subrequests * root_tags_size());
+  CHECK(before - after <= subrequests * (root_tags_size() + 2));
+}
+
+// Run with `request_span_tests "[benchmark]"`.
+TEST_CASE("Payload size of process-constant tags", "[.][benchmark]") {
+  for (const std::uint64_t subrequests : {0, 1, 4, 16, 64}) {
+    const auto before = send_trace(subrequests, true).size();
+    const auto after = send_trace(subrequests, false).size();
+    WARN(subrequests << " subrequests: " << before << " -> " << after
+                     << " bytes ("
+                     << 100.0 * static_cast<double>(before - after) /
+                            static_cast<double>(before)
+                     << "% saved)");
+  }
+}
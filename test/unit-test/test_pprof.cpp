@@ -0,0 +1,147 @@
+#include <catch2/catch.hpp>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "profiling/pprof.h"
+
+using datadog::profiling::PprofBuilder;
+
+namespace {
+
+// Field of a decoded protocol buffers message: a varint or bytes.
+struct Field final {
+  std::uint32_t number;
+  std::uint64_t value;
+  std::string bytes;
+};
+
+std::uint64_t read_varint(std::string_view& in) {
+  std::uint64_t value = 0;
+  for (int shift = 0; !in.empty(); shift += 7) {
+    const auto byte = static_cast<std::uint8_t>(in.front());
+    in.remove_prefix(1);
+    value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+    if (byte < 0x80) break;
+  }
+  return value;
+}
+
+std::vector<Field> decode(std::string_view in) {
+  std::vector<Field> fields;
+  while (!in.empty()) {
+    const auto key = read_varint(in);
+    Field field{static_cast<std::uint32_t>(key >> 3), 0, {}};
+    if ((key & 7) == 2) {
+      const auto size = read_varint(in);
+      field.bytes = std::string(in.substr(0, size));
+      in.remove_prefix(size);
+    } else {
+      field.value = read_varint(in);
+    }
+    fields.push_back(std::move(field));
+  }
+  return fields;
+}
+
+std::vector<Field> find_all(const std::vector<Field>& fields,
+                            std::uint32_t number) {
+  std::vector<Field> found;
+  for (const auto& field : fields) {
+    if (field.number == number) found.push_back(field);
+  }
+  return found;
+}
+
+std::uint64_t find_value(const std::vector<Field>& fields,
+                         std::uint32_t number) {
+  for (const auto& field : fields) {
+    if (field.number == number) return field.value;
+  }
+  return 0;
+}
+
+std::vector<std::uint64_t> unpack(std::string_view in) {
+  std::vector<std::uint64_t> values;
+  while (!in.empty()) values.push_back(read_varint(in));
+  return values;
+}
+
+}  // namespace
+
+TEST_CASE("Varints are encoded in base 128", "[pprof]") {
+  std::string out;
+  datadog::profiling::protobuf::write_varint(out, 300);
+  CHECK(out == std::string("\xAC\x02"));
+
+  std::string_view in = out;
+  CHECK(read_varint(in) == 300);
+}
+
+TEST_CASE("Profiles hold samples, locations and labels", "[pprof]") {
+  PprofBuilder builder{10'000'000};
+  builder.add_mapping(0x1000, 0x2000, 0x400, "/usr/lib/mod_datadog.so");
+  const auto inner = builder.add_location(0x1010, "datadog::inner()");
+  const auto outer = builder.add_location(0x1020, "");
+  CHECK(builder.add_location(0x1010, "datadog::inner()") == inner);
+  const auto unmapped = builder.add_location(0x9000, "");
+
+  builder.add_sample({inner, outer}, 3,
+                     {{"span id", {}, 42}, {"trace endpoint", "GET /", 0}});
+  builder.add_sample({unmapped}, 1, {});
+
+  const auto profile = decode(builder.serialize(1'700'000'000'000'000'000,
+                                                60'000'000'000));
+
+  std::vector<std::string> strings;
+  for (const auto& field : find_all(profile, 6)) strings.push_back(field.bytes);
+  REQUIRE(!strings.empty());
+  CHECK(strings[0].empty());
+
+  const auto sample_types = find_all(profile, 1);
+  REQUIRE(sample_types.size() == 2);
+  const auto cpu = decode(sample_types[1].bytes);
+  CHECK(strings.at(find_value(cpu, 1)) == "cpu");
+  CHECK(strings.at(find_value(cpu, 2)) == "nanoseconds");
+
+  const auto samples = find_all(profile, 2);
+  REQUIRE(samples.size() == 2);
+  const auto sample = decode(samples[0].bytes);
+  CHECK(unpack(find_all(sample, 1).at(0).bytes) ==
+        std::vector<std::uint64_t>{inner, outer});
+  CHECK(unpack(find_all(sample, 2).at(0).bytes) ==
+        std::vector<std::uint64_t>{3, 30'000'000});
+
+  const auto labels = find_all(sample, 3);
+  REQUIRE(labels.size() == 2);
+  const auto span_id = decode(labels[0].bytes);
+  CHECK(strings.at(find_value(span_id, 1)) == "span id");
+  CHECK(find_value(span_id, 3) == 42);
+  const auto endpoint = decode(labels[1].bytes);
+  CHECK(strings.at(find_value(endpoint, 1)) == "trace endpoint");
+  CHECK(strings.at(find_value(endpoint, 2)) == "GET /");
+
+  const auto mappings = find_all(profile, 3);
+  REQUIRE(mappings.size() == 1);
+  const auto mapping = decode(mappings[0].bytes);
+  CHECK(find_value(mapping, 2) == 0x1000);
+  CHECK(find_value(mapping, 4) == 0x400);
+  CHECK(strings.at(find_value(mapping, 5)) == "/usr/lib/mod_datadog.so");
+
+  const auto locations = find_all(profile, 4);
+  REQUIRE(locations.size() == 3);
+  CHECK(find_value(decode(locations[0].bytes), 2) == 1);
+  CHECK(find_value(decode(locations[2].bytes), 2) == 0);  // Unmapped
+
+  const auto functions = find_all(profile, 5);
+  REQUIRE(functions.size() == 1);
+  CHECK(strings.at(find_value(decode(functions[0].bytes), 2)) ==
+        "datadog::inner()");
+
+  CHECK(find_value(profile, 10) == 60'000'000'000);
+  CHECK(find_value(profile, 12) == 10'000'000);
+  const auto period_type = decode(find_all(profile, 11).at(0).bytes);
+  CHECK(strings.at(find_value(period_type, 1)) == "cpu");
+}
@@ -0,0 +1,44 @@
+#include <catch2/catch.hpp>
+
+#include "tracing/rate_limiter.h"
+
+using datadog::tracing::SharedRateLimiter;
+using namespace std::chrono_literals;
+
+namespace {
+
+int take_all(SharedRateLimiter& limiter,
+             std::chrono::steady_clock::time_point now) {
+  int allowed = 0;
+  while (limiter.allow(now)) ++allowed;
+  return allowed;
+}
+
+}  // namespace
+
+TEST_CASE("Rate limiter allows a burst of one second", "[rate_limiter]") {
+  SharedRateLimiter limiter;
+  limiter.configure(100);
+
+  const auto start = std::chrono::steady_clock::now();
+  CHECK(take_all(limiter, start) == 100);
+  CHECK(take_all(limiter, start + 500ms) == 50);
+  CHECK(take_all(limiter, start + 10s) == 100);
+}
+
+TEST_CASE("Rate limiter handles rates below one per second",
+          "[rate_limiter]") {
+  SharedRateLimiter limiter;
+  limiter.configure(0.5);
+
+  const auto start = std::chrono::steady_clock::now();
+  CHECK(take_all(limiter, start) == 1);
+  CHECK(take_all(limiter, start + 1s) == 0);
+  CHECK(take_all(limiter, start + 2s) == 1);
+}
+
+TEST_CASE("Rate limiter set to zero drops everything", "[rate_limiter]") {
+  SharedRateLimiter limiter;
+  limiter.configure(0);
+  CHECK_FALSE(limiter.allow(std::chrono::steady_clock::now()));
+}
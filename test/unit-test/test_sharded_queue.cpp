@@ -0,0 +1,164 @@
+#include <atomic>
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "tracing/sharded_queue.h"
+
+using datadog::tracing::ShardedQueue;
+
+namespace {
+
+// Stand-in for the tracer collector: a vector behind a mutex, which every
+// finished trace goes through.
+struct Collector final {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<int>> chunks;
+
+  void send(std::unique_ptr<int> chunk) {
+    std::lock_guard<std::mutex> lock(mutex);
+    chunks.emplace_back(std::move(chunk));
+    if (chunks.size() >= 1024) chunks.clear();
+  }
+};
+
+// Finish `per_thread` traces from each of `threads` threads, handing them to
+// the collector directly or through a `ShardedQueue` drained by another
+// thread. Return the number of traces finished per second.
+double finish_traces(int threads, int per_thread, bool sharded) {
+  Collector collector;
+  ShardedQueue<std::unique_ptr<int>> queue{1024};
+  std::atomic<bool> done{false};
+
+  std::thread flusher;
+  if (sharded) {
+    flusher = std::thread([&] {
+      auto consume = [&](std::unique_ptr<int> chunk) {
+        collector.send(std::move(chunk));
+      };
+      while (!done.load()) {
+        queue.drain(consume);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      queue.drain(consume);
+    });
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&] {
+      for (int i = 0; i < per_thread; ++i) {
+        auto chunk = std::make_unique<int>(i);
+        if (!sharded || !queue.push(std::move(chunk))) {
+          collector.send(std::move(chunk));
+        }
+      }
+    });
+  }
+  for (auto& worker : workers) worker.join();
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+
+  done = true;
+  if (flusher.joinable()) flusher.join();
+
+  return threads * per_thread /
+         std::chrono::duration<double>(elapsed).count();
+}
+
+}  // namespace
+
+TEST_CASE("Sharded queue drains items in the order of each thread",
+          "[sharded_queue]") {
+  ShardedQueue<int> queue{16};
+  for (int i = 0; i < 3; ++i) REQUIRE(queue.push(int{i}));
+
+  bool pushed = false;
+  std::thread other([&] { pushed = queue.push(10); });
+  other.join();
+  REQUIRE(pushed);
+
+  std::vector<int> items;
+  CHECK(queue.drain([&](int item) { items.push_back(item); }) == 4);
+  REQUIRE(items.size() == 4);
+  CHECK(items[0] == 0);
+  CHECK(items[1] == 1);
+  CHECK(items[2] == 2);
+  CHECK(items[3] == 10);
+
+  CHECK(queue.drain([](int) { FAIL("queue should be empty"); }) == 0);
+}
+
+TEST_CASE("Sharded queue rejects items once a shard is full",
+          "[sharded_queue]") {
+  ShardedQueue<std::unique_ptr<int>> queue{2};
+  CHECK(queue.push(std::make_unique<int>(1)));
+  CHECK(queue.push(std::make_unique<int>(2)));
+
+  auto rejected = std::make_unique<int>(3);
+  CHECK_FALSE(queue.push(std::move(rejected)));
+  REQUIRE(rejected != nullptr);  // Left to the caller
+  CHECK(*rejected == 3);
+
+  // Other threads have shards of their own.
+  bool pushed = false;
+  std::thread other([&] { pushed = queue.push(std::make_unique<int>(4)); });
+  other.join();
+  CHECK(pushed);
+
+  CHECK(queue.drain([](std::unique_ptr<int>) {}) == 3);
+  CHECK(queue.push(std::move(rejected)));
+}
+
+TEST_CASE("Sharded queue loses no item while drained concurrently",
+          "[sharded_queue]") {
+  constexpr int threads = 8;
+  constexpr int per_thread = 20000;
+
+  ShardedQueue<int> queue{per_thread};
+  std::atomic<bool> done{false};
+  std::atomic<long long> rejected{0};
+  std::atomic<long long> drained{0};
+  std::atomic<long long> sum{0};
+
+  auto consume = [&](int item) {
+    drained.fetch_add(1);
+    sum.fetch_add(item);
+  };
+  std::thread consumer([&] {
+    while (!done.load()) queue.drain(consume);
+    queue.drain(consume);
+  });
+
+  std::vector<std::thread> producers;
+  for (int t = 0; t < threads; ++t) {
+    producers.emplace_back([&] {
+      for (int i = 0; i < per_thread; ++i) {
+        if (!queue.push(int{i})) rejected.fetch_add(1);
+      }
+    });
+  }
+  for (auto& producer : producers) producer.join();
+  done = true;
+  consumer.join();
+
+  CHECK(rejected.load() == 0);
+  CHECK(drained.load() == threads * per_thread);
+  CHECK(sum.load() ==
+        threads * (static_cast<long long>(per_thread) * (per_thread - 1) / 2));
+}
+
+// Run with `tests "[benchmark]"`.
+TEST_CASE("Span collection scaling with ThreadsPerChild", "[.][benchmark]") {
+  constexpr int traces = 1 << 20;
+  for (int threads = 1; threads <= 256; threads *= 2) {
+    const double direct = finish_traces(threads, traces / threads, false);
+    const double sharded = finish_traces(threads, traces / threads, true);
+    WARN(threads << " threads: direct " << direct / 1e6
+                 << " M traces/s, per thread " << sharded / 1e6
+                 << " M traces/s");
+  }
+}
@@ -0,0 +1,72 @@
+#include <catch2/catch.hpp>
+
+#include "metrics/sketch.h"
+
+using datadog::metrics::LatencySketch;
+
+TEST_CASE("Latency sketch quantiles are within relative accuracy",
+          "[sketch]") {
+  LatencySketch sketch;
+  for (int value = 1; value <= 10000; ++value) {
+    sketch.add(value);
+  }
+
+  CHECK(sketch.count() == 10000);
+  CHECK(sketch.min() == 1);
+  CHECK(sketch.max() == 10000);
+
+  for (double q : {0.5, 0.9, 0.95, 0.99}) {
+    const double expected = 1 + q * 9999;
+    CHECK(sketch.quantile(q) ==
+          Approx(expected).epsilon(LatencySketch::relative_accuracy));
+  }
+}
+
+TEST_CASE("Merged latency sketches match a single sketch", "[sketch]") {
+  LatencySketch whole;
+  LatencySketch low;
+  LatencySketch high;
+  for (int value = 1; value <= 1000; ++value) {
+    whole.add(value);
+    (value <= 500 ? low : high).add(value);
+  }
+
+  low.merge(high);
+
+  CHECK(low.count() == whole.count());
+  CHECK(low.sum() == whole.sum());
+  CHECK(low.quantile(0.5) == whole.quantile(0.5));
+  CHECK(low.quantile(0.99) == whole.quantile(0.99));
+}
+
+TEST_CASE("Empty latency sketch", "[sketch]") {
+  LatencySketch sketch;
+  CHECK(sketch.count() == 0);
+  CHECK(sketch.quantile(0.5) == 0);
+  CHECK(sketch.max() == 0);
+}
+
+TEST_CASE("Latency sketch bins cover every value", "[sketch]") {
+  LatencySketch sketch;
+  sketch.add(0);
+  for (int value = 1; value <= 1000; ++value) {
+    sketch.add(value);
+  }
+
+  std::uint64_t count = 0;
+  double previous = -1;
+  sketch.visit([&](double value, std::uint64_t weight) {
+    CHECK(value > previous);
+    previous = value;
+    count += weight;
+  });
+  CHECK(count == sketch.count());
+
+  // Each bin value is within the relative accuracy of the values it holds.
+  LatencySketch single;
+  single.add(123.0, 7);
+  single.visit([](double value, std::uint64_t weight) {
+    CHECK(value == Approx(123.0).epsilon(LatencySketch::relative_accuracy));
+    CHECK(weight == 7);
+  });
+}
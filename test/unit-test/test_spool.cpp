@@ -0,0 +1,330 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "tracing/spool.h"
+
+using datadog::tracing::Spool;
+using Opened = Spool::Opened;
+using namespace std::chrono_literals;
+
+namespace {
+
+// Spool file in a directory of its own, removed with it.
+class SpoolPath final {
+  std::string directory_;
+  std::string path_;
+
+ public:
+  SpoolPath() {
+    char pattern[] = "/tmp/spool-test-XXXXXX";
+    REQUIRE(::mkdtemp(pattern) != nullptr);
+    directory_ = pattern;
+    path_ = directory_ + "/spool";
+  }
+
+  ~SpoolPath() {
+    ::unlink(path_.c_str());
+    ::rmdir(directory_.c_str());
+  }
+
+  const char* c_str() const { return path_.c_str(); }
+};
+
+// Records of less than 10 traces take 96 bytes in the ring, plus their body
+// size rounded up to 8.
+Spool::Record make_record(std::uint64_t trace_count, std::size_t body_size) {
+  Spool::Record record;
+  record.url = {"http", "localhost:8126", "/v0.4/traces"};
+  record.headers = {{"X-Datadog-Trace-Count", std::to_string(trace_count)}};
+  record.body = std::string(body_size, static_cast<char>('a' + trace_count));
+  record.trace_count = trace_count;
+  return record;
+}
+
+std::unique_ptr<Spool> open_spool(const SpoolPath& path, std::size_t size,
+                                  Opened expected) {
+  Opened opened;
+  std::string error;
+  auto spool = Spool::open(path.c_str(), size, opened, error);
+  REQUIRE(spool != nullptr);
+  CHECK(error.empty());
+  CHECK(opened == expected);
+  return spool;
+}
+
+// Replays are rate limited: each one happens a second after the previous
+// one. Popped records are committed right away.
+class Replayer final {
+  std::chrono::steady_clock::time_point now_ =
+      std::chrono::steady_clock::time_point{} + 1h;
+
+ public:
+  std::optional<Spool::Lease> peek(Spool& spool) {
+    now_ += 1s;
+    return spool.peek(now_);
+  }
+
+  std::optional<Spool::Record> pop(Spool& spool) {
+    auto lease = peek(spool);
+    if (!lease) return std::nullopt;
+    spool.commit(lease->offset);
+    return std::move(lease->record);
+  }
+};
+
+void check_record(const std::optional<Spool::Record>& record,
+                  std::uint64_t trace_count, std::size_t body_size) {
+  REQUIRE(record);
+  const auto expected = make_record(trace_count, body_size);
+  CHECK(record->url.scheme == expected.url.scheme);
+  CHECK(record->url.authority == expected.url.authority);
+  CHECK(record->url.path == expected.url.path);
+  CHECK(record->headers == expected.headers);
+  CHECK(record->body == expected.body);
+  CHECK(record->trace_count == trace_count);
+}
+
+}  // namespace
+
+TEST_CASE("Spool replays records in the order they were pushed",
+          "[spool]") {
+  SpoolPath path;
+  auto spool = open_spool(path, 4096, Opened::CREATED);
+  Replayer replayer;
+
+  CHECK_FALSE(replayer.pop(*spool));
+  REQUIRE(spool->push(make_record(1, 10)));
+  REQUIRE(spool->push(make_record(2, 20)));
+  CHECK(spool->pending_bytes() != 0);
+
+  check_record(replayer.pop(*spool), 1, 10);
+  check_record(replayer.pop(*spool), 2, 20);
+  CHECK_FALSE(replayer.pop(*spool));
+  CHECK(spool->pending_bytes() == 0);
+
+  SECTION("at the replay rate") {
+    REQUIRE(spool->push(make_record(3, 10)));
+    REQUIRE(spool->push(make_record(4, 10)));
+    const auto now = std::chrono::steady_clock::time_point{} + 2h;
+    auto lease = spool->peek(now);
+    REQUIRE(lease);
+    check_record(lease->record, 3, 10);
+    spool->commit(lease->offset);
+    CHECK_FALSE(spool->peek(now + 10ms));
+    lease = spool->peek(now + 1s);
+    REQUIRE(lease);
+    check_record(lease->record, 4, 10);
+  }
+
+  SECTION("records larger than the ring are rejected") {
+    CHECK_FALSE(spool->push(make_record(5, 4096)));
+    CHECK(spool->pending_bytes() == 0);
+  }
+}
+
+TEST_CASE("Spool leases its oldest record until it is acknowledged",
+          "[spool]") {
+  SpoolPath path;
+  auto spool = open_spool(path, 4096, Opened::CREATED);
+  Replayer replayer;
+
+  REQUIRE(spool->push(make_record(1, 10)));
+  REQUIRE(spool->push(make_record(2, 10)));
+  auto lease = replayer.peek(*spool);
+  REQUIRE(lease);
+  check_record(lease->record, 1, 10);
+
+  SECTION("no other record is replayed while it is leased") {
+    CHECK_FALSE(replayer.peek(*spool));
+    CHECK_FALSE(replayer.peek(*spool));
+
+    spool->commit(lease->offset);
+    check_record(replayer.pop(*spool), 2, 10);
+    CHECK_FALSE(replayer.pop(*spool));
+  }
+
+  SECTION("a released record is replayed again, before the next ones") {
+    CHECK(spool->release(lease->offset));
+    check_record(replayer.pop(*spool), 1, 10);
+    check_record(replayer.pop(*spool), 2, 10);
+  }
+
+  SECTION("a record is dropped after 5 failed attempts") {
+    for (int attempt = 1; attempt != 5; ++attempt) {
+      CHECK(spool->release(lease->offset));
+      lease = replayer.peek(*spool);
+      REQUIRE(lease);
+      check_record(lease->record, 1, 10);
+    }
+    CHECK_FALSE(spool->release(lease->offset));
+    check_record(replayer.pop(*spool), 2, 10);
+    CHECK_FALSE(replayer.pop(*spool));
+  }
+
+  SECTION("the next record gets attempts of its own") {
+    CHECK(spool->release(lease->offset));
+    check_record(replayer.pop(*spool), 1, 10);
+    for (int attempt = 1; attempt != 5; ++attempt) {
+      lease = replayer.peek(*spool);
+      REQUIRE(lease);
+      check_record(lease->record, 2, 10);
+      CHECK(spool->release(lease->offset));
+    }
+    check_record(replayer.pop(*spool), 2, 10);
+  }
+
+  SECTION("the lease of a replayer that died expires") {
+    auto later = replayer.peek(*spool);
+    for (int i = 0; i != 10 && !later; ++i) later = replayer.peek(*spool);
+    REQUIRE(later);
+    check_record(later->record, 1, 10);
+
+    // Ending the first lease afterwards leaves the next record alone.
+    spool->commit(later->offset);
+    CHECK(spool->release(lease->offset));
+    check_record(replayer.pop(*spool), 2, 10);
+  }
+
+  SECTION("acknowledging a record dropped to make room does nothing") {
+    // Each record takes 112 bytes: pushing 36 of them overwrites both.
+    for (std::uint64_t i = 3; i != 39; ++i) {
+      REQUIRE(spool->push(make_record(i, 10)));
+    }
+    spool->commit(lease->offset);
+    CHECK(spool->release(lease->offset));
+    const auto record = replayer.pop(*spool);
+    REQUIRE(record);
+    CHECK(record->trace_count > 2);
+    check_record(record, record->trace_count, 10);
+  }
+}
+
+TEST_CASE("Spool wraps around its ring", "[spool]") {
+  SpoolPath path;
+  auto spool = open_spool(path, 256, Opened::CREATED);
+  Replayer replayer;
+
+  SECTION("the oldest records make room for new ones") {
+    // 112 bytes each: the third one goes at the start of the ring, after
+    // padding, and the first one is dropped.
+    REQUIRE(spool->push(make_record(1, 16)));
+    REQUIRE(spool->push(make_record(2, 16)));
+    REQUIRE(spool->push(make_record(3, 16)));
+    CHECK(spool->pending_bytes() <= 256);
+
+    check_record(replayer.pop(*spool), 2, 16);
+    check_record(replayer.pop(*spool), 3, 16);
+    CHECK_FALSE(replayer.pop(*spool));
+  }
+
+  SECTION("over many rounds") {
+    // Records come out in order, some of them dropped to make room.
+    std::uint64_t last = 0;
+    for (std::uint64_t i = 1; i != 50; ++i) {
+      REQUIRE(spool->push(make_record(i, 8 * (i % 10))));
+      CHECK(spool->pending_bytes() <= 256);
+      if (i % 3 != 0) continue;
+
+      const auto record = replayer.pop(*spool);
+      REQUIRE(record);
+      CHECK(record->trace_count > last);
+      last = record->trace_count;
+      check_record(record, last, 8 * (last % 10));
+    }
+  }
+
+  SECTION("a record longer than the ring left after its tail") {
+    // 96 bytes, then 216 bytes: with the 160 bytes of padding the second
+    // record needs, both exceed the ring, which restarts empty.
+    REQUIRE(spool->push(make_record(1, 0)));
+    REQUIRE(spool->push(make_record(2, 120)));
+    CHECK(spool->pending_bytes() <= 256);
+
+    // Still valid once reopened.
+    spool.reset();
+    spool = open_spool(path, 256, Opened::KEPT);
+    check_record(replayer.pop(*spool), 2, 120);
+    CHECK_FALSE(replayer.pop(*spool));
+
+    REQUIRE(spool->push(make_record(3, 40)));
+    REQUIRE(spool->push(make_record(4, 0)));
+    check_record(replayer.pop(*spool), 3, 40);
+    check_record(replayer.pop(*spool), 4, 0);
+  }
+}
+
+TEST_CASE("Spool drops damaged records and the ones after them", "[spool]") {
+  SpoolPath path;
+  auto spool = open_spool(path, 4096, Opened::CREATED);
+  Replayer replayer;
+
+  REQUIRE(spool->push(make_record(1, 10)));
+  REQUIRE(spool->push(make_record(2, 10)));
+
+  // A byte in the content of the first record, after the 4KB file header
+  // and the 8 bytes record header.
+  const int fd = ::open(path.c_str(), O_RDWR);
+  REQUIRE(fd >= 0);
+  const char byte = 0x7F;
+  CHECK(::pwrite(fd, &byte, 1, 4096 + 8 + 20) == 1);
+  ::close(fd);
+
+  CHECK_FALSE(replayer.pop(*spool));
+  CHECK(spool->pending_bytes() == 0);
+  CHECK_FALSE(replayer.pop(*spool));
+
+  // The spool keeps working.
+  REQUIRE(spool->push(make_record(3, 10)));
+  check_record(replayer.pop(*spool), 3, 10);
+}
+
+TEST_CASE("Spool keeps records across reopenings of the same size",
+          "[spool]") {
+  SpoolPath path;
+  Replayer replayer;
+  {
+    auto spool = open_spool(path, 4096, Opened::CREATED);
+    REQUIRE(spool->push(make_record(1, 10)));
+  }
+
+  SECTION("same size") {
+    auto spool = open_spool(path, 4096, Opened::KEPT);
+    check_record(replayer.pop(*spool), 1, 10);
+  }
+
+  SECTION("another size") {
+    auto spool = open_spool(path, 8192, Opened::CREATED);
+    CHECK(spool->pending_bytes() == 0);
+    CHECK_FALSE(replayer.pop(*spool));
+
+    REQUIRE(spool->push(make_record(2, 10)));
+    spool.reset();
+    spool = open_spool(path, 8192, Opened::KEPT);
+    check_record(replayer.pop(*spool), 2, 10);
+  }
+
+  SECTION("invalid file") {
+    const int fd = ::open(path.c_str(), O_RDWR);
+    REQUIRE(fd >= 0);
+    CHECK(::pwrite(fd, "garbage", 7, 0) == 7);
+    ::close(fd);
+
+    auto spool = open_spool(path, 4096, Opened::RESET);
+    CHECK(spool->pending_bytes() == 0);
+    CHECK_FALSE(replayer.pop(*spool));
+  }
+}
+
+TEST_CASE("Spool reports files it cannot open", "[spool]") {
+  Opened opened;
+  std::string error;
+  CHECK(Spool::open("/nonexistent/spool", 4096, opened, error) == nullptr);
+  CHECK(error.find("/nonexistent/spool") != std::string::npos);
+}
@@ -1,37 +1,37 @@
-// #include "utils.h"
 #include <catch2/catch.hpp>
 
-std::unordered_map<std::string, std::string>
-parse_http_header_tags(std::string_view in) {
-  std::unordered_map<std::string, std::string> res;
+#include "tracing/header_tags.h"
 
-  const std::size_t end = in.size();
-
-  for (std::size_t beg = 0; beg < end;) {
-    beg = in.find_first_not_of(' ', beg);
-    std::size_t comma_idx = in.find(',', beg);
-    if (comma_idx == std::string_view::npos) {
-      comma_idx = end;
-    }
-
-    auto kv = in.substr(beg, comma_idx - beg);
-    beg = comma_idx + 1;
-
-    std::size_t colon_idx = kv.find(':');
-    if (colon_idx == std::string_view::npos) {
-      continue;
-    }
-
-    auto http_header = kv.substr(0, colon_idx);
-    auto tag = kv.substr(colon_idx + 1);
-
-    res[std::string(http_header)] = tag;
-  }
-
-  return res;
-}
+using datadog::tracing::HeaderTags;
+using datadog::tracing::parse_http_header_tags;
 
 TEST_CASE("Parse HTTP Header Tags", "[http_header_tags]") {
   CHECK(parse_http_header_tags(" user-agent ") ==
         std::unordered_map<std::string, std::string>{{"user-agent", ""}});
+
+  CHECK(parse_http_header_tags("X-Tenant-ID:tenant, x-canary , ,:nope") ==
+        std::unordered_map<std::string, std::string>{
+            {"X-Tenant-ID", "tenant"}, {"x-canary", ""}});
+}
+
+TEST_CASE("HTTP Header Tags match headers whatever their case",
+          "[http_header_tags]") {
+  const HeaderTags header_tags(
+      parse_http_header_tags("X-Tenant-ID:tenant,x-canary,Content-Type"));
+
+  const auto* tenant = header_tags.find("x-tenant-id");
+  REQUIRE(tenant != nullptr);
+  CHECK(tenant->request_tag == "tenant");
+  CHECK(tenant->response_tag == "tenant");
+
+  const auto* canary = header_tags.find("X-CANARY");
+  REQUIRE(canary != nullptr);
+  CHECK(canary->request_tag == "http.request.headers.x-canary");
+  CHECK(canary->response_tag == "http.response.headers.x-canary");
+
+  CHECK(header_tags.find("content-type") != nullptr);
+  CHECK(header_tags.find("X-Canar") == nullptr);
+  CHECK(header_tags.find("X-Tenant-IE") == nullptr);
+  CHECK(header_tags.find("Accept") == nullptr);
+  CHECK(header_tags.find("") == nullptr);
 }